@@ -0,0 +1,13 @@
+#pragma once
+
+#include "global.h"
+
+// Global operator new/delete are replaced in alloc_counter.cpp so every benchmark can report
+// allocations per operation. Counters are relaxed atomics, benchmarks only look at deltas.
+namespace bench
+{
+
+[[nodiscard]] u64 allocationCount() noexcept;
+[[nodiscard]] u64 allocatedBytes() noexcept;
+
+} // namespace bench
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "alloc_counter.h"
+
+// nlohmann
+#include "json.hpp"
+
+// std
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+struct Result
+{
+    std::string name;
+    u64 iterations = 0;
+    f64 nsPerOp = 0.0;
+    f64 allocsPerOp = 0.0;
+    f64 bytesAllocatedPerOp = 0.0;
+};
+
+// Keeps the optimizer from discarding the value computed by the benchmarked operation
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+// Runs op in batches until minTime has elapsed and reports the per-operation cost
+template <typename Op>
+[[nodiscard]] Result run(const std::string& name, Op&& op, std::chrono::milliseconds minTime)
+{
+    constexpr u64 batchSize = 64;
+
+    // warm up caches and any lazily initialized state
+    for (u64 i = 0; i < batchSize; ++i)
+    {
+        op();
+    }
+
+    u64 iterations = 0;
+    const u64 allocationsBefore = allocationCount();
+    const u64 bytesBefore = allocatedBytes();
+    const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+
+    do
+    {
+        for (u64 i = 0; i < batchSize; ++i)
+        {
+            op();
+        }
+        iterations += batchSize;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < minTime);
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = static_cast<f64>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / static_cast<f64>(iterations);
+    result.allocsPerOp = static_cast<f64>(allocationCount() - allocationsBefore) / static_cast<f64>(iterations);
+    result.bytesAllocatedPerOp = static_cast<f64>(allocatedBytes() - bytesBefore) / static_cast<f64>(iterations);
+    return result;
+}
+
+// Baseline files
+// ////////////////////////////////////////////////////////////
+
+[[nodiscard]] inline nlohmann::json toJson(const std::vector<Result>& results, const std::string& version)
+{
+    nlohmann::json out;
+    out["version"] = version;
+    for (const auto& result : results)
+    {
+        nlohmann::json entry;
+        entry["iterations"] = result.iterations;
+        entry["ns_per_op"] = result.nsPerOp;
+        entry["allocs_per_op"] = result.allocsPerOp;
+        entry["bytes_allocated_per_op"] = result.bytesAllocatedPerOp;
+        out["results"][result.name] = entry;
+    }
+    return out;
+}
+
+inline bool saveBaseline(const std::string& path, const std::vector<Result>& results, const std::string& version)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+    file << toJson(results, version).dump(2) << "\n";
+    return true;
+}
+
+[[nodiscard]] inline std::optional<nlohmann::json> loadBaseline(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return std::nullopt;
+    }
+
+    nlohmann::json data = nlohmann::json::parse(file, nullptr, false);
+    if (data.is_discarded() || !data.contains("results"))
+    {
+        return std::nullopt;
+    }
+    return data;
+}
+
+// Prints the results, and the relative change against the baseline if one is given.
+// Returns the number of results whose time regressed by more than thresholdPercent.
+inline u32 report(const std::vector<Result>& results, const std::optional<nlohmann::json>& baseline, f64 thresholdPercent)
+{
+    u32 regressions = 0;
+
+    std::printf("%-48s %14s %12s %14s %10s\n", "benchmark", "ns/op", "allocs/op", "bytes/op", "delta");
+    for (const auto& result : results)
+    {
+        std::string delta = "-";
+        if (baseline.has_value() && (*baseline)["results"].contains(result.name))
+        {
+            const f64 before = (*baseline)["results"][result.name]["ns_per_op"].get<f64>();
+            if (before > 0.0)
+            {
+                const f64 change = (result.nsPerOp - before) / before * 100.0;
+                char buffer[32];
+                std::snprintf(buffer, sizeof(buffer), "%+.1f%%", change);
+                delta = buffer;
+                if (change > thresholdPercent)
+                {
+                    delta += " !";
+                    ++regressions;
+                }
+            }
+        }
+
+        std::printf("%-48s %14.1f %12.2f %14.1f %10s\n",
+            result.name.c_str(), result.nsPerOp, result.allocsPerOp, result.bytesAllocatedPerOp, delta.c_str());
+    }
+
+    return regressions;
+}
+
+} // namespace bench
@@ -0,0 +1,694 @@
+#include "bench_utils.h"
+#include "cmake_constants.h"
+#include "db_manager.h"
+#include "log_message_store.h"
+
+// cli11
+#include "CLI/CLI.hpp"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
+namespace
+{
+
+struct Options
+{
+    std::chrono::milliseconds minTime{500};
+    std::filesystem::path directory;
+    std::string filter;
+    std::vector<u32> databaseRows;
+    spdlog::logger* logger = nullptr;
+};
+
+[[nodiscard]] bool selected(const Options& options, const std::string& name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+[[nodiscard]] std::string fileName(const std::string& name)
+{
+    std::string result = name;
+    for (char& c : result)
+    {
+        if (c == '/')
+        {
+            c = '_';
+        }
+    }
+    return result;
+}
+
+// Profile of the benchmarks that do not pick one. The SQLite defaults the insert benchmarks ran on
+// before durability profiles existed, so their results stay comparable with older baselines.
+constexpr DurabilityProfile DEFAULT_BENCH_PROFILE = DurabilityProfile::STRICT;
+
+// Path of an empty database for the benchmark, with the schema already created
+[[nodiscard]] std::string freshDatabase(const Options& options, const std::string& name, DurabilityProfile profile = DEFAULT_BENCH_PROFILE)
+{
+    const std::string path = (options.directory / (fileName(name) + ".db")).string();
+    for (const std::string suffix : {"", "-journal", "-wal", "-shm"})
+    {
+        std::error_code ignore;
+        std::filesystem::remove(path + suffix, ignore);
+    }
+
+    const DataBaseManager schema{options.logger, DatabaseConfig{path, profile}};
+    return path;
+}
+
+[[nodiscard]] server::messages::NewMessageReceived sampleMessage()
+{
+    server::messages::NewMessageReceived message;
+    message.username = "benchmark_user";
+    message.message = "The quick brown fox jumps over the lazy dog, again and again.";
+    message.timestamp = currentSecondsSinceEpoch();
+    return message;
+}
+
+constexpr std::string_view insertSQL = "INSERT INTO messages (username, message, timestamp) VALUES (?, ?, ?);";
+
+void bindMessage(sqlite3_stmt* stmt, const server::messages::NewMessageReceived& message)
+{
+    sqlite3_bind_text(stmt, 1, message.username.c_str(), static_cast<int>(message.username.size()), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, message.message.c_str(), static_cast<int>(message.message.size()), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(message.timestamp));
+}
+
+// Inserts through a raw connection, either compiling the SQL for every row (what addMessageEntry
+// used to do) or reusing one prepared statement. With inTransaction all rows share a single
+// transaction, so the cost of compiling the SQL is not hidden behind a journal sync per row.
+void rawInsert(std::vector<bench::Result>& results, const Options& options, const std::string& name, bool cached, bool inTransaction)
+{
+    if (!selected(options, name))
+    {
+        return;
+    }
+
+    const auto message = sampleMessage();
+
+    sqlite3* db = nullptr;
+    sqlite3_open(freshDatabase(options, name).c_str(), &db);
+    if (inTransaction)
+    {
+        sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    }
+
+    sqlite3_stmt* prepared = nullptr;
+    sqlite3_prepare_v2(db, insertSQL.data(), static_cast<int>(insertSQL.size()), &prepared, nullptr);
+
+    results.emplace_back(bench::run(name, [&]
+    {
+        if (cached)
+        {
+            bindMessage(prepared, message);
+            sqlite3_step(prepared);
+            sqlite3_reset(prepared);
+            sqlite3_clear_bindings(prepared);
+            return;
+        }
+
+        sqlite3_stmt* stmt = nullptr;
+        sqlite3_prepare_v2(db, insertSQL.data(), static_cast<int>(insertSQL.size()), &stmt, nullptr);
+        bindMessage(stmt, message);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }, options.minTime));
+
+    sqlite3_finalize(prepared);
+    if (inTransaction)
+    {
+        sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    }
+    sqlite3_close(db);
+}
+
+void insertSuite(std::vector<bench::Result>& results, const Options& options)
+{
+    rawInsert(results, options, "insert/transaction/prepare_per_row", false, true);
+    rawInsert(results, options, "insert/transaction/cached_statement", true, true);
+    rawInsert(results, options, "insert/autocommit/prepare_per_row", false, false);
+    rawInsert(results, options, "insert/autocommit/cached_statement", true, false);
+
+    if (const std::string name = "insert/autocommit/DataBaseManager"; selected(options, name))
+    {
+        const auto message = sampleMessage();
+        DataBaseManager dbManager{options.logger, DatabaseConfig{freshDatabase(options, name), DEFAULT_BENCH_PROFILE}};
+        results.emplace_back(bench::run(name, [&]
+        {
+            dbManager.addMessageEntry(message);
+        }, options.minTime));
+    }
+}
+
+// History pages read by several threads at once, the way login history loads hit the database
+// from the worker pool. With no read connection every query shares the writer connection, with
+// one connection per thread the readers run in parallel on their own WAL snapshots.
+void readSuite(std::vector<bench::Result>& results, const Options& options)
+{
+    constexpr u32 rows = 10000;
+    constexpr u32 threads = 4;
+    constexpr std::array connectionCounts{0u, 1u, 2u, threads};
+
+    for (const u32 connections : connectionCounts)
+    {
+        const std::string name = fmt::format("read/{}connections/history_page_{}threads", connections, threads);
+        if (!selected(options, name))
+        {
+            continue;
+        }
+
+        const std::string path = freshDatabase(options, name);
+        {
+            DataBaseManager writer{options.logger, DatabaseConfig{path}};
+            std::vector<server::messages::NewMessageReceived> batch(rows, sampleMessage());
+            std::ignore = writer.addMessageEntries(batch);
+        }
+
+        DataBaseManager dbManager{options.logger, DatabaseConfig{path, DurabilityProfile::BALANCED, connections}};
+
+        std::atomic<u64> operations{0};
+        std::atomic<bool> running{true};
+        std::vector<std::thread> readers;
+        const auto start = std::chrono::steady_clock::now();
+        for (u32 t = 0; t < threads; ++t)
+        {
+            readers.emplace_back([&, t]
+            {
+                u64 visited = 0;
+                const MessageVisitor countMessages = [&visited](const server::messages::NewMessageReceived& message)
+                {
+                    visited += message.message.size();
+                };
+
+                u64 done = 0;
+                HistoryQuery page;
+                for (u64 i = t; running.load(std::memory_order_relaxed); i += threads, ++done)
+                {
+                    // pages spread over the whole table, not only the newest one
+                    page.beforeId = 1 + page.limit + (i * 7919) % (rows - page.limit);
+                    visited += dbManager.getMessages(page, countMessages);
+                }
+                bench::doNotOptimize(visited);
+                operations.fetch_add(done, std::memory_order_relaxed);
+            });
+        }
+
+        std::this_thread::sleep_for(options.minTime);
+        running.store(false, std::memory_order_relaxed);
+        for (auto& reader : readers)
+        {
+            reader.join();
+        }
+        const std::chrono::duration<f64, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        bench::Result result;
+        result.name = name;
+        result.iterations = operations.load();
+        result.nsPerOp = result.iterations > 0 ? elapsed.count() / static_cast<f64>(result.iterations) : 0.0;
+        results.push_back(result);
+    }
+}
+
+// Insert throughput and history reads of every durability profile on databases that already
+// hold the given number of rows
+void profileSuite(std::vector<bench::Result>& results, const Options& options)
+{
+    constexpr std::array allProfiles{DurabilityProfile::STRICT, DurabilityProfile::BALANCED, DurabilityProfile::FAST};
+    constexpr u32 batchRows = 64;
+
+    struct Summary
+    {
+        std::string_view profile;
+        u32 rows;
+        f64 insertsPerSecond;
+        f64 batchedInsertsPerSecond;
+        f64 historyMs;
+    };
+    std::vector<Summary> summaries;
+
+    for (const auto profile : allProfiles)
+    {
+        const std::string_view profileName = databaseSettings(profile).name;
+        for (const u32 rows : options.databaseRows)
+        {
+            const std::string prefix = fmt::format("profile/{}/{}rows/", profileName, rows);
+            const std::string historyName = prefix + "history_page";
+            const std::string windowName = prefix + "history_window";
+            const std::string insertName = prefix + "insert";
+            const std::string batchName = fmt::format("{}insert_batch{}", prefix, batchRows);
+            if (!selected(options, historyName) && !selected(options, windowName) && !selected(options, insertName) && !selected(options, batchName))
+            {
+                continue;
+            }
+
+            DataBaseManager dbManager{options.logger, DatabaseConfig{freshDatabase(options, prefix, profile), profile}};
+
+            // one message per second, so time windows map to a known number of rows
+            const u64 firstTimestamp = currentSecondsSinceEpoch() - rows;
+            std::vector<server::messages::NewMessageReceived> batch(1000, sampleMessage());
+            for (u32 written = 0; written < rows; written += static_cast<u32>(batch.size()))
+            {
+                batch.resize(std::min<std::size_t>(batch.size(), rows - written));
+                for (std::size_t i = 0; i < batch.size(); ++i)
+                {
+                    batch[i].timestamp = firstTimestamp + written + i;
+                }
+                std::ignore = dbManager.addMessageEntries(batch);
+            }
+
+            u64 visited = 0;
+            const MessageVisitor countMessages = [&visited](const server::messages::NewMessageReceived& message)
+            {
+                visited += message.message.size();
+            };
+
+            Summary summary{profileName, rows, 0.0, 0.0, 0.0};
+
+            // reads first, the insert benchmarks grow the table
+            if (selected(options, historyName))
+            {
+                // newest page, what a connecting client gets
+                const auto& result = results.emplace_back(bench::run(historyName, [&]
+                {
+                    bench::doNotOptimize(dbManager.getMessages(HistoryQuery{}, countMessages));
+                }, options.minTime));
+                summary.historyMs = result.nsPerOp / 1e6;
+            }
+
+            if (selected(options, windowName))
+            {
+                // a page from the middle of the table, located through the timestamp index
+                HistoryQuery window;
+                window.fromTimestamp = firstTimestamp + rows / 2;
+                window.toTimestamp = window.fromTimestamp + 3600;
+                results.emplace_back(bench::run(windowName, [&]
+                {
+                    bench::doNotOptimize(dbManager.getMessages(window, countMessages));
+                }, options.minTime));
+            }
+            bench::doNotOptimize(visited);
+
+            if (selected(options, insertName))
+            {
+                const auto message = sampleMessage();
+                const auto& result = results.emplace_back(bench::run(insertName, [&]
+                {
+                    dbManager.addMessageEntry(message);
+                }, options.minTime));
+                summary.insertsPerSecond = 1e9 / result.nsPerOp;
+            }
+
+            if (selected(options, batchName))
+            {
+                batch.assign(batchRows, sampleMessage());
+                const auto& result = results.emplace_back(bench::run(batchName, [&]
+                {
+                    std::ignore = dbManager.addMessageEntries(batch);
+                }, options.minTime));
+                summary.batchedInsertsPerSecond = 1e9 * batchRows / result.nsPerOp;
+            }
+
+            summaries.push_back(summary);
+        }
+    }
+
+    if (summaries.empty())
+    {
+        return;
+    }
+
+    std::printf("%-10s %10s %14s %18s %12s\n", "profile", "rows", "inserts/s", "batched inserts/s", "page ms");
+    for (const auto& summary : summaries)
+    {
+        std::printf("%-10.*s %10u %14.0f %18.0f %12.3f\n", static_cast<int>(summary.profile.size()), summary.profile.data(),
+            summary.rows, summary.insertsPerSecond, summary.batchedInsertsPerSecond, summary.historyMs);
+    }
+    std::printf("\n");
+}
+
+// Ranked full-text search pages on databases of varied messages, for a word in about half of them,
+// one in a few hundred and a prefix. The insert benchmark shows what the index adds to a commit.
+void searchSuite(std::vector<bench::Result>& results, const Options& options)
+{
+    constexpr std::array vocabulary{"deploy", "server", "lunch", "coffee", "review", "merge", "branch", "build",
+                                    "release", "ticket", "meeting", "tomorrow", "today", "broken", "fixed", "again"};
+    constexpr u32 batchRows = 64;
+
+    for (const u32 rows : options.databaseRows)
+    {
+        const std::string prefix = fmt::format("search/{}rows/", rows);
+        const std::array searches{std::pair{prefix + "common_word", "server"}, std::pair{prefix + "rare_word", "zebra"},
+                                  std::pair{prefix + "prefix", "rel"}};
+        const std::string insertName = fmt::format("{}insert_batch{}", prefix, batchRows);
+        if (std::none_of(searches.begin(), searches.end(), [&](const auto& search) { return selected(options, search.first); }) &&
+            !selected(options, insertName))
+        {
+            continue;
+        }
+
+        DataBaseManager dbManager{options.logger, DatabaseConfig{freshDatabase(options, prefix)}};
+
+        u64 seed = 1;
+        const auto sentence = [&]
+        {
+            std::string text;
+            for (u32 word = 0; word < 8; ++word)
+            {
+                seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+                text += vocabulary[(seed >> 33) % vocabulary.size()];
+                text += ' ';
+            }
+            if ((seed >> 20) % 300 == 0)
+            {
+                text += "zebra";
+            }
+            return text;
+        };
+
+        std::vector<server::messages::NewMessageReceived> batch(1000, sampleMessage());
+        for (u32 written = 0; written < rows; written += static_cast<u32>(batch.size()))
+        {
+            batch.resize(std::min<std::size_t>(batch.size(), rows - written));
+            for (auto& message : batch)
+            {
+                message.message = sentence();
+            }
+            std::ignore = dbManager.addMessageEntries(batch);
+        }
+
+        u64 visited = 0;
+        const MessageVisitor countMessages = [&visited](const server::messages::NewMessageReceived& message)
+        {
+            visited += message.message.size();
+        };
+
+        for (const auto& [name, text] : searches)
+        {
+            if (!selected(options, name))
+            {
+                continue;
+            }
+
+            SearchQuery query;
+            query.text = text;
+            results.emplace_back(bench::run(name, [&]
+            {
+                bench::doNotOptimize(dbManager.searchMessages(query, countMessages));
+            }, options.minTime));
+        }
+        bench::doNotOptimize(visited);
+
+        if (selected(options, insertName))
+        {
+            batch.assign(batchRows, sampleMessage());
+            results.emplace_back(bench::run(insertName, [&]
+            {
+                std::ignore = dbManager.addMessageEntries(batch);
+            }, options.minTime));
+        }
+    }
+}
+
+// The same workload on every message store backend: batched appends the way the DB writer
+// commits, the newest page and pages from anywhere in the history
+void storeSuite(std::vector<bench::Result>& results, const Options& options)
+{
+    constexpr u32 batchRows = 256;
+    const std::array stores{std::pair{MessageStoreType::SQLITE, "sqlite"}, std::pair{MessageStoreType::LOG, "log"}};
+
+    for (const auto& [type, storeName] : stores)
+    {
+        for (const u32 rows : options.databaseRows)
+        {
+            const std::string prefix = fmt::format("store/{}/{}rows/", storeName, rows);
+            const std::string pageName = prefix + "history_page";
+            const std::string randomName = prefix + "history_random_page";
+            const std::string viewsName = prefix + "history_page_views";
+            const std::string appendName = fmt::format("{}append_batch{}", prefix, batchRows);
+            if (!selected(options, pageName) && !selected(options, randomName) && !selected(options, viewsName) && !selected(options, appendName))
+            {
+                continue;
+            }
+
+            std::unique_ptr<IMessageStore> store;
+            server::LogMessageStore* logStore = nullptr;
+            if (type == MessageStoreType::LOG)
+            {
+                server::LogStoreConfig config;
+                config.directory = (options.directory / fileName(prefix)).string();
+                std::error_code ignore;
+                std::filesystem::remove_all(config.directory, ignore);
+
+                auto created = std::make_unique<server::LogMessageStore>(options.logger, config);
+                logStore = created.get();
+                store = std::move(created);
+            }
+            else
+            {
+                store = std::make_unique<DataBaseManager>(options.logger, DatabaseConfig{freshDatabase(options, prefix)});
+            }
+
+            std::vector<server::messages::NewMessageReceived> batch(1000, sampleMessage());
+            for (u32 written = 0; written < rows; written += static_cast<u32>(batch.size()))
+            {
+                batch.resize(std::min<std::size_t>(batch.size(), rows - written));
+                std::ignore = store->addMessageEntries(batch);
+            }
+
+            u64 visited = 0;
+            const MessageVisitor countMessages = [&visited](const server::messages::NewMessageReceived& message)
+            {
+                visited += message.message.size();
+            };
+
+            // reads first, the append benchmark grows the history
+            if (selected(options, pageName))
+            {
+                results.emplace_back(bench::run(pageName, [&]
+                {
+                    bench::doNotOptimize(store->getMessages(HistoryQuery{}, countMessages));
+                }, options.minTime));
+            }
+
+            if (selected(options, randomName))
+            {
+                HistoryQuery page;
+                u64 i = 0;
+                results.emplace_back(bench::run(randomName, [&]
+                {
+                    page.beforeId = 1 + page.limit + (++i * 7919) % (rows - std::min(rows - 1, page.limit));
+                    bench::doNotOptimize(store->getMessages(page, countMessages));
+                }, options.minTime));
+            }
+
+            if (logStore != nullptr && selected(options, viewsName))
+            {
+                const server::MessageViewVisitor countViews = [&visited](const server::MessageView& view)
+                {
+                    visited += view.message.size();
+                };
+                results.emplace_back(bench::run(viewsName, [&]
+                {
+                    bench::doNotOptimize(logStore->getMessageViews(HistoryQuery{}, countViews));
+                }, options.minTime));
+            }
+            bench::doNotOptimize(visited);
+
+            if (selected(options, appendName))
+            {
+                batch.assign(batchRows, sampleMessage());
+                results.emplace_back(bench::run(appendName, [&]
+                {
+                    std::ignore = store->addMessageEntries(batch);
+                }, options.minTime));
+            }
+        }
+    }
+}
+
+// One row per message against closed blocks of 512 messages packed into compressed BLOB rows:
+// the newest page, a long history read, batched appends (packing included) and the file size
+void layoutSuite(std::vector<bench::Result>& results, const Options& options)
+{
+    constexpr std::array layouts{std::pair{0u, "rows"}, std::pair{512u, "blocks"}};
+    constexpr u32 batchRows = 256;
+    constexpr u32 longHistory = 5000;
+
+    struct Summary
+    {
+        std::string_view layout;
+        u32 rows;
+        f64 fileMiB;
+        f64 longHistoryMs;
+    };
+    std::vector<Summary> summaries;
+
+    for (const auto& [blockMessages, layoutName] : layouts)
+    {
+        for (const u32 rows : options.databaseRows)
+        {
+            const std::string prefix = fmt::format("layout/{}/{}rows/", layoutName, rows);
+            const std::string pageName = prefix + "history_page";
+            const std::string longName = fmt::format("{}history_{}", prefix, longHistory);
+            const std::string appendName = fmt::format("{}append_batch{}", prefix, batchRows);
+            if (!selected(options, pageName) && !selected(options, longName) && !selected(options, appendName))
+            {
+                continue;
+            }
+
+            DatabaseConfig config{freshDatabase(options, prefix)};
+            config.blockMessages = blockMessages;
+
+            // messages differ a little, like a real chat, so compression has something to do
+            const u64 firstTimestamp = currentSecondsSinceEpoch() - rows;
+            {
+                DataBaseManager writer{options.logger, config};
+                std::vector<server::messages::NewMessageReceived> batch(1000, sampleMessage());
+                for (u32 written = 0; written < rows; written += static_cast<u32>(batch.size()))
+                {
+                    batch.resize(std::min<std::size_t>(batch.size(), rows - written));
+                    for (std::size_t i = 0; i < batch.size(); ++i)
+                    {
+                        batch[i].username = fmt::format("user_{}", (written + i) % 37);
+                        batch[i].message = fmt::format("{} ({})", sampleMessage().message, written + i);
+                        batch[i].timestamp = firstTimestamp + written + i;
+                    }
+                    std::ignore = writer.addMessageEntries(batch);
+                }
+            }
+
+            // the WAL is checkpointed into the file when the writer closes
+            std::error_code ignore;
+            Summary summary{layoutName, rows, static_cast<f64>(std::filesystem::file_size(config.path, ignore)) / (1024.0 * 1024.0), 0.0};
+
+            DataBaseManager dbManager{options.logger, config};
+
+            u64 visited = 0;
+            const MessageVisitor countMessages = [&visited](const server::messages::NewMessageReceived& message)
+            {
+                visited += message.message.size();
+            };
+
+            // reads first, the append benchmark grows the table
+            if (selected(options, pageName))
+            {
+                results.emplace_back(bench::run(pageName, [&]
+                {
+                    bench::doNotOptimize(dbManager.getMessages(HistoryQuery{}, countMessages));
+                }, options.minTime));
+            }
+
+            if (selected(options, longName))
+            {
+                HistoryQuery query;
+                query.limit = longHistory;
+                const auto& result = results.emplace_back(bench::run(longName, [&]
+                {
+                    bench::doNotOptimize(dbManager.getMessages(query, countMessages));
+                }, options.minTime));
+                summary.longHistoryMs = result.nsPerOp / 1e6;
+            }
+            bench::doNotOptimize(visited);
+
+            if (selected(options, appendName))
+            {
+                std::vector<server::messages::NewMessageReceived> batch(batchRows, sampleMessage());
+                results.emplace_back(bench::run(appendName, [&]
+                {
+                    std::ignore = dbManager.addMessageEntries(batch);
+                }, options.minTime));
+            }
+
+            summaries.push_back(summary);
+        }
+    }
+
+    if (summaries.empty())
+    {
+        return;
+    }
+
+    std::printf("%-10s %10s %12s %18s\n", "layout", "rows", "file MiB", fmt::format("history {} ms", longHistory).c_str());
+    for (const auto& summary : summaries)
+    {
+        std::printf("%-10.*s %10u %12.2f %18.3f\n", static_cast<int>(summary.layout.size()), summary.layout.data(),
+            summary.rows, summary.fileMiB, summary.longHistoryMs);
+    }
+    std::printf("\n");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    CLI::App benchApplication(DB_BENCH_DESCRIPTION);
+    benchApplication.set_version_flag("--version", PROJECT_VERSION);
+
+    Options options;
+    options.databaseRows = {1000, 10000, 100000};
+    u32 minTimeMs = 500;
+    std::string directory = (std::filesystem::temp_directory_path() / "yapping_db_bench").string();
+    std::string savePath;
+    std::string baselinePath;
+    f64 thresholdPercent = 10.0;
+
+    benchApplication.add_option("--min-time", minTimeMs, "Minimum time in milliseconds spent on every benchmark")
+        ->check(CLI::Range(1u, 600000u));
+    benchApplication.add_option("--rows", options.databaseRows, "Rows in the database before the profile benchmarks run");
+    benchApplication.add_option("-d,--dir", directory, "Directory where the benchmark databases are created");
+    benchApplication.add_option("-f,--filter", options.filter, "Only run benchmarks whose name contains this string");
+    benchApplication.add_option("-s,--save", savePath, "Write the results to this baseline file");
+    benchApplication.add_option("-b,--baseline", baselinePath, "Compare the results against this baseline file")
+        ->check(CLI::ExistingFile);
+    benchApplication.add_option("--threshold", thresholdPercent, "Slowdown in percent reported as a regression")
+        ->check(CLI::NonNegativeNumber);
+
+    CLI11_PARSE(benchApplication, argc, argv);
+    options.minTime = std::chrono::milliseconds(minTimeMs);
+    options.directory = directory;
+
+    std::error_code ec;
+    std::filesystem::create_directories(options.directory, ec);
+    if (ec)
+    {
+        std::fprintf(stderr, "Could not create %s: %s\n", directory.c_str(), ec.message().c_str());
+        return EXIT_FAILURE;
+    }
+
+    const auto logger = spdlog::default_logger();
+    logger->set_level(spdlog::level::warn);
+    options.logger = logger.get();
+
+    std::optional<nlohmann::json> baseline;
+    if (!baselinePath.empty())
+    {
+        baseline = bench::loadBaseline(baselinePath);
+        if (!baseline.has_value())
+        {
+            std::fprintf(stderr, "Could not read baseline file %s\n", baselinePath.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<bench::Result> results;
+    insertSuite(results, options);
+    readSuite(results, options);
+    profileSuite(results, options);
+    storeSuite(results, options);
+    searchSuite(results, options);
+    layoutSuite(results, options);
+
+    const u32 regressions = bench::report(results, baseline, thresholdPercent);
+
+    if (!savePath.empty() && !bench::saveBaseline(savePath, results, PROJECT_VERSION))
+    {
+        std::fprintf(stderr, "Could not write baseline file %s\n", savePath.c_str());
+        return EXIT_FAILURE;
+    }
+
+    return regressions == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
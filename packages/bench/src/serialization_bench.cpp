@@ -0,0 +1,201 @@
+#include "bench_utils.h"
+#include "cmake_constants.h"
+#include "messages.h"
+#include "wire_frame.h"
+
+// cli11
+#include "CLI/CLI.hpp"
+
+namespace
+{
+
+struct Options
+{
+    std::chrono::milliseconds minTime{200};
+    std::string filter;
+};
+
+[[nodiscard]] std::string makeString(std::size_t size)
+{
+    std::string out(size, ' ');
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        out[i] = static_cast<char>('a' + i % 26);
+    }
+    return out;
+}
+
+// Encode measures toString(), decode parses the line into a document, reads the header and builds
+// the typed message from the content. read does the same with decodePacket(), what the read loops
+// use, which fills the message straight from the text. The -msgpack and -cbor entries encode and
+// read whole binary frames.
+template <typename Header, typename Message>
+void benchmarkMessage(std::vector<bench::Result>& results, const Options& options, const std::string& name, std::size_t payloadSize, const Message& message)
+{
+    const std::string prefix = name + "/" + std::to_string(payloadSize) + "/";
+    if (!options.filter.empty() && prefix.find(options.filter) == std::string::npos)
+    {
+        return;
+    }
+
+    results.emplace_back(bench::run(prefix + "encode", [&message]
+    {
+        const std::string encoded = message.toString();
+        bench::doNotOptimize(encoded);
+    }, options.minTime));
+
+    const std::string encoded = message.toString();
+    results.emplace_back(bench::run(prefix + "decode", [&encoded]
+    {
+        const nlohmann::json data = nlohmann::json::parse(encoded);
+        const auto header = data[PACKET_HEADER_KEY].get<Header>();
+        const Message decoded{data[PACKET_CONTENT_KEY]};
+        bench::doNotOptimize(header);
+        bench::doNotOptimize(decoded);
+    }, options.minTime));
+
+    using Variant = std::conditional_t<std::is_same_v<Header, ServerMessageType>, server::messages::ServerMessage, client::messages::ClientMessage>;
+    results.emplace_back(bench::run(prefix + "read", [&encoded]
+    {
+        const auto decoded = wire::decodePacket<Variant>(encoded);
+        bench::doNotOptimize(decoded);
+    }, options.minTime));
+
+    for (const WireEncoding encoding : {WireEncoding::MSGPACK, WireEncoding::CBOR})
+    {
+        const std::string suffix = "-" + std::string(wire::encodingName(encoding));
+        results.emplace_back(bench::run(prefix + "encode" + suffix, [&message, encoding]
+        {
+            const std::string frame = wire::encodeFrame(encoding, message);
+            bench::doNotOptimize(frame);
+        }, options.minTime));
+
+        const std::string frame = wire::encodeFrame(encoding, message);
+        results.emplace_back(bench::run(prefix + "read" + suffix, [&frame]
+        {
+            const auto decoded = wire::decodeFrame<Variant>(wire::nextFrame(frame));
+            bench::doNotOptimize(decoded);
+        }, options.minTime));
+    }
+}
+
+void benchmarkAll(std::vector<bench::Result>& results, const Options& options, const std::vector<std::size_t>& payloadSizes)
+{
+    server::messages::ServerResponse response;
+    response.code = ServerResponseCode::SUCCESSFUL_LOGIN;
+    benchmarkMessage<ServerMessageType>(results, options, "server/ServerResponse", 0, response);
+
+    for (const std::size_t size : payloadSizes)
+    {
+        const std::string text = makeString(size);
+
+        server::messages::NewMessageReceived received;
+        received.username = text;
+        received.message = text;
+        received.timestamp = currentSecondsSinceEpoch();
+        benchmarkMessage<ServerMessageType>(results, options, "server/NewMessageReceived", size, received);
+
+        // broadcasts and ring replays name the author by id
+        server::messages::NewMessageReceived receivedById = received;
+        receivedById.username.clear();
+        receivedById.userId = 4242;
+        benchmarkMessage<ServerMessageType>(results, options, "server/NewMessageReceivedById", size, receivedById);
+
+        server::messages::UserStatus status;
+        status.username = text;
+        status.userId = 4242;
+        status.status = UserStatusType::ONLINE;
+        status.color = {200, 10, 10};
+        status.timestamp = currentSecondsSinceEpoch();
+        benchmarkMessage<ServerMessageType>(results, options, "server/UserStatus", size, status);
+
+        client::messages::InitialConnection initialConnection;
+        initialConnection.username = text;
+        benchmarkMessage<ClientMessageType>(results, options, "client/InitialConnection", size, initialConnection);
+
+        client::messages::NewMessage newMessage;
+        newMessage.message = text;
+        benchmarkMessage<ClientMessageType>(results, options, "client/NewMessage", size, newMessage);
+
+        client::messages::Login login;
+        login.username = text;
+        login.passwordHash = hashImpl(text);
+        benchmarkMessage<ClientMessageType>(results, options, "client/Login", size, login);
+
+        client::messages::Register registration;
+        registration.username = text;
+        registration.passwordHash = hashImpl(text);
+        benchmarkMessage<ClientMessageType>(results, options, "client/Register", size, registration);
+
+        client::messages::SearchMessages search;
+        search.query = text;
+        benchmarkMessage<ClientMessageType>(results, options, "client/SearchMessages", size, search);
+
+        // a full page of results
+        server::messages::SearchResults searchResults;
+        searchResults.query = text;
+        searchResults.hasMore = true;
+        searchResults.messages.assign(search.limit, received);
+        benchmarkMessage<ServerMessageType>(results, options, "server/SearchResults", size, searchResults);
+
+        // the authors of a history replay
+        server::messages::UserNames userNames;
+        for (u32 userId = 1; userId <= 20; ++userId)
+        {
+            userNames.users.push_back({userId, text});
+        }
+        benchmarkMessage<ServerMessageType>(results, options, "server/UserNames", size, userNames);
+    }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    CLI::App benchApplication(BENCH_DESCRIPTION);
+    benchApplication.set_version_flag("--version", PROJECT_VERSION);
+
+    Options options;
+    u32 minTimeMs = 200;
+    std::vector<std::size_t> payloadSizes{16, 64, 256, 1024};
+    std::string savePath;
+    std::string baselinePath;
+    f64 thresholdPercent = 10.0;
+
+    benchApplication.add_option("--min-time", minTimeMs, "Minimum time in milliseconds spent on every benchmark")
+        ->check(CLI::Range(1u, 60000u));
+    benchApplication.add_option("--sizes", payloadSizes, "Payload sizes in bytes used for the string fields");
+    benchApplication.add_option("-f,--filter", options.filter, "Only run benchmarks whose name contains this string");
+    benchApplication.add_option("-s,--save", savePath, "Write the results to this baseline file");
+    benchApplication.add_option("-b,--baseline", baselinePath, "Compare the results against this baseline file")
+        ->check(CLI::ExistingFile);
+    benchApplication.add_option("--threshold", thresholdPercent, "Slowdown in percent reported as a regression")
+        ->check(CLI::NonNegativeNumber);
+
+    CLI11_PARSE(benchApplication, argc, argv);
+    options.minTime = std::chrono::milliseconds(minTimeMs);
+
+    std::optional<nlohmann::json> baseline;
+    if (!baselinePath.empty())
+    {
+        baseline = bench::loadBaseline(baselinePath);
+        if (!baseline.has_value())
+        {
+            std::fprintf(stderr, "Could not read baseline file %s\n", baselinePath.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<bench::Result> results;
+    benchmarkAll(results, options, payloadSizes);
+
+    const u32 regressions = bench::report(results, baseline, thresholdPercent);
+
+    if (!savePath.empty() && !bench::saveBaseline(savePath, results, PROJECT_VERSION))
+    {
+        std::fprintf(stderr, "Could not write baseline file %s\n", savePath.c_str());
+        return EXIT_FAILURE;
+    }
+
+    return regressions == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
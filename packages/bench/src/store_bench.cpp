@@ -0,0 +1,500 @@
+#include "bench_utils.h"
+#include "cmake_constants.h"
+#include "db_manager.h"
+#include "histogram.h"
+#include "log_message_store.h"
+#include "memory_message_store.h"
+#include "memory_user_store.h"
+#include "workload.h"
+
+// cli11
+#include "CLI/CLI.hpp"
+
+// std
+#include <atomic>
+#include <filesystem>
+#include <set>
+#include <thread>
+
+namespace
+{
+
+using server::WorkloadOperation;
+using server::WorkloadOperationType;
+
+constexpr std::size_t OPERATION_TYPES = static_cast<std::size_t>(WorkloadOperationType::COUNT);
+// workload files carry no password hashes, every user is registered with this one
+constexpr u64 REPLAY_PASSWORD_HASH = 0x5eed;
+
+struct Options
+{
+    std::filesystem::path directory;
+    DurabilityProfile profile = DurabilityProfile::BALANCED;
+    u32 readConnections = 2;
+    u32 blockMessages = 0;
+    u32 readers = 2;
+    spdlog::logger* logger = nullptr;
+};
+
+// Empty stores of one backend. The log backend keeps its users in the database, the way the
+// server runs with --message-store log.
+struct Stores
+{
+    std::unique_ptr<DataBaseManager> database;
+    std::unique_ptr<IMessageStore> otherMessages;
+    std::unique_ptr<IUserStore> otherUsers;
+    IMessageStore* messages = nullptr;
+    IUserStore* users = nullptr;
+};
+
+[[nodiscard]] Stores createStores(const Options& options, const std::string& name)
+{
+    const auto path = options.directory / name;
+    std::error_code ignore;
+    std::filesystem::remove_all(path, ignore);
+    std::filesystem::create_directories(path, ignore);
+
+    Stores stores;
+    if (name == "memory")
+    {
+        stores.otherMessages = std::make_unique<server::MemoryMessageStore>();
+        stores.otherUsers = std::make_unique<server::MemoryUserStore>();
+        stores.messages = stores.otherMessages.get();
+        stores.users = stores.otherUsers.get();
+        return stores;
+    }
+
+    DatabaseConfig config{(path / DEFAULT_DB_PATH).string(), options.profile, options.readConnections};
+    config.blockMessages = options.blockMessages;
+    stores.database = std::make_unique<DataBaseManager>(options.logger, config);
+    stores.messages = stores.database.get();
+    stores.users = stores.database.get();
+
+    if (name == "log")
+    {
+        server::LogStoreConfig config;
+        config.directory = (path / "log").string();
+        config.syncEveryBatch = options.profile == DurabilityProfile::STRICT;
+        stores.otherMessages = std::make_unique<server::LogMessageStore>(options.logger, config);
+        stores.messages = stores.otherMessages.get();
+    }
+    return stores;
+}
+
+// Messages and users the workload expects to exist before it starts. Messages older than the
+// first one appended are filled in with generated ones, so history pages have the same depth,
+// and users that log in without registering first are registered.
+void preload(const Stores& stores, const std::vector<WorkloadOperation>& operations)
+{
+    std::set<std::string> registered;
+    std::set<std::string> missing;
+    const server::messages::NewMessageReceived* first = nullptr;
+    for (const auto& operation : operations)
+    {
+        if (operation.type == WorkloadOperationType::APPEND && first == nullptr && !operation.messages.empty())
+        {
+            first = &operation.messages.front();
+        }
+        else if (operation.type == WorkloadOperationType::ADD_USER)
+        {
+            registered.insert(operation.username);
+        }
+        else if (operation.type == WorkloadOperationType::USER_LOOKUP && !registered.contains(operation.username))
+        {
+            missing.insert(operation.username);
+        }
+    }
+
+    for (const auto& username : missing)
+    {
+        std::ignore = stores.users->addNewUser(username, REPLAY_PASSWORD_HASH);
+    }
+
+    if (first == nullptr || first->id <= 1)
+    {
+        return;
+    }
+
+    server::messages::NewMessageReceived message;
+    message.username = "preloaded_user";
+    message.message = "A message sent before the workload was recorded, about this long.";
+
+    std::vector<server::messages::NewMessageReceived> batch;
+    for (u64 id = 1; id < first->id; ++id)
+    {
+        // one message a second up to the first recorded one
+        const u64 age = first->id - id;
+        message.id = id;
+        message.timestamp = first->timestamp > age ? first->timestamp - age : 0;
+        batch.push_back(message);
+        if (batch.size() == 1000 || id + 1 == first->id)
+        {
+            std::ignore = stores.messages->addMessageEntries(batch);
+            batch.clear();
+        }
+    }
+}
+
+// Synthetic workload when no recording is given: batches of 32 messages from 100 users, with a
+// couple of logins, an older history page per batch and a search or a registration now and then
+[[nodiscard]] std::vector<WorkloadOperation> generateWorkload(u32 messages)
+{
+    constexpr std::array vocabulary{"deploy", "server", "lunch", "coffee", "review", "merge", "branch", "build",
+                                    "release", "ticket", "meeting", "tomorrow", "today", "broken", "fixed", "again"};
+    constexpr u32 batchRows = 32;
+    u32 users = 100;
+
+    u64 seed = 1;
+    const auto random = [&seed]
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return seed >> 33;
+    };
+    const auto user = [](u64 index) { return fmt::format("user{}", index); };
+
+    std::vector<WorkloadOperation> operations;
+    for (u32 i = 0; i < users; ++i)
+    {
+        operations.push_back(WorkloadOperation{WorkloadOperationType::ADD_USER, {}, {}, {}, user(i)});
+    }
+
+    const u64 firstTimestamp = currentSecondsSinceEpoch() - messages;
+    u64 lastId = 0;
+    for (u32 batch = 0; lastId < messages; ++batch)
+    {
+        auto& append = operations.emplace_back();
+        append.type = WorkloadOperationType::APPEND;
+        for (u32 row = 0; row < batchRows && lastId < messages; ++row)
+        {
+            auto& message = append.messages.emplace_back();
+            message.id = ++lastId;
+            message.timestamp = firstTimestamp + lastId;
+            message.username = user(random() % users);
+            for (u32 word = 0; word < 8; ++word)
+            {
+                message.message += vocabulary[random() % vocabulary.size()];
+                message.message += ' ';
+            }
+        }
+
+        for (u32 login = 0; login < 2; ++login)
+        {
+            operations.push_back(WorkloadOperation{WorkloadOperationType::USER_LOOKUP, {}, {}, {}, user(random() % users)});
+        }
+
+        auto& page = operations.emplace_back();
+        page.type = WorkloadOperationType::HISTORY;
+        page.history.beforeId = 1 + random() % lastId;
+
+        if (batch % 8 == 7)
+        {
+            auto& search = operations.emplace_back();
+            search.type = WorkloadOperationType::SEARCH;
+            search.search.text = vocabulary[random() % vocabulary.size()];
+            // the server asks for one match more than a page
+            search.search.limit = 21;
+        }
+
+        if (batch % 16 == 15)
+        {
+            operations.push_back(WorkloadOperation{WorkloadOperationType::ADD_USER, {}, {}, {}, user(users++)});
+        }
+    }
+    return operations;
+}
+
+struct OperationStats
+{
+    histogram::Histogram latency;
+    u64 failed = 0;
+};
+
+using Stats = std::array<OperationStats, OPERATION_TYPES>;
+
+[[nodiscard]] constexpr bool isWrite(WorkloadOperationType type) noexcept
+{
+    return type == WorkloadOperationType::APPEND || type == WorkloadOperationType::ADD_USER;
+}
+
+void execute(const Stores& stores, const WorkloadOperation& operation, Stats& stats, u64& visited)
+{
+    const MessageVisitor countMessages = [&visited](const server::messages::NewMessageReceived& message)
+    {
+        visited += message.message.size();
+    };
+
+    bool ok = true;
+    const auto start = std::chrono::steady_clock::now();
+    switch (operation.type)
+    {
+    case WorkloadOperationType::APPEND:
+        ok = stores.messages->addMessageEntries(operation.messages);
+        break;
+    case WorkloadOperationType::HISTORY:
+        visited += stores.messages->getMessages(operation.history, countMessages);
+        break;
+    case WorkloadOperationType::SEARCH:
+        ok = stores.messages->searchMessages(operation.search, countMessages).has_value();
+        break;
+    case WorkloadOperationType::ADD_USER:
+        ok = stores.users->addNewUser(operation.username, REPLAY_PASSWORD_HASH) != AddUserResult::FAILED;
+        break;
+    case WorkloadOperationType::USER_LOOKUP:
+        visited += stores.users->userPasswordHash(operation.username).value_or(0);
+        break;
+    case WorkloadOperationType::COUNT:
+        break;
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+    auto& operationStats = stats[static_cast<std::size_t>(operation.type)];
+    operationStats.latency.record(static_cast<u64>(elapsed.count()));
+    operationStats.failed += ok ? 0 : 1;
+}
+
+struct Replay
+{
+    Stats stats;
+    std::chrono::nanoseconds elapsed{0};
+};
+
+// Writes run in recorded order on one thread, like the DB writer thread and the registrations
+// that take the write lock. Reads are spread over the reader threads, which is what the worker
+// pool does, but a read never starts before the writes recorded ahead of it are done.
+[[nodiscard]] Replay replay(const Stores& stores, const std::vector<WorkloadOperation>& operations, u32 readers)
+{
+    Replay result;
+    u64 visited = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    if (readers == 0)
+    {
+        for (const auto& operation : operations)
+        {
+            execute(stores, operation, result.stats, visited);
+        }
+        result.elapsed = std::chrono::steady_clock::now() - start;
+        bench::doNotOptimize(visited);
+        return result;
+    }
+
+    std::vector<std::size_t> writes;
+    std::vector<std::size_t> reads;
+    std::vector<u64> writesBefore(operations.size());
+    for (std::size_t i = 0; i < operations.size(); ++i)
+    {
+        writesBefore[i] = writes.size();
+        (isWrite(operations[i].type) ? writes : reads).push_back(i);
+    }
+
+    std::atomic<u64> writesDone{0};
+    std::atomic<std::size_t> nextRead{0};
+    std::vector<Stats> threadStats(readers + 1);
+
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]
+    {
+        u64 written = 0;
+        for (const std::size_t index : writes)
+        {
+            execute(stores, operations[index], threadStats[0], written);
+            writesDone.store(writesDone.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+        bench::doNotOptimize(written);
+    });
+    for (u32 t = 1; t <= readers; ++t)
+    {
+        threads.emplace_back([&, t]
+        {
+            u64 read = 0;
+            for (std::size_t next = nextRead.fetch_add(1); next < reads.size(); next = nextRead.fetch_add(1))
+            {
+                const std::size_t index = reads[next];
+                while (writesDone.load(std::memory_order_acquire) < writesBefore[index])
+                {
+                    std::this_thread::yield();
+                }
+                execute(stores, operations[index], threadStats[t], read);
+            }
+            bench::doNotOptimize(read);
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    result.elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const auto& stats : threadStats)
+    {
+        for (std::size_t type = 0; type < OPERATION_TYPES; ++type)
+        {
+            result.stats[type].latency.merge(stats[type].latency);
+            result.stats[type].failed += stats[type].failed;
+        }
+    }
+    return result;
+}
+
+[[nodiscard]] f64 microseconds(u64 nanoseconds)
+{
+    return static_cast<f64>(nanoseconds) / 1e3;
+}
+
+[[nodiscard]] nlohmann::json toJson(const Replay& replay, u64 messages)
+{
+    const f64 seconds = std::chrono::duration<f64>(replay.elapsed).count();
+
+    nlohmann::json out;
+    out["elapsed_seconds"] = seconds;
+    out["messages_per_second"] = seconds > 0.0 ? static_cast<f64>(messages) / seconds : 0.0;
+    for (std::size_t type = 0; type < OPERATION_TYPES; ++type)
+    {
+        const auto& stats = replay.stats[type];
+        if (stats.latency.count() == 0)
+        {
+            continue;
+        }
+
+        nlohmann::json entry;
+        entry["count"] = stats.latency.count();
+        entry["failed"] = stats.failed;
+        entry["mean_ns"] = stats.latency.mean();
+        entry["p50_ns"] = stats.latency.percentile(50.0);
+        entry["p99_ns"] = stats.latency.percentile(99.0);
+        entry["p999_ns"] = stats.latency.percentile(99.9);
+        entry["max_ns"] = stats.latency.max();
+        out["operations"][std::string(server::workloadOperationName(static_cast<WorkloadOperationType>(type)))] = entry;
+    }
+    return out;
+}
+
+void report(const std::string& store, const Replay& replay, u64 operations, u64 messages)
+{
+    const f64 seconds = std::chrono::duration<f64>(replay.elapsed).count();
+    std::printf("%s: %llu operations in %.3f s, %.0f ops/s, %.0f messages/s\n", store.c_str(),
+        static_cast<unsigned long long>(operations), seconds, static_cast<f64>(operations) / seconds, static_cast<f64>(messages) / seconds);
+
+    std::printf("  %-12s %10s %12s %12s %12s %12s %12s %8s\n", "operation", "count", "mean us", "p50 us", "p99 us", "p99.9 us", "max us", "failed");
+    for (std::size_t type = 0; type < OPERATION_TYPES; ++type)
+    {
+        const auto& stats = replay.stats[type];
+        if (stats.latency.count() == 0)
+        {
+            continue;
+        }
+
+        const auto name = server::workloadOperationName(static_cast<WorkloadOperationType>(type));
+        std::printf("  %-12.*s %10llu %12.1f %12.1f %12.1f %12.1f %12.1f %8llu\n", static_cast<int>(name.size()), name.data(),
+            static_cast<unsigned long long>(stats.latency.count()), stats.latency.mean() / 1e3,
+            microseconds(stats.latency.percentile(50.0)), microseconds(stats.latency.percentile(99.0)),
+            microseconds(stats.latency.percentile(99.9)), microseconds(stats.latency.max()),
+            static_cast<unsigned long long>(stats.failed));
+    }
+    std::printf("\n");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    CLI::App benchApplication(STORE_BENCH_DESCRIPTION);
+    benchApplication.set_version_flag("--version", PROJECT_VERSION);
+
+    Options options;
+    std::string workloadPath;
+    u32 generatedMessages = 100000;
+    std::string saveWorkloadPath;
+    std::vector<std::string> storeNames{"sqlite", "log", "memory"};
+    std::string directory = (std::filesystem::temp_directory_path() / "yapping_store_bench").string();
+    std::string savePath;
+
+    benchApplication.add_option("-w,--workload", workloadPath, "Workload recorded by the server with --record-workload, a synthetic one is generated if not set")
+        ->check(CLI::ExistingFile);
+    benchApplication.add_option("--generate", generatedMessages, "Messages in the synthetic workload")
+        ->check(CLI::Range(1u, 100000000u));
+    benchApplication.add_option("--save-workload", saveWorkloadPath, "Write the replayed workload to this file");
+    benchApplication.add_option("--stores", storeNames, "Backends to replay the workload against")
+        ->check(CLI::IsMember(std::vector<std::string>{"sqlite", "log", "memory"}));
+    benchApplication.add_option("--readers", options.readers, "Threads replaying reads next to the writer thread, 0 replays everything in order on one thread")
+        ->check(CLI::Range(0u, 64u));
+
+    const std::map<std::string, DurabilityProfile> dbProfiles{
+        {"strict", DurabilityProfile::STRICT},
+        {"balanced", DurabilityProfile::BALANCED},
+        {"fast", DurabilityProfile::FAST},
+    };
+    benchApplication.add_option("--db-profile", options.profile, "Durability profile of the sqlite and log stores: strict, balanced or fast")
+        ->transform(CLI::CheckedTransformer(dbProfiles, CLI::ignore_case));
+    benchApplication.add_option("--db-readers", options.readConnections, "Read-only connections of the sqlite store")
+        ->check(CLI::Range(0u, 64u));
+    benchApplication.add_option("--db-block-messages", options.blockMessages, "Messages per compressed block of the sqlite store, 0 keeps one row per message")
+        ->check(CLI::Range(0u, 65536u));
+    benchApplication.add_option("-d,--dir", directory, "Directory where the stores are created");
+    benchApplication.add_option("-s,--save", savePath, "Write the results of every store to this JSON file");
+
+    CLI11_PARSE(benchApplication, argc, argv);
+    options.directory = directory;
+
+    const auto logger = spdlog::default_logger();
+    logger->set_level(spdlog::level::warn);
+    options.logger = logger.get();
+
+    std::vector<WorkloadOperation> operations;
+    if (!workloadPath.empty())
+    {
+        std::string error;
+        auto recorded = server::readWorkload(workloadPath, error);
+        if (!recorded.has_value())
+        {
+            std::fprintf(stderr, "Could not read the workload: %s\n", error.c_str());
+            return EXIT_FAILURE;
+        }
+        operations = std::move(recorded.value());
+    }
+    else
+    {
+        operations = generateWorkload(generatedMessages);
+    }
+
+    if (!saveWorkloadPath.empty() && !server::writeWorkload(saveWorkloadPath, operations))
+    {
+        std::fprintf(stderr, "Could not write the workload to %s\n", saveWorkloadPath.c_str());
+        return EXIT_FAILURE;
+    }
+
+    u64 messages = 0;
+    for (const auto& operation : operations)
+    {
+        messages += operation.messages.size();
+    }
+    std::printf("Replaying %zu operations with %llu messages, %u reader threads\n\n", operations.size(),
+        static_cast<unsigned long long>(messages), options.readers);
+
+    nlohmann::json results;
+    results["version"] = PROJECT_VERSION;
+    results["workload"] = workloadPath.empty() ? fmt::format("generated {} messages", generatedMessages) : workloadPath;
+    results["readers"] = options.readers;
+    for (const auto& name : storeNames)
+    {
+        const auto stores = createStores(options, name);
+        preload(stores, operations);
+
+        const auto result = replay(stores, operations, options.readers);
+        report(name, result, operations.size(), messages);
+        results["stores"][name] = toJson(result, messages);
+    }
+
+    if (!savePath.empty())
+    {
+        std::ofstream file(savePath);
+        file << results.dump(2) << "\n";
+        if (!file)
+        {
+            std::fprintf(stderr, "Could not write results file %s\n", savePath.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
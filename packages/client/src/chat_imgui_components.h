@@ -120,9 +120,9 @@ static void renderMessageBubble(const std::string& text, const std::string& auth
     ImGui::SetCursorScreenPos(ImVec2(cursor.x, bubble_max.y + space_y));
 }
 
-void inline renderServerMessage(const server::messages::NewMessageReceived &msg, const std::string &username, server::messages::UserColor color)
+void inline renderServerMessage(const server::messages::NewMessageReceived &msg, const std::string &author, const std::string &username, server::messages::UserColor color)
 {
-    renderMessageBubble(msg.message, msg.username, getTimeStamp(msg.timestamp),(username == msg.username),
+    renderMessageBubble(msg.message, author, getTimeStamp(msg.timestamp),(username == author),
         ImGui::GetContentRegionAvail().x
         ,nullptr, IM_COL32(color.red, color.green, color.blue, 255) );
 }
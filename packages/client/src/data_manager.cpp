@@ -1,7 +1,7 @@
 #include "data_manager.h"
 
-DataManager::DataManager(const std::string &username, spdlog::logger *logger) :
- logger_(logger), tcpClient_(std::make_unique<TcpClient>(logger)), username(username)
+DataManager::DataManager(const std::string &username, WireEncoding encoding, spdlog::logger *logger) :
+ logger_(logger), tcpClient_(std::make_unique<TcpClient>(logger)), username(username), encoding_(encoding)
 {
   tcpClient_->on_connect([this]{onConnect();});
   tcpClient_->on_disconnect([this]{onDisconnect();});
@@ -27,19 +27,84 @@ bool DataManager::sendMessage(const std::string &message) const noexcept
   return true;
 }
 
+bool DataManager::searchMessages(const std::string &query, u32 page) const noexcept
+{
+  if (query.empty())
+  {
+    return false;
+  }
+
+  client::messages::SearchMessages search;
+  search.query = query;
+  search.page = page;
+  tcpClient_->write(search);
+
+  return true;
+}
+
+server::messages::SearchResults DataManager::getSearchResults() const noexcept
+{
+  const std::lock_guard lock(dataMutex_);
+  return searchResults_;
+}
+
 std::string DataManager::getUsername() const noexcept
 {
+  const std::lock_guard lock(usernameMutex_);
   return username;
 }
+
+void DataManager::setUsername(const std::string &value) const
+{
+  const std::lock_guard lock(usernameMutex_);
+  username = value;
+}
+
+void DataManager::login(const std::string &username, u64 passwordHash) const noexcept
+{
+  setUsername(username);
+  {
+    const std::lock_guard lock(dataMutex_);
+    loginResponse_.reset();
+  }
+
+  client::messages::Login login;
+  login.username = username;
+  login.passwordHash = passwordHash;
+  tcpClient_->write(login);
+}
+
+void DataManager::registerUser(const std::string &username, u64 passwordHash) const noexcept
+{
+  setUsername(username);
+  {
+    const std::lock_guard lock(dataMutex_);
+    loginResponse_.reset();
+  }
+
+  client::messages::Register registration;
+  registration.username = username;
+  registration.passwordHash = passwordHash;
+  tcpClient_->write(registration);
+}
+
+std::optional<ServerResponseCode> DataManager::getLoginResponse() const noexcept
+{
+  const std::lock_guard lock(dataMutex_);
+  return loginResponse_;
+}
+
 std::vector<server::messages::NewMessageReceived>
 DataManager::getMessages() const noexcept
 {
+  const std::lock_guard lock(dataMutex_);
   return messages_;
 }
 
-std::map<std::string, UserData> DataManager::getUsers() const noexcept
+std::vector<KnownUser> DataManager::getUsers() const noexcept
 {
-  return usersMap_;
+  const std::lock_guard lock(dataMutex_);
+  return users_;
 }
 
 void DataManager::connect(const std::string &host, u16 port) const noexcept
@@ -48,11 +113,16 @@ void DataManager::connect(const std::string &host, u16 port) const noexcept
 }
 
 void DataManager::onConnect()
+{
+  logger_->info("Connected");
+}
+
+void DataManager::joinChat()
 {
   client::messages::InitialConnection msg;
-  msg.username = username;
+  msg.username = getUsername();
+  msg.encoding = encoding_;
   tcpClient_->write(msg);
-  logger_->info("Connected");
 }
 
 void DataManager::onDisconnect()
@@ -73,23 +143,97 @@ void DataManager::onMessage(const server::messages::ServerMessage &message)
 void DataManager::manageMessageContent(
     const server::messages::NewMessageReceived &value)
 {
-  if (const auto it = usersMap_.find(value.username); it == usersMap_.end())
+  const std::lock_guard lock(dataMutex_);
+  auto& message = messages_.emplace_back(value);
+  if (message.userId == 0)
   {
-    logger_->error("User {} not found in users map, can not display message with color", value.username);
+    if (const auto it = userIds_.find(message.username); it != userIds_.end())
+    {
+      message.userId = it->second;
+    }
   }
 
-  messages_.emplace_back(value);
+  if (message.userId >= users_.size() || !users_[message.userId].data.has_value())
+  {
+    logger_->debug("No status of the author of message {} yet, it is shown without color", message.id);
+  }
 }
 
 void DataManager::manageMessageContent(
     const server::messages::UserStatus &value)
 {
-  usersMap_[value.username].status = value.status;
-  usersMap_[value.username].color = value.color;
+  const std::lock_guard lock(dataMutex_);
+  if (auto* user = learnUser(value.userId, value.username); user != nullptr)
+  {
+    user->data = UserData{value.status, value.color};
+  }
 }
 
 void DataManager::manageMessageContent(
     const server::messages::ServerResponse &value)
 {
-  std::ignore = value;
+  switch (value.code)
+  {
+  case ServerResponseCode::SUCCESSFUL_LOGIN:
+  case ServerResponseCode::SUCCESSFUL_REGISTRATION:
+    joinChat();
+    break;
+  case ServerResponseCode::USERNAME_ALREADY_EXISTS:
+  case ServerResponseCode::INCORRECT_PASSWORD:
+  case ServerResponseCode::SERVER_ERROR:
+    logger_->warn("Server refused the login, response code {}", static_cast<u32>(value.code));
+    break;
+  case ServerResponseCode::NOT_LOGGED_IN:
+    logger_->warn("Server refused a message of a connection that has not logged in");
+    return;
+  default:
+    return;
+  }
+
+  // the login scene waits on it
+  const std::lock_guard lock(dataMutex_);
+  loginResponse_ = value.code;
+}
+
+void DataManager::manageMessageContent(
+    const server::messages::SearchResults &value)
+{
+  const std::lock_guard lock(dataMutex_);
+  searchResults_ = value;
+}
+
+void DataManager::manageMessageContent(
+    const server::messages::UserNames &value)
+{
+  const std::lock_guard lock(dataMutex_);
+  for (const auto& user : value.users)
+  {
+    std::ignore = learnUser(user.userId, user.username);
+  }
+}
+
+KnownUser* DataManager::learnUser(u32 userId, const std::string& username)
+{
+  if (userId == 0 || userId > MAX_USER_ID)
+  {
+    logger_->error("Invalid id {} for user {}", userId, username);
+    return nullptr;
+  }
+
+  if (userId >= users_.size())
+  {
+    users_.resize(userId + 1);
+  }
+
+  auto& user = users_[userId];
+  if (user.username != username)
+  {
+    if (!user.username.empty())
+    {
+      userIds_.erase(user.username);
+    }
+    user.username = username;
+    userIds_[username] = userId;
+  }
+  return &user;
 }
\ No newline at end of file
@@ -2,28 +2,59 @@
 
 #include "tcp_client.h"
 
+// std
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+// A user the server gave an id to, the users of DataManager are indexed by it
+struct KnownUser
+{
+  std::string username;
+  // set once the server sent a status of the user, only those are listed
+  std::optional<UserData> data;
+};
+
 class DataManager
 {
 public:
-  DataManager(const std::string &username, spdlog::logger *logger);
+  DataManager(const std::string &username, WireEncoding encoding, spdlog::logger *logger);
   ~DataManager();
 
 public:
   [[nodiscard]] bool sendMessage(const std::string& message) const noexcept;
+  // The client joins the chat as username once the server accepted the login or registration
+  void login(const std::string& username, u64 passwordHash) const noexcept;
+  void registerUser(const std::string& username, u64 passwordHash) const noexcept;
+  // The answer of the server to the last login or registration, nullopt until it arrives
+  [[nodiscard]] std::optional<ServerResponseCode> getLoginResponse() const noexcept;
+  // Asks the server for a page of messages matching query, the results replace the previous ones
+  [[nodiscard]] bool searchMessages(const std::string& query, u32 page) const noexcept;
+  [[nodiscard]] server::messages::SearchResults getSearchResults() const noexcept;
   [[nodiscard]] std::string getUsername() const noexcept;
   [[nodiscard]] std::vector<server::messages::NewMessageReceived> getMessages() const noexcept;
-  [[nodiscard]] std::map<std::string, UserData> getUsers() const noexcept;
+  // indexed by user id, slot 0 stays empty
+  [[nodiscard]] std::vector<KnownUser> getUsers() const noexcept;
   void connect(const std::string &host, u16 port) const noexcept;
 
 private:
   void onConnect();
   void onDisconnect();
   void onMessage(const server::messages::ServerMessage& message);
+  void setUsername(const std::string& value) const;
+  // sends the InitialConnection, the server only takes it from a logged in connection
+  void joinChat();
 
 private:
   void manageMessageContent(const server::messages::NewMessageReceived &value);
   void manageMessageContent(const server::messages::UserStatus &value);
   void manageMessageContent(const server::messages::ServerResponse &value);
+  void manageMessageContent(const server::messages::SearchResults &value);
+  void manageMessageContent(const server::messages::UserNames &value);
+
+  // the entry of userId, added if needed, nullptr for an id the server could not have handed out.
+  // Called with dataMutex_ held.
+  [[nodiscard]] KnownUser* learnUser(u32 userId, const std::string& username);
 
 private:
   spdlog::logger* logger_;
@@ -31,8 +62,19 @@ private:
 
 private:
   // Data containers
-  const std::string username;
-  std::map<std::string, UserData> usersMap_;
+  // the one of the last login, set from the ui thread and read when the server answers it
+  mutable std::mutex usernameMutex_;
+  mutable std::string username;
+  // asked of the server when connecting
+  const WireEncoding encoding_;
+  // filled on the network thread and copied by the ui thread, guards the containers below
+  mutable std::mutex dataMutex_;
+  std::vector<KnownUser> users_;
+  // for the messages that name their author instead of giving the id, like search results
+  std::unordered_map<std::string, u32> userIds_;
   std::vector<server::messages::NewMessageReceived> messages_;
+  server::messages::SearchResults searchResults_;
+  // reset by every login or registration sent from the ui thread
+  mutable std::optional<ServerResponseCode> loginResponse_;
 };
 
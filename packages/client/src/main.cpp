@@ -32,6 +32,7 @@ int main(int argc, char **argv)
     std::string serverIp;
     std::string loggingFolder = "./logs";
     u16 serverPort;
+    WireEncoding encoding = WireEncoding::JSON;
 
     clientCliApplication.add_option("-u,--username", username, "Username for the client to use when connecting")
         ->check([](const std::string &input) {
@@ -48,6 +49,9 @@ int main(int argc, char **argv)
     clientCliApplication.add_option("-p,--port", serverPort, "Port of the server to connect to")
         ->check(CLI::Range(1, 65535));
 
+    clientCliApplication.add_option("--wire-encoding", encoding, "Encoding asked of the server: json, msgpack or cbor")
+        ->transform(CLI::CheckedTransformer(std::map<std::string, WireEncoding>{{"json", WireEncoding::JSON}, {"msgpack", WireEncoding::MSGPACK}, {"cbor", WireEncoding::CBOR}}, CLI::ignore_case));
+
     clientCliApplication
         .add_option("-l,--log-folder", loggingFolder,
                     "Path tp the folder where the logs from the application will "
@@ -63,7 +67,7 @@ int main(int argc, char **argv)
 
     logger->info("Starting {} version {}", CLIENT_TARGET_NAME, PROJECT_VERSION);
 
-    const auto dataManager = DataManager(username, logger.get());
+    const auto dataManager = DataManager(username, encoding, logger.get());
     const auto imguiClient = std::make_unique<ImguiClient>(logger.get());
 
     if (!imguiClient->initialize())
@@ -35,16 +35,18 @@ void ChatScene::drawChat()
   {
     bool isAtBottom =  ImGui::GetScrollY() >= ImGui::GetScrollMaxY() - 1.0f;
 
+    const auto users = getData().getUsers();
     for (const auto &message : getData().getMessages())
     {
-      const auto& users = getData().getUsers();
-      if (const auto it = users.find(message.username); it != users.end())
+      const KnownUser* author = message.userId < users.size() ? &users[message.userId] : nullptr;
+      const std::string& authorName = message.username.empty() && author != nullptr ? author->username : message.username;
+      if (author != nullptr && author->data.has_value())
       {
-        renderServerMessage(message, getData().getUsername(), getData().getUsers().at(message.username).color);
+        renderServerMessage(message, authorName, getData().getUsername(), author->data->color);
       }
       else
       {
-        renderServerMessage(message, getData().getUsername(), server::messages::UserColor{100, 100, 100});
+        renderServerMessage(message, authorName, getData().getUsername(), server::messages::UserColor{100, 100, 100});
       }
     }
 
@@ -63,6 +65,12 @@ void ChatScene::drawUsers()
 
   for (const auto &[user, data] : getData().getUsers())
   {
+    // users only known by name, from the history, are not listed
+    if (!data.has_value())
+    {
+      continue;
+    }
+
     // Current cursor position in window space
     ImVec2 pos = ImGui::GetCursorScreenPos();
     float textHeight = ImGui::GetTextLineHeight();
@@ -72,7 +80,7 @@ void ChatScene::drawUsers()
     ImVec2 center = ImVec2(pos.x + radius + 2.0f, pos.y + textHeight * 0.5f);
 
     ImU32 color;
-    switch (data.status)
+    switch (data->status)
     {
     case UserStatusType::AWAY:
       color = IM_COL32(0, 200, 0, 255);
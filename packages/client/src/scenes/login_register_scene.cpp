@@ -1,5 +1,24 @@
 #include "login_register_scene.h"
 
+namespace
+{
+
+[[nodiscard]] std::string_view refusalText(ServerResponseCode code)
+{
+  switch (code)
+  {
+  case ServerResponseCode::USERNAME_ALREADY_EXISTS:
+    return "That username is already registered";
+  case ServerResponseCode::INCORRECT_PASSWORD:
+    return "Incorrect username or password";
+  case ServerResponseCode::SERVER_ERROR:
+    return "The server could not log you in, try again";
+  default:
+    return "The server refused the login";
+  }
+}
+
+}
 
 LoginRegisterScene::LoginRegisterScene(
     spdlog::logger *logger,
@@ -19,6 +38,20 @@ std::optional<ScenesEnum> LoginRegisterScene::update()
 
 [[nodiscard]] std::optional<ScenesEnum> LoginRegisterScene::drawLogin()
 {
+  // the chat is only shown once the server took the login, a refusal keeps the form up
+  if (waitingForServer_)
+  {
+    if (const auto response = getData().getLoginResponse(); response.has_value())
+    {
+      waitingForServer_ = false;
+      if (response == ServerResponseCode::SUCCESSFUL_LOGIN || response == ServerResponseCode::SUCCESSFUL_REGISTRATION)
+      {
+        return ScenesEnum::CHAT_SCENE;
+      }
+      refusal_ = fmt::format("{} (code {})", refusalText(response.value()), static_cast<u32>(response.value()));
+    }
+  }
+
   ImGui::Begin("Login");
 
   ImGui::Text("Username: ");
@@ -31,25 +64,31 @@ std::optional<ScenesEnum> LoginRegisterScene::update()
   {
   }
 
-  if (ImGui::Button("Login"))
+  if (waitingForServer_)
   {
-    ImGui::End();
-    client::messages::Login lgnMessage;
-    lgnMessage.passwordHash = hashImpl(std::string(passwordBuff_));
-    lgnMessage.username = std::string(usernameBuff_);
-    std::ignore = getData().sendMessage(lgnMessage.toString());
-    return ScenesEnum::CHAT_SCENE;
+    ImGui::Text("Waiting for the server...");
+  }
+  else
+  {
+    if (ImGui::Button("Login"))
+    {
+      getData().login(std::string(usernameBuff_), hashImpl(std::string(passwordBuff_)));
+      waitingForServer_ = true;
+      refusal_.clear();
+    }
+    ImGui::SameLine();
+
+    if (ImGui::Button("Register"))
+    {
+      getData().registerUser(std::string(usernameBuff_), hashImpl(std::string(passwordBuff_)));
+      waitingForServer_ = true;
+      refusal_.clear();
+    }
   }
-  ImGui::SameLine();
 
-  if (ImGui::Button("Register"))
+  if (!refusal_.empty())
   {
-    ImGui::End();
-    client::messages::Register rgsMessage;
-    rgsMessage.passwordHash = hashImpl(std::string(passwordBuff_));
-    rgsMessage.username = std::string(usernameBuff_);
-    std::ignore = getData().sendMessage(rgsMessage.toString());
-    return ScenesEnum::CHAT_SCENE;
+    ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "%s", refusal_.c_str());
   }
   ImGui::End();
 
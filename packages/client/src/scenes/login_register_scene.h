@@ -19,4 +19,8 @@ private:
   // Data containers
   char usernameBuff_[12] = "";
   char passwordBuff_[32] = "";
+  // a login or registration was sent and the server has not answered it yet
+  bool waitingForServer_ = false;
+  // shown under the form, the reason the server gave for refusing the last try
+  std::string refusal_;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "messages.h"
+#include "wire_frame.h"
 
 // asio
 #include "asio.hpp"
@@ -55,20 +56,18 @@ class TcpClient
         connected_ = false;
         writing_ = false;
         write_queue_.clear();
+        encoding_ = WireEncoding::JSON;
     }
 
+    // Encoded on the io thread, where the encoding of the connection is known
     void write(client::messages::ClientMessage clientMsg)
     {
-        std::string msg = std::visit([](auto const &m) { return m.toString(); }, clientMsg);
-
-        if (msg.empty() || msg.back() != '\n')
-            msg.push_back('\n');
-        asio::post(io_, [this, m = std::move(msg)]() mutable {
+        asio::post(io_, [this, message = std::move(clientMsg)] {
             if (!connected_ || !socket_.is_open()) {
                 return;
             }
 
-            write_queue_.push_back(std::move(m));
+            write_queue_.push_back(std::visit([this](auto const &m) { return wire::encodeFrame(encoding_, m); }, message));
             if (!writing_) {
                 do_write_next();
             }
@@ -154,46 +153,68 @@ class TcpClient
 
     void do_read_loop()
     {
-        // Read newline-terminated frames
-        asio::async_read_until(socket_, read_buf_, '\n', [this](std::error_code ec, std::size_t) {
+        // Frames already buffered are handled first, then the rest of the next one is read
+        wire::Frame frame;
+        while (connected_)
+        {
+            const auto buffered = read_buf_.data();
+            frame = wire::nextFrame({static_cast<const char *>(buffered.data()), buffered.size()}, read_searched_);
+            if (frame.size == 0)
+            {
+                break;
+            }
+            handle_frame(frame);
+            read_buf_.consume(frame.size);
+            read_searched_ = 0;
+        }
+        read_searched_ = frame.searched;
+
+        if (!connected_)
+        {
+            return;
+        }
+        if (frame.oversized)
+        {
+            handle_disconnect(asio::error::message_size);
+            return;
+        }
+
+        asio::async_read(socket_, read_buf_, asio::transfer_at_least(frame.missing), [this](std::error_code ec, std::size_t) {
             if (ec)
             {
                 handle_disconnect(ec);
                 return;
             }
+            do_read_loop();
+        });
+    }
 
-            std::istream is(&read_buf_);
-            std::string line;
-            std::getline(is, line);
-
-            if (message_handler_)
-            {
-                const nlohmann::json data = nlohmann::json::parse(line, nullptr, false);
-                if (data.is_discarded())
-                {
-                    logger_->error("Invalid json for message: {}", line);
-                }
+    void handle_frame(const wire::Frame &frame)
+    {
+        // The server only answers in binary once it was asked to, from then on this side writes it too
+        if (frame.encoding != encoding_ && frame.encoding != WireEncoding::JSON)
+        {
+            logger_->info("Server writes {}, switching to it", wire::encodingName(frame.encoding));
+            encoding_ = frame.encoding;
+        }
 
-                const auto &content = data[PACKET_CONTENT_KEY];
-                switch (data[PACKET_HEADER_KEY].get<ServerMessageType>())
-                {
-                case ServerMessageType::RECEIVED_MESSAGE:
-                    message_handler_(server::messages::NewMessageReceived{content});
-                    break;
-                case ServerMessageType::USER_STATUS:
-                    message_handler_(server::messages::UserStatus{content});
-                    break;
-                case ServerMessageType::SERVER_RESPONSE:
-                    message_handler_(server::messages::ServerResponse{content});
-                    break;
-                }
-            }
+        if (!message_handler_)
+        {
+            return;
+        }
 
-            if (connected_)
-            {
-                do_read_loop();
-            }
-        });
+        if (auto message = wire::decodeFrame<server::messages::ServerMessage>(frame); message.has_value())
+        {
+            message_handler_(std::move(message.value()));
+        }
+        else if (frame.encoding == WireEncoding::JSON)
+        {
+            logger_->error("Invalid message: {}", frame.packet);
+        }
+        else
+        {
+            logger_->error("Invalid {} message of {} bytes", wire::encodingName(frame.encoding), frame.packet.size());
+        }
     }
 
     void do_write_next()
@@ -229,6 +250,7 @@ class TcpClient
             connected_ = false;
             writing_ = false;
             write_queue_.clear();
+            encoding_ = WireEncoding::JSON;
             if (on_disconnect_)
             {on_disconnect_();}
         }
@@ -248,6 +270,10 @@ private:
 
     // Read
     asio::streambuf read_buf_;
+    // bytes of read_buf_ already searched for the line end of a text frame
+    std::size_t read_searched_ = 0;
+    // Of the frames written, the server's once it writes binary frames
+    WireEncoding encoding_{WireEncoding::JSON};
 
     // Write queue
     std::deque<std::string> write_queue_;
@@ -38,11 +38,14 @@ using f32 = float;
 using f64 = double;
 
 constexpr u16 MAX_MESSAGE_LENGTH = 256;
+// Most user ids the server hands out before a restart, clients refuse larger ones
+constexpr u32 MAX_USER_ID = 1u << 20;
 
 // Content keys
 constexpr std::string_view USERNAME_KEY = "username";
 constexpr std::string_view TIMESTAMP_KEY = "timestamp";
 constexpr std::string_view MESSAGE_KEY = "message";
+constexpr std::string_view MESSAGE_ID_KEY = "id";
 constexpr std::string_view REASON_KEY = "reason";
 constexpr std::string_view USER_STATUS_KEY = "status";
 constexpr std::string_view USER_COLOR_KEY = "color";
@@ -51,6 +54,14 @@ constexpr std::string_view COLOR_GREEN_KEY = "green";
 constexpr std::string_view COLOR_BLUE_KEY = "blue";
 constexpr std::string_view SERVER_RESPONSE_CODE_KEY = "responseCode";
 constexpr std::string_view PASSWORD_HASH_KEY = "passwordHash";
+constexpr std::string_view SEARCH_QUERY_KEY = "query";
+constexpr std::string_view PAGE_KEY = "page";
+constexpr std::string_view LIMIT_KEY = "limit";
+constexpr std::string_view MESSAGES_KEY = "messages";
+constexpr std::string_view HAS_MORE_KEY = "hasMore";
+constexpr std::string_view ENCODING_KEY = "encoding";
+constexpr std::string_view USER_ID_KEY = "userId";
+constexpr std::string_view USERS_KEY = "users";
 
 // Packet keys
 constexpr std::string_view PACKET_HEADER_KEY = "header";
@@ -62,6 +73,10 @@ enum class ServerResponseCode
     SUCCESSFUL_LOGIN,
     USERNAME_ALREADY_EXISTS,
     INCORRECT_PASSWORD,
+    SERVER_ERROR,
+    SEARCH_UNAVAILABLE,
+    // InitialConnection or NewMessage from a connection that has not logged in
+    NOT_LOGGED_IN,
 };
 
 enum class UserStatusType
@@ -75,7 +90,9 @@ enum class ServerMessageType
 {
     RECEIVED_MESSAGE = 0,
     USER_STATUS = 1,
-    SERVER_RESPONSE = 2
+    SERVER_RESPONSE = 2,
+    SEARCH_RESULTS = 3,
+    USER_NAMES = 4
 };
 
 enum class ClientMessageType
@@ -83,7 +100,16 @@ enum class ClientMessageType
     INITIAL_CONNECTION = 0,
     NEW_MESSAGE = 2,
     REGISTER = 3,
-    LOGIN = 4
+    LOGIN = 4,
+    SEARCH_MESSAGES = 5
+};
+
+// Encoding of the packets of a connection, asked for by the client in its InitialConnection
+enum class WireEncoding : u8
+{
+    JSON = 0,
+    MSGPACK = 1,
+    CBOR = 2
 };
 
 // FNV-1a (64-bit) implementation
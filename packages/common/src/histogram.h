@@ -0,0 +1,131 @@
+#pragma once
+
+#include "global.h"
+
+// std
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <limits>
+
+namespace histogram
+{
+
+// Log-linear (HDR style) bucketing: values are grouped by their most significant bit and every
+// group is split linearly in SUB_BUCKETS, so the relative error stays below 1 / SUB_BUCKETS over
+// the whole u64 range with a fixed footprint.
+constexpr u32 SUB_BUCKET_BITS = 4;
+constexpr u32 SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+constexpr u32 BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+[[nodiscard]] constexpr u32 bucketIndex(u64 value) noexcept
+{
+    if (value < SUB_BUCKETS)
+    {
+        return static_cast<u32>(value);
+    }
+
+    const u32 shift = static_cast<u32>(63 - std::countl_zero(value)) - SUB_BUCKET_BITS;
+    const u32 sub = static_cast<u32>(value >> shift) & (SUB_BUCKETS - 1);
+    return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+// Highest value that falls in the bucket, this is what percentiles report
+[[nodiscard]] constexpr u64 bucketUpperBound(u32 index) noexcept
+{
+    if (index < SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    const u32 shift = index / SUB_BUCKETS - 1;
+    const u64 sub = index % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+static_assert(bucketIndex(std::numeric_limits<u64>::max()) == BUCKET_COUNT - 1);
+static_assert(bucketUpperBound(bucketIndex(1000)) >= 1000);
+
+class Histogram
+{
+public:
+    void record(u64 value) noexcept
+    {
+        ++counts_[bucketIndex(value)];
+        ++count_;
+        sum_ += value;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    // Adds count samples to a bucket, the samples are accounted at the bucket upper bound
+    void recordBucket(u32 index, u64 count) noexcept
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        const u64 value = bucketUpperBound(index);
+        counts_[index] += count;
+        count_ += count;
+        sum_ += value * count;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const Histogram& other) noexcept
+    {
+        for (u32 i = 0; i < BUCKET_COUNT; ++i)
+        {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() noexcept
+    {
+        *this = Histogram{};
+    }
+
+    [[nodiscard]] u64 count() const noexcept { return count_; }
+    [[nodiscard]] u64 sum() const noexcept { return sum_; }
+    [[nodiscard]] u64 min() const noexcept { return count_ == 0 ? 0 : min_; }
+    [[nodiscard]] u64 max() const noexcept { return max_; }
+    [[nodiscard]] f64 mean() const noexcept { return count_ == 0 ? 0.0 : static_cast<f64>(sum_) / static_cast<f64>(count_); }
+
+    // percentile in the range [0, 100]
+    [[nodiscard]] u64 percentile(f64 percentile) const noexcept
+    {
+        if (count_ == 0)
+        {
+            return 0;
+        }
+
+        const f64 clamped = std::clamp(percentile, 0.0, 100.0);
+        const u64 target = std::max<u64>(1, static_cast<u64>(clamped / 100.0 * static_cast<f64>(count_) + 0.5));
+
+        u64 seen = 0;
+        for (u32 i = 0; i < BUCKET_COUNT; ++i)
+        {
+            seen += counts_[i];
+            if (seen >= target)
+            {
+                return std::min(bucketUpperBound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    std::array<u64, BUCKET_COUNT> counts_{};
+    u64 count_ = 0;
+    u64 sum_ = 0;
+    u64 min_ = std::numeric_limits<u64>::max();
+    u64 max_ = 0;
+};
+
+} // namespace histogram
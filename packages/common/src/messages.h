@@ -1,6 +1,7 @@
 #pragma once
 
 #include "global.h"
+#include "wire_format.h"
 
 // nlohmann
 #include "json.hpp"
@@ -10,12 +11,22 @@
 #include <filesystem>
 #include <string>
 #include <variant>
+#include <vector>
 
 namespace server::messages
 {
 
 struct UserColor
 {
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(COLOR_BLUE_KEY, &UserColor::blue),
+            wire::field(COLOR_GREEN_KEY, &UserColor::green),
+            wire::field(COLOR_RED_KEY, &UserColor::red),
+        };
+    }
+
     u8 red = 0;
     u8 green = 0;
     u8 blue = 0;
@@ -23,23 +34,25 @@ struct UserColor
 
 struct ServerResponse
 {
+    static constexpr auto TYPE = ServerMessageType::SERVER_RESPONSE;
+
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(SERVER_RESPONSE_CODE_KEY, &ServerResponse::code),
+        };
+    }
+
     explicit ServerResponse(const nlohmann::json &data)
     {
-        code = data[SERVER_RESPONSE_CODE_KEY].get<ServerResponseCode>();
+        wire::fromJson(data, *this);
     }
 
     ServerResponse() = default;
 
     [[nodiscard]] std::string toString() const noexcept
     {
-        nlohmann::json data;
-        data[PACKET_HEADER_KEY] = ServerMessageType::SERVER_RESPONSE;
-
-        nlohmann::json content;
-        content[SERVER_RESPONSE_CODE_KEY] = code;
-        data[PACKET_CONTENT_KEY] = content;
-
-        return data.dump();
+        return wire::toString(*this);
     }
 
     ServerResponseCode code;
@@ -47,76 +60,156 @@ struct ServerResponse
 
 struct NewMessageReceived
 {
+    static constexpr auto TYPE = ServerMessageType::RECEIVED_MESSAGE;
+
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(MESSAGE_ID_KEY, &NewMessageReceived::id, wire::Presence::OPTIONAL),
+            wire::field(MESSAGE_KEY, &NewMessageReceived::message),
+            wire::field(TIMESTAMP_KEY, &NewMessageReceived::timestamp),
+            wire::field(USER_ID_KEY, &NewMessageReceived::userId, wire::Presence::OMIT_DEFAULT),
+            wire::field(USERNAME_KEY, &NewMessageReceived::username, wire::Presence::OMIT_DEFAULT),
+        };
+    }
+
     explicit NewMessageReceived(const nlohmann::json &data)
     {
-        username = data[USERNAME_KEY].get<std::string>();
-        message = data[MESSAGE_KEY].get<std::string>();
-        timestamp = data[TIMESTAMP_KEY].get<u64>();
+        wire::fromJson(data, *this);
     }
     NewMessageReceived() = default;
 
     [[nodiscard]] std::string toString() const noexcept
     {
-        nlohmann::json data;
-        data[PACKET_HEADER_KEY] = ServerMessageType::RECEIVED_MESSAGE;
-
-        nlohmann::json content;
-        content[USERNAME_KEY] = username;
-        content[TIMESTAMP_KEY] = timestamp;
-        content[MESSAGE_KEY] = message;
-
-        data[PACKET_CONTENT_KEY] = content;
+        return wire::toString(*this);
+    }
 
-        return data.dump();
+    // the content object alone, also how messages are nested in other packets
+    [[nodiscard]] nlohmann::json content() const
+    {
+        return wire::toJson(*this);
     }
 
+    // empty when the packet names the user by userId alone
     std::string username;
     std::string message;
     u64 timestamp;
+    // server assigned, increases with every message
+    u64 id = 0;
+    // id of the user in the user directory of the server, 0 when the packet carries the username.
+    // Stored messages only keep the username.
+    u32 userId = 0;
 };
 
 struct UserStatus
 {
+    static constexpr auto TYPE = ServerMessageType::USER_STATUS;
+
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(USER_COLOR_KEY, &UserStatus::color),
+            wire::field(USER_STATUS_KEY, &UserStatus::status),
+            wire::field(TIMESTAMP_KEY, &UserStatus::timestamp),
+            wire::field(USER_ID_KEY, &UserStatus::userId, wire::Presence::OPTIONAL),
+            wire::field(USERNAME_KEY, &UserStatus::username),
+        };
+    }
+
     explicit UserStatus(const nlohmann::json &data)
     {
-        username = data[USERNAME_KEY].get<std::string>();
-        timestamp = data[TIMESTAMP_KEY].get<u64>();
-        status = data[USER_STATUS_KEY].get<UserStatusType>();
-        color.red = data[USER_COLOR_KEY][COLOR_RED_KEY].get<u8>();
-        color.blue = data[USER_COLOR_KEY][COLOR_BLUE_KEY].get<u8>();
-        color.green = data[USER_COLOR_KEY][COLOR_GREEN_KEY].get<u8>();
+        wire::fromJson(data, *this);
     }
     UserStatus() = default;
 
     [[nodiscard]] std::string toString() const noexcept
     {
-        nlohmann::json data;
-        data[PACKET_HEADER_KEY] = ServerMessageType::USER_STATUS;
+        return wire::toString(*this);
+    }
 
-        nlohmann::json content;
-        content[USERNAME_KEY] = username;
-        content[TIMESTAMP_KEY] = timestamp;
-        content[USER_STATUS_KEY] = status;
+    std::string username;
+    // what later packets call the user by
+    u32 userId = 0;
+    UserStatusType status;
+    UserColor color;
+    u64 timestamp;
+};
 
-        nlohmann::json colorKey;
-        colorKey[COLOR_RED_KEY] = color.red;
-        colorKey[COLOR_BLUE_KEY]= color.blue;
-        colorKey[COLOR_GREEN_KEY]= color.green;
+struct UserName
+{
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(USER_ID_KEY, &UserName::userId),
+            wire::field(USERNAME_KEY, &UserName::username),
+        };
+    }
 
-        content[USER_COLOR_KEY] = colorKey;
+    u32 userId = 0;
+    std::string username;
+};
 
-        data[PACKET_CONTENT_KEY] = content;
+// Names of users that the packets after it refer to by id, sent before a history replay for the
+// authors of its messages
+struct UserNames
+{
+    static constexpr auto TYPE = ServerMessageType::USER_NAMES;
 
-        return data.dump();
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(USERS_KEY, &UserNames::users),
+        };
     }
 
-    std::string username;
-    UserStatusType status;
-    UserColor color;
-    u64 timestamp;
+    explicit UserNames(const nlohmann::json &data)
+    {
+        wire::fromJson(data, *this);
+    }
+    UserNames() = default;
+
+    [[nodiscard]] std::string toString() const noexcept
+    {
+        return wire::toString(*this);
+    }
+
+    std::vector<UserName> users;
 };
 
-using ServerMessage = std::variant<UserStatus, NewMessageReceived, ServerResponse>;
+// One page of a message search, best matches first
+struct SearchResults
+{
+    static constexpr auto TYPE = ServerMessageType::SEARCH_RESULTS;
+
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(HAS_MORE_KEY, &SearchResults::hasMore),
+            wire::field(MESSAGES_KEY, &SearchResults::messages),
+            wire::field(PAGE_KEY, &SearchResults::page),
+            wire::field(SEARCH_QUERY_KEY, &SearchResults::query),
+        };
+    }
+
+    explicit SearchResults(const nlohmann::json &data)
+    {
+        wire::fromJson(data, *this);
+    }
+    SearchResults() = default;
+
+    [[nodiscard]] std::string toString() const noexcept
+    {
+        return wire::toString(*this);
+    }
+
+    std::string query;
+    u32 page = 0;
+    // there are more matches after this page
+    bool hasMore = false;
+    std::vector<NewMessageReceived> messages;
+};
+
+using ServerMessage = std::variant<UserStatus, NewMessageReceived, ServerResponse, SearchResults, UserNames>;
 
 } // namespace server::messages
 
@@ -125,47 +218,53 @@ namespace client::messages
 
 struct InitialConnection
 {
+    static constexpr auto TYPE = ClientMessageType::INITIAL_CONNECTION;
+
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(ENCODING_KEY, &InitialConnection::encoding, wire::Presence::OPTIONAL),
+            wire::field(USERNAME_KEY, &InitialConnection::username),
+        };
+    }
+
     explicit InitialConnection(const nlohmann::json &data)
     {
-        username = data[USERNAME_KEY].get<std::string>();
+        wire::fromJson(data, *this);
     }
     InitialConnection() = default;
 
     [[nodiscard]] std::string toString() const noexcept
     {
-        nlohmann::json data;
-        data[PACKET_HEADER_KEY] = ClientMessageType::INITIAL_CONNECTION;
-
-        nlohmann::json content;
-        content[USERNAME_KEY] = username;
-
-        data[PACKET_CONTENT_KEY] = content;
-
-        return data.dump();
+        return wire::toString(*this);
     }
 
     std::string username;
+    // encoding the server writes in to this connection from now on, the client switches its own
+    // writes to it when the first frame in it arrives
+    WireEncoding encoding = WireEncoding::JSON;
 };
 
 struct NewMessage
 {
+    static constexpr auto TYPE = ClientMessageType::NEW_MESSAGE;
+
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(MESSAGE_KEY, &NewMessage::message),
+        };
+    }
+
     explicit NewMessage(const nlohmann::json &data)
     {
-        message = data[MESSAGE_KEY].get<std::string>();
+        wire::fromJson(data, *this);
     }
     NewMessage() = default;
 
     [[nodiscard]] std::string toString() const noexcept
     {
-        nlohmann::json data;
-        data[PACKET_HEADER_KEY] = ClientMessageType::NEW_MESSAGE;
-
-        nlohmann::json content;
-        content[MESSAGE_KEY] = message;
-
-        data[PACKET_CONTENT_KEY] = content;
-
-        return data.dump();
+        return wire::toString(*this);
     }
 
     std::string message;
@@ -174,25 +273,25 @@ struct NewMessage
 
 struct Login
 {
+    static constexpr auto TYPE = ClientMessageType::LOGIN;
+
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(PASSWORD_HASH_KEY, &Login::passwordHash),
+            wire::field(USERNAME_KEY, &Login::username),
+        };
+    }
+
     explicit Login(const nlohmann::json &data)
     {
-        username = data[USERNAME_KEY].get<std::string>();
-        passwordHash = data[PASSWORD_HASH_KEY].get<u64>();
+        wire::fromJson(data, *this);
     }
     Login() = default;
 
     [[nodiscard]] std::string toString() const noexcept
     {
-        nlohmann::json data;
-        data[PACKET_HEADER_KEY] = ClientMessageType::LOGIN;
-
-        nlohmann::json content;
-        content[USERNAME_KEY] = username;
-        content[PASSWORD_HASH_KEY] = passwordHash;
-
-        data[PACKET_CONTENT_KEY] = content;
-
-        return data.dump();
+        return wire::toString(*this);
     }
 
     std::string username;
@@ -201,25 +300,25 @@ struct Login
 
 struct Register
 {
+    static constexpr auto TYPE = ClientMessageType::REGISTER;
+
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(PASSWORD_HASH_KEY, &Register::passwordHash),
+            wire::field(USERNAME_KEY, &Register::username),
+        };
+    }
+
     explicit Register(const nlohmann::json &data)
     {
-        username = data[USERNAME_KEY].get<std::string>();
-        passwordHash = data[PASSWORD_HASH_KEY].get<u64>();
+        wire::fromJson(data, *this);
     }
     Register() = default;
 
     [[nodiscard]] std::string toString() const noexcept
     {
-        nlohmann::json data;
-        data[PACKET_HEADER_KEY] = ClientMessageType::REGISTER;
-
-        nlohmann::json content;
-        content[USERNAME_KEY] = username;
-        content[PASSWORD_HASH_KEY] = passwordHash;
-
-        data[PACKET_CONTENT_KEY] = content;
-
-        return data.dump();
+        return wire::toString(*this);
     }
 
     std::string username;
@@ -227,7 +326,38 @@ struct Register
 };
 
 
-using ClientMessage = std::variant<NewMessage, InitialConnection, Login, Register>;
+// Full-text search of the message history. Words are matched as a whole except the last one,
+// which also matches as a prefix. Pages hold limit messages, ranked by relevance.
+struct SearchMessages
+{
+    static constexpr auto TYPE = ClientMessageType::SEARCH_MESSAGES;
+
+    static constexpr auto fields() noexcept
+    {
+        return std::tuple{
+            wire::field(LIMIT_KEY, &SearchMessages::limit, wire::Presence::OPTIONAL),
+            wire::field(PAGE_KEY, &SearchMessages::page, wire::Presence::OPTIONAL),
+            wire::field(SEARCH_QUERY_KEY, &SearchMessages::query),
+        };
+    }
+
+    explicit SearchMessages(const nlohmann::json &data)
+    {
+        wire::fromJson(data, *this);
+    }
+    SearchMessages() = default;
+
+    [[nodiscard]] std::string toString() const noexcept
+    {
+        return wire::toString(*this);
+    }
+
+    std::string query;
+    u32 page = 0;
+    u32 limit = 20;
+};
+
+using ClientMessage = std::variant<NewMessage, InitialConnection, Login, Register, SearchMessages>;
 
 } // namespace client::messages
 
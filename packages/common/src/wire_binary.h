@@ -0,0 +1,918 @@
+#pragma once
+
+#include "wire_format.h"
+
+// std
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+// MessagePack and CBOR versions of the packets, written and read through the same fields() tables as
+// the JSON text. A packet is the map {"content":{...},"header":TYPE} in both, the data model of the
+// text, so nlohmann::json::from_msgpack() and from_cbor() turn one into the document parse() builds
+// from the text. Numbers and sizes take their shortest form and keys keep the order of the tables,
+// which gives the bytes to_msgpack() and to_cbor() write for that document.
+namespace wire
+{
+
+namespace detail
+{
+
+template <typename N>
+void appendBigEndian(std::string& out, N value)
+{
+    for (std::size_t shift = sizeof(N) * 8; shift != 0; shift -= 8)
+    {
+        out += static_cast<char>(static_cast<u8>(value >> (shift - 8)));
+    }
+}
+
+[[nodiscard]] inline bool isUtf8(std::string_view text) noexcept
+{
+    std::size_t i = 0;
+    while (i < text.size())
+    {
+        if (static_cast<u8>(text[i]) < 0x80)
+        {
+            ++i;
+            continue;
+        }
+        const std::size_t length = utf8SequenceLength(text.substr(i));
+        if (length == 0)
+        {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+// Invalid bytes become U+FFFD, as writeString() does for the text
+[[nodiscard]] inline std::string toValidUtf8(std::string_view text)
+{
+    std::string out;
+    out.reserve(text.size());
+    std::size_t i = 0;
+    while (i < text.size())
+    {
+        const std::size_t length = static_cast<u8>(text[i]) < 0x80 ? 1 : utf8SequenceLength(text.substr(i));
+        if (length == 0)
+        {
+            out += REPLACEMENT_CHARACTER;
+            ++i;
+            continue;
+        }
+        out.append(text, i, length);
+        i += length;
+    }
+    return out;
+}
+
+// The head of an item, sizes of strings and containers checked against the bytes left
+struct BinaryItem
+{
+    enum class Type : u8
+    {
+        UNSIGNED,
+        // value holds the i64 two's complement
+        NEGATIVE,
+        BOOLEAN,
+        // value holds the size, the bytes follow the head
+        STRING,
+        BYTES,
+        ARRAY,
+        MAP,
+        // CBOR tag, one item follows
+        TAG,
+        // null, floats and MessagePack extensions, their bytes already consumed
+        OTHER
+    };
+
+    Type type = Type::OTHER;
+    u64 value = 0;
+};
+
+class BinaryInput
+{
+public:
+    explicit BinaryInput(std::string_view data) noexcept : data_(data) {}
+
+    [[nodiscard]] bool atEnd() const noexcept { return pos_ == data_.size(); }
+    [[nodiscard]] std::size_t position() const noexcept { return pos_; }
+    [[nodiscard]] std::size_t left() const noexcept { return data_.size() - pos_; }
+
+    [[nodiscard]] bool byte(u8& out) noexcept
+    {
+        if (pos_ == data_.size())
+        {
+            return false;
+        }
+        out = static_cast<u8>(data_[pos_++]);
+        return true;
+    }
+
+    template <typename N>
+    [[nodiscard]] bool bigEndian(N& out) noexcept
+    {
+        if (left() < sizeof(N))
+        {
+            return false;
+        }
+        out = 0;
+        for (std::size_t i = 0; i < sizeof(N); ++i)
+        {
+            out = static_cast<N>((out << 8) | static_cast<u8>(data_[pos_++]));
+        }
+        return true;
+    }
+
+    [[nodiscard]] bool bytes(std::size_t size, std::string_view& out) noexcept
+    {
+        if (left() < size)
+        {
+            return false;
+        }
+        out = data_.substr(pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    [[nodiscard]] bool skip(std::size_t size) noexcept
+    {
+        std::string_view ignored;
+        return bytes(size, ignored);
+    }
+
+private:
+    std::string_view data_;
+    std::size_t pos_ = 0;
+};
+
+struct Msgpack
+{
+    static void writeUnsigned(std::string& out, u64 value)
+    {
+        if (value < 0x80)
+        {
+            out += static_cast<char>(value);
+        }
+        else if (value <= 0xFF)
+        {
+            out += '\xCC';
+            appendBigEndian(out, static_cast<u8>(value));
+        }
+        else if (value <= 0xFFFF)
+        {
+            out += '\xCD';
+            appendBigEndian(out, static_cast<u16>(value));
+        }
+        else if (value <= 0xFFFFFFFF)
+        {
+            out += '\xCE';
+            appendBigEndian(out, static_cast<u32>(value));
+        }
+        else
+        {
+            out += '\xCF';
+            appendBigEndian(out, value);
+        }
+    }
+
+    static void writeNegative(std::string& out, i64 value)
+    {
+        if (value >= -32)
+        {
+            out += static_cast<char>(static_cast<u8>(value));
+        }
+        else if (value >= std::numeric_limits<i8>::min())
+        {
+            out += '\xD0';
+            appendBigEndian(out, static_cast<u8>(value));
+        }
+        else if (value >= std::numeric_limits<i16>::min())
+        {
+            out += '\xD1';
+            appendBigEndian(out, static_cast<u16>(value));
+        }
+        else if (value >= std::numeric_limits<i32>::min())
+        {
+            out += '\xD2';
+            appendBigEndian(out, static_cast<u32>(value));
+        }
+        else
+        {
+            out += '\xD3';
+            appendBigEndian(out, static_cast<u64>(value));
+        }
+    }
+
+    static void writeBool(std::string& out, bool value)
+    {
+        out += value ? '\xC3' : '\xC2';
+    }
+
+    static void writeStringHead(std::string& out, std::size_t size)
+    {
+        writeHead(out, size, 0xA0, 32, '\xD9', '\xDA', '\xDB');
+    }
+
+    static void writeArrayHead(std::string& out, std::size_t size)
+    {
+        writeHead(out, size, 0x90, 16, 0, '\xDC', '\xDD');
+    }
+
+    static void writeMapHead(std::string& out, std::size_t size)
+    {
+        writeHead(out, size, 0x80, 16, 0, '\xDE', '\xDF');
+    }
+
+    [[nodiscard]] static bool readHead(BinaryInput& in, BinaryItem& item) noexcept
+    {
+        using Type = BinaryItem::Type;
+
+        u8 lead = 0;
+        if (!in.byte(lead))
+        {
+            return false;
+        }
+
+        if (lead < 0x80)
+        {
+            item = {Type::UNSIGNED, lead};
+            return true;
+        }
+        if (lead >= 0xE0)
+        {
+            item = {Type::NEGATIVE, static_cast<u64>(static_cast<i64>(static_cast<i8>(lead)))};
+            return true;
+        }
+        if (lead <= 0x8F)
+        {
+            item = {Type::MAP, lead & 0x0Fu};
+            return true;
+        }
+        if (lead <= 0x9F)
+        {
+            item = {Type::ARRAY, lead & 0x0Fu};
+            return true;
+        }
+        if (lead <= 0xBF)
+        {
+            item = {Type::STRING, lead & 0x1Fu};
+            return true;
+        }
+
+        switch (lead)
+        {
+        case 0xC0: item = {Type::OTHER, 0}; return true;
+        case 0xC2: item = {Type::BOOLEAN, 0}; return true;
+        case 0xC3: item = {Type::BOOLEAN, 1}; return true;
+        case 0xC4: return sized<u8>(in, item, Type::BYTES);
+        case 0xC5: return sized<u16>(in, item, Type::BYTES);
+        case 0xC6: return sized<u32>(in, item, Type::BYTES);
+        case 0xC7: return extension<u8>(in, item);
+        case 0xC8: return extension<u16>(in, item);
+        case 0xC9: return extension<u32>(in, item);
+        case 0xCA: item = {Type::OTHER, 0}; return in.skip(4);
+        case 0xCB: item = {Type::OTHER, 0}; return in.skip(8);
+        case 0xCC: return sized<u8>(in, item, Type::UNSIGNED);
+        case 0xCD: return sized<u16>(in, item, Type::UNSIGNED);
+        case 0xCE: return sized<u32>(in, item, Type::UNSIGNED);
+        case 0xCF: return sized<u64>(in, item, Type::UNSIGNED);
+        case 0xD0: return negative<u8, i8>(in, item);
+        case 0xD1: return negative<u16, i16>(in, item);
+        case 0xD2: return negative<u32, i32>(in, item);
+        case 0xD3: return negative<u64, i64>(in, item);
+        case 0xD4: item = {Type::OTHER, 0}; return in.skip(1 + 1);
+        case 0xD5: item = {Type::OTHER, 0}; return in.skip(1 + 2);
+        case 0xD6: item = {Type::OTHER, 0}; return in.skip(1 + 4);
+        case 0xD7: item = {Type::OTHER, 0}; return in.skip(1 + 8);
+        case 0xD8: item = {Type::OTHER, 0}; return in.skip(1 + 16);
+        case 0xD9: return sized<u8>(in, item, Type::STRING);
+        case 0xDA: return sized<u16>(in, item, Type::STRING);
+        case 0xDB: return sized<u32>(in, item, Type::STRING);
+        case 0xDC: return sized<u16>(in, item, Type::ARRAY);
+        case 0xDD: return sized<u32>(in, item, Type::ARRAY);
+        case 0xDE: return sized<u16>(in, item, Type::MAP);
+        case 0xDF: return sized<u32>(in, item, Type::MAP);
+        default:
+            // 0xC1 is never used
+            return false;
+        }
+    }
+
+private:
+    static void writeHead(std::string& out, std::size_t size, u8 fixed, std::size_t fixedLimit, char head8, char head16, char head32)
+    {
+        if (size < fixedLimit)
+        {
+            out += static_cast<char>(fixed | size);
+        }
+        else if (head8 != 0 && size <= 0xFF)
+        {
+            out += head8;
+            appendBigEndian(out, static_cast<u8>(size));
+        }
+        else if (size <= 0xFFFF)
+        {
+            out += head16;
+            appendBigEndian(out, static_cast<u16>(size));
+        }
+        else
+        {
+            out += head32;
+            appendBigEndian(out, static_cast<u32>(size));
+        }
+    }
+
+    template <typename N>
+    [[nodiscard]] static bool sized(BinaryInput& in, BinaryItem& item, BinaryItem::Type type) noexcept
+    {
+        N value = 0;
+        if (!in.bigEndian(value))
+        {
+            return false;
+        }
+        item = {type, value};
+        return true;
+    }
+
+    template <typename U, typename S>
+    [[nodiscard]] static bool negative(BinaryInput& in, BinaryItem& item) noexcept
+    {
+        U bits = 0;
+        if (!in.bigEndian(bits))
+        {
+            return false;
+        }
+        const auto value = static_cast<i64>(static_cast<S>(bits));
+        item = {value < 0 ? BinaryItem::Type::NEGATIVE : BinaryItem::Type::UNSIGNED, static_cast<u64>(value)};
+        return true;
+    }
+
+    template <typename N>
+    [[nodiscard]] static bool extension(BinaryInput& in, BinaryItem& item) noexcept
+    {
+        N size = 0;
+        if (!in.bigEndian(size))
+        {
+            return false;
+        }
+        item = {BinaryItem::Type::OTHER, 0};
+        return in.skip(std::size_t{1} + size);
+    }
+};
+
+struct Cbor
+{
+    static void writeUnsigned(std::string& out, u64 value)
+    {
+        writeHead(out, 0, value);
+    }
+
+    static void writeNegative(std::string& out, i64 value)
+    {
+        writeHead(out, 1, static_cast<u64>(-1 - value));
+    }
+
+    static void writeBool(std::string& out, bool value)
+    {
+        out += value ? '\xF5' : '\xF4';
+    }
+
+    static void writeStringHead(std::string& out, std::size_t size)
+    {
+        writeHead(out, 3, size);
+    }
+
+    static void writeArrayHead(std::string& out, std::size_t size)
+    {
+        writeHead(out, 4, size);
+    }
+
+    static void writeMapHead(std::string& out, std::size_t size)
+    {
+        writeHead(out, 5, size);
+    }
+
+    // Indefinite lengths are not accepted, nothing in the protocol writes them
+    [[nodiscard]] static bool readHead(BinaryInput& in, BinaryItem& item) noexcept
+    {
+        using Type = BinaryItem::Type;
+
+        u8 lead = 0;
+        if (!in.byte(lead))
+        {
+            return false;
+        }
+
+        const u8 major = lead >> 5;
+        const u8 info = lead & 0x1F;
+        u64 argument = 0;
+        if (info < 24)
+        {
+            argument = info;
+        }
+        else if (!(info == 24 && readArgument<u8>(in, argument)) && !(info == 25 && readArgument<u16>(in, argument)) &&
+                 !(info == 26 && readArgument<u32>(in, argument)) && !(info == 27 && readArgument<u64>(in, argument)))
+        {
+            return false;
+        }
+
+        switch (major)
+        {
+        case 0:
+            item = {Type::UNSIGNED, argument};
+            return true;
+        case 1:
+            if (argument > static_cast<u64>(std::numeric_limits<i64>::max()))
+            {
+                return false;
+            }
+            item = {Type::NEGATIVE, static_cast<u64>(-1 - static_cast<i64>(argument))};
+            return true;
+        case 2:
+            item = {Type::BYTES, argument};
+            return true;
+        case 3:
+            item = {Type::STRING, argument};
+            return true;
+        case 4:
+            item = {Type::ARRAY, argument};
+            return true;
+        case 5:
+            item = {Type::MAP, argument};
+            return true;
+        case 6:
+            item = {Type::TAG, argument};
+            return true;
+        default:
+            // false, true, null, undefined, simple values and floats, whose bytes were the argument
+            if (info == 20 || info == 21)
+            {
+                item = {Type::BOOLEAN, info == 21 ? 1u : 0u};
+            }
+            else
+            {
+                item = {Type::OTHER, 0};
+            }
+            return true;
+        }
+    }
+
+private:
+    static void writeHead(std::string& out, u8 major, u64 argument)
+    {
+        const auto lead = static_cast<u8>(major << 5);
+        if (argument < 24)
+        {
+            out += static_cast<char>(lead | argument);
+        }
+        else if (argument <= 0xFF)
+        {
+            out += static_cast<char>(lead | 24);
+            appendBigEndian(out, static_cast<u8>(argument));
+        }
+        else if (argument <= 0xFFFF)
+        {
+            out += static_cast<char>(lead | 25);
+            appendBigEndian(out, static_cast<u16>(argument));
+        }
+        else if (argument <= 0xFFFFFFFF)
+        {
+            out += static_cast<char>(lead | 26);
+            appendBigEndian(out, static_cast<u32>(argument));
+        }
+        else
+        {
+            out += static_cast<char>(lead | 27);
+            appendBigEndian(out, argument);
+        }
+    }
+
+    template <typename N>
+    [[nodiscard]] static bool readArgument(BinaryInput& in, u64& argument) noexcept
+    {
+        N value = 0;
+        if (!in.bigEndian(value))
+        {
+            return false;
+        }
+        argument = value;
+        return true;
+    }
+};
+
+template <typename Format>
+void writeBinaryString(std::string& out, std::string_view text)
+{
+    if (isUtf8(text))
+    {
+        Format::writeStringHead(out, text.size());
+        out += text;
+        return;
+    }
+    const std::string valid = toValidUtf8(text);
+    Format::writeStringHead(out, valid.size());
+    out += valid;
+}
+
+template <typename Format, typename N>
+void writeBinaryInteger(std::string& out, N value)
+{
+    if constexpr (std::is_signed_v<N>)
+    {
+        if (value < 0)
+        {
+            Format::writeNegative(out, value);
+            return;
+        }
+    }
+    Format::writeUnsigned(out, static_cast<u64>(value));
+}
+
+template <typename Format, Described T>
+void writeBinaryObject(std::string& out, const T& value);
+
+template <typename Format, typename V>
+void writeBinaryValue(std::string& out, const V& value)
+{
+    if constexpr (std::is_same_v<V, std::string>)
+    {
+        writeBinaryString<Format>(out, value);
+    }
+    else if constexpr (std::is_same_v<V, bool>)
+    {
+        Format::writeBool(out, value);
+    }
+    else if constexpr (std::is_enum_v<V>)
+    {
+        writeBinaryInteger<Format>(out, static_cast<std::underlying_type_t<V>>(value));
+    }
+    else if constexpr (std::is_integral_v<V>)
+    {
+        writeBinaryInteger<Format>(out, value);
+    }
+    else if constexpr (Described<V>)
+    {
+        writeBinaryObject<Format>(out, value);
+    }
+    else
+    {
+        static_assert(IsVector<V>::value, "no wire encoding for this type");
+        Format::writeArrayHead(out, value.size());
+        for (const auto& element : value)
+        {
+            writeBinaryValue<Format>(out, element);
+        }
+    }
+}
+
+template <typename Format, Described T>
+void writeBinaryObject(std::string& out, const T& value)
+{
+    std::apply([&](const auto&... fields)
+    {
+        Format::writeMapHead(out, (std::size_t{0} + ... + (isWritten(fields, value) ? 1 : 0)));
+        const auto write = [&](const auto& field)
+        {
+            if (isWritten(field, value))
+            {
+                writeBinaryString<Format>(out, field.key);
+                writeBinaryValue<Format>(out, value.*field.member);
+            }
+        };
+        (write(fields), ...);
+    }, T::fields());
+}
+
+// Reads one format item by item, with the checks of Reader: valid UTF-8, integers in range, a
+// limited depth
+template <typename Format>
+class BinaryReader
+{
+public:
+    explicit BinaryReader(std::string_view data) noexcept : in_(data) {}
+
+    [[nodiscard]] bool atEnd() const noexcept { return in_.atEnd(); }
+    [[nodiscard]] std::size_t position() const noexcept { return in_.position(); }
+
+    [[nodiscard]] bool readString(std::string_view& out) noexcept
+    {
+        BinaryItem item;
+        return Format::readHead(in_, item) && item.type == BinaryItem::Type::STRING && in_.bytes(item.value, out) && isUtf8(out);
+    }
+
+    [[nodiscard]] bool readString(std::string& out)
+    {
+        std::string_view text;
+        if (!readString(text))
+        {
+            return false;
+        }
+        out.assign(text);
+        return true;
+    }
+
+    template <typename N>
+    [[nodiscard]] bool readInteger(N& out) noexcept
+    {
+        BinaryItem item;
+        if (!Format::readHead(in_, item))
+        {
+            return false;
+        }
+        if (item.type == BinaryItem::Type::UNSIGNED && item.value <= static_cast<u64>(std::numeric_limits<N>::max()))
+        {
+            out = static_cast<N>(item.value);
+            return true;
+        }
+        if constexpr (std::is_signed_v<N>)
+        {
+            const auto value = static_cast<i64>(item.value);
+            if (item.type == BinaryItem::Type::NEGATIVE && value >= std::numeric_limits<N>::min())
+            {
+                out = static_cast<N>(value);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    [[nodiscard]] bool readBool(bool& out) noexcept
+    {
+        BinaryItem item;
+        if (!Format::readHead(in_, item) || item.type != BinaryItem::Type::BOOLEAN)
+        {
+            return false;
+        }
+        out = item.value != 0;
+        return true;
+    }
+
+    // Every item takes at least a byte, larger counts are rejected before anything is read
+    [[nodiscard]] bool readArrayHead(u64& size) noexcept
+    {
+        BinaryItem item;
+        if (!Format::readHead(in_, item) || item.type != BinaryItem::Type::ARRAY || item.value > in_.left())
+        {
+            return false;
+        }
+        size = item.value;
+        return true;
+    }
+
+    [[nodiscard]] bool readMapHead(u64& size) noexcept
+    {
+        BinaryItem item;
+        if (!Format::readHead(in_, item) || item.type != BinaryItem::Type::MAP || item.value > in_.left() / 2)
+        {
+            return false;
+        }
+        size = item.value;
+        return true;
+    }
+
+    [[nodiscard]] bool skipValue(u32 depth = 0) noexcept
+    {
+        BinaryItem item;
+        if (depth > MAX_DEPTH || !Format::readHead(in_, item))
+        {
+            return false;
+        }
+
+        switch (item.type)
+        {
+        case BinaryItem::Type::STRING:
+        case BinaryItem::Type::BYTES:
+            return in_.skip(item.value);
+        case BinaryItem::Type::MAP:
+            if (item.value > in_.left() / 2)
+            {
+                return false;
+            }
+            item.value *= 2;
+            [[fallthrough]];
+        case BinaryItem::Type::ARRAY:
+            if (item.value > in_.left())
+            {
+                return false;
+            }
+            for (u64 i = 0; i < item.value; ++i)
+            {
+                if (!skipValue(depth + 1))
+                {
+                    return false;
+                }
+            }
+            return true;
+        case BinaryItem::Type::TAG:
+            return skipValue(depth + 1);
+        default:
+            return true;
+        }
+    }
+
+private:
+    BinaryInput in_;
+};
+
+template <typename Format, Described T>
+[[nodiscard]] bool readBinaryObject(BinaryReader<Format>& reader, T& value);
+
+template <typename Format, typename V>
+[[nodiscard]] bool readBinaryValue(BinaryReader<Format>& reader, V& value)
+{
+    if constexpr (std::is_same_v<V, std::string>)
+    {
+        return reader.readString(value);
+    }
+    else if constexpr (std::is_same_v<V, bool>)
+    {
+        return reader.readBool(value);
+    }
+    else if constexpr (std::is_enum_v<V>)
+    {
+        std::underlying_type_t<V> number{};
+        if (!reader.readInteger(number))
+        {
+            return false;
+        }
+        value = static_cast<V>(number);
+        return true;
+    }
+    else if constexpr (std::is_integral_v<V>)
+    {
+        return reader.readInteger(value);
+    }
+    else if constexpr (Described<V>)
+    {
+        return readBinaryObject(reader, value);
+    }
+    else
+    {
+        static_assert(IsVector<V>::value, "no wire encoding for this type");
+        u64 size = 0;
+        if (!reader.readArrayHead(size))
+        {
+            return false;
+        }
+        value.clear();
+        for (u64 i = 0; i < size; ++i)
+        {
+            if (!readBinaryValue(reader, value.emplace_back()))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+// Same rules as readObject(): unknown keys are skipped and a repeated key keeps its last value
+template <typename Format, Described T>
+[[nodiscard]] bool readBinaryObject(BinaryReader<Format>& reader, T& value)
+{
+    u64 size = 0;
+    if (!reader.readMapHead(size))
+    {
+        return false;
+    }
+
+    u64 seen = 0;
+    for (u64 entry = 0; entry < size; ++entry)
+    {
+        std::string_view key;
+        if (!reader.readString(key))
+        {
+            return false;
+        }
+
+        bool found = false;
+        bool ok = true;
+        std::apply([&](const auto&... fields)
+        {
+            u32 index = 0;
+            const auto read = [&](const auto& field)
+            {
+                if (!found && field.key == key)
+                {
+                    found = true;
+                    seen |= u64{1} << index;
+                    ok = readBinaryValue(reader, value.*field.member);
+                }
+                ++index;
+            };
+            (read(fields), ...);
+        }, T::fields());
+
+        if (!found)
+        {
+            ok = reader.skipValue();
+        }
+        if (!ok)
+        {
+            return false;
+        }
+    }
+
+    constexpr u64 required = requiredFields<T>();
+    return (seen & required) == required;
+}
+
+} // namespace detail
+
+using detail::Cbor;
+using detail::Msgpack;
+
+// The whole packet, the content before the header like toString()
+template <typename Format, Described T>
+void writeBinary(std::string& out, const T& message)
+{
+    Format::writeMapHead(out, 2);
+    detail::writeBinaryString<Format>(out, PACKET_CONTENT_KEY);
+    detail::writeBinaryObject<Format>(out, message);
+    detail::writeBinaryString<Format>(out, PACKET_HEADER_KEY);
+    detail::writeBinaryValue<Format>(out, T::TYPE);
+}
+
+// Fills message from a content map, false if it is malformed or a required key is missing
+template <typename Format, Described T>
+[[nodiscard]] bool readBinary(std::string_view data, T& message)
+{
+    detail::BinaryReader<Format> reader{data};
+    return detail::readBinaryObject(reader, message) && reader.atEnd();
+}
+
+// Splits a packet into its header and its content, like readPacket() does for the text
+template <typename Format, typename Header>
+[[nodiscard]] std::optional<Packet<Header>> readBinaryPacket(std::string_view data)
+{
+    detail::BinaryReader<Format> reader{data};
+    u64 size = 0;
+    if (!reader.readMapHead(size))
+    {
+        return std::nullopt;
+    }
+
+    Packet<Header> packet{};
+    bool header = false;
+    bool content = false;
+    for (u64 entry = 0; entry < size; ++entry)
+    {
+        std::string_view key;
+        if (!reader.readString(key))
+        {
+            return std::nullopt;
+        }
+
+        bool ok;
+        if (key == PACKET_HEADER_KEY)
+        {
+            ok = detail::readBinaryValue(reader, packet.header);
+            header = true;
+        }
+        else if (key == PACKET_CONTENT_KEY)
+        {
+            const std::size_t start = reader.position();
+            ok = reader.skipValue();
+            packet.content = data.substr(start, reader.position() - start);
+            content = true;
+        }
+        else
+        {
+            ok = reader.skipValue();
+        }
+
+        if (!ok)
+        {
+            return std::nullopt;
+        }
+    }
+
+    if (!reader.atEnd() || !header || !content)
+    {
+        return std::nullopt;
+    }
+    return packet;
+}
+
+// The message of a variant the header of a binary packet names, see decodePacket()
+template <typename Format, typename Message>
+[[nodiscard]] std::optional<Message> decodeBinaryPacket(std::string_view data)
+{
+    const auto packet = readBinaryPacket<Format, u64>(data);
+    if (!packet.has_value())
+    {
+        return std::nullopt;
+    }
+    return detail::VariantDecoder<Message>::decode(packet->header, packet->content, [](std::string_view content, auto& message)
+    {
+        return readBinary<Format>(content, message);
+    });
+}
+
+} // namespace wire
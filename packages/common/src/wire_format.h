@@ -0,0 +1,1010 @@
+#pragma once
+
+#include "global.h"
+
+// nlohmann
+#include "json.hpp"
+
+// std
+#include <array>
+#include <charconv>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+// Every message lists the fields of its content in a constexpr table, fields(). The table drives a
+// writer that appends the JSON straight to a string and a reader that fills the struct straight out
+// of the text, neither builds a nlohmann::json on the way. The writer produces the same bytes as
+// nlohmann::json::dump(), which writes the keys of an object in sorted order, so the tables list
+// them sorted as well.
+namespace wire
+{
+
+enum class Presence : u8
+{
+    REQUIRED,
+    // keeps its default when the key is missing
+    OPTIONAL,
+    // read like OPTIONAL and only written while it holds something else than its default, for
+    // fields that are often left empty
+    OMIT_DEFAULT
+};
+
+template <typename T, typename M>
+struct Field
+{
+    std::string_view key;
+    M T::*member;
+    Presence presence;
+};
+
+template <typename T, typename M>
+[[nodiscard]] constexpr Field<T, M> field(std::string_view key, M T::*member, Presence presence = Presence::REQUIRED) noexcept
+{
+    return {key, member, presence};
+}
+
+template <typename T>
+concept Described = requires { T::fields(); };
+
+template <typename T>
+struct IsVector : std::false_type {};
+
+template <typename T>
+struct IsVector<std::vector<T>> : std::true_type {};
+
+template <Described T>
+[[nodiscard]] consteval bool keysSorted()
+{
+    return std::apply([](const auto&... fields)
+    {
+        const std::array<std::string_view, sizeof...(fields)> keys{fields.key...};
+        for (std::size_t i = 1; i < keys.size(); ++i)
+        {
+            if (!(keys[i - 1] < keys[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }, T::fields());
+}
+
+// bit i is set if field i has to be there
+template <Described T>
+[[nodiscard]] consteval u64 requiredFields()
+{
+    return std::apply([](const auto&... fields)
+    {
+        static_assert(sizeof...(fields) <= 64, "at most 64 fields per message");
+        u64 mask = 0;
+        u32 index = 0;
+        ((mask |= fields.presence == Presence::REQUIRED ? u64{1} << index : 0, ++index), ...);
+        return mask;
+    }, T::fields());
+}
+
+// false for an OMIT_DEFAULT field holding its default value, the writers leave its key out. Only
+// numbers, enums and strings can be left out.
+template <typename T, typename M>
+[[nodiscard]] bool isWritten(const Field<T, M>& field, const T& value) noexcept
+{
+    if constexpr (std::is_arithmetic_v<M> || std::is_enum_v<M> || std::is_same_v<M, std::string>)
+    {
+        return field.presence != Presence::OMIT_DEFAULT || !(value.*field.member == M{});
+    }
+    else
+    {
+        return true;
+    }
+}
+
+template <Described T>
+[[nodiscard]] nlohmann::json toJson(const T& value);
+
+template <Described T>
+void fromJson(const nlohmann::json& data, T& value);
+
+namespace detail
+{
+
+constexpr std::string_view REPLACEMENT_CHARACTER = "\xEF\xBF\xBD";
+// objects and arrays nested deeper than this are rejected instead of skipped
+constexpr u32 MAX_DEPTH = 64;
+
+// Length of the UTF-8 sequence at the start of text, 0 if it is not one (overlong, surrogate,
+// past U+10FFFF or cut off)
+[[nodiscard]] inline std::size_t utf8SequenceLength(std::string_view text) noexcept
+{
+    const auto continuation = [&](std::size_t i, u8 low = 0x80, u8 high = 0xBF)
+    {
+        return i < text.size() && static_cast<u8>(text[i]) >= low && static_cast<u8>(text[i]) <= high;
+    };
+
+    const auto lead = static_cast<u8>(text[0]);
+    if (lead < 0x80)
+    {
+        return 1;
+    }
+    if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        return continuation(1) ? 2 : 0;
+    }
+    if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        const u8 low = lead == 0xE0 ? 0xA0 : 0x80;
+        const u8 high = lead == 0xED ? 0x9F : 0xBF;
+        return continuation(1, low, high) && continuation(2) ? 3 : 0;
+    }
+    if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        const u8 low = lead == 0xF0 ? 0x90 : 0x80;
+        const u8 high = lead == 0xF4 ? 0x8F : 0xBF;
+        return continuation(1, low, high) && continuation(2) && continuation(3) ? 4 : 0;
+    }
+    return 0;
+}
+
+inline void appendUtf8(std::string& out, u32 codePoint)
+{
+    if (codePoint < 0x80)
+    {
+        out += static_cast<char>(codePoint);
+    }
+    else if (codePoint < 0x800)
+    {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else if (codePoint < 0x10000)
+    {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else
+    {
+        out += static_cast<char>(0xF0 | (codePoint >> 18));
+        out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+// Escapes like dump() does. Bytes that are not valid UTF-8 become U+FFFD, where dump() would throw.
+inline void writeString(std::string& out, std::string_view text)
+{
+    static constexpr std::string_view HEX = "0123456789abcdef";
+
+    out += '"';
+    std::size_t run = 0;
+    std::size_t i = 0;
+    while (i < text.size())
+    {
+        const auto c = static_cast<u8>(text[i]);
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+        {
+            ++i;
+            continue;
+        }
+        if (c >= 0x80)
+        {
+            if (const std::size_t length = utf8SequenceLength(text.substr(i)); length != 0)
+            {
+                i += length;
+                continue;
+            }
+        }
+
+        out.append(text.data() + run, i - run);
+        switch (c)
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20)
+            {
+                out += "\\u00";
+                out += HEX[c >> 4];
+                out += HEX[c & 0xF];
+            }
+            else
+            {
+                out += REPLACEMENT_CHARACTER;
+            }
+            break;
+        }
+        run = ++i;
+    }
+    out.append(text.data() + run, text.size() - run);
+    out += '"';
+}
+
+template <typename N>
+void writeNumber(std::string& out, N value)
+{
+    std::array<char, 24> buffer{};
+    const auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    out.append(buffer.data(), result.ptr);
+}
+
+inline void writeKey(std::string& out, std::string_view key)
+{
+    out += '"';
+    out += key;
+    out += "\":";
+}
+
+template <Described T>
+void writeObject(std::string& out, const T& value);
+
+template <typename V>
+void writeValue(std::string& out, const V& value)
+{
+    if constexpr (std::is_same_v<V, std::string>)
+    {
+        writeString(out, value);
+    }
+    else if constexpr (std::is_same_v<V, bool>)
+    {
+        out += value ? "true" : "false";
+    }
+    else if constexpr (std::is_enum_v<V>)
+    {
+        writeNumber(out, static_cast<std::underlying_type_t<V>>(value));
+    }
+    else if constexpr (std::is_integral_v<V>)
+    {
+        writeNumber(out, value);
+    }
+    else if constexpr (Described<V>)
+    {
+        writeObject(out, value);
+    }
+    else
+    {
+        static_assert(IsVector<V>::value, "no wire encoding for this type");
+        out += '[';
+        for (std::size_t i = 0; i < value.size(); ++i)
+        {
+            if (i != 0)
+            {
+                out += ',';
+            }
+            writeValue(out, value[i]);
+        }
+        out += ']';
+    }
+}
+
+template <Described T>
+void writeObject(std::string& out, const T& value)
+{
+    static_assert(keysSorted<T>(), "fields() has to list the keys sorted, the order dump() writes them in");
+
+    out += '{';
+    std::apply([&](const auto&... fields)
+    {
+        bool first = true;
+        const auto write = [&](const auto& field)
+        {
+            if (!isWritten(field, value))
+            {
+                return;
+            }
+            if (!first)
+            {
+                out += ',';
+            }
+            first = false;
+            writeKey(out, field.key);
+            writeValue(out, value.*field.member);
+        };
+        (write(fields), ...);
+    }, T::fields());
+    out += '}';
+}
+
+// Close to the encoded size when nothing needs escaping, so the output is allocated once
+template <typename V>
+[[nodiscard]] std::size_t sizeHint(const V& value) noexcept
+{
+    if constexpr (std::is_same_v<V, std::string>)
+    {
+        return value.size() + 2;
+    }
+    else if constexpr (Described<V>)
+    {
+        return std::apply([&](const auto&... fields)
+        {
+            return (std::size_t{2} + ... + (fields.key.size() + 4 + sizeHint(value.*fields.member)));
+        }, V::fields());
+    }
+    else if constexpr (IsVector<V>::value)
+    {
+        std::size_t size = 2;
+        for (const auto& element : value)
+        {
+            size += sizeHint(element) + 1;
+        }
+        return size;
+    }
+    else
+    {
+        return 20;
+    }
+}
+
+// Reads JSON text without keeping any of it but the values of known fields
+class Reader
+{
+public:
+    explicit Reader(std::string_view text) noexcept : text_(text) {}
+
+    [[nodiscard]] bool atEnd() noexcept
+    {
+        skipWhitespace();
+        return pos_ == text_.size();
+    }
+
+    [[nodiscard]] std::size_t position() const noexcept { return pos_; }
+
+    void skipWhitespace() noexcept
+    {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r'))
+        {
+            ++pos_;
+        }
+    }
+
+    [[nodiscard]] bool consume(char c) noexcept
+    {
+        skipWhitespace();
+        if (pos_ < text_.size() && text_[pos_] == c)
+        {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    // Keys without escapes are returned as a view of the text, the others are decoded into scratch
+    [[nodiscard]] bool readKey(std::string_view& key)
+    {
+        skipWhitespace();
+        if (pos_ >= text_.size() || text_[pos_] != '"')
+        {
+            return false;
+        }
+
+        for (std::size_t i = pos_ + 1; i < text_.size(); ++i)
+        {
+            const auto c = static_cast<u8>(text_[i]);
+            if (c == '"')
+            {
+                key = text_.substr(pos_ + 1, i - pos_ - 1);
+                pos_ = i + 1;
+                return consume(':');
+            }
+            if (c == '\\' || c < 0x20 || c >= 0x80)
+            {
+                break;
+            }
+        }
+
+        if (!readString(scratch_))
+        {
+            return false;
+        }
+        key = scratch_;
+        return consume(':');
+    }
+
+    [[nodiscard]] bool readString(std::string& out)
+    {
+        if (!consume('"'))
+        {
+            return false;
+        }
+
+        out.clear();
+        std::size_t run = pos_;
+        while (pos_ < text_.size())
+        {
+            const auto c = static_cast<u8>(text_[pos_]);
+            if (c == '"')
+            {
+                out.append(text_.data() + run, pos_ - run);
+                ++pos_;
+                return true;
+            }
+            if (c < 0x20)
+            {
+                return false;
+            }
+            if (c == '\\')
+            {
+                out.append(text_.data() + run, pos_ - run);
+                ++pos_;
+                if (!readEscape(out))
+                {
+                    return false;
+                }
+                run = pos_;
+                continue;
+            }
+            if (c >= 0x80)
+            {
+                const std::size_t length = utf8SequenceLength(text_.substr(pos_));
+                if (length == 0)
+                {
+                    return false;
+                }
+                pos_ += length;
+                continue;
+            }
+            ++pos_;
+        }
+        return false;
+    }
+
+    // Integers only, out of range values are rejected rather than wrapped
+    template <typename N>
+    [[nodiscard]] bool readInteger(N& out) noexcept
+    {
+        skipWhitespace();
+        const char* first = text_.data() + pos_;
+        const char* last = text_.data() + text_.size();
+        const char* digits = first != last && *first == '-' ? first + 1 : first;
+        if (digits != last && *digits == '0' && digits + 1 != last && *(digits + 1) >= '0' && *(digits + 1) <= '9')
+        {
+            return false;
+        }
+
+        const auto result = std::from_chars(first, last, out);
+        if (result.ec != std::errc{} || (result.ptr != last && (*result.ptr == '.' || *result.ptr == 'e' || *result.ptr == 'E')))
+        {
+            return false;
+        }
+        pos_ = static_cast<std::size_t>(result.ptr - text_.data());
+        return true;
+    }
+
+    [[nodiscard]] bool readBool(bool& out) noexcept
+    {
+        skipWhitespace();
+        if (literal("true"))
+        {
+            out = true;
+            return true;
+        }
+        if (literal("false"))
+        {
+            out = false;
+            return true;
+        }
+        return false;
+    }
+
+    [[nodiscard]] bool skipValue(u32 depth = 0)
+    {
+        skipWhitespace();
+        if (pos_ >= text_.size() || depth > MAX_DEPTH)
+        {
+            return false;
+        }
+
+        switch (text_[pos_])
+        {
+        case '"':
+            return readString(scratch_);
+        case '{':
+            ++pos_;
+            if (consume('}'))
+            {
+                return true;
+            }
+            do
+            {
+                std::string_view key;
+                if (!readKey(key) || !skipValue(depth + 1))
+                {
+                    return false;
+                }
+            }
+            while (consume(','));
+            return consume('}');
+        case '[':
+            ++pos_;
+            if (consume(']'))
+            {
+                return true;
+            }
+            do
+            {
+                if (!skipValue(depth + 1))
+                {
+                    return false;
+                }
+            }
+            while (consume(','));
+            return consume(']');
+        case 't':
+            return literal("true");
+        case 'f':
+            return literal("false");
+        case 'n':
+            return literal("null");
+        default:
+            return skipNumber();
+        }
+    }
+
+private:
+    [[nodiscard]] bool literal(std::string_view word) noexcept
+    {
+        if (text_.substr(pos_, word.size()) != word)
+        {
+            return false;
+        }
+        pos_ += word.size();
+        return true;
+    }
+
+    [[nodiscard]] bool skipDigits() noexcept
+    {
+        const std::size_t start = pos_;
+        while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9')
+        {
+            ++pos_;
+        }
+        return pos_ != start;
+    }
+
+    [[nodiscard]] bool skipNumber() noexcept
+    {
+        if (pos_ < text_.size() && text_[pos_] == '-')
+        {
+            ++pos_;
+        }
+        if (!skipDigits())
+        {
+            return false;
+        }
+        if (pos_ < text_.size() && text_[pos_] == '.')
+        {
+            ++pos_;
+            if (!skipDigits())
+            {
+                return false;
+            }
+        }
+        if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E'))
+        {
+            ++pos_;
+            if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-'))
+            {
+                ++pos_;
+            }
+            return skipDigits();
+        }
+        return true;
+    }
+
+    [[nodiscard]] bool readHex(u32& out) noexcept
+    {
+        if (pos_ + 4 > text_.size())
+        {
+            return false;
+        }
+        const auto result = std::from_chars(text_.data() + pos_, text_.data() + pos_ + 4, out, 16);
+        if (result.ec != std::errc{} || result.ptr != text_.data() + pos_ + 4)
+        {
+            return false;
+        }
+        pos_ += 4;
+        return true;
+    }
+
+    [[nodiscard]] bool readEscape(std::string& out)
+    {
+        if (pos_ >= text_.size())
+        {
+            return false;
+        }
+
+        switch (text_[pos_++])
+        {
+        case '"': out += '"'; return true;
+        case '\\': out += '\\'; return true;
+        case '/': out += '/'; return true;
+        case 'b': out += '\b'; return true;
+        case 'f': out += '\f'; return true;
+        case 'n': out += '\n'; return true;
+        case 'r': out += '\r'; return true;
+        case 't': out += '\t'; return true;
+        case 'u': break;
+        default: return false;
+        }
+
+        u32 codePoint = 0;
+        if (!readHex(codePoint) || (codePoint >= 0xDC00 && codePoint <= 0xDFFF))
+        {
+            return false;
+        }
+
+        // characters past the BMP come as a surrogate pair
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF)
+        {
+            u32 low = 0;
+            if (!literal("\\u") || !readHex(low) || low < 0xDC00 || low > 0xDFFF)
+            {
+                return false;
+            }
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+        }
+
+        appendUtf8(out, codePoint);
+        return true;
+    }
+
+private:
+    std::string_view text_;
+    std::size_t pos_ = 0;
+    std::string scratch_;
+};
+
+template <Described T>
+[[nodiscard]] bool readObject(Reader& reader, T& value);
+
+template <typename V>
+[[nodiscard]] bool readValue(Reader& reader, V& value)
+{
+    if constexpr (std::is_same_v<V, std::string>)
+    {
+        return reader.readString(value);
+    }
+    else if constexpr (std::is_same_v<V, bool>)
+    {
+        return reader.readBool(value);
+    }
+    else if constexpr (std::is_enum_v<V>)
+    {
+        std::underlying_type_t<V> number{};
+        if (!reader.readInteger(number))
+        {
+            return false;
+        }
+        value = static_cast<V>(number);
+        return true;
+    }
+    else if constexpr (std::is_integral_v<V>)
+    {
+        return reader.readInteger(value);
+    }
+    else if constexpr (Described<V>)
+    {
+        return readObject(reader, value);
+    }
+    else
+    {
+        static_assert(IsVector<V>::value, "no wire encoding for this type");
+        value.clear();
+        if (!reader.consume('['))
+        {
+            return false;
+        }
+        if (reader.consume(']'))
+        {
+            return true;
+        }
+        do
+        {
+            if (!readValue(reader, value.emplace_back()))
+            {
+                return false;
+            }
+        }
+        while (reader.consume(','));
+        return reader.consume(']');
+    }
+}
+
+// Unknown keys are skipped, a repeated key keeps its last value like nlohmann::json::parse() does
+template <Described T>
+[[nodiscard]] bool readObject(Reader& reader, T& value)
+{
+    if (!reader.consume('{'))
+    {
+        return false;
+    }
+
+    u64 seen = 0;
+    if (!reader.consume('}'))
+    {
+        do
+        {
+            std::string_view key;
+            if (!reader.readKey(key))
+            {
+                return false;
+            }
+
+            bool found = false;
+            bool ok = true;
+            std::apply([&](const auto&... fields)
+            {
+                u32 index = 0;
+                const auto read = [&](const auto& field)
+                {
+                    if (!found && field.key == key)
+                    {
+                        found = true;
+                        seen |= u64{1} << index;
+                        ok = readValue(reader, value.*field.member);
+                    }
+                    ++index;
+                };
+                (read(fields), ...);
+            }, T::fields());
+
+            if (!found)
+            {
+                ok = reader.skipValue();
+            }
+            if (!ok)
+            {
+                return false;
+            }
+        }
+        while (reader.consume(','));
+
+        if (!reader.consume('}'))
+        {
+            return false;
+        }
+    }
+
+    constexpr u64 required = requiredFields<T>();
+    return (seen & required) == required;
+}
+
+template <typename V>
+[[nodiscard]] nlohmann::json toJsonValue(const V& value)
+{
+    if constexpr (Described<V>)
+    {
+        return toJson(value);
+    }
+    else if constexpr (IsVector<V>::value)
+    {
+        nlohmann::json array = nlohmann::json::array();
+        for (const auto& element : value)
+        {
+            array.push_back(toJsonValue(element));
+        }
+        return array;
+    }
+    else
+    {
+        return value;
+    }
+}
+
+template <typename V>
+void fromJsonValue(const nlohmann::json& data, V& value)
+{
+    if constexpr (Described<V>)
+    {
+        fromJson(data, value);
+    }
+    else if constexpr (IsVector<V>::value)
+    {
+        value.clear();
+        for (const auto& element : data)
+        {
+            fromJsonValue(element, value.emplace_back());
+        }
+    }
+    else
+    {
+        data.get_to(value);
+    }
+}
+
+} // namespace detail
+
+// The whole packet, {"content":{...},"header":TYPE}
+template <Described T>
+[[nodiscard]] std::string toString(const T& message)
+{
+    static_assert(PACKET_CONTENT_KEY < PACKET_HEADER_KEY, "the content is written before the header");
+
+    std::string out;
+    out.reserve(detail::sizeHint(message) + PACKET_CONTENT_KEY.size() + PACKET_HEADER_KEY.size() + 32);
+    out += '{';
+    detail::writeKey(out, PACKET_CONTENT_KEY);
+    detail::writeObject(out, message);
+    out += ',';
+    detail::writeKey(out, PACKET_HEADER_KEY);
+    detail::writeValue(out, T::TYPE);
+    out += '}';
+    return out;
+}
+
+// The content object alone
+template <Described T>
+void write(std::string& out, const T& message)
+{
+    detail::writeObject(out, message);
+}
+
+// Fills message from a content object, false if it is not valid JSON or a required key is missing
+template <Described T>
+[[nodiscard]] bool read(std::string_view json, T& message)
+{
+    detail::Reader reader{json};
+    return detail::readObject(reader, message) && reader.atEnd();
+}
+
+template <typename Header>
+struct Packet
+{
+    Header header;
+    // not decoded yet, read() it into the message the header names
+    std::string_view content;
+};
+
+// Splits a packet into its header and its content in one pass over the text
+template <typename Header>
+[[nodiscard]] std::optional<Packet<Header>> readPacket(std::string_view line)
+{
+    detail::Reader reader{line};
+    if (!reader.consume('{'))
+    {
+        return std::nullopt;
+    }
+
+    Packet<Header> packet{};
+    bool header = false;
+    bool content = false;
+    do
+    {
+        std::string_view key;
+        if (!reader.readKey(key))
+        {
+            return std::nullopt;
+        }
+
+        bool ok;
+        if (key == PACKET_HEADER_KEY)
+        {
+            ok = detail::readValue(reader, packet.header);
+            header = true;
+        }
+        else if (key == PACKET_CONTENT_KEY)
+        {
+            reader.skipWhitespace();
+            const std::size_t start = reader.position();
+            ok = reader.skipValue();
+            packet.content = line.substr(start, reader.position() - start);
+            content = true;
+        }
+        else
+        {
+            ok = reader.skipValue();
+        }
+
+        if (!ok)
+        {
+            return std::nullopt;
+        }
+    }
+    while (reader.consume(','));
+
+    if (!reader.consume('}') || !reader.atEnd() || !header || !content)
+    {
+        return std::nullopt;
+    }
+    return packet;
+}
+
+namespace detail
+{
+
+template <typename Message>
+struct VariantDecoder;
+
+template <Described... Ts>
+struct VariantDecoder<std::variant<Ts...>>
+{
+    // The alternative whose TYPE is header, filled by read(content, message)
+    template <typename Read>
+    [[nodiscard]] static std::optional<std::variant<Ts...>> decode(u64 header, std::string_view content, Read&& read)
+    {
+        std::optional<std::variant<Ts...>> message;
+        const auto decodeAs = [&]<typename T>()
+        {
+            if (header != static_cast<u64>(T::TYPE))
+            {
+                return false;
+            }
+            if (T typed{}; read(content, typed))
+            {
+                message.emplace(std::in_place_type<T>, std::move(typed));
+            }
+            return true;
+        };
+        (decodeAs.template operator()<Ts>() || ...);
+        return message;
+    }
+};
+
+} // namespace detail
+
+// The message of a variant the header of the packet names, read in one pass without building a
+// document, so the only allocations are the ones of its string fields. nullopt if the packet is not
+// valid JSON, names no message of the variant or the content misses a required key.
+template <typename Message>
+[[nodiscard]] std::optional<Message> decodePacket(std::string_view line)
+{
+    const auto packet = readPacket<u64>(line);
+    if (!packet.has_value())
+    {
+        return std::nullopt;
+    }
+    return detail::VariantDecoder<Message>::decode(packet->header, packet->content, [](std::string_view content, auto& message)
+    {
+        return read(content, message);
+    });
+}
+
+template <Described T>
+[[nodiscard]] nlohmann::json toJson(const T& value)
+{
+    nlohmann::json data = nlohmann::json::object();
+    std::apply([&](const auto&... fields)
+    {
+        const auto write = [&](const auto& field)
+        {
+            if (isWritten(field, value))
+            {
+                data[field.key] = detail::toJsonValue(value.*field.member);
+            }
+        };
+        (write(fields), ...);
+    }, T::fields());
+    return data;
+}
+
+// For code that already holds a parsed document, throws nlohmann::json::exception like get() does
+template <Described T>
+void fromJson(const nlohmann::json& data, T& value)
+{
+    std::apply([&](const auto&... fields)
+    {
+        const auto read = [&](const auto& field)
+        {
+            if (field.presence == Presence::REQUIRED)
+            {
+                detail::fromJsonValue(data.at(field.key), value.*field.member);
+            }
+            else if (const auto it = data.find(field.key); it != data.end())
+            {
+                detail::fromJsonValue(*it, value.*field.member);
+            }
+        };
+        (read(fields), ...);
+    }, T::fields());
+}
+
+} // namespace wire
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "wire_binary.h"
+
+// std
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Every packet on a connection is one frame:
+//   JSON            the packet text, ended by '\n'
+//   MSGPACK, CBOR   u8 encoding | u32 big-endian payload size | payload
+// A text packet starts with '{', so the first byte tells the frames apart and either side can read
+// whatever the other one writes. The encoding a side writes is agreed on in the InitialConnection.
+namespace wire
+{
+
+constexpr std::size_t WIRE_ENCODING_COUNT = 3;
+constexpr std::size_t BINARY_FRAME_HEADER_SIZE = 1 + sizeof(u32);
+// a binary frame claiming more than this, or this much text without a line end, is taken for a
+// stream out of sync
+constexpr u32 MAX_FRAME_BYTES = 16 * 1024 * 1024;
+
+[[nodiscard]] constexpr bool isKnownEncoding(WireEncoding encoding) noexcept
+{
+    return static_cast<std::size_t>(encoding) < WIRE_ENCODING_COUNT;
+}
+
+[[nodiscard]] constexpr std::string_view encodingName(WireEncoding encoding) noexcept
+{
+    switch (encoding)
+    {
+    case WireEncoding::MSGPACK:
+        return "msgpack";
+    case WireEncoding::CBOR:
+        return "cbor";
+    default:
+        return "json";
+    }
+}
+
+// The packet of message as one frame, line end or frame header included
+template <Described T>
+[[nodiscard]] std::string encodeFrame(WireEncoding encoding, const T& message)
+{
+    if (encoding != WireEncoding::MSGPACK && encoding != WireEncoding::CBOR)
+    {
+        std::string frame = toString(message);
+        frame += '\n';
+        return frame;
+    }
+
+    std::string frame;
+    frame.reserve(BINARY_FRAME_HEADER_SIZE + detail::sizeHint(message));
+    frame.resize(BINARY_FRAME_HEADER_SIZE);
+    frame[0] = static_cast<char>(encoding);
+    if (encoding == WireEncoding::MSGPACK)
+    {
+        writeBinary<Msgpack>(frame, message);
+    }
+    else
+    {
+        writeBinary<Cbor>(frame, message);
+    }
+
+    const auto size = static_cast<u32>(frame.size() - BINARY_FRAME_HEADER_SIZE);
+    for (std::size_t i = 0; i < sizeof(u32); ++i)
+    {
+        frame[1 + i] = static_cast<char>(static_cast<u8>(size >> (8 * (sizeof(u32) - 1 - i))));
+    }
+    return frame;
+}
+
+// An encoded frame queued in any number of outboxes, never written to once it is shared
+using SharedFrame = std::shared_ptr<const std::string>;
+
+// The frame at the start of a receive buffer
+struct Frame
+{
+    WireEncoding encoding = WireEncoding::JSON;
+    // the packet without the frame header or the line end, a view into the buffer
+    std::string_view packet;
+    // bytes of the buffer the frame takes, 0 while it is not complete
+    std::size_t size = 0;
+    // while it is not complete, bytes to wait for before looking again
+    std::size_t missing = 0;
+    // while a text frame is not complete, bytes of the buffer searched for its line end
+    std::size_t searched = 0;
+    // a frame over MAX_FRAME_BYTES, the connection can not be read any further
+    bool oversized = false;
+};
+
+// searched is Frame::searched of the last call on the same incomplete frame, so a long line is only
+// searched once as it comes in, 0 after a frame was consumed
+[[nodiscard]] inline Frame nextFrame(std::string_view buffered, std::size_t searched = 0) noexcept
+{
+    Frame frame;
+    if (buffered.empty())
+    {
+        frame.missing = 1;
+        return frame;
+    }
+
+    const auto first = static_cast<WireEncoding>(buffered[0]);
+    if (first != WireEncoding::MSGPACK && first != WireEncoding::CBOR)
+    {
+        const std::size_t end = buffered.find('\n', searched);
+        if (end == std::string_view::npos)
+        {
+            frame.oversized = buffered.size() > MAX_FRAME_BYTES;
+            frame.searched = buffered.size();
+            frame.missing = 1;
+            return frame;
+        }
+        frame.packet = buffered.substr(0, end);
+        frame.size = end + 1;
+        return frame;
+    }
+
+    frame.encoding = first;
+    if (buffered.size() < BINARY_FRAME_HEADER_SIZE)
+    {
+        frame.missing = BINARY_FRAME_HEADER_SIZE - buffered.size();
+        return frame;
+    }
+
+    u32 payload = 0;
+    for (std::size_t i = 1; i < BINARY_FRAME_HEADER_SIZE; ++i)
+    {
+        payload = (payload << 8) | static_cast<u8>(buffered[i]);
+    }
+    if (payload > MAX_FRAME_BYTES)
+    {
+        frame.oversized = true;
+        return frame;
+    }
+
+    const std::size_t size = BINARY_FRAME_HEADER_SIZE + payload;
+    if (buffered.size() < size)
+    {
+        frame.missing = size - buffered.size();
+        return frame;
+    }
+    frame.packet = buffered.substr(BINARY_FRAME_HEADER_SIZE, payload);
+    frame.size = size;
+    return frame;
+}
+
+// The message of a variant a complete frame holds, nullopt if it is not one
+template <typename Message>
+[[nodiscard]] std::optional<Message> decodeFrame(const Frame& frame)
+{
+    switch (frame.encoding)
+    {
+    case WireEncoding::MSGPACK:
+        return decodeBinaryPacket<Msgpack, Message>(frame.packet);
+    case WireEncoding::CBOR:
+        return decodeBinaryPacket<Cbor, Message>(frame.packet);
+    default:
+        return decodePacket<Message>(frame.packet);
+    }
+}
+
+} // namespace wire
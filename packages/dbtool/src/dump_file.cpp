@@ -0,0 +1,218 @@
+#include "dump_file.h"
+#include "archive_codec.h"
+
+// std
+#include <array>
+
+namespace dbtool
+{
+
+namespace
+{
+
+constexpr std::size_t FRAME_HEADER_SIZE = 3 * sizeof(u32);
+// a frame claiming more than this is taken for corruption instead of being allocated
+constexpr u32 MAX_FRAME_BYTES = 1u << 30;
+
+void putU32(std::string& out, u32 value)
+{
+    for (std::size_t i = 0; i < sizeof(u32); ++i)
+    {
+        out.push_back(static_cast<char>(static_cast<u8>(value >> (8 * i))));
+    }
+}
+
+[[nodiscard]] u32 getU32(const char* in)
+{
+    u32 value = 0;
+    for (std::size_t i = 0; i < sizeof(u32); ++i)
+    {
+        value |= static_cast<u32>(static_cast<u8>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+[[nodiscard]] std::string encodeFrame(const std::vector<server::messages::NewMessageReceived>& rows)
+{
+    const auto segment = server::archive::encode(rows, server::archive::Layout::COLUMNS);
+
+    std::string frame;
+    frame.reserve(FRAME_HEADER_SIZE + segment.data.size());
+    putU32(frame, static_cast<u32>(rows.size()));
+    putU32(frame, static_cast<u32>(segment.rawSize));
+    putU32(frame, static_cast<u32>(segment.data.size()));
+    frame += segment.data;
+    return frame;
+}
+
+[[nodiscard]] std::string encodeLines(const std::vector<server::messages::NewMessageReceived>& rows)
+{
+    std::string lines;
+    for (const auto& row : rows)
+    {
+        wire::write(lines, row);
+        lines += '\n';
+    }
+    return lines;
+}
+
+[[nodiscard]] std::optional<std::vector<server::messages::NewMessageReceived>> decodeLines(std::string_view lines, std::string& error)
+{
+    std::vector<server::messages::NewMessageReceived> rows;
+    std::size_t begin = 0;
+    while (begin < lines.size())
+    {
+        std::size_t end = lines.find('\n', begin);
+        if (end == std::string_view::npos)
+        {
+            end = lines.size();
+        }
+
+        const std::string_view line = lines.substr(begin, end - begin);
+        begin = end + 1;
+        if (line.empty() || line == "\r")
+        {
+            continue;
+        }
+
+        if (!wire::read(line, rows.emplace_back()))
+        {
+            error = "not a message: " + std::string(line.substr(0, 120));
+            return std::nullopt;
+        }
+    }
+    return rows;
+}
+
+} // namespace
+
+std::string_view formatName(DumpFormat format) noexcept
+{
+    return format == DumpFormat::BINARY ? "binary" : "ndjson";
+}
+
+std::string encodeChunk(DumpFormat format, const std::vector<server::messages::NewMessageReceived>& rows)
+{
+    return format == DumpFormat::BINARY ? encodeFrame(rows) : encodeLines(rows);
+}
+
+std::optional<std::vector<server::messages::NewMessageReceived>> decodeChunk(DumpFormat format, const RawChunk& chunk, std::string& error)
+{
+    if (format == DumpFormat::NDJSON)
+    {
+        return decodeLines(chunk.data, error);
+    }
+
+    std::vector<server::messages::NewMessageReceived> rows;
+    rows.reserve(chunk.rows);
+    if (!server::archive::decode(chunk.data, chunk.rawSize, server::archive::Layout::COLUMNS, rows) || rows.size() != chunk.rows)
+    {
+        error = "corrupt frame of " + std::to_string(chunk.rows) + " messages";
+        return std::nullopt;
+    }
+    return rows;
+}
+
+bool DumpReader::open(const std::string& path)
+{
+    file_.open(path, std::ios::binary);
+    if (!file_.is_open())
+    {
+        error_ = "cannot open " + path;
+        return false;
+    }
+
+    std::array<char, BINARY_MAGIC.size()> magic{};
+    file_.read(magic.data(), magic.size());
+    if (file_.gcount() == static_cast<std::streamsize>(magic.size()) && std::string_view(magic.data(), magic.size()) == BINARY_MAGIC)
+    {
+        format_ = DumpFormat::BINARY;
+        return true;
+    }
+
+    // anything else is read as text from the start
+    format_ = DumpFormat::NDJSON;
+    file_.clear();
+    file_.seekg(0);
+    return true;
+}
+
+std::optional<RawChunk> DumpReader::next()
+{
+    if (failed())
+    {
+        return std::nullopt;
+    }
+    return format_ == DumpFormat::BINARY ? nextFrame() : nextLines();
+}
+
+std::optional<RawChunk> DumpReader::nextFrame()
+{
+    std::array<char, FRAME_HEADER_SIZE> header{};
+    file_.read(header.data(), header.size());
+    if (file_.gcount() == 0)
+    {
+        return std::nullopt;
+    }
+    if (file_.gcount() != static_cast<std::streamsize>(header.size()))
+    {
+        error_ = "truncated frame header";
+        return std::nullopt;
+    }
+
+    RawChunk chunk;
+    chunk.rows = getU32(header.data());
+    chunk.rawSize = getU32(header.data() + sizeof(u32));
+    const u32 dataSize = getU32(header.data() + 2 * sizeof(u32));
+    if (chunk.rawSize > MAX_FRAME_BYTES || dataSize > MAX_FRAME_BYTES)
+    {
+        error_ = "frame of " + std::to_string(dataSize) + " bytes is too large";
+        return std::nullopt;
+    }
+
+    chunk.data.resize(dataSize);
+    file_.read(chunk.data.data(), dataSize);
+    if (file_.gcount() != static_cast<std::streamsize>(dataSize))
+    {
+        error_ = "truncated frame";
+        return std::nullopt;
+    }
+    return chunk;
+}
+
+std::optional<RawChunk> DumpReader::nextLines()
+{
+    RawChunk chunk;
+    chunk.data = std::move(carry_);
+    carry_.clear();
+
+    const std::size_t kept = chunk.data.size();
+    chunk.data.resize(kept + TEXT_CHUNK_BYTES);
+    file_.read(chunk.data.data() + kept, TEXT_CHUNK_BYTES);
+    chunk.data.resize(kept + static_cast<std::size_t>(file_.gcount()));
+    if (file_.bad())
+    {
+        error_ = "read error";
+        return std::nullopt;
+    }
+    if (chunk.data.empty())
+    {
+        return std::nullopt;
+    }
+
+    // the part after the last line end goes into the next chunk, a line longer than a chunk grows it
+    if (!file_.eof())
+    {
+        const std::size_t end = chunk.data.rfind('\n');
+        if (end == std::string::npos)
+        {
+            carry_ = std::move(chunk.data);
+            return nextLines();
+        }
+        carry_.assign(chunk.data, end + 1);
+        chunk.data.resize(end + 1);
+    }
+    return chunk;
+}
+
+} // namespace dbtool
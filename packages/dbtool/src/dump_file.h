@@ -0,0 +1,70 @@
+#pragma once
+
+#include "messages.h"
+
+// std
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dbtool
+{
+
+enum class DumpFormat : u32
+{
+    // starts with BINARY_MAGIC, then one frame per chunk of consecutive messages
+    //   u32 rows | u32 raw size | u32 data size | data
+    // where data is the chunk as a columnar archive block (see archive_codec.h). Integers are little-endian.
+    BINARY,
+    // one message object per line, the content of a RECEIVED_MESSAGE packet
+    NDJSON
+};
+
+constexpr std::string_view BINARY_MAGIC = "YAPDUMP1";
+
+[[nodiscard]] std::string_view formatName(DumpFormat format) noexcept;
+
+// A chunk as it is in the file, decoded on the worker threads
+struct RawChunk
+{
+    std::string data;
+    // only set for binary frames
+    u32 rows = 0;
+    u32 rawSize = 0;
+};
+
+// Chunks in the form they are written to the file, frame header included
+[[nodiscard]] std::string encodeChunk(DumpFormat format, const std::vector<server::messages::NewMessageReceived>& rows);
+// nullopt and the reason in error if the chunk is corrupt
+[[nodiscard]] std::optional<std::vector<server::messages::NewMessageReceived>> decodeChunk(DumpFormat format, const RawChunk& chunk, std::string& error);
+
+// Reads a dump one chunk at a time, the format is told apart by the magic
+class DumpReader
+{
+public:
+    // NDJSON files are cut into chunks of about this many bytes, at line ends
+    static constexpr std::size_t TEXT_CHUNK_BYTES = 4 * 1024 * 1024;
+
+    [[nodiscard]] bool open(const std::string& path);
+    [[nodiscard]] DumpFormat format() const noexcept { return format_; }
+
+    // nullopt at the end of the file or on a read error, failed() tells them apart
+    [[nodiscard]] std::optional<RawChunk> next();
+    [[nodiscard]] bool failed() const noexcept { return !error_.empty(); }
+    [[nodiscard]] const std::string& error() const noexcept { return error_; }
+
+private:
+    [[nodiscard]] std::optional<RawChunk> nextFrame();
+    [[nodiscard]] std::optional<RawChunk> nextLines();
+
+private:
+    std::ifstream file_;
+    DumpFormat format_ = DumpFormat::BINARY;
+    // start of a line cut off at the end of the last NDJSON chunk
+    std::string carry_;
+    std::string error_;
+};
+
+} // namespace dbtool
@@ -0,0 +1,303 @@
+#include "cmake_constants.h"
+#include "db_manager.h"
+#include "dump_file.h"
+#include "ordered_pipeline.h"
+
+// cli11
+#include "CLI/CLI.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <thread>
+
+namespace
+{
+
+using dbtool::DumpFormat;
+
+struct ExportOptions
+{
+    std::string database = std::string(DEFAULT_DB_PATH);
+    std::string output;
+    DumpFormat format = DumpFormat::BINARY;
+    DurabilityProfile profile = DurabilityProfile::BALANCED;
+    u32 threads = std::max(1u, std::thread::hardware_concurrency());
+    u32 chunkRows = 8192;
+};
+
+struct ImportOptions
+{
+    std::string database = std::string(DEFAULT_DB_PATH);
+    std::string input;
+    DurabilityProfile profile = DurabilityProfile::BALANCED;
+    u32 threads = std::max(1u, std::thread::hardware_concurrency());
+    u32 batchRows = 100000;
+};
+
+// Range of ids (first, last] read and encoded by one worker
+struct IdRange
+{
+    u64 after = 0;
+    u64 last = 0;
+};
+
+struct EncodedChunk
+{
+    std::string bytes;
+    u64 rows = 0;
+};
+
+struct DecodedChunk
+{
+    std::optional<std::vector<server::messages::NewMessageReceived>> rows;
+    std::string error;
+};
+
+[[nodiscard]] double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The id space is cut into ranges of chunkRows ids. Every worker reads its range through its own
+// read connection and compresses or formats it, the file is written in id order on this thread.
+int exportMessages(const ExportOptions& options, spdlog::logger* logger)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    DatabaseConfig config;
+    config.path = options.database;
+    config.profile = options.profile;
+    config.readConnections = options.threads;
+    const DataBaseManager database{logger, config};
+
+    std::ofstream file(options.output, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::fprintf(stderr, "Could not create %s\n", options.output.c_str());
+        return EXIT_FAILURE;
+    }
+    if (options.format == DumpFormat::BINARY)
+    {
+        file.write(dbtool::BINARY_MAGIC.data(), static_cast<std::streamsize>(dbtool::BINARY_MAGIC.size()));
+    }
+
+    const u64 lastId = database.lastMessageId();
+    u64 nextAfter = 0;
+    u64 rows = 0;
+
+    const bool ok = dbtool::runOrdered<IdRange, EncodedChunk>(options.threads, 2 * options.threads,
+        [&]() -> std::optional<IdRange>
+        {
+            if (nextAfter >= lastId)
+            {
+                return std::nullopt;
+            }
+            const IdRange range{nextAfter, std::min(lastId, nextAfter + options.chunkRows)};
+            nextAfter = range.last;
+            return range;
+        },
+        [&](const IdRange& range)
+        {
+            // a range holds at most chunkRows messages, so the page is the whole range
+            std::vector<server::messages::NewMessageReceived> messages;
+            HistoryQuery query;
+            query.afterId = range.after;
+            query.beforeId = range.last + 1;
+            query.limit = options.chunkRows;
+            database.getMessages(query, [&](const server::messages::NewMessageReceived& message)
+            {
+                messages.push_back(message);
+            });
+
+            EncodedChunk chunk;
+            chunk.rows = messages.size();
+            if (!messages.empty())
+            {
+                chunk.bytes = dbtool::encodeChunk(options.format, messages);
+            }
+            return chunk;
+        },
+        [&](EncodedChunk chunk)
+        {
+            file.write(chunk.bytes.data(), static_cast<std::streamsize>(chunk.bytes.size()));
+            rows += chunk.rows;
+            return file.good();
+        });
+
+    file.close();
+    if (!ok || file.fail())
+    {
+        std::fprintf(stderr, "Could not write %s\n", options.output.c_str());
+        return EXIT_FAILURE;
+    }
+
+    const double seconds = secondsSince(start);
+    std::printf("Exported %llu messages to %s (%s, %.2f MiB) in %.2f s, %.0f messages/s\n",
+        static_cast<unsigned long long>(rows), options.output.c_str(), dbtool::formatName(options.format).data(),
+        static_cast<double>(std::filesystem::file_size(options.output)) / (1024.0 * 1024.0),
+        seconds, static_cast<double>(rows) / std::max(seconds, 1e-9));
+    return EXIT_SUCCESS;
+}
+
+// Chunks are read from the file in order and decoded on the workers, this thread inserts them in
+// transactions of batchRows messages. The timestamp and search indexes are built once at the end.
+int importMessages(const ImportOptions& options, spdlog::logger* logger)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    dbtool::DumpReader reader;
+    if (!reader.open(options.input))
+    {
+        std::fprintf(stderr, "Could not read the dump: %s\n", reader.error().c_str());
+        return EXIT_FAILURE;
+    }
+
+    DatabaseConfig config;
+    config.path = options.database;
+    config.profile = options.profile;
+    DataBaseManager database{logger, config};
+
+    // ids are kept as they are in the dump, they could clash with the ones already there
+    if (database.lastMessageId() != 0)
+    {
+        std::fprintf(stderr, "%s already holds messages, import into a new database\n", options.database.c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (!database.beginBulkLoad())
+    {
+        std::fprintf(stderr, "Could not prepare %s for the import\n", options.database.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<server::messages::NewMessageReceived> batch;
+    batch.reserve(options.batchRows);
+    u64 rows = 0;
+    std::string error;
+
+    const auto flush = [&]
+    {
+        if (batch.empty())
+        {
+            return true;
+        }
+        if (!database.addMessageEntries(batch))
+        {
+            error = "could not insert a batch of " + std::to_string(batch.size()) + " messages";
+            return false;
+        }
+        rows += batch.size();
+        batch.clear();
+        return true;
+    };
+
+    bool ok = dbtool::runOrdered<dbtool::RawChunk, DecodedChunk>(options.threads, 2 * options.threads,
+        [&] { return reader.next(); },
+        [&](const dbtool::RawChunk& chunk)
+        {
+            DecodedChunk decoded;
+            decoded.rows = dbtool::decodeChunk(reader.format(), chunk, decoded.error);
+            return decoded;
+        },
+        [&](DecodedChunk chunk)
+        {
+            if (!chunk.rows.has_value())
+            {
+                error = std::move(chunk.error);
+                return false;
+            }
+            for (auto& message : chunk.rows.value())
+            {
+                batch.push_back(std::move(message));
+                if (batch.size() >= options.batchRows && !flush())
+                {
+                    return false;
+                }
+            }
+            return true;
+        });
+
+    if (ok && reader.failed())
+    {
+        error = reader.error();
+        ok = false;
+    }
+    ok = ok && flush();
+
+    const auto loaded = std::chrono::steady_clock::now();
+    if (!database.endBulkLoad())
+    {
+        std::fprintf(stderr, "Could not build the indexes of %s\n", options.database.c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (!ok)
+    {
+        std::fprintf(stderr, "Import stopped after %llu messages: %s\n", static_cast<unsigned long long>(rows), error.c_str());
+        return EXIT_FAILURE;
+    }
+
+    const double seconds = secondsSince(start);
+    std::printf("Imported %llu messages from %s (%s) in %.2f s, %.0f messages/s, %.2f s of it building indexes\n",
+        static_cast<unsigned long long>(rows), options.input.c_str(), dbtool::formatName(reader.format()).data(),
+        seconds, static_cast<double>(rows) / std::max(seconds, 1e-9), secondsSince(loaded));
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    CLI::App dbtoolApplication(DBTOOL_DESCRIPTION);
+    dbtoolApplication.set_version_flag("--version", PROJECT_VERSION);
+    dbtoolApplication.require_subcommand(1);
+
+    const std::map<std::string, DurabilityProfile> dbProfiles{
+        {"strict", DurabilityProfile::STRICT},
+        {"balanced", DurabilityProfile::BALANCED},
+        {"fast", DurabilityProfile::FAST},
+    };
+
+    ExportOptions exportOptions;
+    auto* exportCommand = dbtoolApplication.add_subcommand("export", "Dump every message of a database, archived ones included, to a file");
+    exportCommand->add_option("--db", exportOptions.database, "Database to export")
+        ->check(CLI::ExistingFile);
+    exportCommand->add_option("-o,--output", exportOptions.output, "Dump file to write")
+        ->required();
+    exportCommand->add_option("-f,--format", exportOptions.format, "binary (compressed columnar frames) or ndjson (one JSON message per line)")
+        ->transform(CLI::CheckedTransformer(std::map<std::string, DumpFormat>{{"binary", DumpFormat::BINARY}, {"ndjson", DumpFormat::NDJSON}}, CLI::ignore_case));
+    exportCommand->add_option("--db-profile", exportOptions.profile, "Durability profile the database is opened with: strict, balanced or fast")
+        ->transform(CLI::CheckedTransformer(dbProfiles, CLI::ignore_case));
+    exportCommand->add_option("-t,--threads", exportOptions.threads, "Threads reading and encoding chunks, each with its own read connection")
+        ->check(CLI::Range(1u, 64u));
+    exportCommand->add_option("--chunk-rows", exportOptions.chunkRows, "Message ids per chunk, every chunk is one binary frame")
+        ->check(CLI::Range(1u, 1000000u));
+
+    ImportOptions importOptions;
+    auto* importCommand = dbtoolApplication.add_subcommand("import", "Load a dump into a database without messages, the format is detected");
+    importCommand->add_option("--db", importOptions.database, "Database to import into, created if missing");
+    importCommand->add_option("-i,--input", importOptions.input, "Dump file to read")
+        ->required()
+        ->check(CLI::ExistingFile);
+    importCommand->add_option("--db-profile", importOptions.profile, "Durability profile the database is opened with: strict, balanced or fast")
+        ->transform(CLI::CheckedTransformer(dbProfiles, CLI::ignore_case));
+    importCommand->add_option("-t,--threads", importOptions.threads, "Threads decoding chunks, the inserts run on one")
+        ->check(CLI::Range(1u, 64u));
+    importCommand->add_option("--batch-rows", importOptions.batchRows, "Messages inserted per transaction")
+        ->check(CLI::Range(1u, 10000000u));
+
+    CLI11_PARSE(dbtoolApplication, argc, argv);
+
+    const auto logger = spdlog::default_logger();
+    logger->set_level(spdlog::level::warn);
+
+    if (*exportCommand)
+    {
+        return exportMessages(exportOptions, logger.get());
+    }
+    return importMessages(importOptions, logger.get());
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "global.h"
+
+// std
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace dbtool
+{
+
+// Runs work in three stages on a pool of threads while keeping the order of the input:
+//   next      hands out the next piece of work, nullopt once there is none left, always called by one thread at a time
+//   transform the expensive part, runs on every thread in parallel
+//   consume   called on the thread that runs the pipeline, in the order next handed the work out
+// At most window pieces are in flight, so a slow consumer holds back the workers instead of
+// piling up results in memory. Returns false if consume asked to stop.
+template <typename In, typename Out, typename Next, typename Transform, typename Consume>
+bool runOrdered(u32 threads, u32 window, Next&& next, Transform&& transform, Consume&& consume)
+{
+    std::mutex mutex;
+    std::condition_variable workerWake;
+    std::condition_variable consumerWake;
+    std::map<u64, Out> done;
+    u64 handedOut = 0;
+    u64 consumed = 0;
+    bool exhausted = false;
+    bool stopped = false;
+    u32 running = threads;
+
+    const auto work = [&]
+    {
+        std::unique_lock lock(mutex);
+        while (true)
+        {
+            workerWake.wait(lock, [&] { return stopped || exhausted || handedOut - consumed < window; });
+            if (stopped || exhausted)
+            {
+                break;
+            }
+
+            std::optional<In> input = next();
+            if (!input.has_value())
+            {
+                exhausted = true;
+                workerWake.notify_all();
+                break;
+            }
+
+            const u64 sequence = handedOut++;
+            lock.unlock();
+            Out output = transform(std::move(input.value()));
+            lock.lock();
+
+            done.emplace(sequence, std::move(output));
+            consumerWake.notify_one();
+        }
+
+        --running;
+        consumerWake.notify_one();
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (u32 i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(work);
+    }
+
+    bool ok = true;
+    {
+        std::unique_lock lock(mutex);
+        while (true)
+        {
+            consumerWake.wait(lock, [&] { return done.contains(consumed) || running == 0; });
+            const auto it = done.find(consumed);
+            if (it == done.end())
+            {
+                break;
+            }
+
+            Out output = std::move(it->second);
+            done.erase(it);
+            lock.unlock();
+            ok = consume(std::move(output));
+            lock.lock();
+
+            ++consumed;
+            workerWake.notify_all();
+            if (!ok)
+            {
+                stopped = true;
+                break;
+            }
+        }
+    }
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    return ok;
+}
+
+} // namespace dbtool
@@ -0,0 +1,398 @@
+#include "load_client.h"
+#include "load_stats.h"
+
+// std
+#include <charconv>
+
+namespace
+{
+
+[[nodiscard]] i64 steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+LoadClient::LoadClient(asio::io_context& io, const asio::ip::tcp::endpoint& endpoint, const LoadConfig& config, u32 index, u64 runId)
+    : strand_(asio::make_strand(io)),
+      socket_(strand_),
+      timer_(strand_),
+      endpoint_(endpoint),
+      config_(config),
+      username_("lg" + std::to_string(index)),
+      payloadPrefix_("lg|" + std::to_string(runId) + "|"),
+      rng_(runId ^ (static_cast<u64>(index) * 0x9E3779B97F4A7C15ULL))
+{
+}
+
+void LoadClient::start(std::chrono::milliseconds delay)
+{
+    asio::post(strand_, [self = shared_from_this(), delay]
+    {
+        self->timer_.expires_after(delay);
+        self->timer_.async_wait([self](std::error_code ec)
+        {
+            if (!ec && !self->stopping_)
+            {
+                self->doConnect();
+            }
+        });
+    });
+}
+
+void LoadClient::stop()
+{
+    asio::post(strand_, [self = shared_from_this()]
+    {
+        self->stopping_ = true;
+        self->timer_.cancel();
+        self->closeSocket();
+    });
+}
+
+void LoadClient::doConnect()
+{
+    ++threadStats().connectsAttempted;
+    const u64 generation = ++generation_;
+
+    socket_.async_connect(endpoint_, [self = shared_from_this(), generation](std::error_code ec)
+    {
+        if (generation != self->generation_ || self->stopping_)
+        {
+            return;
+        }
+
+        if (ec)
+        {
+            ++threadStats().connectErrors;
+            self->reconnectLater();
+            return;
+        }
+
+        self->onConnected();
+    });
+}
+
+void LoadClient::onConnected()
+{
+    ++threadStats().connectsSucceeded;
+    connected_ = true;
+    connectedAtNs_ = steadyNowNs();
+
+    std::error_code ignore;
+    std::ignore = socket_.set_option(asio::ip::tcp::no_delay(true), ignore);
+
+    // the server only lets logged in connections join, the first run of a username registers it
+    client::messages::Register registration;
+    registration.username = username_;
+    registration.passwordHash = hashImpl(username_);
+    send(registration);
+
+    doReadLoop();
+    scheduleNextAction();
+}
+
+void LoadClient::doReadLoop()
+{
+    // frames already buffered are handled first, then the rest of the next one is read
+    wire::Frame frame;
+    while (true)
+    {
+        const auto buffered = readBuf_.data();
+        frame = wire::nextFrame({static_cast<const char*>(buffered.data()), buffered.size()}, readSearched_);
+        if (frame.size == 0)
+        {
+            break;
+        }
+        onFrame(frame);
+        readBuf_.consume(frame.size);
+        readSearched_ = 0;
+    }
+    readSearched_ = frame.searched;
+
+    if (frame.oversized)
+    {
+        ++threadStats().readErrors;
+        reconnectLater();
+        return;
+    }
+
+    asio::async_read(socket_, readBuf_, asio::transfer_at_least(frame.missing),
+        [self = shared_from_this(), generation = generation_](std::error_code ec, std::size_t bytes)
+        {
+            if (generation != self->generation_)
+            {
+                return;
+            }
+
+            if (ec)
+            {
+                if (!self->stopping_ && ec != asio::error::operation_aborted)
+                {
+                    ++threadStats().readErrors;
+                    self->reconnectLater();
+                }
+                return;
+            }
+
+            threadStats().bytesReceived += bytes;
+
+            if (self->connected_)
+            {
+                self->doReadLoop();
+            }
+        });
+}
+
+void LoadClient::onFrame(const wire::Frame& frame)
+{
+    // the server only answers in binary once asked to, from then on this client writes it too
+    if (frame.encoding != WireEncoding::JSON)
+    {
+        encoding_ = frame.encoding;
+    }
+
+    const auto message = wire::decodeFrame<server::messages::ServerMessage>(frame);
+    if (!message.has_value())
+    {
+        ++threadStats().parseErrors;
+        return;
+    }
+
+    if (const auto* response = std::get_if<server::messages::ServerResponse>(&message.value()); response != nullptr)
+    {
+        onResponse(response->code);
+        return;
+    }
+
+    const auto* received = std::get_if<server::messages::NewMessageReceived>(&message.value());
+    if (received == nullptr)
+    {
+        return;
+    }
+
+    auto& stats = threadStats();
+    ++stats.messagesReceived;
+
+    if (!received->message.starts_with(payloadPrefix_))
+    {
+        return;
+    }
+
+    // payload is "lg|<runId>|<sendNs>|<padding>"
+    const char* first = received->message.data() + payloadPrefix_.size();
+    const char* last = received->message.data() + received->message.size();
+    i64 sentAtNs = 0;
+    if (const auto [ptr, errc] = std::from_chars(first, last, sentAtNs); errc != std::errc{})
+    {
+        ++stats.parseErrors;
+        return;
+    }
+
+    // Messages sent before this connection was established come from the history replay,
+    // they say nothing about broadcast latency
+    if (sentAtNs < connectedAtNs_)
+    {
+        return;
+    }
+
+    stats.broadcastLatencyUs.record(static_cast<u64>(steadyNowNs() - sentAtNs) / 1000);
+}
+
+void LoadClient::onResponse(ServerResponseCode code)
+{
+    switch (code)
+    {
+    case ServerResponseCode::SUCCESSFUL_REGISTRATION:
+    case ServerResponseCode::SUCCESSFUL_LOGIN:
+    {
+        client::messages::InitialConnection initialConnection;
+        initialConnection.username = username_;
+        initialConnection.encoding = config_.encoding;
+        send(initialConnection);
+        joined_ = true;
+        break;
+    }
+    case ServerResponseCode::USERNAME_ALREADY_EXISTS:
+        sendLogin();
+        break;
+    case ServerResponseCode::INCORRECT_PASSWORD:
+    case ServerResponseCode::NOT_LOGGED_IN:
+    case ServerResponseCode::SERVER_ERROR:
+        ++threadStats().authErrors;
+        break;
+    case ServerResponseCode::SEARCH_UNAVAILABLE:
+        break;
+    }
+}
+
+void LoadClient::sendLogin()
+{
+    client::messages::Login login;
+    login.username = username_;
+    login.passwordHash = hashImpl(username_);
+    send(login);
+    ++threadStats().loginsSent;
+}
+
+void LoadClient::scheduleNextAction()
+{
+    if (config_.actionsPerSecond <= 0.0)
+    {
+        return;
+    }
+
+    // Poisson arrivals so clients do not synchronize into bursts
+    std::exponential_distribution<f64> interval(config_.actionsPerSecond);
+    const auto delay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<f64>(interval(rng_)));
+
+    timer_.expires_after(delay);
+    timer_.async_wait([self = shared_from_this(), generation = generation_](std::error_code ec)
+    {
+        if (ec || generation != self->generation_ || self->stopping_ || !self->connected_)
+        {
+            return;
+        }
+        self->performAction();
+    });
+}
+
+void LoadClient::performAction()
+{
+    auto& stats = threadStats();
+
+    switch (pickAction())
+    {
+    case Action::MESSAGE:
+    {
+        if (!joined_)
+        {
+            break;
+        }
+        client::messages::NewMessage message;
+        message.message = makePayload();
+        send(message);
+        ++stats.messagesSent;
+        break;
+    }
+    case Action::LOGIN:
+        // joins again once the server answers
+        sendLogin();
+        break;
+    case Action::DISCONNECT:
+        ++stats.requestedDisconnects;
+        reconnectLater();
+        return;
+    }
+
+    scheduleNextAction();
+}
+
+LoadClient::Action LoadClient::pickAction()
+{
+    const u32 total = config_.messageWeight + config_.loginWeight + config_.disconnectWeight;
+    if (total == 0)
+    {
+        return Action::MESSAGE;
+    }
+
+    const u32 pick = std::uniform_int_distribution<u32>(0, total - 1)(rng_);
+    if (pick < config_.messageWeight)
+    {
+        return Action::MESSAGE;
+    }
+    if (pick < config_.messageWeight + config_.loginWeight)
+    {
+        return Action::LOGIN;
+    }
+    return Action::DISCONNECT;
+}
+
+std::string LoadClient::makePayload()
+{
+    std::string payload = payloadPrefix_ + std::to_string(steadyNowNs()) + "|";
+    if (payload.size() < config_.payloadSize)
+    {
+        payload.append(config_.payloadSize - payload.size(), 'x');
+    }
+    return payload;
+}
+
+void LoadClient::send(const client::messages::ClientMessage& message)
+{
+    outbox_.push_back(std::visit([this](const auto& m) { return wire::encodeFrame(encoding_, m); }, message));
+    if (!writing_)
+    {
+        doWriteNext();
+    }
+}
+
+void LoadClient::doWriteNext()
+{
+    if (outbox_.empty() || !connected_)
+    {
+        writing_ = false;
+        return;
+    }
+
+    writing_ = true;
+    asio::async_write(socket_, asio::buffer(outbox_.front()),
+        [self = shared_from_this(), generation = generation_](std::error_code ec, std::size_t bytes)
+        {
+            if (generation != self->generation_)
+            {
+                return;
+            }
+
+            if (ec)
+            {
+                if (!self->stopping_ && ec != asio::error::operation_aborted)
+                {
+                    ++threadStats().writeErrors;
+                    self->reconnectLater();
+                }
+                return;
+            }
+
+            threadStats().bytesSent += bytes;
+            self->outbox_.pop_front();
+            self->doWriteNext();
+        });
+}
+
+void LoadClient::closeSocket()
+{
+    ++generation_;
+    connected_ = false;
+    joined_ = false;
+    writing_ = false;
+    outbox_.clear();
+    readBuf_.consume(readBuf_.size());
+    readSearched_ = 0;
+    encoding_ = WireEncoding::JSON;
+
+    std::error_code ignore;
+    std::ignore = socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ignore);
+    std::ignore = socket_.close(ignore);
+}
+
+void LoadClient::reconnectLater()
+{
+    closeSocket();
+    if (stopping_)
+    {
+        return;
+    }
+
+    timer_.expires_after(std::chrono::milliseconds(config_.reconnectDelayMilliseconds));
+    timer_.async_wait([self = shared_from_this()](std::error_code ec)
+    {
+        if (!ec && !self->stopping_)
+        {
+            self->doConnect();
+        }
+    });
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#ifndef ASIO_STANDALONE
+#  define ASIO_STANDALONE
+#endif
+
+#include "messages.h"
+#include "wire_frame.h"
+
+// asio
+#include "asio.hpp"
+
+// std
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+
+struct LoadConfig
+{
+    u32 clients = 100;
+    u32 threads = 2;
+    u32 durationSeconds = 30;
+    u32 rampUpMilliseconds = 2000;
+    f64 actionsPerSecond = 1.0;
+    u32 messageWeight = 90;
+    u32 loginWeight = 5;
+    u32 disconnectWeight = 5;
+    u32 payloadSize = 64;
+    u32 reconnectDelayMilliseconds = 250;
+    // asked of the server in the InitialConnection
+    WireEncoding encoding = WireEncoding::JSON;
+};
+
+// A single simulated chat user. Everything it does runs on its own strand, so thousands of them
+// can share a small pool of io threads.
+class LoadClient : public std::enable_shared_from_this<LoadClient>
+{
+public:
+    LoadClient(asio::io_context& io, const asio::ip::tcp::endpoint& endpoint, const LoadConfig& config, u32 index, u64 runId);
+
+public:
+    void start(std::chrono::milliseconds delay);
+    void stop();
+
+private:
+    enum class Action
+    {
+        MESSAGE,
+        LOGIN,
+        DISCONNECT
+    };
+
+    void doConnect();
+    void onConnected();
+    void doReadLoop();
+    void onFrame(const wire::Frame& frame);
+    // joins the chat once logged in, logs in when the username was registered by an earlier run
+    void onResponse(ServerResponseCode code);
+    void sendLogin();
+
+    void scheduleNextAction();
+    void performAction();
+    [[nodiscard]] Action pickAction();
+    [[nodiscard]] std::string makePayload();
+
+    void send(const client::messages::ClientMessage& message);
+    void doWriteNext();
+
+    void closeSocket();
+    void reconnectLater();
+
+private:
+    asio::strand<asio::io_context::executor_type> strand_;
+    asio::ip::tcp::socket socket_;
+    asio::steady_timer timer_;
+    asio::ip::tcp::endpoint endpoint_;
+    const LoadConfig& config_;
+
+    std::string username_;
+    std::string payloadPrefix_;
+    std::mt19937_64 rng_;
+
+    // connection state, bumped on every reconnect so stale completions can be ignored
+    u64 generation_{0};
+    bool connected_{false};
+    // logged in and joined, messages are only sent from then on
+    bool joined_{false};
+    bool stopping_{false};
+    i64 connectedAtNs_{0};
+
+    // io
+    asio::streambuf readBuf_;
+    // bytes of readBuf_ already searched for the line end of a text frame
+    std::size_t readSearched_ = 0;
+    // of the frames written, the server's once it writes binary frames
+    WireEncoding encoding_{WireEncoding::JSON};
+    std::deque<std::string> outbox_;
+    bool writing_{false};
+};
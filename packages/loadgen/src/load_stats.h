@@ -0,0 +1,141 @@
+#pragma once
+
+#include "histogram.h"
+
+// nlohmann
+#include "json.hpp"
+
+// std
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct LoadStats
+{
+    // connections
+    u64 connectsAttempted = 0;
+    u64 connectsSucceeded = 0;
+    u64 requestedDisconnects = 0;
+
+    // traffic
+    u64 messagesSent = 0;
+    u64 loginsSent = 0;
+    u64 bytesSent = 0;
+    u64 bytesReceived = 0;
+    u64 messagesReceived = 0;
+
+    // errors
+    u64 connectErrors = 0;
+    u64 readErrors = 0;
+    u64 writeErrors = 0;
+    u64 parseErrors = 0;
+    // logins the server refused
+    u64 authErrors = 0;
+
+    // end-to-end latency from NewMessage write to NewMessageReceived read, in microseconds
+    histogram::Histogram broadcastLatencyUs;
+
+    void merge(const LoadStats& other) noexcept
+    {
+        connectsAttempted += other.connectsAttempted;
+        connectsSucceeded += other.connectsSucceeded;
+        requestedDisconnects += other.requestedDisconnects;
+        messagesSent += other.messagesSent;
+        loginsSent += other.loginsSent;
+        bytesSent += other.bytesSent;
+        bytesReceived += other.bytesReceived;
+        messagesReceived += other.messagesReceived;
+        connectErrors += other.connectErrors;
+        readErrors += other.readErrors;
+        writeErrors += other.writeErrors;
+        parseErrors += other.parseErrors;
+        authErrors += other.authErrors;
+        broadcastLatencyUs.merge(other.broadcastLatencyUs);
+    }
+};
+
+// Every io thread records into its own LoadStats, they are only merged once the io threads are
+// joined so the hot path never touches shared state.
+class LoadStatsRegistry
+{
+public:
+    [[nodiscard]] static LoadStatsRegistry& instance()
+    {
+        static LoadStatsRegistry registry;
+        return registry;
+    }
+
+    [[nodiscard]] LoadStats& threadLocal()
+    {
+        thread_local LoadStats* stats = [this]
+        {
+            const std::lock_guard lock(mutex_);
+            return perThread_.emplace_back(std::make_unique<LoadStats>()).get();
+        }();
+        return *stats;
+    }
+
+    [[nodiscard]] LoadStats merged() const
+    {
+        const std::lock_guard lock(mutex_);
+        LoadStats out;
+        for (const auto& stats : perThread_)
+        {
+            out.merge(*stats);
+        }
+        return out;
+    }
+
+private:
+    LoadStatsRegistry() = default;
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<LoadStats>> perThread_;
+};
+
+[[nodiscard]] inline LoadStats& threadStats()
+{
+    return LoadStatsRegistry::instance().threadLocal();
+}
+
+[[nodiscard]] inline nlohmann::json toJson(const LoadStats& stats, f64 elapsedSeconds)
+{
+    const auto perSecond = [elapsedSeconds](u64 value)
+    {
+        return elapsedSeconds > 0.0 ? static_cast<f64>(value) / elapsedSeconds : 0.0;
+    };
+
+    const auto& latency = stats.broadcastLatencyUs;
+
+    nlohmann::json report;
+    report["elapsed_seconds"] = elapsedSeconds;
+
+    report["connections"]["attempted"] = stats.connectsAttempted;
+    report["connections"]["succeeded"] = stats.connectsSucceeded;
+    report["connections"]["requested_disconnects"] = stats.requestedDisconnects;
+
+    report["throughput"]["messages_sent"] = stats.messagesSent;
+    report["throughput"]["logins_sent"] = stats.loginsSent;
+    report["throughput"]["messages_received"] = stats.messagesReceived;
+    report["throughput"]["messages_sent_per_second"] = perSecond(stats.messagesSent);
+    report["throughput"]["messages_received_per_second"] = perSecond(stats.messagesReceived);
+    report["throughput"]["bytes_sent"] = stats.bytesSent;
+    report["throughput"]["bytes_received"] = stats.bytesReceived;
+
+    report["broadcast_latency_us"]["samples"] = latency.count();
+    report["broadcast_latency_us"]["min"] = latency.min();
+    report["broadcast_latency_us"]["mean"] = latency.mean();
+    report["broadcast_latency_us"]["p50"] = latency.percentile(50.0);
+    report["broadcast_latency_us"]["p90"] = latency.percentile(90.0);
+    report["broadcast_latency_us"]["p99"] = latency.percentile(99.0);
+    report["broadcast_latency_us"]["p999"] = latency.percentile(99.9);
+    report["broadcast_latency_us"]["max"] = latency.max();
+
+    report["errors"]["connect"] = stats.connectErrors;
+    report["errors"]["read"] = stats.readErrors;
+    report["errors"]["write"] = stats.writeErrors;
+    report["errors"]["parse"] = stats.parseErrors;
+    report["errors"]["auth"] = stats.authErrors;
+
+    return report;
+}
@@ -0,0 +1,127 @@
+#include "load_client.h"
+#include "load_stats.h"
+#include "cmake_constants.h"
+
+// cli11
+#include "CLI/CLI.hpp"
+
+// std
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+int main(int argc, char **argv)
+{
+    CLI::App loadgenApplication(LOADGEN_DESCRIPTION);
+    loadgenApplication.set_version_flag("--version", PROJECT_VERSION);
+
+    LoadConfig config;
+    std::string host = "127.0.0.1";
+    std::string loggingFolder = "./logs";
+    std::string outputFile;
+    u16 port;
+
+    loadgenApplication.add_option("-i,--ip", host, "Loopback address of the local server under test")
+        ->check([](const std::string& input)
+        {
+            std::error_code ec;
+            const auto address = asio::ip::make_address(input, ec);
+            if (ec || !address.is_loopback())
+            {
+                return std::string("The load generator only runs against a local (loopback) server");
+            }
+            return std::string{};
+        });
+
+    loadgenApplication.add_option("-p,--port", port, "Port of the local server")
+        ->required()
+        ->check(CLI::Range(1, 65535));
+
+    loadgenApplication.add_option("-c,--clients", config.clients, "Number of concurrent simulated clients")
+        ->check(CLI::Range(1u, 100000u));
+    loadgenApplication.add_option("-t,--threads", config.threads, "Number of io threads")
+        ->check(CLI::Range(1u, 256u));
+    loadgenApplication.add_option("-d,--duration", config.durationSeconds, "Test duration in seconds")
+        ->check(CLI::Range(1u, 86400u));
+    loadgenApplication.add_option("--ramp-up", config.rampUpMilliseconds, "Time in milliseconds over which the clients connect");
+    loadgenApplication.add_option("-r,--rate", config.actionsPerSecond, "Actions per second issued by every client")
+        ->check(CLI::NonNegativeNumber);
+    loadgenApplication.add_option("--message-weight", config.messageWeight, "Relative weight of chat messages in the action mix");
+    loadgenApplication.add_option("--login-weight", config.loginWeight, "Relative weight of logins in the action mix");
+    loadgenApplication.add_option("--disconnect-weight", config.disconnectWeight, "Relative weight of disconnects in the action mix");
+    loadgenApplication.add_option("--payload-size", config.payloadSize, "Size in bytes of every chat message")
+        ->check(CLI::Range(32u, static_cast<u32>(MAX_MESSAGE_LENGTH)));
+    loadgenApplication.add_option("--wire-encoding", config.encoding, "Encoding the clients ask the server for: json, msgpack or cbor")
+        ->transform(CLI::CheckedTransformer(std::map<std::string, WireEncoding>{{"json", WireEncoding::JSON}, {"msgpack", WireEncoding::MSGPACK}, {"cbor", WireEncoding::CBOR}}, CLI::ignore_case));
+    loadgenApplication.add_option("--reconnect-delay", config.reconnectDelayMilliseconds, "Milliseconds to wait before reconnecting");
+    loadgenApplication.add_option("-o,--output", outputFile, "File where the JSON report is written, stdout if empty");
+
+    loadgenApplication.add_option("-l,--log-folder", loggingFolder, "Path tp the folder where the logs from the application will be generated.")
+       ->check(CLI::ExistingDirectory);
+
+    CLI11_PARSE(loadgenApplication, argc, argv);
+
+    const auto timeStampStringForFile = makeSafeForFilename(getTimeStamp(currentSecondsSinceEpoch()));
+    const std::string logFile = std::string(LOADGEN_TARGET_NAME) + "_" + timeStampStringForFile + ".log";
+
+    const auto logger = getLogger(
+        LOADGEN_TARGET_NAME,
+        (std::filesystem::path(loggingFolder) / logFile).string()
+    );
+
+    logger->info("Starting {} version {}", LOADGEN_TARGET_NAME, PROJECT_VERSION);
+    logger->info("Simulating {} clients against {}:{} for {}s", config.clients, host, port, config.durationSeconds);
+
+    asio::io_context io;
+    auto work = asio::make_work_guard(io);
+    const asio::ip::tcp::endpoint endpoint(asio::ip::make_address(host), port);
+    const u64 runId = std::random_device{}();
+
+    std::vector<std::shared_ptr<LoadClient>> clients;
+    clients.reserve(config.clients);
+    for (u32 i = 0; i < config.clients; ++i)
+    {
+        clients.emplace_back(std::make_shared<LoadClient>(io, endpoint, config, i, runId));
+        clients.back()->start(std::chrono::milliseconds(static_cast<u64>(config.rampUpMilliseconds) * i / config.clients));
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    threads.reserve(config.threads);
+    for (u32 i = 0; i < config.threads; ++i)
+    {
+        threads.emplace_back([&io] { io.run(); });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(config.durationSeconds));
+
+    for (const auto& client : clients)
+    {
+        client->stop();
+    }
+
+    // the clients close their sockets and cancel their timers on their strands, run() returns once
+    // every handler they still had pending has finished
+    work.reset();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    const f64 elapsedSeconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - startTime).count();
+
+    const std::string report = toJson(LoadStatsRegistry::instance().merged(), elapsedSeconds).dump(2);
+    logger->info("Load test finished: {}", report);
+
+    if (outputFile.empty())
+    {
+        std::cout << report << "\n";
+    }
+    else
+    {
+        std::ofstream(outputFile) << report << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
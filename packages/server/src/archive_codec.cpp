@@ -0,0 +1,288 @@
+#include "archive_codec.h"
+
+// zlib
+#include "zlib.h"
+
+namespace server::archive
+{
+
+namespace
+{
+
+constexpr std::size_t ROW_HEADER_SIZE = 2 * sizeof(u64) + 2 * sizeof(u32);
+
+template <typename T>
+void put(std::string& out, T value)
+{
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out.push_back(static_cast<char>(static_cast<u8>(value >> (8 * i))));
+    }
+}
+
+template <typename T>
+[[nodiscard]] T get(const char* in)
+{
+    T value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        value |= static_cast<T>(static_cast<u8>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+void putVarint(std::string& out, u64 value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>(static_cast<u8>(value) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Reads a varint at offset and moves past it, false if it runs past the end
+[[nodiscard]] bool getVarint(std::string_view in, std::size_t& offset, u64& value)
+{
+    value = 0;
+    for (u32 shift = 0; shift < 64 && offset < in.size(); shift += 7)
+    {
+        const auto byte = static_cast<u8>(in[offset++]);
+        value |= static_cast<u64>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+[[nodiscard]] u64 zigzag(u64 delta)
+{
+    return (delta << 1) ^ (0 - (delta >> 63));
+}
+
+[[nodiscard]] u64 unzigzag(u64 value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+void encodeRows(const std::vector<server::messages::NewMessageReceived>& rows, std::string& raw)
+{
+    std::size_t rawSize = 0;
+    for (const auto& row : rows)
+    {
+        rawSize += ROW_HEADER_SIZE + row.username.size() + row.message.size();
+    }
+    raw.reserve(rawSize);
+
+    for (const auto& row : rows)
+    {
+        put<u64>(raw, row.id);
+        put<u64>(raw, row.timestamp);
+        put<u32>(raw, static_cast<u32>(row.username.size()));
+        put<u32>(raw, static_cast<u32>(row.message.size()));
+        raw += row.username;
+        raw += row.message;
+    }
+}
+
+void encodeColumns(const std::vector<server::messages::NewMessageReceived>& rows, std::string& raw)
+{
+    std::size_t textSize = 0;
+    for (const auto& row : rows)
+    {
+        textSize += row.username.size() + row.message.size();
+    }
+    raw.reserve(sizeof(u32) + rows.size() * 8 + textSize);
+
+    put<u32>(raw, static_cast<u32>(rows.size()));
+
+    u64 previous = 0;
+    for (const auto& row : rows)
+    {
+        putVarint(raw, row.id - previous);
+        previous = row.id;
+    }
+
+    previous = 0;
+    for (const auto& row : rows)
+    {
+        putVarint(raw, zigzag(row.timestamp - previous));
+        previous = row.timestamp;
+    }
+
+    for (const auto& row : rows)
+    {
+        putVarint(raw, row.username.size());
+    }
+    for (const auto& row : rows)
+    {
+        putVarint(raw, row.message.size());
+    }
+    for (const auto& row : rows)
+    {
+        raw += row.username;
+    }
+    for (const auto& row : rows)
+    {
+        raw += row.message;
+    }
+}
+
+[[nodiscard]] bool decodeRows(std::string_view raw, std::vector<server::messages::NewMessageReceived>& rows)
+{
+    std::size_t offset = 0;
+    while (offset < raw.size())
+    {
+        if (raw.size() - offset < ROW_HEADER_SIZE)
+        {
+            return false;
+        }
+
+        const char* header = raw.data() + offset;
+        const auto usernameSize = get<u32>(header + 2 * sizeof(u64));
+        const auto messageSize = get<u32>(header + 2 * sizeof(u64) + sizeof(u32));
+        offset += ROW_HEADER_SIZE;
+        if (raw.size() - offset < static_cast<std::size_t>(usernameSize) + messageSize)
+        {
+            return false;
+        }
+
+        auto& row = rows.emplace_back();
+        row.id = get<u64>(header);
+        row.timestamp = get<u64>(header + sizeof(u64));
+        row.username.assign(raw.substr(offset, usernameSize));
+        row.message.assign(raw.substr(offset + usernameSize, messageSize));
+        offset += usernameSize + messageSize;
+    }
+    return true;
+}
+
+[[nodiscard]] bool decodeColumns(std::string_view raw, std::vector<server::messages::NewMessageReceived>& rows)
+{
+    if (raw.size() < sizeof(u32))
+    {
+        return false;
+    }
+
+    const auto count = get<u32>(raw.data());
+    // every row takes at least four bytes of varints, a larger count is corrupt
+    if (count > (raw.size() - sizeof(u32)) / 4)
+    {
+        return false;
+    }
+
+    const std::size_t first = rows.size();
+    rows.resize(first + count);
+    std::size_t offset = sizeof(u32);
+
+    u64 value = 0;
+    u64 previous = 0;
+    for (u32 i = 0; i < count; ++i)
+    {
+        if (!getVarint(raw, offset, value))
+        {
+            return false;
+        }
+        previous += value;
+        rows[first + i].id = previous;
+    }
+
+    previous = 0;
+    for (u32 i = 0; i < count; ++i)
+    {
+        if (!getVarint(raw, offset, value))
+        {
+            return false;
+        }
+        previous += unzigzag(value);
+        rows[first + i].timestamp = previous;
+    }
+
+    // every size is checked against the text left after the earlier ones, so a corrupt block can
+    // neither wrap the sum around nor make substr read past the end
+    std::vector<u64> sizes(2 * static_cast<std::size_t>(count));
+    for (auto& size : sizes)
+    {
+        if (!getVarint(raw, offset, size))
+        {
+            return false;
+        }
+    }
+    u64 textLeft = raw.size() - offset;
+    for (const u64 size : sizes)
+    {
+        if (size > textLeft)
+        {
+            return false;
+        }
+        textLeft -= size;
+    }
+    if (textLeft != 0)
+    {
+        return false;
+    }
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        rows[first + i].username.assign(raw.substr(offset, sizes[i]));
+        offset += sizes[i];
+    }
+    for (u32 i = 0; i < count; ++i)
+    {
+        rows[first + i].message.assign(raw.substr(offset, sizes[count + i]));
+        offset += sizes[count + i];
+    }
+    return true;
+}
+
+}
+
+EncodedSegment encode(const std::vector<server::messages::NewMessageReceived>& rows, Layout layout)
+{
+    std::string raw;
+    if (layout == Layout::COLUMNS)
+    {
+        encodeColumns(rows, raw);
+    }
+    else
+    {
+        encodeRows(rows, raw);
+    }
+
+    EncodedSegment segment;
+    segment.rawSize = raw.size();
+
+    uLongf compressedSize = compressBound(static_cast<uLong>(raw.size()));
+    segment.data.resize(compressedSize);
+    if (compress2(reinterpret_cast<Bytef*>(segment.data.data()), &compressedSize,
+                  reinterpret_cast<const Bytef*>(raw.data()), static_cast<uLong>(raw.size()), Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        return {};
+    }
+    segment.data.resize(compressedSize);
+    return segment;
+}
+
+bool decode(std::string_view data, std::size_t rawSize, Layout layout, std::vector<server::messages::NewMessageReceived>& rows)
+{
+    std::string raw(rawSize, '\0');
+    uLongf size = static_cast<uLongf>(rawSize);
+    if (uncompress(reinterpret_cast<Bytef*>(raw.data()), &size,
+                   reinterpret_cast<const Bytef*>(data.data()), static_cast<uLong>(data.size())) != Z_OK || size != rawSize)
+    {
+        return false;
+    }
+
+    switch (layout)
+    {
+    case Layout::ROWS:
+        return decodeRows(raw, rows);
+    case Layout::COLUMNS:
+        return decodeColumns(raw, rows);
+    }
+    return false;
+}
+
+} // namespace server::archive
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "messages.h"
+
+// std
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace server::archive
+{
+
+// Archive segments and closed message blocks hold a run of consecutive messages as one
+// zlib-compressed BLOB. Integers are little-endian, so segments read back the same on any host.
+enum class Layout : u32
+{
+    // Every row after the other, what segments were written in first
+    //   u64 id | u64 timestamp | u32 username size | u32 message size | username | message
+    ROWS = 0,
+    // One column after the other, so zlib sees runs of similar bytes
+    //   u32 count | id deltas | timestamp deltas | username sizes | message sizes | usernames | messages
+    // Deltas and sizes are LEB128 varints, timestamp deltas zigzag encoded as they can go back.
+    COLUMNS = 1
+};
+
+struct EncodedSegment
+{
+    std::string data;
+    // bytes before compression, needed to size the buffer when the segment is read back
+    std::size_t rawSize = 0;
+};
+
+[[nodiscard]] EncodedSegment encode(const std::vector<server::messages::NewMessageReceived>& rows, Layout layout = Layout::COLUMNS);
+
+// Appends the rows of the segment to rows, returns false if the data is corrupt
+[[nodiscard]] bool decode(std::string_view data, std::size_t rawSize, Layout layout, std::vector<server::messages::NewMessageReceived>& rows);
+
+} // namespace server::archive
@@ -0,0 +1,87 @@
+#include "auth_service.h"
+
+// std
+#include <vector>
+
+namespace server
+{
+
+AuthService::AuthService(IUserStore* userStore, WorkerPool* workers, spdlog::logger* logger, u32 cacheCapacity)
+    : userStore_(userStore), workers_(workers), logger_(logger), cache_(cacheCapacity)
+{
+}
+
+void AuthService::login(std::string username, u64 passwordHash, AuthCallback done)
+{
+    workers_->post([this, username = std::move(username), passwordHash, done = std::move(done)]
+    {
+        const auto record = lookup(username);
+        if (record.exists && record.passwordHash == passwordHash)
+        {
+            done(ServerResponseCode::SUCCESSFUL_LOGIN);
+            return;
+        }
+
+        // unknown users get the same answer, a login attempt does not reveal who is registered
+        logger_->info("Failed login for username {}", username);
+        done(ServerResponseCode::INCORRECT_PASSWORD);
+    });
+}
+
+void AuthService::registerUser(std::string username, u64 passwordHash, AuthCallback done)
+{
+    workers_->post([this, username = std::move(username), passwordHash, done = std::move(done)]
+    {
+        if (const auto cached = cache_.find(username); cached.has_value() && cached->exists)
+        {
+            done(ServerResponseCode::USERNAME_ALREADY_EXISTS);
+            return;
+        }
+
+        switch (userStore_->addNewUser(username, passwordHash))
+        {
+        case AddUserResult::ADDED:
+            cache_.store(username, CredentialRecord{true, passwordHash});
+            logger_->info("Registered username {}", username);
+            done(ServerResponseCode::SUCCESSFUL_REGISTRATION);
+            return;
+        case AddUserResult::USERNAME_TAKEN:
+            done(ServerResponseCode::USERNAME_ALREADY_EXISTS);
+            return;
+        case AddUserResult::FAILED:
+            done(ServerResponseCode::SERVER_ERROR);
+            return;
+        }
+    });
+}
+
+u32 AuthService::warmUp()
+{
+    std::vector<std::pair<std::string, u64>> users;
+    userStore_->getUsers(cache_.capacity(), [&users](const std::string& username, u64 passwordHash)
+    {
+        users.emplace_back(username, passwordHash);
+    });
+
+    // oldest first, so the latest registrations end up as the most recently used records
+    for (auto it = users.rbegin(); it != users.rend(); ++it)
+    {
+        cache_.storeIfAbsent(it->first, CredentialRecord{true, it->second});
+    }
+    return static_cast<u32>(users.size());
+}
+
+CredentialRecord AuthService::lookup(const std::string& username)
+{
+    if (const auto cached = cache_.find(username); cached.has_value())
+    {
+        return cached.value();
+    }
+
+    const auto passwordHash = userStore_->userPasswordHash(username);
+    const CredentialRecord record{passwordHash.has_value(), passwordHash.value_or(0)};
+    cache_.storeIfAbsent(username, record);
+    return record;
+}
+
+} // namespace server
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "credential_cache.h"
+#include "user_store.h"
+#include "worker_pool.h"
+
+// std
+#include <functional>
+
+namespace server
+{
+
+using AuthCallback = std::function<void(ServerResponseCode)>;
+
+// Login and registration against the user store. Every check runs on the worker pool and goes
+// through the credential cache first, the callback is invoked from the worker thread.
+class AuthService
+{
+public:
+    AuthService(IUserStore* userStore, WorkerPool* workers, spdlog::logger* logger, u32 cacheCapacity);
+
+public:
+    void login(std::string username, u64 passwordHash, AuthCallback done);
+    void registerUser(std::string username, u64 passwordHash, AuthCallback done);
+
+    // Fills the credential cache with the latest registered users, so the first logins after a
+    // restart do not all go to the store. Blocking, returns the number of records loaded.
+    u32 warmUp();
+
+private:
+    [[nodiscard]] CredentialRecord lookup(const std::string& username);
+
+private:
+    IUserStore* userStore_;
+    WorkerPool* workers_;
+    spdlog::logger* logger_;
+    CredentialCache cache_;
+};
+
+} // namespace server
@@ -0,0 +1,74 @@
+#include "credential_cache.h"
+#include "metrics.h"
+
+namespace server
+{
+
+CredentialCache::CredentialCache(u32 capacity)
+    : capacity_(capacity)
+{
+    index_.reserve(capacity_);
+}
+
+std::optional<CredentialRecord> CredentialCache::find(const std::string& username)
+{
+    auto& counters = metrics::counters();
+
+    const std::lock_guard lock(mutex_);
+    const auto it = index_.find(username);
+    if (it == index_.end())
+    {
+        counters.authCacheMisses.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    entries_.splice(entries_.begin(), entries_, it->second);
+    counters.authCacheHits.fetch_add(1, std::memory_order_relaxed);
+    return it->second->second;
+}
+
+void CredentialCache::store(const std::string& username, const CredentialRecord& record)
+{
+    const std::lock_guard lock(mutex_);
+    if (const auto it = index_.find(username); it != index_.end())
+    {
+        it->second->second = record;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+    insert(username, record);
+}
+
+void CredentialCache::storeIfAbsent(const std::string& username, const CredentialRecord& record)
+{
+    const std::lock_guard lock(mutex_);
+    if (!index_.contains(username))
+    {
+        insert(username, record);
+    }
+}
+
+void CredentialCache::insert(const std::string& username, const CredentialRecord& record)
+{
+    if (capacity_ == 0)
+    {
+        return;
+    }
+
+    if (entries_.size() >= capacity_)
+    {
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+
+    entries_.emplace_front(username, record);
+    index_.emplace(username, entries_.begin());
+    publishSize();
+}
+
+void CredentialCache::publishSize() const noexcept
+{
+    metrics::counters().authCacheEntries.store(entries_.size(), std::memory_order_relaxed);
+}
+
+} // namespace server
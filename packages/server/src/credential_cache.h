@@ -0,0 +1,55 @@
+#pragma once
+
+#include "global.h"
+
+// std
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace server
+{
+
+struct CredentialRecord
+{
+    // false caches that the username is not registered
+    bool exists = false;
+    u64 passwordHash = 0;
+};
+
+// Bounded LRU of credential records, shared by the worker threads. Reconnect storms log the same
+// users in again and again, with the cache those logins never reach SQLite.
+class CredentialCache
+{
+public:
+    explicit CredentialCache(u32 capacity);
+
+public:
+    [[nodiscard]] std::optional<CredentialRecord> find(const std::string& username);
+
+    // Records written by registrations, they replace whatever is cached
+    void store(const std::string& username, const CredentialRecord& record);
+
+    // Records read from the database. A registration that finished while the read was in flight
+    // has already stored a newer record, so an existing entry is kept.
+    void storeIfAbsent(const std::string& username, const CredentialRecord& record);
+
+    [[nodiscard]] u32 capacity() const noexcept { return capacity_; }
+
+private:
+    using Entry = std::pair<std::string, CredentialRecord>;
+
+    void insert(const std::string& username, const CredentialRecord& record);
+    void publishSize() const noexcept;
+
+private:
+    std::mutex mutex_;
+    u32 capacity_;
+    // most recently used first
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+} // namespace server
@@ -1,16 +1,35 @@
 #include "data_manager.h"
+#include "tracing.h"
 #include "utils.h"
 
 namespace server
 {
 
-DataManager::DataManager(DataBaseManager* dbManager, spdlog::logger* logger)
-    : logger_(logger), dbManager_(dbManager)
+// Messages sent to a client when it connects, older history is paged with HistoryQuery
+constexpr u32 INITIAL_HISTORY_MESSAGES = 200;
+// Largest page of search results, and how deep into the ranking a search can page
+constexpr u32 MAX_SEARCH_RESULTS = 100;
+constexpr u32 MAX_SEARCH_OFFSET = 10000;
+// Longest a history read waits for the write-behind thread to commit the messages before the join
+constexpr std::chrono::milliseconds HISTORY_COMMIT_TIMEOUT{1000};
+// Most client messages queued during the warm-up, later ones are answered with SERVER_ERROR
+constexpr std::size_t MAX_PENDING_MESSAGES = 10000;
+
+DataManager::DataManager(IUserStore* userStore, IMessageStore* messageStore, MessageWriter* messageWriter, spdlog::logger* logger, const DataManagerConfig& config)
+    : logger_(logger), messageStore_(messageStore), messageWriter_(messageWriter),
+      history_(messageStore, &userIds_, config.historyRingSize), workers_(config.workerThreads, logger),
+      auth_(userStore, &workers_, logger, config.credentialCacheSize)
 {
 }
 
 DataManager::~DataManager()
 {
+    // no new work once the io thread is gone, then let the workers finish what is queued
+    if (tcpServer_)
+    {
+        tcpServer_->stop();
+    }
+    workers_.stop();
 }
 
 void DataManager::connect(const std::string& ip, u16 port)
@@ -24,85 +43,353 @@ void DataManager::connect(const std::string& ip, u16 port)
     tcpServer_->on_disconnect([this](u64 id){onDisconnect(id);});
     tcpServer_->on_message([&](u64 id, const client::messages::ClientMessage& msg)
     {
-        std::visit(overloaded{
-            [id, this](const auto& value)
+        // cold caches would send every login of a reconnect burst to the store
+        if (!warm_)
+        {
+            if (pendingMessages_.size() >= MAX_PENDING_MESSAGES)
             {
-                manageMessageContent(id, value);
+                metrics::counters().warmUpRejectedMessages.fetch_add(1, std::memory_order_relaxed);
+                respond(id, ServerResponseCode::SERVER_ERROR);
+                return;
             }
-    }, msg);
+            pendingMessages_.emplace_back(id, msg);
+            metrics::counters().warmUpQueuedMessages.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        dispatch(id, msg);
     });
 
-    // start server
+    // start server, connections are accepted while the caches load
     tcpServer_->start();
+    warmUp();
+}
+
+void DataManager::dispatch(u64 id, const client::messages::ClientMessage& message)
+{
+    std::visit(overloaded{
+        [id, this](const auto& value)
+        {
+            constexpr auto type = std::decay_t<decltype(value)>::TYPE;
+            const metrics::ScopedTimer timer{metrics::handlerHistogram(type)};
+            const tracing::Span span{"handler", "type", static_cast<u64>(type)};
+            manageMessageContent(id, value);
+        }
+    }, message);
+}
+
+void DataManager::warmUp()
+{
+    logger_->info("Warming up the caches, client messages are queued until they are loaded");
+    metrics::counters().warmUpRunning.store(1, std::memory_order_relaxed);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto done = [this, start]
+    {
+        if (warmUpTasks_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            tcpServer_->post([this, start] { finishWarmUp(start); });
+        }
+    };
+
+    // nothing reads the ring or the last id before the queued messages are replayed
+    warmUpTasks_.store(2, std::memory_order_relaxed);
+    workers_.post([this, done]
+    {
+        const tracing::Span span{"warmup.history"};
+        const u32 loaded = history_.load();
+        lastMessageId_ = messageStore_->lastMessageId();
+        logger_->info("Loaded the {} newest messages into the history ring, last message id {}", loaded, lastMessageId_);
+        done();
+    });
+    workers_.post([this, done]
+    {
+        const tracing::Span span{"warmup.credentials"};
+        logger_->info("Loaded {} users into the credential cache", auth_.warmUp());
+        done();
+    });
+}
+
+void DataManager::finishWarmUp(std::chrono::steady_clock::time_point start)
+{
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    auto& counters = metrics::counters();
+    counters.warmUpDurationMs.store(static_cast<u64>(elapsed.count()), std::memory_order_relaxed);
+    counters.warmUpRunning.store(0, std::memory_order_relaxed);
+    logger_->info("Warm-up finished in {} ms, replaying {} queued messages", elapsed.count(), pendingMessages_.size());
+
+    warm_ = true;
+    while (!pendingMessages_.empty())
+    {
+        const auto [id, message] = std::move(pendingMessages_.front());
+        pendingMessages_.pop_front();
+        dispatch(id, message);
+    }
 }
 
 void DataManager::manageMessageContent(u64 id, const client::messages::Login& value)
 {
+    auth_.login(value.username, value.passwordHash, [this, id, username = value.username](ServerResponseCode code)
+    {
+        if (code != ServerResponseCode::SUCCESSFUL_LOGIN)
+        {
+            respond(id, code);
+            return;
+        }
+
+        // bound before the answer is queued, so the InitialConnection the client sends on it finds the login
+        tcpServer_->post([this, id, username, code]
+        {
+            logIn(id, username);
+            respond(id, code);
+        });
+    });
 }
 
 void DataManager::manageMessageContent(u64 id, const client::messages::Register& value)
 {
+    auth_.registerUser(value.username, value.passwordHash, [this, id, username = value.username](ServerResponseCode code)
+    {
+        if (code != ServerResponseCode::SUCCESSFUL_REGISTRATION)
+        {
+            respond(id, code);
+            return;
+        }
+
+        tcpServer_->post([this, id, username, code]
+        {
+            logIn(id, username);
+            respond(id, code);
+        });
+    });
 }
 
 void DataManager::manageMessageContent(u64 id, const client::messages::InitialConnection& value)
 {
-    logger_->info("New user connected message id {} with username {}", id, value.username);
+    const auto loggedIn = loggedIn_.find(id);
+    if (loggedIn == loggedIn_.end())
+    {
+        logger_->warn("Connection {} tried to join as {} without logging in", id, value.username);
+        respond(id, ServerResponseCode::NOT_LOGGED_IN);
+        return;
+    }
 
-    // Add user to users map
-    if (const auto it = currentUsers_.find(value.username); it == currentUsers_.end())
+    // the connection joins as the user it logged in as, whatever name the packet carries
+    const std::string& username = loggedIn->second;
+    if (value.username != username)
+    {
+        logger_->warn("Connection {} logged in as {} and asked to join as {}", id, username, value.username);
+    }
+    const auto userId = userIds_.intern(username);
+    if (!userId.has_value())
     {
-        // If its the first time a user is registered, we assign a random color
-        currentUsers_[value.username].color =  getRandomColor();
+        logger_->error("No user id left for {}, connection {} cannot join", username, id);
+        respond(id, ServerResponseCode::SERVER_ERROR);
+        return;
     }
-    currentUsers_[value.username].status = UserStatusType::ONLINE;
+    logger_->info("New user connected message id {} with username {}", id, username);
 
-    server::messages::UserStatus status;
-    status.timestamp = currentSecondsSinceEpoch();
-    status.status = currentUsers_.at(value.username).status;
-    status.username = value.username;
-    status.color = currentUsers_[status.username].color;
+    // everything written to the connection from here on, the history included, uses the encoding
+    if (!tcpServer_->setEncoding(id, value.encoding))
+    {
+        logger_->warn("Connection {} asked for unknown encoding {}, it stays on json", id, static_cast<u32>(value.encoding));
+    }
+    else if (value.encoding != WireEncoding::JSON)
+    {
+        logger_->info("Connection {} switched to {}", id, wire::encodingName(value.encoding));
+    }
+
+    // Add user to users map
+    setUserStatus(userId.value(), UserStatusType::ONLINE);
+
+    HistoryQuery history;
+    history.limit = INITIAL_HISTORY_MESSAGES;
 
+    // the ring hands out frames already encoded for the connection, they are queued without a copy
+    std::vector<wire::SharedFrame> frames;
+    std::vector<u32> authors;
+    frames.reserve(history.limit);
+    authors.reserve(history.limit);
+    const auto served = history_.getRecentFrames(history, tcpServer_->getEncoding(id),
+        [&frames, &authors](const server::messages::NewMessageReceived& message, const wire::SharedFrame& frame)
+        {
+            frames.push_back(frame);
+            authors.push_back(message.userId);
+        });
 
-    const auto previousMessages = dbManager_->getMessages();
-    for (const auto& previousMessage : previousMessages)
+    // pages older than the ring are read on a worker, from its own read connection
+    if (served.has_value())
     {
-        tcpServer_->write(id, previousMessage);
-    }
+        // ring frames name their authors by id, the names go first
+        std::ranges::sort(authors);
+        const auto [last, end] = std::ranges::unique(authors);
+        authors.erase(last, end);
 
-    for (const auto& [username, data] : currentUsers_)
+        server::messages::UserNames names;
+        names.users.reserve(authors.size());
+        for (const u32 author : authors)
+        {
+            // authors without an id are named in their messages
+            if (author != 0)
+            {
+                names.users.push_back({author, userIds_.name(author)});
+            }
+        }
+        if (!names.users.empty())
+        {
+            tcpServer_->write(id, std::move(names));
+        }
+        tcpServer_->writeFrames(id, server::messages::NewMessageReceived::TYPE, std::move(frames));
+    }
+    else
     {
-        server::messages::UserStatus currentUserStatus;
-        currentUserStatus.username = username;
-        currentUserStatus.status = data.status;
-        currentUserStatus.color = data.color;
-        currentUserStatus.timestamp = currentSecondsSinceEpoch();
+        // the page ends at the join, whatever is sent to the connection meanwhile waits behind it
+        const u64 joinedAt = lastMessageId_;
+        history.beforeId = joinedAt + 1;
+        tcpServer_->holdWrites(id);
 
-        tcpServer_->write(id, currentUserStatus);
+        workers_.post([this, id, history, joinedAt]
+        {
+            // messages accepted before the join can still be queued for the write-behind thread
+            if (!messageWriter_->waitForCommit(joinedAt, HISTORY_COMMIT_TIMEOUT))
+            {
+                logger_->warn("Messages up to {} are not committed yet, the history of connection {} can miss some", joinedAt, id);
+            }
+
+            std::vector<server::messages::ServerMessage> page;
+            page.reserve(history.limit);
+            messageStore_->getMessages(history, [&page](const server::messages::NewMessageReceived& previousMessage)
+            {
+                page.emplace_back(previousMessage);
+            });
+            tcpServer_->releaseWrites(id, std::move(page));
+        });
+    }
+
+    // users that went offline are left out, the replay only grows with the users online
+    for (u32 currentUser = 1; currentUser < currentUsers_.size(); ++currentUser)
+    {
+        if (currentUsers_[currentUser].has_value() && currentUsers_[currentUser]->status != UserStatusType::OFFLINE)
+        {
+            tcpServer_->write(id, makeUserStatus(currentUser));
+        }
     }
 
-    tcpServer_->addNewUsername(id, value.username);
-    tcpServer_->broadcast(status);
+    tcpServer_->addNewUser(id, userId.value());
+    tcpServer_->broadcast(makeUserStatus(userId.value()));
 }
 
 void DataManager::manageMessageContent(u64 id, const client::messages::NewMessage& value)
 {
+    const auto userId = tcpServer_->getUserId(id);
+    if (!userId.has_value())
+    {
+        logger_->warn("Connection {} sent a message before joining the chat", id);
+        respond(id, ServerResponseCode::NOT_LOGGED_IN);
+        return;
+    }
+
     logger_->info("User {} said {}", id, value.message);
 
     server::messages::NewMessageReceived received;
     received.timestamp = currentSecondsSinceEpoch();
     received.message = value.message;
+    received.id = ++lastMessageId_;
+    received.userId = userId.value();
+    received.username = userIds_.name(received.userId);
+
+    // persisted by the writer thread, the broadcast does not wait for the commit
+    history_.append(received);
+    messageWriter_->enqueue(received);
+
+    // every client got the name with the UserStatus of the author, only the id goes out
+    received.username.clear();
+    tcpServer_->broadcast(std::move(received));
+}
+
+void DataManager::manageMessageContent(u64 id, const client::messages::SearchMessages& value)
+{
+    SearchQuery query;
+    query.text = value.query.substr(0, MAX_MESSAGE_LENGTH);
+    query.limit = std::clamp<u32>(value.limit, 1, MAX_SEARCH_RESULTS);
+    query.offset = static_cast<u32>(std::min<u64>(static_cast<u64>(value.page) * query.limit, MAX_SEARCH_OFFSET));
+
+    // ranking reads the whole match list, so it never runs on the io thread
+    workers_.post([this, id, query, page = value.page]
+    {
+        server::messages::SearchResults results;
+        results.query = query.text;
+        results.page = page;
+
+        // one match past the page tells whether there is a next one
+        SearchQuery probe = query;
+        ++probe.limit;
+        const auto found = messageStore_->searchMessages(probe, [&results](const server::messages::NewMessageReceived& message)
+        {
+            results.messages.push_back(message);
+        });
+
+        if (!found.has_value())
+        {
+            respond(id, ServerResponseCode::SEARCH_UNAVAILABLE);
+            return;
+        }
+
+        results.hasMore = results.messages.size() > query.limit;
+        if (results.hasMore)
+        {
+            results.messages.pop_back();
+        }
+        tcpServer_->write(id, std::move(results));
+    });
+}
+
+void DataManager::logIn(u64 id, const std::string& username)
+{
+    // the connection can be gone by the time the store answered
+    if (tcpServer_->isConnected(id))
+    {
+        loggedIn_[id] = username;
+    }
+}
 
-    if (const auto username = tcpServer_->getUsername(id); username.has_value())
+void DataManager::setUserStatus(u32 userId, UserStatusType status)
+{
+    if (userId >= currentUsers_.size())
     {
-        received.username = username.value();
+        currentUsers_.resize(userId + 1);
     }
-    else
+
+    if (auto& user = currentUsers_[userId]; user.has_value())
     {
-        logger_->error("Invalid connection id {}", id);
+        metrics::changeUserStatus(user->status, status);
+        user->status = status;
+        return;
     }
 
-    dbManager_->addMessageEntry(received);
-    tcpServer_->broadcast(received);
+    // If its the first time a user is registered, we assign a random color
+    currentUsers_[userId] = UserData{status, getRandomColor()};
+    metrics::addUserWithStatus(status);
+}
+
+server::messages::UserStatus DataManager::makeUserStatus(u32 userId) const
+{
+    const auto& user = currentUsers_.at(userId).value();
+
+    server::messages::UserStatus status;
+    status.userId = userId;
+    status.username = userIds_.name(userId);
+    status.status = user.status;
+    status.color = user.color;
+    status.timestamp = currentSecondsSinceEpoch();
+    return status;
+}
+
+// Called from the worker threads, write only posts to the io thread
+void DataManager::respond(u64 id, ServerResponseCode code)
+{
+    server::messages::ServerResponse response;
+    response.code = code;
+    tcpServer_->write(id, response);
 }
 
 void DataManager::onConnect(u64 id)
@@ -113,22 +400,18 @@ void DataManager::onConnect(u64 id)
 void DataManager::onDisconnect(u64 id)
 {
     logger_->info("Disconnected client with id {}", id);
-    server::messages::UserStatus status;
-    status.timestamp = currentSecondsSinceEpoch();
-    status.status = UserStatusType::OFFLINE;
 
-    if (const auto username = tcpServer_->getUsername(id); username.has_value())
-    {
-        status.username = username.value();
-        status.color = currentUsers_[status.username].color;
-        currentUsers_[status.username].status = UserStatusType::OFFLINE;
-    }
-    else
+    // a login replayed after the warm-up would answer a connection that is gone
+    std::erase_if(pendingMessages_, [id](const auto& pending) { return pending.first == id; });
+    loggedIn_.erase(id);
+
+    // connections that never joined the chat have no status to change
+    if (const auto userId = tcpServer_->getUserId(id); userId.has_value())
     {
-        logger_->error("Invalid connection id {}", id);
+        tcpServer_->removeUser(id);
+        setUserStatus(userId.value(), UserStatusType::OFFLINE);
+        tcpServer_->broadcast(makeUserStatus(userId.value()));
     }
-
-    tcpServer_->broadcast(status);
 }
 
 }
@@ -1,15 +1,32 @@
 #pragma once
 
-#include "db_manager.h"
+#include "auth_service.h"
+#include "message_history.h"
+#include "message_writer.h"
 #include "tcp_server.h"
+#include "user_directory.h"
+
+// std
+#include <atomic>
+#include <deque>
 
 namespace server
 {
 
+struct DataManagerConfig
+{
+    // recent messages kept in memory, 0 disables the ring
+    u32 historyRingSize = 1000;
+    // threads running database lookups off the io thread
+    u32 workerThreads = 2;
+    // credential records kept by the auth cache
+    u32 credentialCacheSize = 10000;
+};
+
 class DataManager
 {
 public:
-    DataManager(DataBaseManager* dbManager, spdlog::logger* logger);
+    DataManager(IUserStore* userStore, IMessageStore* messageStore, MessageWriter* messageWriter, spdlog::logger* logger, const DataManagerConfig& config);
     ~DataManager();
 
 public:
@@ -20,19 +37,47 @@ public:
     void manageMessageContent(u64 id, const client::messages::Register &value);
     void manageMessageContent(u64 id, const client::messages::InitialConnection &value);
     void manageMessageContent(u64 id, const client::messages::NewMessage &value);
+    void manageMessageContent(u64 id, const client::messages::SearchMessages &value);
 
 private:
+    void dispatch(u64 id, const client::messages::ClientMessage& message);
+    // Loads the history ring and the credential cache on the workers, client messages are queued
+    // until both are done and replayed in order on the io thread
+    void warmUp();
+    void finishWarmUp(std::chrono::steady_clock::time_point start);
+
     void onConnect(u64 id);
     void onDisconnect(u64 id);
+    // Called on the io thread once a login or registration of the connection succeeded
+    void logIn(u64 id, const std::string& username);
+    void setUserStatus(u32 userId, UserStatusType status);
+    [[nodiscard]] server::messages::UserStatus makeUserStatus(u32 userId) const;
+    void respond(u64 id, ServerResponseCode code);
 
 private:
     spdlog::logger* logger_;
-    DataBaseManager* dbManager_;
+    IMessageStore* messageStore_;
+    MessageWriter* messageWriter_;
+    UserDirectory userIds_;
+    MessageHistory history_;
+    WorkerPool workers_;
+    AuthService auth_;
     std::unique_ptr<TcpServerMulti> tcpServer_;
 
 private:
     // data containers
-    std::map<std::string, UserData> currentUsers_;
+    // username each connection logged in or registered as, only those can join the chat
+    std::unordered_map<u64, std::string> loggedIn_;
+    // indexed by user id, empty for users that have not connected since the server started
+    std::vector<std::optional<UserData>> currentUsers_;
+    // id of the last message accepted, ids are assigned here so broadcasts carry them before the row is written
+    u64 lastMessageId_{0};
+
+    // warm-up state, only used from the io thread
+    bool warm_{false};
+    std::deque<std::pair<u64, client::messages::ClientMessage>> pendingMessages_;
+    // warm-up tasks still running on the workers
+    std::atomic<u32> warmUpTasks_{0};
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "database_backup.h"
+#include "metrics.h"
+
+// std
+#include <algorithm>
+#include <filesystem>
+
+namespace server
+{
+
+namespace
+{
+
+constexpr std::string_view BACKUP_PREFIX = "backup-";
+constexpr std::string_view BACKUP_EXTENSION = ".db";
+constexpr u32 MAX_PAGES_PER_STEP = 16 * 1024;
+
+}
+
+DatabaseBackup::DatabaseBackup(DataBaseManager* dbManager, spdlog::logger* logger, const DatabaseBackupConfig& config)
+    : dbManager_(dbManager), logger_(logger), config_(config)
+{
+    config_.pagesPerStep = std::clamp<u32>(config_.pagesPerStep, 1, MAX_PAGES_PER_STEP);
+    config_.keep = std::max<u32>(1, config_.keep);
+
+    if (config_.directory.empty())
+    {
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(config_.directory, ec);
+    if (ec)
+    {
+        logger_->error("Backups are disabled, could not create {}: {}", config_.directory, ec.message());
+        return;
+    }
+
+    if (config_.interval.count() > 0)
+    {
+        logger_->info("Backing up the database into {} every {} s, keeping {}", config_.directory, config_.interval.count(), config_.keep);
+    }
+    else
+    {
+        logger_->info("Backing up the database into {} on request, keeping {}", config_.directory, config_.keep);
+    }
+
+    thread_ = std::thread([this]
+    {
+        run();
+    });
+}
+
+DatabaseBackup::~DatabaseBackup()
+{
+    stop();
+}
+
+bool DatabaseBackup::request()
+{
+    {
+        const std::lock_guard lock(mutex_);
+        if (!thread_.joinable() || stopping_ || requested_ || running_)
+        {
+            return false;
+        }
+        requested_ = true;
+    }
+    cv_.notify_all();
+    return true;
+}
+
+void DatabaseBackup::stop()
+{
+    {
+        const std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void DatabaseBackup::run()
+{
+    std::unique_lock lock(mutex_);
+    while (true)
+    {
+        const auto wake = [this] { return stopping_ || requested_; };
+        if (config_.interval.count() > 0)
+        {
+            // a scheduled backup is due when the wait times out
+            requested_ = cv_.wait_for(lock, config_.interval, wake) ? requested_ : true;
+        }
+        else
+        {
+            cv_.wait(lock, wake);
+        }
+
+        if (stopping_)
+        {
+            return;
+        }
+
+        requested_ = false;
+        running_ = true;
+        lock.unlock();
+        backup();
+        lock.lock();
+        running_ = false;
+    }
+}
+
+void DatabaseBackup::backup()
+{
+    const auto name = fmt::format("{}{}{}", BACKUP_PREFIX, currentSecondsSinceEpoch(), BACKUP_EXTENSION);
+    const auto path = std::filesystem::path(config_.directory) / name;
+    const std::string partial = path.string() + ".part";
+
+    auto& counters = metrics::counters();
+    counters.backupRunning.store(1, std::memory_order_relaxed);
+
+    const auto start = std::chrono::steady_clock::now();
+    u32 pages = config_.pagesPerStep;
+    const bool copied = dbManager_->backup(partial, pages, [&](const BackupProgress& progress) -> u32
+    {
+        counters.backupPagesTotal.store(progress.total, std::memory_order_relaxed);
+        counters.backupPagesRemaining.store(progress.remaining, std::memory_order_relaxed);
+
+        // halve the step when it held the lock past the budget, grow it back when well under
+        if (progress.step > config_.stepBudget)
+        {
+            pages = std::max<u32>(1, pages / 2);
+        }
+        else if (progress.step < config_.stepBudget / 2)
+        {
+            pages = std::min(pages * 2, MAX_PAGES_PER_STEP);
+        }
+
+        std::unique_lock lock(mutex_);
+        return cv_.wait_for(lock, config_.stepPause, [this] { return stopping_; }) ? 0 : pages;
+    });
+
+    std::error_code ec;
+    if (copied)
+    {
+        std::filesystem::rename(partial, path, ec);
+    }
+    counters.backupRunning.store(0, std::memory_order_relaxed);
+    counters.backupPagesRemaining.store(0, std::memory_order_relaxed);
+
+    if (!copied || ec)
+    {
+        std::filesystem::remove(partial, ec);
+        counters.backupsFailed.fetch_add(1, std::memory_order_relaxed);
+        logger_->error("Backup {} did not complete", path.string());
+        return;
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    counters.backupsCompleted.fetch_add(1, std::memory_order_relaxed);
+    counters.backupLastDurationMs.store(static_cast<u64>(elapsed.count()), std::memory_order_relaxed);
+    counters.backupLastSuccess.store(currentSecondsSinceEpoch(), std::memory_order_relaxed);
+    logger_->info("Backed up {} pages into {} in {} ms", counters.backupPagesTotal.load(std::memory_order_relaxed), path.string(), elapsed.count());
+
+    removeOldBackups();
+}
+
+void DatabaseBackup::removeOldBackups() const
+{
+    std::vector<std::filesystem::path> backups;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(config_.directory, ec))
+    {
+        const std::string name = entry.path().filename().string();
+        if (entry.is_regular_file() && name.starts_with(BACKUP_PREFIX) && entry.path().extension() == BACKUP_EXTENSION)
+        {
+            backups.push_back(entry.path());
+        }
+    }
+
+    if (backups.size() <= config_.keep)
+    {
+        return;
+    }
+
+    // unix times have the same number of digits until 2286, so names sort by age
+    std::sort(backups.begin(), backups.end());
+    for (std::size_t i = 0; i + config_.keep < backups.size(); ++i)
+    {
+        if (std::filesystem::remove(backups[i], ec))
+        {
+            logger_->info("Removed old backup {}", backups[i].string());
+        }
+    }
+}
+
+} // namespace server
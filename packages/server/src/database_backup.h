@@ -0,0 +1,68 @@
+#pragma once
+
+#include "db_manager.h"
+
+// std
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace server
+{
+
+struct DatabaseBackupConfig
+{
+    // folder the backups are written to, empty disables backups
+    std::string directory;
+    // time between scheduled backups, 0 only backs up on request
+    std::chrono::seconds interval{0};
+    // backups kept in the folder, older ones are deleted
+    u32 keep = 3;
+    // pages copied by the first step, later steps are sized to the step budget
+    u32 pagesPerStep = 64;
+    // longest a step should hold the write lock, the DB writer waits at most that long for it
+    std::chrono::microseconds stepBudget{2000};
+    // pause between two steps
+    std::chrono::milliseconds stepPause{5};
+};
+
+// Background job copying the live database into backup-<unix time>.db files, on a schedule or
+// when an admin asks for one. The copy is made in small steps with pauses in between, and the
+// step size follows how long the last step held the write lock, so message commits keep their
+// latency while a backup runs.
+class DatabaseBackup
+{
+public:
+    DatabaseBackup(DataBaseManager* dbManager, spdlog::logger* logger, const DatabaseBackupConfig& config = {});
+    ~DatabaseBackup();
+
+    DatabaseBackup(const DatabaseBackup&) = delete;
+    DatabaseBackup& operator=(const DatabaseBackup&) = delete;
+
+public:
+    // Starts a backup on the background thread, false if backups are disabled or one is already
+    // pending or running
+    [[nodiscard]] bool request();
+    // Aborts the running backup and joins the thread
+    void stop();
+
+private:
+    void run();
+    void backup();
+    void removeOldBackups() const;
+
+private:
+    DataBaseManager* dbManager_;
+    spdlog::logger* logger_;
+    DatabaseBackupConfig config_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_{false};
+    bool requested_{false};
+    bool running_{false};
+    std::thread thread_;
+};
+
+} // namespace server
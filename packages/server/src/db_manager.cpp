@@ -1,8 +1,14 @@
 #include "db_manager.h"
+#include "archive_codec.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "tracing.h"
 
+#include <algorithm>
 #include <cassert>
-
-static constexpr std::string_view defaultDbPath = "chat.db";
+#include <cstdlib>
+#include <limits>
+#include <map>
 
 static constexpr std::string_view createMessagesTableSQL = R"SQL(
 CREATE TABLE IF NOT EXISTS messages (
@@ -11,6 +17,7 @@ CREATE TABLE IF NOT EXISTS messages (
     message   TEXT    NOT NULL,
     timestamp INTEGER NOT NULL
 );
+CREATE INDEX IF NOT EXISTS idx_messages_timestamp ON messages (timestamp);
 )SQL";
 
 
@@ -18,14 +25,183 @@ static constexpr std::string_view createUsersTableSQL = R"SQL(
 CREATE TABLE IF NOT EXISTS users (
     id        INTEGER PRIMARY KEY AUTOINCREMENT,
     username  TEXT    NOT NULL,
-    password  TEXT    NOT NULL
+    password  INTEGER NOT NULL
+);
+CREATE UNIQUE INDEX IF NOT EXISTS idx_users_username ON users (username);
+)SQL";
+
+// Messages past the retention policy and closed message blocks, moved out of the live table in runs
+// of consecutive ids. Segments never overlap, so ordering them by first_id or last_id is the same.
+// layout is the server::archive::Layout the data is encoded with.
+static constexpr std::string_view createArchiveTableSQL = R"SQL(
+CREATE TABLE IF NOT EXISTS message_archive (
+    first_id      INTEGER PRIMARY KEY,
+    last_id       INTEGER NOT NULL,
+    min_timestamp INTEGER NOT NULL,
+    max_timestamp INTEGER NOT NULL,
+    row_count     INTEGER NOT NULL,
+    raw_size      INTEGER NOT NULL,
+    data          BLOB    NOT NULL,
+    layout        INTEGER NOT NULL DEFAULT 0
 );
+CREATE UNIQUE INDEX IF NOT EXISTS idx_message_archive_last_id ON message_archive (last_id);
 )SQL";
 
-DataBaseManager::DataBaseManager(spdlog::logger *logger)
-    : logger_(logger)
+// Full-text index over the message bodies. It stores no copy of the text (external content on
+// messages), the index is updated next to every insert and every archived range. Packed blocks
+// stay indexed, their text is only in the block.
+static constexpr std::string_view createSearchTableSQL = R"SQL(
+CREATE VIRTUAL TABLE IF NOT EXISTS messages_fts USING fts5 (message, content='messages', content_rowid='id');
+)SQL";
+
+// History pages are keyset ranges on the primary key, so every page is a rowid seek plus at most
+// limit rows no matter how large the table is. Time windows are turned into id bounds through the
+// timestamp index first (ids and timestamps grow together), the timestamp test in the page
+// queries only trims the edges.
+static constexpr std::array<std::string_view, 25> statementsSQL = {
+    // INSERT_MESSAGE
+    "INSERT INTO messages (id, username, message, timestamp) VALUES (?, ?, ?, ?);",
+    // SELECT_HISTORY_FORWARD
+    "SELECT id, username, message, timestamp FROM messages"
+    " WHERE id > ?1 AND id < ?2 AND timestamp BETWEEN ?3 AND ?4 ORDER BY id ASC LIMIT ?5;",
+    // SELECT_HISTORY_BACKWARD
+    "SELECT id, username, message, timestamp FROM (SELECT id, username, message, timestamp FROM messages"
+    " WHERE id > ?1 AND id < ?2 AND timestamp BETWEEN ?3 AND ?4 ORDER BY id DESC LIMIT ?5) ORDER BY id ASC;",
+    // FIRST_ID_FROM_TIME
+    "SELECT id FROM messages WHERE timestamp >= ? ORDER BY timestamp ASC, id ASC LIMIT 1;",
+    // LAST_ID_UNTIL_TIME
+    "SELECT id FROM messages WHERE timestamp <= ? ORDER BY timestamp DESC, id DESC LIMIT 1;",
+    // LAST_MESSAGE_ID
+    "SELECT MAX(COALESCE((SELECT MAX(id) FROM messages), 0), COALESCE((SELECT MAX(last_id) FROM message_archive), 0));",
+    // NTH_NEWEST_ID
+    "SELECT id FROM messages ORDER BY id DESC LIMIT 1 OFFSET ?;",
+    // SELECT_OLDEST
+    "SELECT id, username, message, timestamp FROM messages WHERE id <= ?1 ORDER BY id ASC LIMIT ?2;",
+    // DELETE_UP_TO
+    "DELETE FROM messages WHERE id BETWEEN ?1 AND ?2;",
+    // INSERT_SEGMENT
+    "INSERT INTO message_archive (first_id, last_id, min_timestamp, max_timestamp, row_count, raw_size, data, layout)"
+    " VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+    // SELECT_SEGMENTS_FORWARD
+    "SELECT raw_size, data, layout FROM message_archive"
+    " WHERE last_id > ?1 AND first_id < ?2 AND max_timestamp >= ?3 AND min_timestamp <= ?4 ORDER BY last_id ASC;",
+    // SELECT_SEGMENTS_BACKWARD
+    "SELECT raw_size, data, layout FROM message_archive"
+    " WHERE last_id > ?1 AND first_id < ?2 AND max_timestamp >= ?3 AND min_timestamp <= ?4 ORDER BY first_id DESC;",
+    // HAS_SEGMENTS
+    "SELECT EXISTS (SELECT 1 FROM message_archive);",
+    // INSERT_SEARCH
+    "INSERT INTO messages_fts (rowid, message) VALUES (?, ?);",
+    // DELETE_SEARCH_RANGE
+    "INSERT INTO messages_fts (messages_fts, rowid, message) SELECT 'delete', id, message FROM messages WHERE id BETWEEN ?1 AND ?2;",
+    // SEARCH_MESSAGES
+    "SELECT m.id, m.username, m.message, m.timestamp FROM messages_fts JOIN messages AS m ON m.id = messages_fts.rowid"
+    " WHERE messages_fts MATCH ?1 ORDER BY messages_fts.rank, m.id DESC LIMIT ?2 OFFSET ?3;",
+    // SEARCH_IDS
+    "SELECT rowid FROM messages_fts WHERE messages_fts MATCH ?1 ORDER BY rank, rowid DESC LIMIT ?2 OFFSET ?3;",
+    // SELECT_MESSAGE
+    "SELECT id, username, message, timestamp FROM messages WHERE id = ?;",
+    // SELECT_BLOCK
+    "SELECT first_id, raw_size, data, layout FROM message_archive WHERE first_id <= ? ORDER BY first_id DESC LIMIT 1;",
+    // INSERT_USER
+    "INSERT INTO users (username, password) VALUES (?, ?);",
+    // USER_PASSWORD_HASH
+    "SELECT password FROM users WHERE username = ? LIMIT 1;",
+    // SELECT_USERS
+    "SELECT username, password FROM users ORDER BY id DESC LIMIT ?;",
+    // BEGIN
+    "BEGIN IMMEDIATE;",
+    // COMMIT
+    "COMMIT;",
+    // ROLLBACK
+    "ROLLBACK;",
+};
+
+static constexpr std::array<DatabaseSettings, 3> profiles = {{
+    {"strict", "DELETE", "FULL", 0, -2000, 1000, false},
+    {"balanced", "WAL", "NORMAL", 64ll * 1024 * 1024, -16 * 1024, 1000, true},
+    {"fast", "WAL", "OFF", 256ll * 1024 * 1024, -64 * 1024, 10000, true},
+}};
+
+const DatabaseSettings& databaseSettings(DurabilityProfile profile) noexcept
+{
+    return profiles[static_cast<std::size_t>(profile)];
+}
+
+// Messages without a server assigned id get the next AUTOINCREMENT value
+static void bindMessage(sqlite3_stmt* stmt, const server::messages::NewMessageReceived& message) noexcept
+{
+    if (message.id != 0)
+    {
+        sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(message.id));
+    }
+    else
+    {
+        sqlite3_bind_null(stmt, 1);
+    }
+    sqlite3_bind_text(stmt, 2, message.username.c_str(), static_cast<int>(message.username.size()), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, message.message.c_str(), static_cast<int>(message.message.size()), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(message.timestamp));
+}
+
+// Reads a (id, username, message, timestamp) row
+static void readMessage(sqlite3_stmt* stmt, server::messages::NewMessageReceived& row) noexcept
+{
+    const auto* u = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    const auto* m = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+
+    row.id = static_cast<u64>(sqlite3_column_int64(stmt, 0));
+    row.username.assign(u ? u : "", static_cast<std::size_t>(sqlite3_column_bytes(stmt, 1)));
+    row.message.assign(m ? m : "", static_cast<std::size_t>(sqlite3_column_bytes(stmt, 2)));
+    row.timestamp = static_cast<u64>(sqlite3_column_int64(stmt, 3));
+}
+
+// User text as an FTS5 query. Every word is quoted, so nothing the user types is query syntax,
+// and the last one also matches as a prefix. Words are ANDed.
+static std::string matchExpression(std::string_view text)
+{
+    const auto space = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+
+    std::string match;
+    std::size_t i = 0;
+    while (i < text.size())
+    {
+        if (space(text[i]))
+        {
+            ++i;
+            continue;
+        }
+
+        if (!match.empty())
+        {
+            match += ' ';
+        }
+        match += '"';
+        for (; i < text.size() && !space(text[i]); ++i)
+        {
+            if (text[i] == '"')
+            {
+                match += '"';
+            }
+            match += text[i];
+        }
+        match += '"';
+    }
+
+    if (!match.empty())
+    {
+        match += '*';
+    }
+    return match;
+}
+
+DataBaseManager::DataBaseManager(spdlog::logger *logger, const DatabaseConfig& config)
+    : logger_(logger), profile_(config.profile), retention_(config.retention), blockMessages_(config.blockMessages)
 {
-    if (const int rc = sqlite3_open(defaultDbPath.data(), &db_); rc != SQLITE_OK)
+    static_assert(statementsSQL.size() == static_cast<std::size_t>(Statement::COUNT), "every statement needs its SQL");
+
+    constexpr int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX;
+    if (const int rc = sqlite3_open_v2(config.path.c_str(), &db_, flags, nullptr); rc != SQLITE_OK)
     {
         const std::string err = sqlite3_errmsg(db_ ? db_ : nullptr);
         if (db_)
@@ -35,37 +211,242 @@ DataBaseManager::DataBaseManager(spdlog::logger *logger)
         logger_->error("Failed to open SQLite DB: {}", err);
     }
 
+    sqlite3_extended_result_codes(db_, 1);
+    const bool wal = applyProfile();
     ensureSchema();
+    prepareStatements(db_, statements_);
+
+    search_ = statements_[static_cast<std::size_t>(Statement::INSERT_SEARCH)] != nullptr;
+    if (!search_)
+    {
+        logger_->warn("Message search is disabled, SQLite was built without FTS5");
+    }
+
+    if (blockMessages_ != 0 && retention_.enabled())
+    {
+        // the archive is kept whole, expired messages would be packed into blocks anyway
+        logger_->warn("Retention has no effect with message blocks of {} messages", blockMessages_);
+        retention_ = {};
+    }
+
+    archive_ = retention_.enabled() || blockMessages_ != 0;
+    if (const auto stmt = statement(Statement::HAS_SEGMENTS); stmt && sqlite3_step(stmt.get()) == SQLITE_ROW)
+    {
+        archive_ = archive_ || sqlite3_column_int(stmt.get(), 0) != 0;
+    }
+
+    u64 liveRows = 0;
+    sqlite3_exec(db_, "SELECT COUNT(*) FROM messages;", [](void* out, int, char** values, char**)
+    {
+        *static_cast<u64*>(out) = values[0] ? std::strtoull(values[0], nullptr, 10) : 0;
+        return 0;
+    }, &liveRows, nullptr);
+    liveRows_ = liveRows;
+
+    if (blockMessages_ != 0)
+    {
+        logger_->info("Storing messages in blocks of {}, {} messages are in the live table", blockMessages_, liveRows);
+        // rows from before the block layout, or from a larger block size, are packed once
+        packClosedBlocks();
+    }
+
+    if (config.readConnections > 0)
+    {
+        if (wal)
+        {
+            openReadConnections(config.path, config.readConnections);
+        }
+        else
+        {
+            logger_->warn("Read connections need WAL, profile {} runs every query on the writer connection", databaseSettings(profile_).name);
+        }
+    }
 }
 
 DataBaseManager::~DataBaseManager()
 {
+    for (auto& reader : readers_)
+    {
+        for (auto& stmt : reader->statements)
+        {
+            finalizeSilently(stmt);
+        }
+        sqlite3_close(reader->db);
+    }
+    readers_.clear();
+
+    for (auto& stmt : statements_)
+    {
+        finalizeSilently(stmt);
+        stmt = nullptr;
+    }
+
     if (db_)
     {
+        if (databaseSettings(profile_).checkpointOnClose)
+        {
+            sqlite3_exec(db_, "PRAGMA wal_checkpoint(TRUNCATE);", nullptr, nullptr, nullptr);
+        }
         sqlite3_close(db_);
         db_ = nullptr;
     }
 }
 
+bool DataBaseManager::applyProfile() const noexcept
+{
+    const auto& settings = databaseSettings(profile_);
+    const std::string pragmas = fmt::format(
+        "PRAGMA journal_mode={}; PRAGMA synchronous={}; PRAGMA mmap_size={}; PRAGMA cache_size={}; PRAGMA wal_autocheckpoint={};",
+        settings.journalMode, settings.synchronous, settings.mmapSize, settings.cacheSize, settings.walAutoCheckpoint);
+
+    if (!exec(pragmas.c_str(), fmt::format("apply database profile {}", settings.name)))
+    {
+        return false;
+    }
+
+    // journal_mode silently keeps the old mode when the file system cannot support the new one
+    std::string journalMode;
+    sqlite3_exec(db_, "PRAGMA journal_mode;", [](void* out, int, char** values, char**)
+    {
+        *static_cast<std::string*>(out) = values[0] ? values[0] : "";
+        return 0;
+    }, &journalMode, nullptr);
+
+    logger_->info("Database profile {}: journal_mode={} synchronous={} mmap_size={} cache_size={} wal_autocheckpoint={}",
+        settings.name, journalMode, settings.synchronous, settings.mmapSize, settings.cacheSize, settings.walAutoCheckpoint);
+
+    return journalMode == "wal";
+}
+
+void DataBaseManager::openReadConnections(const std::string& path, u32 count)
+{
+    const auto& settings = databaseSettings(profile_);
+    const std::string pragmas = fmt::format("PRAGMA mmap_size={}; PRAGMA cache_size={};", settings.mmapSize, settings.cacheSize);
+
+    constexpr int flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_FULLMUTEX;
+    for (u32 i = 0; i < count; ++i)
+    {
+        auto reader = std::make_unique<ReadConnection>();
+        if (const int rc = sqlite3_open_v2(path.c_str(), &reader->db, flags, nullptr); rc != SQLITE_OK)
+        {
+            logger_->error("Failed to open read connection: {}", sqlite3_errmsg(reader->db));
+            sqlite3_close(reader->db);
+            break;
+        }
+
+        sqlite3_extended_result_codes(reader->db, 1);
+        // only a checkpoint restarting the WAL can make a reader wait
+        sqlite3_busy_timeout(reader->db, 1000);
+        sqlite3_exec(reader->db, pragmas.c_str(), nullptr, nullptr, nullptr);
+        prepareStatements(reader->db, reader->statements);
+        readers_.emplace_back(std::move(reader));
+    }
+
+    logger_->info("Opened {} read connections", readers_.size());
+}
+
 void DataBaseManager::ensureSchema() const noexcept
 {
-    char* errMsg = nullptr;
+    std::ignore = exec(createMessagesTableSQL.data(), "ensure schema");
+    std::ignore = exec(createUsersTableSQL.data(), "ensure schema");
+    std::ignore = exec(createArchiveTableSQL.data(), "ensure schema");
 
-    if (const int rc = sqlite3_exec(db_, createMessagesTableSQL.data(), nullptr, nullptr, &errMsg); rc != SQLITE_OK)
+    // archives from before the block layout only hold row segments
+    bool layout = false;
+    sqlite3_exec(db_, "SELECT 1 FROM pragma_table_info('message_archive') WHERE name = 'layout';", [](void* out, int, char**, char**)
     {
-        std::string err = errMsg ? errMsg : "unknown error";
-        sqlite3_free(errMsg);
-        logger_->error("Failed to ensure schema: {}" ,err);
+        *static_cast<bool*>(out) = true;
+        return 0;
+    }, &layout, nullptr);
+
+    if (!layout)
+    {
+        std::ignore = exec("ALTER TABLE message_archive ADD COLUMN layout INTEGER NOT NULL DEFAULT 0;", "ensure schema");
+    }
+
+    bool indexed = false;
+    sqlite3_exec(db_, "SELECT 1 FROM sqlite_master WHERE name = 'messages_fts';", [](void* out, int, char**, char**)
+    {
+        *static_cast<bool*>(out) = true;
+        return 0;
+    }, &indexed, nullptr);
+
+    if (!exec(createSearchTableSQL.data(), "create the search index"))
+    {
+        return;
     }
 
-    if (const int rc = sqlite3_exec(db_, createUsersTableSQL.data(), nullptr, nullptr, &errMsg); rc != SQLITE_OK)
+    // databases from before the index existed are indexed once
+    if (!indexed)
+    {
+        std::ignore = exec("INSERT INTO messages_fts (messages_fts) VALUES ('rebuild');", "build the search index");
+    }
+}
+
+bool DataBaseManager::exec(const char* sql, std::string_view action) const noexcept
+{
+    char* errMsg = nullptr;
+    if (const int rc = sqlite3_exec(db_, sql, nullptr, nullptr, &errMsg); rc != SQLITE_OK)
     {
         std::string err = errMsg ? errMsg : "unknown error";
         sqlite3_free(errMsg);
-        logger_->error("Failed to ensure schema: {}" ,err);
+        logger_->error("Failed to {}: {}", action, err);
+        return false;
+    }
+    return true;
+}
+
+void DataBaseManager::prepareStatements(sqlite3* db, Statements& statements) const noexcept
+{
+    for (std::size_t i = 0; i < statements.size(); ++i)
+    {
+        if (const int rc = sqlite3_prepare_v3(db, statementsSQL[i].data(), static_cast<int>(statementsSQL[i].size()),
+                                              SQLITE_PREPARE_PERSISTENT, &statements[i], nullptr); rc != SQLITE_OK)
+        {
+            logger_->error("Failed to prepare statement '{}': {}", statementsSQL[i], sqlite3_errmsg(db));
+            finalizeSilently(statements[i]);
+            statements[i] = nullptr;
+        }
+    }
+}
+
+DataBaseManager::CachedStatement DataBaseManager::statement(Statement statement) const noexcept
+{
+    const auto index = static_cast<std::size_t>(statement);
+    return CachedStatement{statements_[index], statementMutexes_[index]};
+}
+
+DataBaseManager::CachedStatement DataBaseManager::readStatement(Statement statement) const noexcept
+{
+    if (readers_.empty())
+    {
+        return this->statement(statement);
+    }
+
+    // threads stick to one connection, with as many connections as workers nobody shares
+    static std::atomic<u32> nextReader{0};
+    thread_local const u32 slot = nextReader.fetch_add(1, std::memory_order_relaxed);
+
+    const auto& reader = *readers_[slot % readers_.size()];
+    const auto index = static_cast<std::size_t>(statement);
+    return CachedStatement{reader.statements[index], reader.mutexes[index]};
+}
+
+DataBaseManager::CachedStatement::~CachedStatement()
+{
+    if (stmt_)
+    {
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
     }
 }
 
+bool DataBaseManager::execute(Statement statement) const noexcept
+{
+    const auto stmt = this->statement(statement);
+    return stmt && sqlite3_step(stmt.get()) == SQLITE_DONE;
+}
+
 void DataBaseManager::finalizeSilently(sqlite3_stmt* stmt) noexcept
 {
     if (stmt)
@@ -76,79 +457,831 @@ void DataBaseManager::finalizeSilently(sqlite3_stmt* stmt) noexcept
 
 void DataBaseManager::addMessageEntry(const server::messages::NewMessageReceived& message)
 {
-    static constexpr std::string_view kInsertSQL =
-        "INSERT INTO messages (username, message, timestamp) VALUES (?, ?, ?);";
+    {
+        const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::INSERT_MESSAGE)};
+        const server::tracing::Span span{"db.addMessageEntry"};
+
+        const std::lock_guard lock(writeMutex_);
+        const auto stmt = statement(Statement::INSERT_MESSAGE);
+        if (!stmt)
+        {
+            logger_->error("INSERT statement is not prepared");
+            return;
+        }
+
+        bindMessage(stmt.get(), message);
+
+        if (const int rc = sqlite3_step(stmt.get()); rc != SQLITE_DONE)
+        {
+            logger_->error("Failed to execute INSERT: {}", sqlite3_errmsg(db_));
+            return;
+        }
+        liveRows_.fetch_add(1, std::memory_order_relaxed);
+
+        if (!indexMessage(sqlite3_last_insert_rowid(db_), message))
+        {
+            logger_->error("Failed to index message {} for search: {}", sqlite3_last_insert_rowid(db_), sqlite3_errmsg(db_));
+        }
+    }
+
+    packClosedBlocks();
+}
+
+bool DataBaseManager::addMessageEntries(const std::vector<server::messages::NewMessageReceived>& messages)
+{
+    bool inserted;
+    {
+        const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::COMMIT_BATCH)};
+        const std::lock_guard lock(writeMutex_);
+        inserted = insertMessages(messages);
+    }
 
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, kInsertSQL.data(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK)
+    // packed outside the batch, the block is compressed without holding the write lock
+    if (inserted)
     {
-        const std::string err = sqlite3_errmsg(db_);
-        finalizeSilently(stmt);
-        logger_->error("Failed to prepare INSERT: {}", err);
+        packClosedBlocks();
+    }
+    return inserted;
+}
+
+bool DataBaseManager::insertMessages(const std::vector<server::messages::NewMessageReceived>& messages)
+{
+    if (!execute(Statement::BEGIN))
+    {
+        logger_->error("Failed to begin transaction: {}", sqlite3_errmsg(db_));
+        return false;
+    }
+
+    const auto stmt = statement(Statement::INSERT_MESSAGE);
+    bool ok = static_cast<bool>(stmt);
+    for (std::size_t i = 0; ok && i < messages.size(); ++i)
+    {
+        bindMessage(stmt.get(), messages[i]);
+
+        ok = sqlite3_step(stmt.get()) == SQLITE_DONE && indexMessage(sqlite3_last_insert_rowid(db_), messages[i]);
+        sqlite3_reset(stmt.get());
+    }
+
+    if (ok && execute(Statement::COMMIT))
+    {
+        liveRows_.fetch_add(messages.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    logger_->error("Failed to insert a batch of {} messages: {}", messages.size(), sqlite3_errmsg(db_));
+    if (!execute(Statement::ROLLBACK))
+    {
+        logger_->error("Failed to roll back: {}", sqlite3_errmsg(db_));
+    }
+    return false;
+}
+
+bool DataBaseManager::indexMessage(i64 id, const server::messages::NewMessageReceived& message) const noexcept
+{
+    if (!search_ || bulkLoad_)
+    {
+        return true;
+    }
+
+    const auto stmt = statement(Statement::INSERT_SEARCH);
+    sqlite3_bind_int64(stmt.get(), 1, id);
+    sqlite3_bind_text(stmt.get(), 2, message.message.c_str(), static_cast<int>(message.message.size()), SQLITE_STATIC);
+    return sqlite3_step(stmt.get()) == SQLITE_DONE;
+}
+
+void DataBaseManager::packClosedBlocks()
+{
+    if (blockMessages_ == 0)
+    {
+        return;
+    }
+
+    // one thread packs at a time, it also packs what the others add meanwhile
+    const std::unique_lock lock(packMutex_, std::try_to_lock);
+    if (!lock.owns_lock())
+    {
+        return;
+    }
+
+    // every block holds the oldest live rows, so the live table keeps the newest as the open block
+    while (liveRows_.load(std::memory_order_relaxed) >= blockMessages_)
+    {
+        if (archiveMessages(std::numeric_limits<sqlite3_int64>::max(), blockMessages_) == 0)
+        {
+            break;
+        }
+    }
+}
+
+std::optional<u32> DataBaseManager::searchMessages(const SearchQuery& query, const MessageVisitor& visitor) const
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::SEARCH_MESSAGES)};
+    const server::tracing::Span span{"db.searchMessages", "limit", query.limit};
+
+    if (!search_)
+    {
+        return std::nullopt;
+    }
+
+    const std::string match = matchExpression(query.text);
+    if (match.empty() || query.limit == 0)
+    {
+        return 0;
+    }
+
+    if (archive_)
+    {
+        return searchArchivedMessages(match, query, visitor);
+    }
+
+    const auto stmt = readStatement(Statement::SEARCH_MESSAGES);
+    if (!stmt)
+    {
+        logger_->error("Search statement is not prepared");
+        return std::nullopt;
     }
 
-    sqlite3_bind_text(stmt, 1, message.username.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, message.message.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(message.timestamp));
+    sqlite3_bind_text(stmt.get(), 1, match.c_str(), static_cast<int>(match.size()), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(query.limit));
+    sqlite3_bind_int64(stmt.get(), 3, static_cast<sqlite3_int64>(query.offset));
+
+    u32 visited = 0;
+    server::messages::NewMessageReceived row;
+
+    int rc;
+    while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+    {
+        readMessage(stmt.get(), row);
+        visitor(row);
+        ++visited;
+    }
 
-    rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE)
     {
-        std::string err = sqlite3_errmsg(db_);
-        finalizeSilently(stmt);
-        logger_->error("Failed to execute INSERT: {}", err);
+        logger_->error("Failed to search for '{}': {}", query.text, stmt.errorMessage());
     }
 
-    finalizeSilently(stmt);
+    return visited;
 }
 
-std::vector<server::messages::NewMessageReceived> DataBaseManager::getMessages() const noexcept
+u32 DataBaseManager::searchArchivedMessages(const std::string& match, const SearchQuery& query, const MessageVisitor& visitor) const
 {
-    std::vector<server::messages::NewMessageReceived> out;
+    std::vector<u64> ids;
+    {
+        const auto stmt = readStatement(Statement::SEARCH_IDS);
+        if (!stmt)
+        {
+            logger_->error("Search statement is not prepared");
+            return 0;
+        }
+
+        sqlite3_bind_text(stmt.get(), 1, match.c_str(), static_cast<int>(match.size()), SQLITE_STATIC);
+        sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(query.limit));
+        sqlite3_bind_int64(stmt.get(), 3, static_cast<sqlite3_int64>(query.offset));
+
+        int rc;
+        while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+        {
+            ids.push_back(static_cast<u64>(sqlite3_column_int64(stmt.get(), 0)));
+        }
 
-    static constexpr std::string_view kSelectSQL =
-        "SELECT username, message, timestamp FROM messages ORDER BY id ASC;";
+        if (rc != SQLITE_DONE)
+        {
+            logger_->error("Failed to search for '{}': {}", query.text, stmt.errorMessage());
+        }
+    }
+
+    // A page usually hits few blocks, each one is decoded once. Like history, the live table is
+    // read first, a row moved into a block in between is found there.
+    std::map<u64, std::vector<server::messages::NewMessageReceived>> blocks;
+    server::messages::NewMessageReceived row;
+    u32 visited = 0;
 
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, kSelectSQL.data(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK)
+    for (const u64 id : ids)
     {
-        logger_->error("Failed to prepare SELECT: {}", sqlite3_errmsg(db_));
-        finalizeSilently(stmt);
-        return out;
+        bool found = false;
+        {
+            const auto stmt = readStatement(Statement::SELECT_MESSAGE);
+            if (!stmt)
+            {
+                logger_->error("Search statement is not prepared");
+                return visited;
+            }
+
+            sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(id));
+            if (sqlite3_step(stmt.get()) == SQLITE_ROW)
+            {
+                readMessage(stmt.get(), row);
+                found = true;
+            }
+        }
+
+        if (!found)
+        {
+            const auto stmt = readStatement(Statement::SELECT_BLOCK);
+            if (!stmt)
+            {
+                logger_->error("Search statement is not prepared");
+                return visited;
+            }
+
+            sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(id));
+            if (sqlite3_step(stmt.get()) != SQLITE_ROW)
+            {
+                continue;
+            }
+
+            const auto firstId = static_cast<u64>(sqlite3_column_int64(stmt.get(), 0));
+            auto [block, added] = blocks.try_emplace(firstId);
+            if (added)
+            {
+                const auto rawSize = static_cast<std::size_t>(sqlite3_column_int64(stmt.get(), 1));
+                const std::string_view data{static_cast<const char*>(sqlite3_column_blob(stmt.get(), 2)),
+                                            static_cast<std::size_t>(sqlite3_column_bytes(stmt.get(), 2))};
+                const auto layout = static_cast<server::archive::Layout>(sqlite3_column_int(stmt.get(), 3));
+                if (!server::archive::decode(data, rawSize, layout, block->second))
+                {
+                    logger_->error("Skipping a corrupt archive segment");
+                    block->second.clear();
+                }
+            }
+
+            const auto& rows = block->second;
+            const auto it = std::lower_bound(rows.begin(), rows.end(), id,
+                [](const server::messages::NewMessageReceived& message, u64 value) { return message.id < value; });
+            if (it == rows.end() || it->id != id)
+            {
+                continue;
+            }
+            row = *it;
+        }
+
+        visitor(row);
+        ++visited;
+    }
+    return visited;
+}
+
+u32 DataBaseManager::getMessages(const HistoryQuery& query, const MessageVisitor& visitor) const
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::GET_MESSAGES)};
+    const server::tracing::Span span{"db.getMessages", "limit", query.limit};
+
+    if (!archive_)
+    {
+        return getLiveMessages(query, visitor);
+    }
+
+    // Live rows are read first. Rows only ever move from the live table into the archive, so a
+    // row this read misses is already archived when the archive is read below.
+    std::vector<server::messages::NewMessageReceived> live;
+    getLiveMessages(query, [&live](const server::messages::NewMessageReceived& message)
+    {
+        live.push_back(message);
+    });
+
+    const bool forward = query.afterId != 0 && query.beforeId == 0;
+    u32 visited = 0;
+    if (forward || live.size() < query.limit)
+    {
+        // archived ids are all below the live ones, so they come first in the page
+        HistoryQuery older = query;
+        older.limit = forward ? query.limit : query.limit - static_cast<u32>(live.size());
+        if (!live.empty())
+        {
+            older.beforeId = live.front().id;
+        }
+        visited = getArchivedMessages(older, forward, visitor);
+    }
+
+    for (std::size_t i = 0; i < live.size() && visited < query.limit; ++i)
+    {
+        visitor(live[i]);
+        ++visited;
+    }
+    return visited;
+}
+
+u32 DataBaseManager::getLiveMessages(const HistoryQuery& query, const MessageVisitor& visitor) const
+{
+    constexpr auto unbounded = static_cast<u64>(std::numeric_limits<sqlite3_int64>::max());
+    u64 afterId = query.afterId;
+    u64 beforeId = query.beforeId != 0 ? std::min(query.beforeId, unbounded) : unbounded;
+    const u64 fromTimestamp = query.fromTimestamp;
+    const u64 toTimestamp = query.toTimestamp != 0 ? std::min(query.toTimestamp, unbounded) : unbounded;
+
+    if (query.limit == 0 || fromTimestamp > toTimestamp)
+    {
+        return 0;
+    }
+
+    if (fromTimestamp != 0)
+    {
+        const auto first = singleId(Statement::FIRST_ID_FROM_TIME, fromTimestamp);
+        if (!first.has_value())
+        {
+            return 0;
+        }
+        afterId = std::max(afterId, first.value() - 1);
+    }
+
+    if (toTimestamp != unbounded)
+    {
+        const auto last = singleId(Statement::LAST_ID_UNTIL_TIME, toTimestamp);
+        if (!last.has_value())
+        {
+            return 0;
+        }
+        beforeId = std::min(beforeId, last.value() + 1);
+    }
+
+    const bool forward = query.afterId != 0 && query.beforeId == 0;
+    const auto stmt = readStatement(forward ? Statement::SELECT_HISTORY_FORWARD : Statement::SELECT_HISTORY_BACKWARD);
+    if (!stmt)
+    {
+        logger_->error("History statement is not prepared");
+        return 0;
+    }
+
+    sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(afterId));
+    sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(beforeId));
+    sqlite3_bind_int64(stmt.get(), 3, static_cast<sqlite3_int64>(fromTimestamp));
+    sqlite3_bind_int64(stmt.get(), 4, static_cast<sqlite3_int64>(toTimestamp));
+    sqlite3_bind_int64(stmt.get(), 5, static_cast<sqlite3_int64>(query.limit));
+
+    u32 visited = 0;
+    server::messages::NewMessageReceived row;
+
+    int rc;
+    while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+    {
+        readMessage(stmt.get(), row);
+        visitor(row);
+        ++visited;
+    }
+
+    if (rc != SQLITE_DONE)
+    {
+        logger_->error("Failed to execute history SELECT: {}", stmt.errorMessage());
+    }
+
+    return visited;
+}
+
+u32 DataBaseManager::getArchivedMessages(const HistoryQuery& query, bool forward, const MessageVisitor& visitor) const
+{
+    constexpr auto unbounded = static_cast<u64>(std::numeric_limits<sqlite3_int64>::max());
+    const u64 beforeId = query.beforeId != 0 ? std::min(query.beforeId, unbounded) : unbounded;
+    const u64 toTimestamp = query.toTimestamp != 0 ? std::min(query.toTimestamp, unbounded) : unbounded;
+    if (query.limit == 0 || query.fromTimestamp > toTimestamp || query.afterId >= beforeId)
+    {
+        return 0;
+    }
+
+    const auto stmt = readStatement(forward ? Statement::SELECT_SEGMENTS_FORWARD : Statement::SELECT_SEGMENTS_BACKWARD);
+    if (!stmt)
+    {
+        logger_->error("Archive statement is not prepared");
+        return 0;
+    }
+
+    sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(query.afterId));
+    sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(beforeId));
+    sqlite3_bind_int64(stmt.get(), 3, static_cast<sqlite3_int64>(query.fromTimestamp));
+    sqlite3_bind_int64(stmt.get(), 4, static_cast<sqlite3_int64>(toTimestamp));
+
+    const auto matches = [&](const server::messages::NewMessageReceived& message)
+    {
+        return message.id > query.afterId && message.id < beforeId &&
+               message.timestamp >= query.fromTimestamp && message.timestamp <= toTimestamp;
+    };
+
+    // segments walked newest first for backward pages, their rows are kept to be visited in id order
+    std::vector<std::vector<server::messages::NewMessageReceived>> segments;
+    std::vector<server::messages::NewMessageReceived> rows;
+    u32 visited = 0;
+
+    int rc = SQLITE_DONE;
+    while (visited < query.limit && (rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+    {
+        const auto rawSize = static_cast<std::size_t>(sqlite3_column_int64(stmt.get(), 0));
+        const std::string_view data{static_cast<const char*>(sqlite3_column_blob(stmt.get(), 1)),
+                                    static_cast<std::size_t>(sqlite3_column_bytes(stmt.get(), 1))};
+        const auto layout = static_cast<server::archive::Layout>(sqlite3_column_int(stmt.get(), 2));
+
+        rows.clear();
+        if (!server::archive::decode(data, rawSize, layout, rows))
+        {
+            logger_->error("Skipping a corrupt archive segment");
+            continue;
+        }
+
+        if (forward)
+        {
+            for (std::size_t i = 0; i < rows.size() && visited < query.limit; ++i)
+            {
+                if (matches(rows[i]))
+                {
+                    visitor(rows[i]);
+                    ++visited;
+                }
+            }
+            continue;
+        }
+
+        auto& page = segments.emplace_back();
+        for (auto it = rows.rbegin(); it != rows.rend() && visited < query.limit; ++it)
+        {
+            if (matches(*it))
+            {
+                page.push_back(std::move(*it));
+                ++visited;
+            }
+        }
+    }
+
+    if (visited < query.limit && rc != SQLITE_DONE)
+    {
+        logger_->error("Failed to read the message archive: {}", stmt.errorMessage());
+    }
+
+    for (auto segment = segments.rbegin(); segment != segments.rend(); ++segment)
+    {
+        for (auto it = segment->rbegin(); it != segment->rend(); ++it)
+        {
+            visitor(*it);
+        }
+    }
+    return visited;
+}
+
+bool DataBaseManager::backup(const std::string& path, u32 firstStepPages, const BackupStepper& next)
+{
+    const server::tracing::Span span{"db.backup"};
+
+    sqlite3* destination = nullptr;
+    constexpr int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (sqlite3_open_v2(path.c_str(), &destination, flags, nullptr) != SQLITE_OK)
+    {
+        logger_->error("Failed to open backup file {}: {}", path, sqlite3_errmsg(destination));
+        sqlite3_close(destination);
+        return false;
+    }
+
+    // An interrupted backup is thrown away, so the copy needs no journal. It is synced once at the
+    // end instead of by the last step, which would hold the write lock for the whole sync.
+    sqlite3_exec(destination, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF;", nullptr, nullptr, nullptr);
+
+    sqlite3_backup* backup = sqlite3_backup_init(destination, "main", db_, "main");
+    if (backup == nullptr)
+    {
+        logger_->error("Failed to start a backup into {}: {}", path, sqlite3_errmsg(destination));
+        sqlite3_close(destination);
+        return false;
+    }
+
+    int rc = SQLITE_OK;
+    u32 pages = std::max<u32>(1, firstStepPages);
+    while (pages > 0)
+    {
+        BackupProgress progress;
+        {
+            const std::lock_guard lock(writeMutex_);
+            const auto start = std::chrono::steady_clock::now();
+            const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::BACKUP_STEP)};
+            rc = sqlite3_backup_step(backup, static_cast<int>(pages));
+            progress.step = std::chrono::steady_clock::now() - start;
+        }
+
+        if (rc == SQLITE_DONE || (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED))
+        {
+            break;
+        }
+
+        progress.remaining = static_cast<u32>(sqlite3_backup_remaining(backup));
+        progress.total = static_cast<u32>(sqlite3_backup_pagecount(backup));
+        pages = next(progress);
+    }
+
+    const int finished = sqlite3_backup_finish(backup);
+    if (rc != SQLITE_DONE || finished != SQLITE_OK)
+    {
+        if (pages > 0)
+        {
+            logger_->error("Backup into {} failed: {}", path, sqlite3_errstr(rc != SQLITE_DONE ? rc : finished));
+        }
+        sqlite3_close(destination);
+        return false;
+    }
+
+    if (sqlite3_close(destination) != SQLITE_OK)
+    {
+        return false;
+    }
+
+    if (std::string error; !server::syncFile(path, error))
+    {
+        logger_->error("Failed to sync backup {}: {}", path, error);
+        return false;
+    }
+    return true;
+}
+
+bool DataBaseManager::beginBulkLoad()
+{
+    // the rebuild at the end only sees the live table, packed blocks would drop out of the index
+    if (blockMessages_ != 0)
+    {
+        logger_->error("Bulk loads need one row per message, not blocks of {}", blockMessages_);
+        return false;
+    }
+
+    const std::lock_guard lock(writeMutex_);
+    if (!exec("DROP INDEX IF EXISTS idx_messages_timestamp;", "drop the timestamp index"))
+    {
+        return false;
+    }
+
+    bulkLoad_ = true;
+    return true;
+}
+
+bool DataBaseManager::endBulkLoad()
+{
+    const server::tracing::Span span{"db.endBulkLoad"};
+
+    const std::lock_guard lock(writeMutex_);
+    bulkLoad_ = false;
+
+    if (!exec(createMessagesTableSQL.data(), "build the timestamp index"))
+    {
+        return false;
+    }
+
+    return !search_ || exec("INSERT INTO messages_fts (messages_fts) VALUES ('rebuild');", "build the search index");
+}
+
+u64 DataBaseManager::lastMessageId() const noexcept
+{
+    const auto stmt = readStatement(Statement::LAST_MESSAGE_ID);
+    if (!stmt || sqlite3_step(stmt.get()) != SQLITE_ROW)
+    {
+        logger_->error("Failed to read the last message id: {}", stmt ? stmt.errorMessage() : "not prepared");
+        return 0;
+    }
+    return static_cast<u64>(sqlite3_column_int64(stmt.get(), 0));
+}
+
+std::optional<u64> DataBaseManager::singleId(Statement statement, u64 timestamp) const noexcept
+{
+    const auto stmt = readStatement(statement);
+    if (!stmt)
+    {
+        return std::nullopt;
+    }
+
+    sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(std::min<u64>(timestamp, std::numeric_limits<sqlite3_int64>::max())));
+    if (sqlite3_step(stmt.get()) != SQLITE_ROW)
+    {
+        return std::nullopt;
+    }
+    return static_cast<u64>(sqlite3_column_int64(stmt.get(), 0));
+}
+
+u64 DataBaseManager::expiredUpTo(u64 now) const noexcept
+{
+    u64 upTo = 0;
+
+    if (retention_.maxMessages != 0)
+    {
+        // newest message past the count limit
+        const auto stmt = readStatement(Statement::NTH_NEWEST_ID);
+        if (stmt)
+        {
+            sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(std::min<u64>(retention_.maxMessages, std::numeric_limits<sqlite3_int64>::max())));
+            if (sqlite3_step(stmt.get()) == SQLITE_ROW)
+            {
+                upTo = static_cast<u64>(sqlite3_column_int64(stmt.get(), 0));
+            }
+        }
+    }
+
+    if (retention_.maxAgeSeconds != 0 && now > retention_.maxAgeSeconds)
+    {
+        // newest message older than the age limit
+        if (const auto id = singleId(Statement::LAST_ID_UNTIL_TIME, now - retention_.maxAgeSeconds - 1); id.has_value())
+        {
+            upTo = std::max(upTo, id.value());
+        }
+    }
+
+    return upTo;
+}
+
+u32 DataBaseManager::archiveMessages(u64 upToId, u32 maxRows)
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::ARCHIVE_SEGMENT)};
+    const server::tracing::Span span{"db.archiveMessages", "maxRows", maxRows};
+
+    if (upToId == 0 || maxRows == 0)
+    {
+        return 0;
+    }
+
+    // Rows this old are only touched by the archiver, so they are read and compressed before the
+    // write lock is taken and the transaction only has to insert one BLOB and delete a key range.
+    // They are read on the writer connection, a read connection can still be on a snapshot from
+    // before the previous segment was moved.
+    std::vector<server::messages::NewMessageReceived> rows;
+    {
+        const auto stmt = statement(Statement::SELECT_OLDEST);
+        if (!stmt)
+        {
+            logger_->error("Archive SELECT statement is not prepared");
+            return 0;
+        }
+
+        sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(std::min<u64>(upToId, std::numeric_limits<sqlite3_int64>::max())));
+        sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(maxRows));
+
+        int rc;
+        while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+        {
+            readMessage(stmt.get(), rows.emplace_back());
+        }
+
+        if (rc != SQLITE_DONE)
+        {
+            logger_->error("Failed to read messages to archive: {}", stmt.errorMessage());
+            return 0;
+        }
+    }
+
+    if (rows.empty())
+    {
+        return 0;
+    }
+
+    constexpr auto layout = server::archive::Layout::COLUMNS;
+    const auto segment = server::archive::encode(rows, layout);
+    if (segment.data.empty())
+    {
+        logger_->error("Failed to compress an archive segment of {} messages", rows.size());
+        return 0;
+    }
+
+    const u64 firstId = rows.front().id;
+    const u64 lastId = rows.back().id;
+    const auto [minTimestamp, maxTimestamp] = std::minmax_element(rows.begin(), rows.end(),
+        [](const auto& a, const auto& b) { return a.timestamp < b.timestamp; });
+
+    const std::lock_guard lock(writeMutex_);
+    if (!execute(Statement::BEGIN))
+    {
+        logger_->error("Failed to begin archive transaction: {}", sqlite3_errmsg(db_));
+        return 0;
     }
 
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    bool ok;
     {
-        const unsigned char* u = sqlite3_column_text(stmt, 0);
-        const unsigned char* m = sqlite3_column_text(stmt, 1);
-        const sqlite3_int64 ts       = sqlite3_column_int64(stmt, 2);
+        const auto insert = statement(Statement::INSERT_SEGMENT);
+        ok = static_cast<bool>(insert);
+        if (ok)
+        {
+            sqlite3_bind_int64(insert.get(), 1, static_cast<sqlite3_int64>(firstId));
+            sqlite3_bind_int64(insert.get(), 2, static_cast<sqlite3_int64>(lastId));
+            sqlite3_bind_int64(insert.get(), 3, static_cast<sqlite3_int64>(minTimestamp->timestamp));
+            sqlite3_bind_int64(insert.get(), 4, static_cast<sqlite3_int64>(maxTimestamp->timestamp));
+            sqlite3_bind_int64(insert.get(), 5, static_cast<sqlite3_int64>(rows.size()));
+            sqlite3_bind_int64(insert.get(), 6, static_cast<sqlite3_int64>(segment.rawSize));
+            sqlite3_bind_blob(insert.get(), 7, segment.data.data(), static_cast<int>(segment.data.size()), SQLITE_STATIC);
+            sqlite3_bind_int(insert.get(), 8, static_cast<int>(layout));
+            ok = sqlite3_step(insert.get()) == SQLITE_DONE;
+        }
+    }
 
-        const std::string username  = u ? reinterpret_cast<const char*>(u) : "";
-        const std::string message   = m ? reinterpret_cast<const char*>(m) : "";
-        const u64 timestamp    = ts;
+    // archived messages drop out of the search index with the live rows, packed blocks stay searchable
+    if (ok && search_ && blockMessages_ == 0)
+    {
+        const auto unindex = statement(Statement::DELETE_SEARCH_RANGE);
+        sqlite3_bind_int64(unindex.get(), 1, static_cast<sqlite3_int64>(firstId));
+        sqlite3_bind_int64(unindex.get(), 2, static_cast<sqlite3_int64>(lastId));
+        ok = sqlite3_step(unindex.get()) == SQLITE_DONE;
+    }
 
-        server::messages::NewMessageReceived newMessage;
-        newMessage.username = username;
-        newMessage.message = message;
-        newMessage.timestamp = timestamp;
+    if (ok)
+    {
+        const auto remove = statement(Statement::DELETE_UP_TO);
+        ok = static_cast<bool>(remove);
+        if (ok)
+        {
+            sqlite3_bind_int64(remove.get(), 1, static_cast<sqlite3_int64>(firstId));
+            sqlite3_bind_int64(remove.get(), 2, static_cast<sqlite3_int64>(lastId));
+            ok = sqlite3_step(remove.get()) == SQLITE_DONE;
+        }
+    }
 
-        out.emplace_back(newMessage);
+    if (!ok || !execute(Statement::COMMIT))
+    {
+        logger_->error("Failed to archive messages {} to {}: {}", firstId, lastId, sqlite3_errmsg(db_));
+        if (!execute(Statement::ROLLBACK))
+        {
+            logger_->error("Failed to roll back: {}", sqlite3_errmsg(db_));
+        }
+        return 0;
     }
+    liveRows_.fetch_sub(rows.size(), std::memory_order_relaxed);
 
-    finalizeSilently(stmt);
-    return out;
+    auto& counters = server::metrics::counters();
+    counters.archiveSegments.fetch_add(1, std::memory_order_relaxed);
+    counters.archivedRows.fetch_add(rows.size(), std::memory_order_relaxed);
+    counters.archiveRawBytes.fetch_add(segment.rawSize, std::memory_order_relaxed);
+    counters.archiveBytes.fetch_add(segment.data.size(), std::memory_order_relaxed);
+    return static_cast<u32>(rows.size());
 }
 
-void DataBaseManager::addNewUser(const std::string& username, u64 passwordHash)
+AddUserResult DataBaseManager::addNewUser(const std::string& username, u64 passwordHash)
 {
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::INSERT_USER)};
+    const server::tracing::Span span{"db.addNewUser"};
+
+    const std::lock_guard lock(writeMutex_);
+    const auto stmt = statement(Statement::INSERT_USER);
+    if (!stmt)
+    {
+        logger_->error("INSERT user statement is not prepared");
+        return AddUserResult::FAILED;
+    }
+
+    sqlite3_bind_text(stmt.get(), 1, username.c_str(), static_cast<int>(username.size()), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(passwordHash));
+
+    const int rc = sqlite3_step(stmt.get());
+    if (rc == SQLITE_DONE)
+    {
+        return AddUserResult::ADDED;
+    }
+
+    // checked on the step result, the connection's error state can already belong to another thread
+    if (rc == SQLITE_CONSTRAINT_UNIQUE)
+    {
+        return AddUserResult::USERNAME_TAKEN;
+    }
+
+    logger_->error("Failed to add user {}: {}", username, sqlite3_errmsg(db_));
+    return AddUserResult::FAILED;
 }
 
-bool DataBaseManager::userExists(const std::string& username)
+std::optional<u64> DataBaseManager::userPasswordHash(const std::string& username) const noexcept
 {
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::GET_USER)};
+    const server::tracing::Span span{"db.userPasswordHash"};
+
+    const auto stmt = readStatement(Statement::USER_PASSWORD_HASH);
+    if (!stmt)
+    {
+        logger_->error("User password statement is not prepared");
+        return std::nullopt;
+    }
+
+    sqlite3_bind_text(stmt.get(), 1, username.c_str(), static_cast<int>(username.size()), SQLITE_STATIC);
+    if (const int rc = sqlite3_step(stmt.get()); rc != SQLITE_ROW)
+    {
+        if (rc != SQLITE_DONE)
+        {
+            logger_->error("Failed to look up user {}: {}", username, stmt.errorMessage());
+        }
+        return std::nullopt;
+    }
+    return static_cast<u64>(sqlite3_column_int64(stmt.get(), 0));
 }
 
-u64 DataBaseManager::userPasswordHash(const std::string& username)
+u32 DataBaseManager::getUsers(u32 limit, const UserVisitor& visitor) const
 {
+    const auto stmt = readStatement(Statement::SELECT_USERS);
+    if (!stmt)
+    {
+        logger_->error("Select users statement is not prepared");
+        return 0;
+    }
+
+    sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(limit));
+
+    u32 visited = 0;
+    std::string username;
+
+    int rc;
+    while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+    {
+        const auto* u = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 0));
+        username.assign(u ? u : "", static_cast<std::size_t>(sqlite3_column_bytes(stmt.get(), 0)));
+        visitor(username, static_cast<u64>(sqlite3_column_int64(stmt.get(), 1)));
+        ++visited;
+    }
+
+    if (rc != SQLITE_DONE)
+    {
+        logger_->error("Failed to read the users: {}", stmt.errorMessage());
+    }
+    return visited;
 }
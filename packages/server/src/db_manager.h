@@ -1,36 +1,238 @@
 #pragma once
 
 
-#include "messages.h"
+#include "message_store.h"
+#include "user_store.h"
 
+// std
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <mutex>
 
 // sqlite3
 #include "../sqlite3/sqlite3.h"
 
-class DataBaseManager
+constexpr std::string_view DEFAULT_DB_PATH = "chat.db";
+
+// Durability / performance tradeoff of the database connection, picked with --db-profile
+enum class DurabilityProfile : u32
+{
+    // rollback journal synced on every commit, the SQLite defaults
+    STRICT,
+    // WAL synced at checkpoints only, a power loss can drop the last commits but never corrupts
+    BALANCED,
+    // WAL without syncs and with large caches, for benchmarks and throwaway servers
+    FAST
+};
+
+struct DatabaseSettings
+{
+    std::string_view name;
+    std::string_view journalMode;
+    std::string_view synchronous;
+    // bytes of the file mapped into memory, 0 disables mmap
+    i64 mmapSize;
+    // page cache size as passed to PRAGMA cache_size, negative values are KiB
+    i64 cacheSize;
+    // WAL pages after which a commit runs a checkpoint, 0 disables automatic checkpoints
+    u32 walAutoCheckpoint;
+    // truncate the WAL when the connection closes
+    bool checkpointOnClose;
+};
+
+[[nodiscard]] const DatabaseSettings& databaseSettings(DurabilityProfile profile) noexcept;
+
+// Which messages stay in the live table. Older ones are moved into compressed archive segments
+// by the MessageArchiver and are still returned by history queries. 0 disables a limit.
+struct RetentionPolicy
+{
+    u64 maxAgeSeconds = 0;
+    u64 maxMessages = 0;
+
+    [[nodiscard]] bool enabled() const noexcept { return maxAgeSeconds != 0 || maxMessages != 0; }
+};
+
+// Where an online backup is, in pages of the source database
+struct BackupProgress
+{
+    u32 remaining = 0;
+    u32 total = 0;
+    // time the last step held the write lock
+    std::chrono::nanoseconds step{0};
+};
+
+// Called after every backup step, returns the pages to copy in the next one, 0 aborts the backup
+using BackupStepper = std::function<u32(const BackupProgress&)>;
+
+struct DatabaseConfig
+{
+    std::string path = std::string(DEFAULT_DB_PATH);
+    DurabilityProfile profile = DurabilityProfile::STRICT;
+    // Read-only connections for history and user lookups. They only help under WAL, where readers
+    // never wait for the writer, with a rollback journal every query uses the writer connection.
+    u32 readConnections = 0;
+    RetentionPolicy retention{};
+    // Messages per closed block. With a block size the live table only holds the open block, every
+    // time it fills up its rows are packed into one compressed BLOB row of the archive table, so a
+    // history page reads a handful of rows. 0 keeps one row per message.
+    u32 blockMessages = 0;
+};
+
+class DataBaseManager final : public IMessageStore, public IUserStore
 {
 public:
-    explicit DataBaseManager(spdlog::logger* logger);
-    ~DataBaseManager();
+    explicit DataBaseManager(spdlog::logger* logger, const DatabaseConfig& config = {});
+    ~DataBaseManager() override;
 
 public:
     // Messages table functions
-    void addMessageEntry(const server::messages::NewMessageReceived& message);
-    [[nodiscard]] std::vector<server::messages::NewMessageReceived> getMessages() const noexcept;
+    void addMessageEntry(const server::messages::NewMessageReceived& message) override;
+    // Inserts every message in a single transaction, returns false if it was rolled back
+    [[nodiscard]] bool addMessageEntries(const std::vector<server::messages::NewMessageReceived>& messages) override;
+    // Returns the number of messages visited, archived messages included
+    u32 getMessages(const HistoryQuery& query, const MessageVisitor& visitor) const override;
+    [[nodiscard]] u64 lastMessageId() const noexcept override;
+    // Ranked FTS5 search of the live messages and of the packed blocks, archived ones are no longer indexed
+    std::optional<u32> searchMessages(const SearchQuery& query, const MessageVisitor& visitor) const override;
+
+    // Archive functions
+    [[nodiscard]] const RetentionPolicy& retention() const noexcept { return retention_; }
+    // Highest id the retention policy expires at time now, 0 if every message is kept
+    [[nodiscard]] u64 expiredUpTo(u64 now) const noexcept;
+    // Moves up to maxRows of the oldest messages with an id up to upToId into one archive segment,
+    // in a single short transaction. Returns the number of messages moved. In block layout the
+    // manager calls it itself for every closed block.
+    [[nodiscard]] u32 archiveMessages(u64 upToId, u32 maxRows);
+
+    // Copies the database into a new file at path while the server keeps running. Every step
+    // copies a few pages under the write lock, so commits wait for one step at most. Writes in
+    // between go through the same connection and are carried into the copy without restarting it.
+    [[nodiscard]] bool backup(const std::string& path, u32 firstStepPages, const BackupStepper& next);
+
+    // Loading a large dump into an empty database. In between the timestamp index is dropped and
+    // inserts skip the search index, endBulkLoad builds both again in one pass each.
+    [[nodiscard]] bool beginBulkLoad();
+    [[nodiscard]] bool endBulkLoad();
 
     // User table functions
-    void addNewUser(const std::string& username, u64 passwordHash);
-    [[nodiscard]] bool userExists(const std::string& username);
-    [[nodiscard]] u64 userPasswordHash(const std::string& username);
+    [[nodiscard]] AddUserResult addNewUser(const std::string& username, u64 passwordHash) override;
+    [[nodiscard]] std::optional<u64> userPasswordHash(const std::string& username) const noexcept override;
+    u32 getUsers(u32 limit, const UserVisitor& visitor) const override;
+
+private:
+    // Every query the manager runs, they are all prepared once at startup.
+    // New queries are added here and to the SQL table in db_manager.cpp.
+    enum class Statement : u32
+    {
+        INSERT_MESSAGE,
+        SELECT_HISTORY_FORWARD,
+        SELECT_HISTORY_BACKWARD,
+        FIRST_ID_FROM_TIME,
+        LAST_ID_UNTIL_TIME,
+        LAST_MESSAGE_ID,
+        NTH_NEWEST_ID,
+        SELECT_OLDEST,
+        DELETE_UP_TO,
+        INSERT_SEGMENT,
+        SELECT_SEGMENTS_FORWARD,
+        SELECT_SEGMENTS_BACKWARD,
+        HAS_SEGMENTS,
+        INSERT_SEARCH,
+        DELETE_SEARCH_RANGE,
+        SEARCH_MESSAGES,
+        SEARCH_IDS,
+        SELECT_MESSAGE,
+        SELECT_BLOCK,
+        INSERT_USER,
+        USER_PASSWORD_HASH,
+        SELECT_USERS,
+        BEGIN,
+        COMMIT,
+        ROLLBACK,
+        COUNT
+    };
+
+    // Hands out a cached statement and resets it and clears its bindings when it goes out of scope.
+    // A statement can only run one query at a time, so it is locked for the lifetime of the handle.
+    class CachedStatement
+    {
+    public:
+        CachedStatement(sqlite3_stmt* stmt, std::mutex& mutex) noexcept : lock_(mutex), stmt_(stmt) {}
+        ~CachedStatement();
+
+        CachedStatement(const CachedStatement&) = delete;
+        CachedStatement& operator=(const CachedStatement&) = delete;
+
+        [[nodiscard]] sqlite3_stmt* get() const noexcept { return stmt_; }
+        // error messages live on the connection the statement belongs to
+        [[nodiscard]] const char* errorMessage() const noexcept { return sqlite3_errmsg(sqlite3_db_handle(stmt_)); }
+        [[nodiscard]] explicit operator bool() const noexcept { return stmt_ != nullptr; }
+
+    private:
+        std::unique_lock<std::mutex> lock_;
+        sqlite3_stmt* stmt_;
+    };
 
 private:
     // helpers
+    [[nodiscard]] bool applyProfile() const noexcept;
     void ensureSchema() const noexcept;
+    // Runs sql on the writer connection, logs "Failed to <action>" with the error if it fails
+    [[nodiscard]] bool exec(const char* sql, std::string_view action) const noexcept;
+    using Statements = std::array<sqlite3_stmt*, static_cast<std::size_t>(Statement::COUNT)>;
+    using StatementMutexes = std::array<std::mutex, static_cast<std::size_t>(Statement::COUNT)>;
+
+    struct ReadConnection
+    {
+        sqlite3* db{nullptr};
+        Statements statements{};
+        mutable StatementMutexes mutexes;
+    };
+
+    void openReadConnections(const std::string& path, u32 count);
+    void prepareStatements(sqlite3* db, Statements& statements) const noexcept;
+    [[nodiscard]] CachedStatement statement(Statement statement) const noexcept;
+    // Statement on the read connection of the calling thread, the writer connection if there are none
+    [[nodiscard]] CachedStatement readStatement(Statement statement) const noexcept;
+    [[nodiscard]] std::optional<u64> singleId(Statement statement, u64 timestamp) const noexcept;
+    u32 getLiveMessages(const HistoryQuery& query, const MessageVisitor& visitor) const;
+    u32 getArchivedMessages(const HistoryQuery& query, bool forward, const MessageVisitor& visitor) const;
+    // Search of a database with archived rows, the ranked ids are looked up in the live table and then in the archive
+    u32 searchArchivedMessages(const std::string& match, const SearchQuery& query, const MessageVisitor& visitor) const;
+    // Inserts and indexes the messages in one transaction, the caller holds the write lock
+    [[nodiscard]] bool insertMessages(const std::vector<server::messages::NewMessageReceived>& messages);
+    // Packs the live rows into blocks until only the open block is left
+    void packClosedBlocks();
+    // Adds a message to the search index, right after its insert
+    [[nodiscard]] bool indexMessage(i64 id, const server::messages::NewMessageReceived& message) const noexcept;
+    // Steps a statement that returns no rows (BEGIN, COMMIT, ...)
+    [[nodiscard]] bool execute(Statement statement) const noexcept;
     static void finalizeSilently(sqlite3_stmt* stmt) noexcept;
 
 private:
     spdlog::logger* logger_;
+    DurabilityProfile profile_;
+    RetentionPolicy retention_;
+    u32 blockMessages_;
+    // rows in the live table, in block layout that is the open block
+    std::atomic<u64> liveRows_{0};
+    // history queries only look at the archive when it can hold messages, decided once at startup
+    // so a query never races with the first segment being written
+    bool archive_{false};
+    // the search index exists, SQLite can be built without FTS5
+    bool search_{false};
+    // between beginBulkLoad and endBulkLoad, only changed under the write lock
+    bool bulkLoad_{false};
     sqlite3* db_{nullptr};
+    // The connection is opened in serialized mode so the DB writer thread and the io thread can
+    // share it. Writes also take this lock so nothing lands inside another thread's transaction.
+    std::mutex writeMutex_;
+    std::mutex packMutex_;
+    Statements statements_{};
+    mutable StatementMutexes statementMutexes_;
+    std::vector<std::unique_ptr<ReadConnection>> readers_;
 };
-
-
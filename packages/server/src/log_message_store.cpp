@@ -0,0 +1,573 @@
+#include "log_message_store.h"
+#include "metrics.h"
+#include "tracing.h"
+
+// std
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+
+// zlib
+#include "zlib.h"
+
+namespace server
+{
+
+namespace
+{
+
+struct RecordHeader
+{
+    u32 size;
+    u32 checksum;
+    u64 id;
+    u64 timestamp;
+    u32 usernameSize;
+    u32 messageSize;
+};
+
+static_assert(sizeof(RecordHeader) == 32, "records are laid out without padding");
+static_assert(std::endian::native == std::endian::little, "the log is written in host byte order");
+
+constexpr u64 RECORD_ALIGNMENT = 8;
+constexpr std::string_view SEGMENT_EXTENSION = ".log";
+constexpr u64 UNBOUNDED = std::numeric_limits<u64>::max();
+constexpr u64 MIN_SEGMENT_BYTES = 1024 * 1024;
+
+[[nodiscard]] constexpr u64 recordSize(u64 usernameSize, u64 messageSize) noexcept
+{
+    const u64 size = sizeof(RecordHeader) + usernameSize + messageSize;
+    return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+[[nodiscard]] u32 checksum(const char* record, u64 size) noexcept
+{
+    constexpr u64 covered = offsetof(RecordHeader, id);
+    return static_cast<u32>(crc32(0, reinterpret_cast<const Bytef*>(record + covered), static_cast<uInt>(size - covered)));
+}
+
+void encode(std::string& buffer, const server::messages::NewMessageReceived& message, u64 id)
+{
+    const u64 size = recordSize(message.username.size(), message.message.size());
+    const std::size_t start = buffer.size();
+    buffer.resize(start + size, '\0');
+    char* record = buffer.data() + start;
+
+    RecordHeader header{static_cast<u32>(size), 0, id, message.timestamp,
+                        static_cast<u32>(message.username.size()), static_cast<u32>(message.message.size())};
+    std::memcpy(record, &header, sizeof(header));
+    std::memcpy(record + sizeof(header), message.username.data(), message.username.size());
+    std::memcpy(record + sizeof(header) + message.username.size(), message.message.data(), message.message.size());
+
+    header.checksum = checksum(record, size);
+    std::memcpy(record + offsetof(RecordHeader, checksum), &header.checksum, sizeof(header.checksum));
+}
+
+}
+
+LogMessageStore::LogMessageStore(spdlog::logger* logger, const LogStoreConfig& config)
+    : logger_(logger), config_(config)
+{
+    config_.indexInterval = std::max<u32>(1, config_.indexInterval);
+    config_.segmentBytes = std::max<u64>(config_.segmentBytes, MIN_SEGMENT_BYTES);
+    open();
+}
+
+LogMessageStore::~LogMessageStore()
+{
+    const std::lock_guard lock(appendMutex_);
+    if (!segments_.empty() && !segments_.back()->file.sync())
+    {
+        logger_->error("Failed to sync log segment {}: {}", segments_.back()->path, segments_.back()->file.lastError());
+    }
+}
+
+void LogMessageStore::open()
+{
+    std::error_code ec;
+    std::filesystem::create_directories(config_.directory, ec);
+    if (ec)
+    {
+        logger_->error("Failed to create the log store directory {}: {}", config_.directory, ec.message());
+        return;
+    }
+
+    std::vector<std::pair<u64, std::string>> files;
+    for (const auto& entry : std::filesystem::directory_iterator(config_.directory, ec))
+    {
+        const std::string stem = entry.path().stem().string();
+        u64 firstId = 0;
+        if (!entry.is_regular_file() || entry.path().extension() != SEGMENT_EXTENSION ||
+            std::from_chars(stem.data(), stem.data() + stem.size(), firstId).ec != std::errc{})
+        {
+            continue;
+        }
+        files.emplace_back(firstId, entry.path().string());
+    }
+    std::sort(files.begin(), files.end());
+
+    u64 records = 0;
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        auto segment = std::make_unique<Segment>();
+        segment->path = files[i].second;
+        if (!segment->file.open(segment->path, config_.segmentBytes) || !recover(*segment, i + 1 == files.size()))
+        {
+            logger_->error("Skipping log segment {}: {}", segment->path, segment->file.lastError());
+            continue;
+        }
+
+        if (segment->records == 0)
+        {
+            segment->file.close();
+            std::filesystem::remove(segment->path, ec);
+            continue;
+        }
+
+        if (!segments_.empty() && segment->index.front().id <= segments_.back()->lastId)
+        {
+            logger_->error("Skipping log segment {}, its ids overlap the previous segment", segment->path);
+            continue;
+        }
+
+        records += segment->records;
+        lastId_.store(segment->lastId, std::memory_order_relaxed);
+        segments_.push_back(std::move(segment));
+    }
+
+    logger_->info("Log store {}: {} messages in {} segments, last id {}", config_.directory, records, segments_.size(), lastMessageId());
+}
+
+bool LogMessageStore::recover(Segment& segment, bool last)
+{
+    const char* data = segment.file.data();
+    const u64 capacity = segment.file.size();
+
+    u64 offset = 0;
+    while (capacity - offset >= sizeof(RecordHeader))
+    {
+        RecordHeader header{};
+        std::memcpy(&header, data + offset, sizeof(header));
+        if (header.size < sizeof(RecordHeader) || header.size > capacity - offset ||
+            header.size != recordSize(header.usernameSize, header.messageSize) ||
+            header.id <= segment.lastId || header.checksum != checksum(data + offset, header.size))
+        {
+            break;
+        }
+
+        if (segment.records % config_.indexInterval == 0)
+        {
+            segment.index.push_back(IndexEntry{header.id, header.timestamp, offset});
+        }
+        ++segment.records;
+        segment.lastId = header.id;
+        segment.lastTimestamp = header.timestamp;
+        offset += header.size;
+    }
+    segment.end = offset;
+
+    // Anything after the last good record is a torn write. It is cleared, otherwise new records
+    // could end up right in front of stale ones that still check out.
+    if (!last || std::all_of(data + offset, data + capacity, [](char c) { return c == 0; }))
+    {
+        return true;
+    }
+
+    logger_->warn("Dropping a torn write at offset {} of log segment {}", offset, segment.path);
+    segment.file.close();
+
+    std::error_code ec;
+    std::filesystem::resize_file(segment.path, offset, ec);
+    return !ec && segment.file.open(segment.path, config_.segmentBytes);
+}
+
+std::unique_ptr<LogMessageStore::Segment> LogMessageStore::createSegment(u64 firstId)
+{
+    auto segment = std::make_unique<Segment>();
+    segment->path = segmentPath(firstId);
+
+    std::error_code ec;
+    if (std::filesystem::exists(segment->path, ec))
+    {
+        logger_->error("Log segment {} already exists", segment->path);
+        return nullptr;
+    }
+
+    if (!segment->file.open(segment->path, config_.segmentBytes))
+    {
+        logger_->error("Failed to create log segment {}: {}", segment->path, segment->file.lastError());
+        return nullptr;
+    }
+    return segment;
+}
+
+std::string LogMessageStore::segmentPath(u64 firstId) const
+{
+    return (std::filesystem::path(config_.directory) / fmt::format("{:020}{}", firstId, SEGMENT_EXTENSION)).string();
+}
+
+void LogMessageStore::addMessageEntry(const server::messages::NewMessageReceived& message)
+{
+    std::ignore = addMessageEntries({message});
+}
+
+bool LogMessageStore::addMessageEntries(const std::vector<server::messages::NewMessageReceived>& messages)
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::COMMIT_BATCH)};
+    const server::tracing::Span span{"log.addMessageEntries", "rows", messages.size()};
+
+    if (messages.empty())
+    {
+        return true;
+    }
+
+    // Only the appender changes the segment list and the segments' end, so they are read here
+    // without mutex_. Readers only take it shared while the batch is written.
+    const std::lock_guard lock(appendMutex_);
+
+    std::vector<PendingAppend> pending;
+    u64 lastId = lastId_.load(std::memory_order_relaxed);
+    for (const auto& message : messages)
+    {
+        const u64 id = message.id != 0 ? message.id : lastId + 1;
+        if (id <= lastId)
+        {
+            logger_->error("Log store got message id {} after {}, ids must grow", id, lastId);
+            return false;
+        }
+
+        const u64 size = recordSize(message.username.size(), message.message.size());
+        if (size > config_.segmentBytes)
+        {
+            logger_->error("Message {} takes {} bytes, more than a log segment holds", id, size);
+            return false;
+        }
+
+        const bool fits = !pending.empty()
+            ? pending.back().begin + pending.back().buffer.size() + size <= pending.back().segment->file.size()
+            : !segments_.empty() && segments_.back()->end + size <= segments_.back()->file.size();
+
+        if (pending.empty() && fits)
+        {
+            Segment* current = segments_.back().get();
+            pending.push_back(PendingAppend{current, nullptr, current->end});
+        }
+        else if (!fits)
+        {
+            // roll over, the segment left behind is synced once its last records are written
+            if (pending.empty() && !segments_.empty() && !segments_.back()->file.sync())
+            {
+                logger_->error("Failed to sync log segment {}: {}", segments_.back()->path, segments_.back()->file.lastError());
+            }
+
+            auto created = createSegment(id);
+            if (!created)
+            {
+                return false;
+            }
+            Segment* segment = created.get();
+            pending.push_back(PendingAppend{segment, std::move(created), 0});
+        }
+
+        auto& append = pending.back();
+        if ((append.segment->records + append.records) % config_.indexInterval == 0)
+        {
+            append.index.push_back(IndexEntry{id, message.timestamp, append.begin + append.buffer.size()});
+        }
+        encode(append.buffer, message, id);
+        ++append.records;
+        append.lastId = id;
+        append.lastTimestamp = message.timestamp;
+        lastId = id;
+    }
+
+    // one sequential write per segment touched, and one sync per batch when every batch is synced
+    for (std::size_t i = 0; i < pending.size(); ++i)
+    {
+        auto& append = pending[i];
+        // segments sealed by the batch are always synced, the open one only when every batch is
+        const bool skipSync = !config_.syncEveryBatch && i + 1 == pending.size();
+        if (!append.segment->file.write(append.begin, append.buffer.data(), append.buffer.size()) ||
+            (!skipSync && !append.segment->file.sync()))
+        {
+            logger_->error("Failed to append {} messages to log segment {}: {}",
+                messages.size(), append.segment->path, append.segment->file.lastError());
+
+            // whatever made it to disk must not be recovered on the next start
+            const RecordHeader end{};
+            for (const auto& written : pending)
+            {
+                if (written.created)
+                {
+                    written.segment->file.close();
+                    std::error_code ec;
+                    std::filesystem::remove(written.segment->path, ec);
+                    continue;
+                }
+                std::ignore = written.segment->file.write(written.begin, &end, sizeof(end));
+            }
+            return false;
+        }
+    }
+
+    // publish the whole batch at once
+    const std::unique_lock publish(mutex_);
+    for (auto& append : pending)
+    {
+        Segment& segment = *append.segment;
+        segment.index.insert(segment.index.end(), append.index.begin(), append.index.end());
+        segment.end = append.begin + append.buffer.size();
+        segment.records += append.records;
+        segment.lastId = append.lastId;
+        segment.lastTimestamp = append.lastTimestamp;
+        if (append.created)
+        {
+            segments_.push_back(std::move(append.created));
+        }
+    }
+    lastId_.store(lastId, std::memory_order_release);
+    return true;
+}
+
+u64 LogMessageStore::lastMessageId() const noexcept
+{
+    return lastId_.load(std::memory_order_acquire);
+}
+
+std::optional<u32> LogMessageStore::searchMessages(const SearchQuery&, const MessageVisitor&) const
+{
+    return std::nullopt;
+}
+
+u32 LogMessageStore::getMessages(const HistoryQuery& query, const MessageVisitor& visitor) const
+{
+    server::messages::NewMessageReceived message;
+    return getMessageViews(query, [&message, &visitor](const MessageView& view)
+    {
+        message.id = view.id;
+        message.timestamp = view.timestamp;
+        message.username.assign(view.username);
+        message.message.assign(view.message);
+        visitor(message);
+    });
+}
+
+u32 LogMessageStore::getMessageViews(const HistoryQuery& query, const MessageViewVisitor& visitor) const
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::GET_MESSAGES)};
+    const server::tracing::Span span{"log.getMessages", "limit", query.limit};
+
+    const u64 beforeId = query.beforeId != 0 ? query.beforeId : UNBOUNDED;
+    const u64 toTimestamp = query.toTimestamp != 0 ? query.toTimestamp : UNBOUNDED;
+    if (query.limit == 0 || query.fromTimestamp > toTimestamp || query.afterId + 1 >= beforeId)
+    {
+        return 0;
+    }
+
+    const bool forward = query.afterId != 0 && query.beforeId == 0;
+    return forward ? visitForward(query, beforeId, toTimestamp, visitor) : visitBackward(query, beforeId, toTimestamp, visitor);
+}
+
+u32 LogMessageStore::visitForward(const HistoryQuery& query, u64 beforeId, u64 toTimestamp, const MessageViewVisitor& visitor) const
+{
+    Position position{};
+    const Segment* segment;
+    u64 end;
+    {
+        const std::shared_lock lock(mutex_);
+        if (segments_.empty())
+        {
+            return 0;
+        }
+
+        position = findId(query.afterId + 1);
+        if (query.fromTimestamp != 0)
+        {
+            const auto fromTime = findTimestamp(query.fromTimestamp);
+            if (fromTime.segment > position.segment || (fromTime.segment == position.segment && fromTime.offset > position.offset))
+            {
+                position = fromTime;
+            }
+        }
+        segment = segments_[position.segment].get();
+        end = segment->end;
+    }
+
+    u32 visited = 0;
+    while (visited < query.limit)
+    {
+        if (position.offset >= end)
+        {
+            const std::shared_lock lock(mutex_);
+            if (position.segment + 1 >= segments_.size())
+            {
+                break;
+            }
+            position = Position{position.segment + 1, 0};
+            segment = segments_[position.segment].get();
+            end = segment->end;
+            continue;
+        }
+
+        const MessageView view = read(*segment, position.offset, position.offset);
+        if (view.id >= beforeId || view.timestamp > toTimestamp)
+        {
+            break;
+        }
+        if (view.id > query.afterId && view.timestamp >= query.fromTimestamp)
+        {
+            visitor(view);
+            ++visited;
+        }
+    }
+    return visited;
+}
+
+u32 LogMessageStore::visitBackward(const HistoryQuery& query, u64 beforeId, u64 toTimestamp, const MessageViewVisitor& visitor) const
+{
+    // The page is collected walking back one index interval at a time. Every chunk is scanned
+    // forward, so the matches are kept per chunk and visited newest chunk last.
+    std::vector<MessageView> matches;
+    std::vector<std::pair<std::size_t, std::size_t>> chunks;
+
+    Position upper{};
+    {
+        const std::shared_lock lock(mutex_);
+        if (segments_.empty())
+        {
+            return 0;
+        }
+
+        upper = beforeId == UNBOUNDED ? Position{segments_.size() - 1, segments_.back()->end} : findId(beforeId);
+        if (toTimestamp != UNBOUNDED)
+        {
+            const auto afterTime = findTimestamp(toTimestamp + 1);
+            if (afterTime.segment < upper.segment || (afterTime.segment == upper.segment && afterTime.offset < upper.offset))
+            {
+                upper = afterTime;
+            }
+        }
+    }
+
+    bool reachedLowerBound = false;
+    while (matches.size() < query.limit && !reachedLowerBound)
+    {
+        const Segment* segment;
+        u64 begin;
+        {
+            const std::shared_lock lock(mutex_);
+            if (upper.offset == 0)
+            {
+                if (upper.segment == 0)
+                {
+                    break;
+                }
+                upper = Position{upper.segment - 1, segments_[upper.segment - 1]->end};
+            }
+
+            segment = segments_[upper.segment].get();
+            const auto entry = std::upper_bound(segment->index.begin(), segment->index.end(), upper.offset - 1,
+                [](u64 offset, const IndexEntry& e) { return offset < e.offset; });
+            begin = std::prev(entry)->offset;
+        }
+
+        const std::size_t first = matches.size();
+        for (u64 offset = begin; offset < upper.offset;)
+        {
+            const MessageView view = read(*segment, offset, offset);
+            if (view.id <= query.afterId || view.timestamp < query.fromTimestamp)
+            {
+                reachedLowerBound = true;
+                continue;
+            }
+            if (view.id < beforeId && view.timestamp <= toTimestamp)
+            {
+                matches.push_back(view);
+            }
+        }
+        chunks.emplace_back(first, matches.size());
+        upper.offset = begin;
+    }
+
+    // the oldest chunk can hold more than the page needs, its oldest matches are dropped
+    std::size_t skip = matches.size() > query.limit ? matches.size() - query.limit : 0;
+    u32 visited = 0;
+    for (auto chunk = chunks.rbegin(); chunk != chunks.rend(); ++chunk)
+    {
+        for (std::size_t i = chunk->first; i < chunk->second; ++i)
+        {
+            if (skip > 0)
+            {
+                --skip;
+                continue;
+            }
+            visitor(matches[i]);
+            ++visited;
+        }
+    }
+    return visited;
+}
+
+LogMessageStore::Position LogMessageStore::findId(u64 id) const noexcept
+{
+    const auto segment = std::lower_bound(segments_.begin(), segments_.end(), id,
+        [](const std::unique_ptr<Segment>& s, u64 key) { return s->lastId < key; });
+    if (segment == segments_.end())
+    {
+        return Position{segments_.size() - 1, segments_.back()->end};
+    }
+
+    const auto& index = (*segment)->index;
+    const auto entry = std::upper_bound(index.begin(), index.end(), id, [](u64 key, const IndexEntry& e) { return key < e.id; });
+    const u64 offset = entry == index.begin() ? 0 : std::prev(entry)->offset;
+    return seek(**segment, static_cast<std::size_t>(segment - segments_.begin()), offset, id, 0);
+}
+
+LogMessageStore::Position LogMessageStore::findTimestamp(u64 timestamp) const noexcept
+{
+    const auto segment = std::lower_bound(segments_.begin(), segments_.end(), timestamp,
+        [](const std::unique_ptr<Segment>& s, u64 key) { return s->lastTimestamp < key; });
+    if (segment == segments_.end())
+    {
+        return Position{segments_.size() - 1, segments_.back()->end};
+    }
+
+    const auto& index = (*segment)->index;
+    const auto entry = std::lower_bound(index.begin(), index.end(), timestamp, [](const IndexEntry& e, u64 key) { return e.timestamp < key; });
+    const u64 offset = entry == index.begin() ? 0 : std::prev(entry)->offset;
+    return seek(**segment, static_cast<std::size_t>(segment - segments_.begin()), offset, 0, timestamp);
+}
+
+LogMessageStore::Position LogMessageStore::seek(const Segment& segment, std::size_t segmentIndex, u64 indexOffset, u64 id, u64 timestamp) const noexcept
+{
+    u64 offset = indexOffset;
+    while (offset < segment.end)
+    {
+        u64 next;
+        const MessageView view = read(segment, offset, next);
+        if (view.id >= id && view.timestamp >= timestamp)
+        {
+            break;
+        }
+        offset = next;
+    }
+    return Position{segmentIndex, offset};
+}
+
+MessageView LogMessageStore::read(const Segment& segment, u64 offset, u64& next) noexcept
+{
+    const char* record = segment.file.data() + offset;
+    RecordHeader header{};
+    std::memcpy(&header, record, sizeof(header));
+    next = offset + header.size;
+
+    const char* username = record + sizeof(header);
+    return MessageView{header.id, header.timestamp, std::string_view(username, header.usernameSize),
+                       std::string_view(username + header.usernameSize, header.messageSize)};
+}
+
+} // namespace server
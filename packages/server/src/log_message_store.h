@@ -0,0 +1,139 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "message_store.h"
+
+// std
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+
+namespace server
+{
+
+struct LogStoreConfig
+{
+    std::string directory = "chat_log";
+    // capacity of every segment file, a segment is mapped in full when it is opened
+    u64 segmentBytes = 64ull * 1024 * 1024;
+    // one entry of the sparse index every this many records
+    u32 indexInterval = 64;
+    // sync every batch before addMessageEntries returns, otherwise segments are only synced when
+    // the store rolls to a new one and when it closes
+    bool syncEveryBatch = false;
+};
+
+// Message as it is stored in the log, the strings point into the mapped segment
+struct MessageView
+{
+    u64 id = 0;
+    u64 timestamp = 0;
+    std::string_view username;
+    std::string_view message;
+};
+
+using MessageViewVisitor = std::function<void(const MessageView&)>;
+
+// Message store made of append-only segment files. Every batch is encoded into one buffer and
+// appended to the current segment with a single write (and at most one sync), reads go through a
+// read-only mapping of the segments. A sparse id and timestamp index, one entry every
+// indexInterval records, takes a page lookup to the right spot in a segment.
+//
+// Records in a segment are
+//   u32 size | u32 crc32 | u64 id | u64 timestamp | u32 username size | u32 message size | username | message
+// padded to 8 bytes, the crc covers everything after itself. A zero size ends the segment, and
+// opening the store drops everything after the first record that does not check out.
+class LogMessageStore final : public IMessageStore
+{
+public:
+    LogMessageStore(spdlog::logger* logger, const LogStoreConfig& config = {});
+    ~LogMessageStore() override;
+
+    LogMessageStore(const LogMessageStore&) = delete;
+    LogMessageStore& operator=(const LogMessageStore&) = delete;
+
+public:
+    void addMessageEntry(const server::messages::NewMessageReceived& message) override;
+    // Messages must come in ascending id order, a message without an id gets the next one
+    [[nodiscard]] bool addMessageEntries(const std::vector<server::messages::NewMessageReceived>& messages) override;
+    u32 getMessages(const HistoryQuery& query, const MessageVisitor& visitor) const override;
+    [[nodiscard]] u64 lastMessageId() const noexcept override;
+    // The log has no search index
+    std::optional<u32> searchMessages(const SearchQuery& query, const MessageVisitor& visitor) const override;
+
+    // Same as getMessages without copying the messages out of the mapped segments. The views stay
+    // valid as long as the store.
+    u32 getMessageViews(const HistoryQuery& query, const MessageViewVisitor& visitor) const;
+
+private:
+    struct IndexEntry
+    {
+        u64 id;
+        u64 timestamp;
+        u64 offset;
+    };
+
+    struct Segment
+    {
+        std::string path;
+        MappedFile file;
+        std::vector<IndexEntry> index;
+        // bytes of published records, readers never look past it
+        u64 end = 0;
+        u64 records = 0;
+        u64 lastId = 0;
+        u64 lastTimestamp = 0;
+    };
+
+    // Record position, offset is the segment's end when it points past the last record
+    struct Position
+    {
+        std::size_t segment;
+        u64 offset;
+    };
+
+    // Records of a batch that are written but not yet visible to readers
+    struct PendingAppend
+    {
+        Segment* segment = nullptr;
+        std::unique_ptr<Segment> created;
+        u64 begin = 0;
+        std::string buffer{};
+        std::vector<IndexEntry> index{};
+        u64 records = 0;
+        u64 lastId = 0;
+        u64 lastTimestamp = 0;
+    };
+
+    void open();
+    [[nodiscard]] bool recover(Segment& segment, bool last);
+    [[nodiscard]] std::unique_ptr<Segment> createSegment(u64 firstId);
+    [[nodiscard]] std::string segmentPath(u64 firstId) const;
+
+    // Lookups need mutex_ held shared. Both return the first record at or above the key.
+    [[nodiscard]] Position findId(u64 id) const noexcept;
+    [[nodiscard]] Position findTimestamp(u64 timestamp) const noexcept;
+    [[nodiscard]] Position seek(const Segment& segment, std::size_t segmentIndex, u64 indexOffset, u64 id, u64 timestamp) const noexcept;
+
+    // Decodes the record at offset, which must be below the segment's end
+    [[nodiscard]] static MessageView read(const Segment& segment, u64 offset, u64& next) noexcept;
+
+    u32 visitForward(const HistoryQuery& query, u64 beforeId, u64 toTimestamp, const MessageViewVisitor& visitor) const;
+    u32 visitBackward(const HistoryQuery& query, u64 beforeId, u64 toTimestamp, const MessageViewVisitor& visitor) const;
+
+private:
+    spdlog::logger* logger_;
+    LogStoreConfig config_;
+
+    // guards the segment list and the index, end and last id of every segment
+    mutable std::shared_mutex mutex_;
+    std::vector<std::unique_ptr<Segment>> segments_;
+    std::atomic<u64> lastId_{0};
+
+    // appends are serialized, only the appender writes to the files
+    std::mutex appendMutex_;
+};
+
+} // namespace server
@@ -6,6 +6,16 @@
 
 #include "db_manager.h"
 #include "data_manager.h"
+#include "database_backup.h"
+#include "log_message_store.h"
+#include "memory_message_store.h"
+#include "memory_user_store.h"
+#include "message_archiver.h"
+#include "message_writer.h"
+#include "metrics.h"
+#include "metrics_http_server.h"
+#include "tracing.h"
+#include "workload.h"
 
 int main(int argc, char **argv)
 {
@@ -14,6 +24,28 @@ int main(int argc, char **argv)
 
     std::string loggingFolder = "./logs";
     u16 port;
+    u32 metricsLogInterval = 60;
+    u16 metricsPort = 0;
+    std::string metricsAddress = "127.0.0.1";
+    server::tracing::Config traceConfig;
+    u32 traceDuration = 0;
+    DatabaseConfig dbConfig;
+    // read connections used when the profile runs on WAL and --db-readers is not given
+    constexpr u32 DEFAULT_WAL_READ_CONNECTIONS = 2;
+    server::MessageWriterConfig writerConfig;
+    u32 batchIntervalMs = static_cast<u32>(writerConfig.batchInterval.count());
+    server::DataManagerConfig dataConfig;
+    u32 retainDays = 0;
+    server::MessageArchiverConfig archiverConfig;
+    u32 archiveIntervalSeconds = static_cast<u32>(archiverConfig.interval.count());
+    server::DatabaseBackupConfig backupConfig;
+    u32 backupIntervalSeconds = 0;
+    std::string backupToken;
+    u32 backupStepBudgetUs = static_cast<u32>(backupConfig.stepBudget.count());
+    MessageStoreType messageStoreType = MessageStoreType::SQLITE;
+    server::LogStoreConfig logStoreConfig;
+    UserStoreType userStoreType = UserStoreType::SQLITE;
+    std::string workloadPath;
 
     serverApplication.add_option("-l,--log-folder", loggingFolder, "Path tp the folder where the logs from the application will be generated.")
        ->check(CLI::ExistingDirectory);
@@ -22,8 +54,99 @@ int main(int argc, char **argv)
        ->required()
        ->check(CLI::Range(1, 65535));
 
+    serverApplication.add_option("--metrics-log-interval", metricsLogInterval, "Seconds between latency histogram summaries in the log, 0 disables them");
+
+    serverApplication.add_option("--metrics-port", metricsPort, "Port of the Prometheus metrics endpoint, disabled if not set")
+       ->check(CLI::Range(1, 65535));
+
+    serverApplication.add_option("--metrics-address", metricsAddress, "Address the metrics endpoint binds to")
+       ->check(CLI::ValidIPV4);
+
+    serverApplication.add_option("--trace-file", traceConfig.path, "Write a Chrome/Perfetto trace of sampled message lifecycles to this file");
+
+    serverApplication.add_option("--trace-sample", traceConfig.sampleEvery, "Trace one in every N incoming messages")
+       ->check(CLI::Range(1u, 1000000u));
+
+    serverApplication.add_option("--trace-duration", traceDuration, "Seconds after which tracing stops and the trace file is finalized, 0 traces until shutdown");
+
+    const std::map<std::string, DurabilityProfile> dbProfiles{
+        {"strict", DurabilityProfile::STRICT},
+        {"balanced", DurabilityProfile::BALANCED},
+        {"fast", DurabilityProfile::FAST},
+    };
+    serverApplication.add_option("--db-profile", dbConfig.profile, "Database durability profile: strict, balanced or fast")
+       ->transform(CLI::CheckedTransformer(dbProfiles, CLI::ignore_case));
+
+    const auto* readersOption = serverApplication.add_option("--db-readers", dbConfig.readConnections, "Read-only database connections for history and user lookups, needs a WAL profile, 2 by default with one")
+       ->check(CLI::Range(0u, 64u));
+
+    serverApplication.add_option("--db-block-messages", dbConfig.blockMessages, "Messages packed into one compressed database row once they are all written, 0 keeps one row per message")
+       ->check(CLI::Range(0u, 65536u));
+
+    serverApplication.add_option("--db-batch-rows", writerConfig.batchRows, "Messages committed to the database in a single transaction")
+       ->check(CLI::Range(1u, 100000u));
+
+    serverApplication.add_option("--db-max-queue", writerConfig.maxQueueDepth, "Messages waiting for the database writer before new ones are dropped")
+       ->check(CLI::Range(u64{1000}, u64{100000000}));
+
+    serverApplication.add_option("--db-batch-ms", batchIntervalMs, "Longest time in milliseconds a message waits before its transaction is committed")
+       ->check(CLI::Range(1u, 60000u));
+
+    serverApplication.add_option("--backup-dir", backupConfig.directory, "Folder of online database backups, backups are disabled if not set");
+
+    serverApplication.add_option("--backup-interval", backupIntervalSeconds, "Seconds between scheduled backups, 0 only backs up on POST /backup to the metrics endpoint");
+
+    serverApplication.add_option("--backup-token", backupToken, "Token POST /backup requests must send as a bearer token, only loopback peers may request backups if not set");
+
+    serverApplication.add_option("--backup-keep", backupConfig.keep, "Backups kept in the backup folder, older ones are deleted")
+       ->check(CLI::Range(1u, 1000u));
+
+    serverApplication.add_option("--backup-step-budget-us", backupStepBudgetUs, "Longest time in microseconds a backup step should hold the database write lock")
+       ->check(CLI::Range(100u, 1000000u));
+
+    const std::map<std::string, MessageStoreType> messageStores{
+        {"sqlite", MessageStoreType::SQLITE},
+        {"log", MessageStoreType::LOG},
+        {"memory", MessageStoreType::MEMORY},
+    };
+    serverApplication.add_option("--message-store", messageStoreType, "Where chat messages are stored: sqlite, log or memory")
+       ->transform(CLI::CheckedTransformer(messageStores, CLI::ignore_case));
+
+    const std::map<std::string, UserStoreType> userStores{
+        {"sqlite", UserStoreType::SQLITE},
+        {"memory", UserStoreType::MEMORY},
+    };
+    serverApplication.add_option("--user-store", userStoreType, "Where registered users are stored: sqlite or memory")
+       ->transform(CLI::CheckedTransformer(userStores, CLI::ignore_case));
+
+    serverApplication.add_option("--record-workload", workloadPath, "Append every message and user store call to this file, for yapping_store_bench. It holds every message sent.");
+
+    serverApplication.add_option("--log-store-dir", logStoreConfig.directory, "Folder of the segment files of the log message store");
+
+    serverApplication.add_option("--retain-days", retainDays, "Days messages stay in the live table before they are archived, 0 keeps them");
+
+    serverApplication.add_option("--retain-messages", dbConfig.retention.maxMessages, "Newest messages kept in the live table, older ones are archived, 0 keeps them all");
+
+    serverApplication.add_option("--archive-interval", archiveIntervalSeconds, "Seconds between two runs of the archive job")
+       ->check(CLI::Range(1u, 86400u));
+
+    serverApplication.add_option("--history-ring", dataConfig.historyRingSize, "Most recent messages kept in memory to serve history without the database, 0 disables it")
+       ->check(CLI::Range(0u, 1000000u));
+
+    serverApplication.add_option("--workers", dataConfig.workerThreads, "Threads running database lookups away from the network thread")
+       ->check(CLI::Range(1u, 64u));
+
+    serverApplication.add_option("--credential-cache", dataConfig.credentialCacheSize, "Credential records cached for logins, 0 disables the cache")
+       ->check(CLI::Range(0u, 10000000u));
+
     CLI11_PARSE(serverApplication, argc, argv);
 
+    // readers only help under WAL, the strict profile keeps every query on the writer connection
+    if (readersOption->count() == 0 && databaseSettings(dbConfig.profile).journalMode == "WAL")
+    {
+        dbConfig.readConnections = DEFAULT_WAL_READ_CONNECTIONS;
+    }
+
     const auto timeStampStringForFile = makeSafeForFilename(getTimeStamp(currentSecondsSinceEpoch()));
     const std::string logFile = std::string(SERVER_TARGET_NAME) + "_" + timeStampStringForFile + ".log";
 
@@ -34,11 +157,87 @@ int main(int argc, char **argv)
 
     logger->info("Starting {} version {}", SERVER_TARGET_NAME, PROJECT_VERSION);
 
-    DataBaseManager dbManager{logger.get()};
+    if (!traceConfig.path.empty())
+    {
+        traceConfig.duration = std::chrono::seconds(traceDuration);
+        server::tracing::start(traceConfig, logger.get());
+    }
+
+    dbConfig.retention.maxAgeSeconds = static_cast<u64>(retainDays) * 24 * 60 * 60;
+    DataBaseManager dbManager{logger.get(), dbConfig};
 
-    server::DataManager dataManager(&dbManager, logger.get());
+    IMessageStore* messageStore = &dbManager;
+    std::unique_ptr<IMessageStore> otherMessageStore;
+    if (messageStoreType != MessageStoreType::SQLITE && dbConfig.retention.enabled())
+    {
+        logger->warn("Retention only archives the sqlite message store, other stores keep every message");
+    }
+    if (messageStoreType == MessageStoreType::LOG)
+    {
+        // the strict profile keeps its meaning, every batch is on disk before it is acknowledged
+        logStoreConfig.syncEveryBatch = dbConfig.profile == DurabilityProfile::STRICT;
+        otherMessageStore = std::make_unique<server::LogMessageStore>(logger.get(), logStoreConfig);
+        messageStore = otherMessageStore.get();
+    }
+    else if (messageStoreType == MessageStoreType::MEMORY)
+    {
+        logger->warn("Messages are kept in memory only and are lost when the server stops");
+        otherMessageStore = std::make_unique<server::MemoryMessageStore>();
+        messageStore = otherMessageStore.get();
+    }
+
+    IUserStore* userStore = &dbManager;
+    std::unique_ptr<IUserStore> memoryUserStore;
+    if (userStoreType == UserStoreType::MEMORY)
+    {
+        logger->warn("Users are kept in memory only and are lost when the server stops");
+        memoryUserStore = std::make_unique<server::MemoryUserStore>();
+        userStore = memoryUserStore.get();
+    }
+
+    std::unique_ptr<server::WorkloadRecorder> workloadRecorder;
+    if (!workloadPath.empty())
+    {
+        workloadRecorder = std::make_unique<server::WorkloadRecorder>(messageStore, userStore, logger.get(), workloadPath);
+        messageStore = workloadRecorder.get();
+        userStore = workloadRecorder.get();
+    }
+
+    backupConfig.interval = std::chrono::seconds(backupIntervalSeconds);
+    backupConfig.stepBudget = std::chrono::microseconds(backupStepBudgetUs);
+    server::DatabaseBackup databaseBackup{&dbManager, logger.get(), backupConfig};
+
+    archiverConfig.interval = std::chrono::seconds(archiveIntervalSeconds);
+    server::MessageArchiver messageArchiver{&dbManager, logger.get(), archiverConfig};
+
+    writerConfig.batchInterval = std::chrono::milliseconds(batchIntervalMs);
+    server::MessageWriter messageWriter{messageStore, logger.get(), writerConfig};
+
+    // declared after the writer, so the io thread is stopped before the writer flushes
+    server::DataManager dataManager(userStore, messageStore, &messageWriter, logger.get(), dataConfig);
     dataManager.connect("0.0.0.0", port);
 
     spdlog::info("Server started on port {}", port);
+
+    std::unique_ptr<server::MetricsHttpServer> metricsServer;
+    if (metricsPort != 0)
+    {
+        metricsServer = std::make_unique<server::MetricsHttpServer>(logger.get(), metricsAddress, metricsPort);
+        if (!backupConfig.directory.empty())
+        {
+            metricsServer->setBackupHandler([&databaseBackup] { return databaseBackup.request(); }, backupToken);
+        }
+        metricsServer->start();
+    }
+
+    std::optional<server::metrics::SummaryLogger> summaryLogger;
+    if (metricsLogInterval > 0)
+    {
+        summaryLogger.emplace(logger.get(), std::chrono::seconds(metricsLogInterval));
+    }
+
     std::cin.get();
+
+    server::tracing::stop();
+    server::metrics::logSummary(logger.get());
 }
@@ -0,0 +1,263 @@
+#include "mapped_file.h"
+
+// std
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace server
+{
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, u64 size)
+{
+    close();
+
+    // a file that failed to open or map is left closed
+    const auto openFailed = [this](std::string_view operation)
+    {
+        const bool result = fail(operation);
+        close();
+        return result;
+    };
+
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                                OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return openFailed("CreateFile");
+    }
+    handle_ = handle;
+
+    LARGE_INTEGER current{};
+    if (!GetFileSizeEx(handle, &current))
+    {
+        return openFailed("GetFileSizeEx");
+    }
+
+    size_ = std::max<u64>(static_cast<u64>(current.QuadPart), size);
+    if (static_cast<u64>(current.QuadPart) < size_)
+    {
+        LARGE_INTEGER end{};
+        end.QuadPart = static_cast<LONGLONG>(size_);
+        if (!SetFilePointerEx(handle, end, nullptr, FILE_BEGIN) || !SetEndOfFile(handle))
+        {
+            return openFailed("SetEndOfFile");
+        }
+    }
+
+    mapping_ = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ == nullptr)
+    {
+        return openFailed("CreateFileMapping");
+    }
+
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(size_)));
+    if (data_ == nullptr)
+    {
+        return openFailed("MapViewOfFile");
+    }
+    return true;
+}
+
+void MappedFile::close() noexcept
+{
+    if (data_ != nullptr)
+    {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+    if (mapping_ != nullptr)
+    {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+    if (handle_ != nullptr)
+    {
+        CloseHandle(handle_);
+        handle_ = nullptr;
+    }
+    size_ = 0;
+}
+
+bool MappedFile::write(u64 offset, const void* data, u64 size)
+{
+    const auto* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        OVERLAPPED position{};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD written = 0;
+        const auto chunk = static_cast<DWORD>(std::min<u64>(size, 1u << 30));
+        if (!WriteFile(handle_, bytes, chunk, &written, &position))
+        {
+            return fail("WriteFile");
+        }
+        bytes += written;
+        offset += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool MappedFile::sync()
+{
+    return FlushFileBuffers(handle_) ? true : fail("FlushFileBuffers");
+}
+
+bool MappedFile::fail(std::string_view operation)
+{
+    lastError_ = fmt::format("{} failed with error {}", operation, GetLastError());
+    return false;
+}
+
+bool syncFile(const std::string& path, std::string& error)
+{
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        error = fmt::format("CreateFile failed with error {}", GetLastError());
+        return false;
+    }
+
+    const bool flushed = FlushFileBuffers(handle);
+    if (!flushed)
+    {
+        error = fmt::format("FlushFileBuffers failed with error {}", GetLastError());
+    }
+    CloseHandle(handle);
+    return flushed;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, u64 size)
+{
+    close();
+
+    // a file that failed to open or map is left closed
+    const auto openFailed = [this](std::string_view operation)
+    {
+        const bool result = fail(operation);
+        close();
+        return result;
+    };
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        return openFailed("open");
+    }
+
+    struct stat status{};
+    if (fstat(fd_, &status) != 0)
+    {
+        return openFailed("fstat");
+    }
+
+    size_ = std::max<u64>(static_cast<u64>(status.st_size), size);
+    if (static_cast<u64>(status.st_size) < size_ && ftruncate(fd_, static_cast<off_t>(size_)) != 0)
+    {
+        return openFailed("ftruncate");
+    }
+
+    void* mapped = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED)
+    {
+        return openFailed("mmap");
+    }
+    data_ = static_cast<const char*>(mapped);
+    return true;
+}
+
+void MappedFile::close() noexcept
+{
+    if (data_ != nullptr)
+    {
+        munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+    }
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+}
+
+bool MappedFile::write(u64 offset, const void* data, u64 size)
+{
+    const auto* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        const ssize_t written = pwrite(fd_, bytes, size, static_cast<off_t>(offset));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return fail("pwrite");
+        }
+        bytes += written;
+        offset += static_cast<u64>(written);
+        size -= static_cast<u64>(written);
+    }
+    return true;
+}
+
+bool MappedFile::sync()
+{
+#ifdef __APPLE__
+    const int rc = fsync(fd_);
+#else
+    const int rc = fdatasync(fd_);
+#endif
+    return rc == 0 ? true : fail("fsync");
+}
+
+bool MappedFile::fail(std::string_view operation)
+{
+    lastError_ = fmt::format("{} failed: {}", operation, std::strerror(errno));
+    return false;
+}
+
+bool syncFile(const std::string& path, std::string& error)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        error = fmt::format("open failed: {}", std::strerror(errno));
+        return false;
+    }
+
+    const bool synced = fsync(fd) == 0;
+    if (!synced)
+    {
+        error = fmt::format("fsync failed: {}", std::strerror(errno));
+    }
+    ::close(fd);
+    return synced;
+}
+
+#endif
+
+} // namespace server
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "global.h"
+
+// std
+#include <string>
+
+namespace server
+{
+
+// File mapped read-only into memory in full. Writes go through the file handle at explicit
+// offsets, on every supported OS the page cache keeps them coherent with the mapping.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+    // Opens or creates path, grows it to at least size bytes and maps the whole file
+    [[nodiscard]] bool open(const std::string& path, u64 size);
+    void close() noexcept;
+
+    [[nodiscard]] bool write(u64 offset, const void* data, u64 size);
+    // Flushes written data to the disk
+    [[nodiscard]] bool sync();
+
+    [[nodiscard]] const char* data() const noexcept { return data_; }
+    [[nodiscard]] u64 size() const noexcept { return size_; }
+    [[nodiscard]] const std::string& lastError() const noexcept { return lastError_; }
+
+private:
+    [[nodiscard]] bool fail(std::string_view operation);
+
+private:
+#ifdef _WIN32
+    void* handle_{nullptr};
+    void* mapping_{nullptr};
+#else
+    int fd_{-1};
+#endif
+    const char* data_{nullptr};
+    u64 size_{0};
+    std::string lastError_;
+};
+
+// Flushes a file written and closed by someone else to the disk, without mapping it. Returns false
+// with the reason in error if it could not.
+[[nodiscard]] bool syncFile(const std::string& path, std::string& error);
+
+} // namespace server
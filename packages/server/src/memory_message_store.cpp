@@ -0,0 +1,217 @@
+#include "memory_message_store.h"
+#include "metrics.h"
+#include "tracing.h"
+
+// std
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <string_view>
+
+namespace server
+{
+
+namespace
+{
+
+constexpr u64 UNBOUNDED = std::numeric_limits<u64>::max();
+
+[[nodiscard]] bool isSpace(char c) noexcept
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+[[nodiscard]] char lower(char c) noexcept
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+[[nodiscard]] std::vector<std::string> splitWords(std::string_view text)
+{
+    std::vector<std::string> words;
+    std::size_t i = 0;
+    while (i < text.size())
+    {
+        if (isSpace(text[i]))
+        {
+            ++i;
+            continue;
+        }
+
+        auto& word = words.emplace_back();
+        for (; i < text.size() && !isSpace(text[i]); ++i)
+        {
+            word += lower(text[i]);
+        }
+    }
+    return words;
+}
+
+// Every word has to be a word of the message, the last one can also be the start of one.
+// Matching ignores ASCII case only, the FTS5 tokenizer of the SQLite store folds more.
+[[nodiscard]] bool matches(std::string_view message, const std::vector<std::string>& words) noexcept
+{
+    for (std::size_t w = 0; w < words.size(); ++w)
+    {
+        const std::string& word = words[w];
+        const bool prefix = w + 1 == words.size();
+
+        bool found = false;
+        std::size_t i = 0;
+        while (!found && i < message.size())
+        {
+            if (isSpace(message[i]))
+            {
+                ++i;
+                continue;
+            }
+
+            const std::size_t begin = i;
+            while (i < message.size() && !isSpace(message[i]))
+            {
+                ++i;
+            }
+
+            const std::size_t length = i - begin;
+            if (length == word.size() || (prefix && length > word.size()))
+            {
+                found = std::equal(word.begin(), word.end(), message.begin() + static_cast<std::ptrdiff_t>(begin),
+                    [](char a, char b) { return a == lower(b); });
+            }
+        }
+
+        if (!found)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+void MemoryMessageStore::addMessageEntry(const server::messages::NewMessageReceived& message)
+{
+    std::ignore = addMessageEntries({message});
+}
+
+bool MemoryMessageStore::addMessageEntries(const std::vector<server::messages::NewMessageReceived>& messages)
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::COMMIT_BATCH)};
+    const server::tracing::Span span{"memory.addMessageEntries", "rows", messages.size()};
+
+    const std::unique_lock lock(mutex_);
+
+    // checked before anything is added, a batch is stored whole or not at all
+    u64 lastId = messages_.empty() ? 0 : messages_.back().id;
+    for (const auto& message : messages)
+    {
+        const u64 id = message.id != 0 ? message.id : lastId + 1;
+        if (id <= lastId)
+        {
+            return false;
+        }
+        lastId = id;
+    }
+
+    lastId = messages_.empty() ? 0 : messages_.back().id;
+    for (const auto& message : messages)
+    {
+        auto& stored = messages_.emplace_back(message);
+        stored.id = message.id != 0 ? message.id : lastId + 1;
+        lastId = stored.id;
+    }
+    return true;
+}
+
+u32 MemoryMessageStore::getMessages(const HistoryQuery& query, const MessageVisitor& visitor) const
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::GET_MESSAGES)};
+    const server::tracing::Span span{"memory.getMessages", "limit", query.limit};
+
+    const u64 beforeId = query.beforeId != 0 ? query.beforeId : UNBOUNDED;
+    const u64 toTimestamp = query.toTimestamp != 0 ? query.toTimestamp : UNBOUNDED;
+    if (query.limit == 0 || query.fromTimestamp > toTimestamp || query.afterId + 1 >= beforeId)
+    {
+        return 0;
+    }
+
+    const std::shared_lock lock(mutex_);
+
+    const auto byId = [](const server::messages::NewMessageReceived& message, u64 id) { return message.id < id; };
+    const auto byTimestamp = [](const server::messages::NewMessageReceived& message, u64 timestamp) { return message.timestamp < timestamp; };
+
+    auto first = std::max(std::lower_bound(messages_.begin(), messages_.end(), query.afterId + 1, byId),
+                          std::lower_bound(messages_.begin(), messages_.end(), query.fromTimestamp, byTimestamp));
+    auto last = std::lower_bound(messages_.begin(), messages_.end(), beforeId, byId);
+    if (toTimestamp != UNBOUNDED)
+    {
+        last = std::min(last, std::lower_bound(messages_.begin(), messages_.end(), toTimestamp + 1, byTimestamp));
+    }
+    if (first >= last)
+    {
+        return 0;
+    }
+
+    const bool forward = query.afterId != 0 && query.beforeId == 0;
+    const auto available = static_cast<u64>(last - first);
+    if (available > query.limit)
+    {
+        const auto skip = static_cast<std::ptrdiff_t>(available - query.limit);
+        if (forward)
+        {
+            last -= skip;
+        }
+        else
+        {
+            first += skip;
+        }
+    }
+
+    u32 visited = 0;
+    for (auto it = first; it != last; ++it, ++visited)
+    {
+        visitor(*it);
+    }
+    return visited;
+}
+
+u64 MemoryMessageStore::lastMessageId() const noexcept
+{
+    const std::shared_lock lock(mutex_);
+    return messages_.empty() ? 0 : messages_.back().id;
+}
+
+std::optional<u32> MemoryMessageStore::searchMessages(const SearchQuery& query, const MessageVisitor& visitor) const
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::SEARCH_MESSAGES)};
+    const server::tracing::Span span{"memory.searchMessages", "limit", query.limit};
+
+    const auto words = splitWords(query.text);
+    if (words.empty() || query.limit == 0)
+    {
+        return 0;
+    }
+
+    const std::shared_lock lock(mutex_);
+
+    u32 skipped = 0;
+    u32 visited = 0;
+    for (auto it = messages_.rbegin(); it != messages_.rend() && visited < query.limit; ++it)
+    {
+        if (!matches(it->message, words))
+        {
+            continue;
+        }
+        if (skipped < query.offset)
+        {
+            ++skipped;
+            continue;
+        }
+        visitor(*it);
+        ++visited;
+    }
+    return visited;
+}
+
+} // namespace server
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "message_store.h"
+
+// std
+#include <shared_mutex>
+#include <vector>
+
+namespace server
+{
+
+// Message store that keeps every message in a vector, for tests, benchmarks and throwaway
+// servers. Messages are kept in id order, and like in the log store ids must grow and timestamps
+// must never go back, so history pages are two binary searches. Search scans the messages newest
+// first and matches words the way the SQLite store does, without ranking them.
+class MemoryMessageStore final : public IMessageStore
+{
+public:
+    MemoryMessageStore() = default;
+
+    MemoryMessageStore(const MemoryMessageStore&) = delete;
+    MemoryMessageStore& operator=(const MemoryMessageStore&) = delete;
+
+public:
+    void addMessageEntry(const server::messages::NewMessageReceived& message) override;
+    // Messages must come in ascending id order, a message without an id gets the next one
+    [[nodiscard]] bool addMessageEntries(const std::vector<server::messages::NewMessageReceived>& messages) override;
+    u32 getMessages(const HistoryQuery& query, const MessageVisitor& visitor) const override;
+    [[nodiscard]] u64 lastMessageId() const noexcept override;
+    std::optional<u32> searchMessages(const SearchQuery& query, const MessageVisitor& visitor) const override;
+
+private:
+    // visitors run with the lock held shared, appends wait for them
+    mutable std::shared_mutex mutex_;
+    std::vector<server::messages::NewMessageReceived> messages_;
+};
+
+} // namespace server
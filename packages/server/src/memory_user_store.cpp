@@ -0,0 +1,41 @@
+#include "memory_user_store.h"
+#include "metrics.h"
+
+// std
+#include <mutex>
+
+namespace server
+{
+
+AddUserResult MemoryUserStore::addNewUser(const std::string& username, u64 passwordHash)
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::INSERT_USER)};
+
+    const std::unique_lock lock(mutex_);
+    return passwordHashes_.try_emplace(username, passwordHash).second ? AddUserResult::ADDED : AddUserResult::USERNAME_TAKEN;
+}
+
+std::optional<u64> MemoryUserStore::userPasswordHash(const std::string& username) const noexcept
+{
+    const server::metrics::ScopedTimer timer{server::metrics::dbHistogram(server::metrics::DbOperation::GET_USER)};
+
+    const std::shared_lock lock(mutex_);
+    if (const auto it = passwordHashes_.find(username); it != passwordHashes_.end())
+    {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+u32 MemoryUserStore::getUsers(u32 limit, const UserVisitor& visitor) const
+{
+    const std::shared_lock lock(mutex_);
+    u32 visited = 0;
+    for (auto it = passwordHashes_.begin(); it != passwordHashes_.end() && visited < limit; ++it, ++visited)
+    {
+        visitor(it->first, it->second);
+    }
+    return visited;
+}
+
+} // namespace server
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "user_store.h"
+
+// std
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace server
+{
+
+// User store kept in a hash map, for tests, benchmarks and throwaway servers
+class MemoryUserStore final : public IUserStore
+{
+public:
+    MemoryUserStore() = default;
+
+    MemoryUserStore(const MemoryUserStore&) = delete;
+    MemoryUserStore& operator=(const MemoryUserStore&) = delete;
+
+public:
+    [[nodiscard]] AddUserResult addNewUser(const std::string& username, u64 passwordHash) override;
+    [[nodiscard]] std::optional<u64> userPasswordHash(const std::string& username) const noexcept override;
+    // in no particular order, the map does not keep one
+    u32 getUsers(u32 limit, const UserVisitor& visitor) const override;
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, u64> passwordHashes_;
+};
+
+} // namespace server
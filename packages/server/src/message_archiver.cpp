@@ -0,0 +1,93 @@
+#include "message_archiver.h"
+
+namespace server
+{
+
+MessageArchiver::MessageArchiver(DataBaseManager* dbManager, spdlog::logger* logger, const MessageArchiverConfig& config)
+    : dbManager_(dbManager), logger_(logger), config_(config)
+{
+    config_.segmentRows = std::max<u32>(1, config_.segmentRows);
+
+    const auto& retention = dbManager_->retention();
+    if (!retention.enabled())
+    {
+        return;
+    }
+
+    logger_->info("Archiving messages every {} s, {} per segment (max age {} s, max messages {}, 0 is unlimited)",
+        config_.interval.count(), config_.segmentRows, retention.maxAgeSeconds, retention.maxMessages);
+
+    thread_ = std::thread([this]
+    {
+        run();
+    });
+}
+
+MessageArchiver::~MessageArchiver()
+{
+    stop();
+}
+
+void MessageArchiver::stop()
+{
+    {
+        const std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void MessageArchiver::run()
+{
+    std::unique_lock lock(mutex_);
+    do
+    {
+        lock.unlock();
+        archivePass();
+        lock.lock();
+    } while (!cv_.wait_for(lock, config_.interval, [this] { return stopping_; }));
+}
+
+void MessageArchiver::archivePass()
+{
+    const u64 upTo = dbManager_->expiredUpTo(currentSecondsSinceEpoch());
+    if (upTo == 0)
+    {
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    u64 moved = 0;
+    u32 segments = 0;
+    while (true)
+    {
+        {
+            const std::lock_guard lock(mutex_);
+            if (stopping_)
+            {
+                break;
+            }
+        }
+
+        const u32 rows = dbManager_->archiveMessages(upTo, config_.segmentRows);
+        if (rows == 0)
+        {
+            break;
+        }
+        moved += rows;
+        ++segments;
+    }
+
+    if (moved > 0)
+    {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        logger_->info("Archived {} messages up to id {} into {} segments in {} ms", moved, upTo, segments, elapsed.count());
+    }
+}
+
+} // namespace server
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "db_manager.h"
+
+// std
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace server
+{
+
+struct MessageArchiverConfig
+{
+    // time between two passes over the live table
+    std::chrono::seconds interval{300};
+    // messages per archive segment, every segment is moved in its own transaction
+    u32 segmentRows = 1000;
+};
+
+// Background job applying the retention policy of the database. Every pass moves the expired
+// messages into compressed archive segments one segment at a time, so the write lock is only held
+// for one small transaction at a time and the DB writer thread can commit in between.
+class MessageArchiver
+{
+public:
+    MessageArchiver(DataBaseManager* dbManager, spdlog::logger* logger, const MessageArchiverConfig& config = {});
+    ~MessageArchiver();
+
+    MessageArchiver(const MessageArchiver&) = delete;
+    MessageArchiver& operator=(const MessageArchiver&) = delete;
+
+public:
+    // Finishes the segment being moved and joins the thread
+    void stop();
+
+private:
+    void run();
+    void archivePass();
+
+private:
+    DataBaseManager* dbManager_;
+    spdlog::logger* logger_;
+    MessageArchiverConfig config_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_{false};
+    std::thread thread_;
+};
+
+} // namespace server
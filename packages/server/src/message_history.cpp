@@ -0,0 +1,258 @@
+#include "message_history.h"
+#include "metrics.h"
+
+namespace server
+{
+
+MessageHistory::MessageHistory(IMessageStore* store, UserDirectory* users, u32 capacity)
+    : store_(store), users_(users), ring_(capacity)
+{
+    bytes_ = ring_.size() * sizeof(Slot);
+    publishSize();
+}
+
+u32 MessageHistory::load()
+{
+    if (ring_.empty())
+    {
+        return 0;
+    }
+
+    HistoryQuery newest;
+    newest.limit = capacity();
+    const u32 loaded = store_->getMessages(newest, [this](const server::messages::NewMessageReceived& message)
+    {
+        append(message);
+    });
+
+    complete_ = loaded < capacity();
+    publishSize();
+    return loaded;
+}
+
+void MessageHistory::append(const server::messages::NewMessageReceived& message)
+{
+    if (ring_.empty())
+    {
+        return;
+    }
+
+    auto& slot = ring_[(head_ + size_) % ring_.size()];
+    if (size_ == ring_.size())
+    {
+        // overwrite the oldest message, its text keeps its capacity
+        head_ = (head_ + 1) % static_cast<u32>(ring_.size());
+        complete_ = false;
+    }
+    else
+    {
+        ++size_;
+    }
+
+    bytes_ -= footprint(slot);
+    slot.message.id = message.id;
+    slot.message.userId = message.userId != 0 ? message.userId : users_->intern(message.username).value_or(0);
+    // an author left without an id, the directory being full, is named in the message itself
+    if (slot.message.userId == 0)
+    {
+        slot.message.username = message.username;
+    }
+    else
+    {
+        slot.message.username.clear();
+    }
+    slot.message.message = message.message;
+    slot.message.timestamp = message.timestamp;
+    // frames still queued to a connection stay alive there
+    for (auto& frame : slot.frames)
+    {
+        frame.reset();
+    }
+    bytes_ += footprint(slot);
+
+    publishSize();
+}
+
+u32 MessageHistory::getMessages(const HistoryQuery& query, const MessageVisitor& visitor)
+{
+    if (const auto served = getRecentMessages(query, visitor); served.has_value())
+    {
+        return served.value();
+    }
+    return store_->getMessages(query, visitor);
+}
+
+std::optional<u32> MessageHistory::getRecentMessages(const HistoryQuery& query, const MessageVisitor& visitor)
+{
+    server::messages::NewMessageReceived named;
+    return countLookup(serveFromRing(query, [&](u32 i)
+    {
+        const auto& message = at(i);
+        named.id = message.id;
+        named.userId = message.userId;
+        named.username = message.userId != 0 ? users_->name(message.userId) : message.username;
+        named.message = message.message;
+        named.timestamp = message.timestamp;
+        visitor(named);
+    }));
+}
+
+std::optional<u32> MessageHistory::getRecentFrames(const HistoryQuery& query, WireEncoding encoding, const FrameVisitor& visitor)
+{
+    const std::size_t before = bytes_;
+    const auto served = countLookup(serveFromRing(query, [&](u32 i) { visitor(at(i), frameAt(i, encoding)); }));
+    if (bytes_ != before)
+    {
+        publishSize();
+    }
+    return served;
+}
+
+std::optional<u32> MessageHistory::countLookup(std::optional<u32> served) noexcept
+{
+    auto& counters = metrics::counters();
+    if (served.has_value())
+    {
+        counters.historyRingHits.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        counters.historyRingMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+    return served;
+}
+
+std::optional<u32> MessageHistory::serveFromRing(const HistoryQuery& query, const std::function<void(u32)>& visitor) const
+{
+    if (query.limit == 0)
+    {
+        return 0;
+    }
+
+    if (size_ == 0)
+    {
+        return complete_ ? std::optional<u32>(0) : std::nullopt;
+    }
+
+    const u64 toTimestamp = query.toTimestamp != 0 ? query.toTimestamp : std::numeric_limits<u64>::max();
+    const auto inWindow = [&](const server::messages::NewMessageReceived& message)
+    {
+        return message.timestamp >= query.fromTimestamp && message.timestamp <= toTimestamp;
+    };
+
+    // every id above afterId is in the ring, or there is nothing older than the ring
+    const bool reachesAfterId = complete_ || query.afterId + 1 >= at(0).id;
+    const u32 end = query.beforeId != 0 ? lowerBound(query.beforeId) : size_;
+
+    u32 begin;
+    if (query.afterId != 0 && query.beforeId == 0)
+    {
+        // forward page, starting right after afterId
+        if (!reachesAfterId)
+        {
+            return std::nullopt;
+        }
+        begin = lowerBound(query.afterId + 1);
+    }
+    else
+    {
+        // backward page, walk down from beforeId until the page is full or a lower bound is hit
+        u32 matches = 0;
+        begin = end;
+        bool bounded = false;
+        while (begin > 0 && matches < query.limit)
+        {
+            const auto& message = at(begin - 1);
+            if (message.id <= query.afterId || message.timestamp < query.fromTimestamp)
+            {
+                bounded = true;
+                break;
+            }
+            matches += inWindow(message) ? 1 : 0;
+            --begin;
+        }
+
+        if (matches < query.limit && !bounded && !reachesAfterId)
+        {
+            return std::nullopt;
+        }
+    }
+
+    u32 visited = 0;
+    for (u32 i = begin; i < end && visited < query.limit; ++i)
+    {
+        const auto& message = at(i);
+        if (message.timestamp > toTimestamp)
+        {
+            break;
+        }
+        if (inWindow(message))
+        {
+            visitor(i);
+            ++visited;
+        }
+    }
+    return visited;
+}
+
+const server::messages::NewMessageReceived& MessageHistory::at(u32 i) const noexcept
+{
+    return ring_[(head_ + i) % ring_.size()].message;
+}
+
+const wire::SharedFrame& MessageHistory::frameAt(u32 i, WireEncoding encoding)
+{
+    auto& slot = ring_[(head_ + i) % ring_.size()];
+    auto& frame = slot.frames[static_cast<std::size_t>(encoding)];
+    auto& counters = metrics::counters();
+    if (frame)
+    {
+        counters.historyFrameHits.fetch_add(1, std::memory_order_relaxed);
+        return frame;
+    }
+
+    frame = std::make_shared<const std::string>(wire::encodeFrame(encoding, slot.message));
+    bytes_ += frame->capacity() + 1;
+    counters.historyFrameEncodes.fetch_add(1, std::memory_order_relaxed);
+    return frame;
+}
+
+u32 MessageHistory::lowerBound(u64 id) const noexcept
+{
+    u32 low = 0;
+    u32 high = size_;
+    while (low < high)
+    {
+        const u32 middle = low + (high - low) / 2;
+        if (at(middle).id < id)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+std::size_t MessageHistory::footprint(const Slot& slot) noexcept
+{
+    // heap blocks of the text and the cached frames, the slots themselves are counted once up front
+    const auto heap = [](const std::string& s) { return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0; };
+    std::size_t bytes = heap(slot.message.message) + heap(slot.message.username);
+    for (const auto& frame : slot.frames)
+    {
+        bytes += frame ? frame->capacity() + 1 : 0;
+    }
+    return bytes;
+}
+
+void MessageHistory::publishSize() const noexcept
+{
+    auto& counters = metrics::counters();
+    counters.historyRingMessages.store(size_, std::memory_order_relaxed);
+    counters.historyRingBytes.store(bytes_, std::memory_order_relaxed);
+}
+
+} // namespace server
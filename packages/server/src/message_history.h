@@ -0,0 +1,84 @@
+#pragma once
+
+#include "message_store.h"
+#include "user_directory.h"
+#include "wire_frame.h"
+
+// std
+#include <array>
+#include <vector>
+
+namespace server
+{
+
+// Visits a ring message, named by its userId only, and its frame
+using FrameVisitor = std::function<void(const server::messages::NewMessageReceived&, const wire::SharedFrame&)>;
+
+// Message history with the newest messages kept in memory. Recent pages, which is what almost
+// every connecting client asks for, are served from a ring of the last N messages and the store is
+// only queried for pages that reach further back. Messages enter the ring when they are accepted,
+// before the write-behind thread commits them, so the ring also covers rows still in flight.
+// Stored messages never change, so the frame of a ring message is encoded the first time it is
+// replayed in an encoding and shared by every later replay until the slot is overwritten. Ring
+// messages keep the id of their author instead of the name, their frames name them by it too.
+//
+// Not thread-safe, it is owned by the DataManager and only used from the io thread once loaded.
+class MessageHistory
+{
+public:
+    MessageHistory(IMessageStore* store, UserDirectory* users, u32 capacity);
+
+public:
+    // Fills the ring with the newest messages of the store, returns the number loaded. Called once
+    // by the startup warm-up, before anything else uses the history.
+    u32 load();
+
+    void append(const server::messages::NewMessageReceived& message);
+
+    // Same contract as IMessageStore::getMessages, the messages visited carry their username
+    u32 getMessages(const HistoryQuery& query, const MessageVisitor& visitor);
+
+    // Only answers from the ring, nullopt (and nothing visited) when the page needs the database
+    [[nodiscard]] std::optional<u32> getRecentMessages(const HistoryQuery& query, const MessageVisitor& visitor);
+
+    // Same as getRecentMessages, with the cached frames of the messages in encoding
+    [[nodiscard]] std::optional<u32> getRecentFrames(const HistoryQuery& query, WireEncoding encoding, const FrameVisitor& visitor);
+
+    [[nodiscard]] u32 size() const noexcept { return size_; }
+    [[nodiscard]] u32 capacity() const noexcept { return static_cast<u32>(ring_.size()); }
+
+private:
+    struct Slot
+    {
+        server::messages::NewMessageReceived message;
+        // one per encoding, null until the message is first replayed in it
+        std::array<wire::SharedFrame, wire::WIRE_ENCODING_COUNT> frames;
+    };
+
+    // Serves the query if the ring holds every message it can match, visiting their positions in the
+    // ring, returns nullopt otherwise
+    [[nodiscard]] std::optional<u32> serveFromRing(const HistoryQuery& query, const std::function<void(u32)>& visitor) const;
+    [[nodiscard]] static std::optional<u32> countLookup(std::optional<u32> served) noexcept;
+
+    // i-th oldest message in the ring
+    [[nodiscard]] const server::messages::NewMessageReceived& at(u32 i) const noexcept;
+    // frame of the i-th oldest message, encoded on the first call for an encoding
+    [[nodiscard]] const wire::SharedFrame& frameAt(u32 i, WireEncoding encoding);
+    // position of the first message with an id greater or equal than id
+    [[nodiscard]] u32 lowerBound(u64 id) const noexcept;
+
+    [[nodiscard]] static std::size_t footprint(const Slot& slot) noexcept;
+    void publishSize() const noexcept;
+
+private:
+    IMessageStore* store_;
+    UserDirectory* users_;
+    std::vector<Slot> ring_;
+    u32 head_{0};
+    u32 size_{0};
+    // true while the ring holds the whole table, older pages can then be answered without the store
+    bool complete_{false};
+    std::size_t bytes_{0};
+};
+
+} // namespace server
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "messages.h"
+
+// std
+#include <functional>
+#include <optional>
+#include <vector>
+
+// Keyset page of the message history. Id bounds are exclusive and the time window (seconds since
+// epoch) is inclusive, 0 leaves a bound open. When only afterId is set the page walks forward from
+// it, otherwise it holds the newest messages below beforeId. Messages are always visited in
+// ascending id order.
+struct HistoryQuery
+{
+    u64 afterId = 0;
+    u64 beforeId = 0;
+    u64 fromTimestamp = 0;
+    u64 toTimestamp = 0;
+    u32 limit = 100;
+};
+
+// Full-text search, best matches first. Pages are offsets into the ranking, so they can shift
+// while new messages are indexed.
+struct SearchQuery
+{
+    std::string text;
+    u32 offset = 0;
+    u32 limit = 20;
+};
+
+// The message is reused between rows, copy what must outlive the call
+using MessageVisitor = std::function<void(const server::messages::NewMessageReceived&)>;
+
+enum class MessageStoreType : u32
+{
+    // the messages table of the SQLite database
+    SQLITE,
+    // segmented append-only log files read through mmap
+    LOG,
+    // a vector that is gone when the server stops
+    MEMORY
+};
+
+// Storage of the chat messages, picked with --message-store. Implementations are thread-safe, the
+// DB writer thread appends while the io thread and the workers read history.
+class IMessageStore
+{
+public:
+    virtual ~IMessageStore() = default;
+
+public:
+    virtual void addMessageEntry(const server::messages::NewMessageReceived& message) = 0;
+    // Stores every message or none of them, returns false if nothing was stored
+    [[nodiscard]] virtual bool addMessageEntries(const std::vector<server::messages::NewMessageReceived>& messages) = 0;
+    // Returns the number of messages visited
+    virtual u32 getMessages(const HistoryQuery& query, const MessageVisitor& visitor) const = 0;
+    [[nodiscard]] virtual u64 lastMessageId() const noexcept = 0;
+    // Returns the number of matches visited, nullopt if the store has no search index
+    virtual std::optional<u32> searchMessages(const SearchQuery& query, const MessageVisitor& visitor) const = 0;
+};
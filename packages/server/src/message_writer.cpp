@@ -0,0 +1,274 @@
+#include "message_writer.h"
+#include "metrics.h"
+
+namespace server
+{
+
+// tries of a failing batch once the server is stopping, before its messages are given up
+constexpr u32 MAX_COMMIT_TRIES_WHILE_STOPPING = 3;
+// failed tries of a batch before it is written row by row to find the rows the store rejects
+constexpr u32 COMMIT_TRIES_BEFORE_SPLIT = 3;
+// a full queue logs the first message it drops and then one in this many
+constexpr u64 DROPPED_MESSAGES_PER_LOG = 1000;
+
+MessageWriter::MessageWriter(IMessageStore* store, spdlog::logger* logger, const MessageWriterConfig& config)
+    : store_(store), logger_(logger), config_(config)
+{
+    config_.batchRows = std::max<u32>(1, config_.batchRows);
+    batch_.reserve(config_.batchRows);
+    origins_.reserve(config_.batchRows);
+
+    logger_->info("DB writer commits every {} messages or {} ms", config_.batchRows, config_.batchInterval.count());
+    thread_ = std::thread([this] { run(); });
+}
+
+MessageWriter::~MessageWriter()
+{
+    stop();
+}
+
+void MessageWriter::enqueue(server::messages::NewMessageReceived message)
+{
+    if (stopping_.load(std::memory_order_acquire))
+    {
+        enqueuedId_.store(message.id, std::memory_order_release);
+        store_->addMessageEntry(message);
+        publishCommitted(message.id);
+        return;
+    }
+
+    // a store that fails for long would otherwise hold every message of the chat in memory
+    if (depth_.load(std::memory_order_relaxed) >= config_.maxQueueDepth)
+    {
+        const u64 dropped = ++droppedMessages_;
+        metrics::counters().dbRowsFailed.fetch_add(1, std::memory_order_relaxed);
+        if (dropped % DROPPED_MESSAGES_PER_LOG == 1)
+        {
+            logger_->error("DB writer queue is full with {} messages, message {} is not persisted ({} dropped so far)",
+                config_.maxQueueDepth, message.id, dropped);
+        }
+        return;
+    }
+
+    enqueuedId_.store(message.id, std::memory_order_release);
+    queue_.push(Entry{std::move(message), Origin{std::chrono::steady_clock::now(), tracing::currentTrace()}});
+    metrics::counters().dbQueueDepth.fetch_add(1, std::memory_order_relaxed);
+
+    // the writer sleeps until there is something to write or a full batch, wake it on those edges only
+    const u64 depth = depth_.fetch_add(1, std::memory_order_acq_rel) + 1;
+    if (depth == 1 || depth == config_.batchRows)
+    {
+        const std::lock_guard lock(mutex_);
+        cv_.notify_one();
+    }
+}
+
+void MessageWriter::stop()
+{
+    {
+        const std::lock_guard lock(mutex_);
+        stopping_.store(true, std::memory_order_release);
+    }
+    cv_.notify_all();
+
+    if (!thread_.joinable())
+    {
+        return;
+    }
+    thread_.join();
+
+    // anything a late producer pushed while the writer was exiting
+    while (auto entry = queue_.pop())
+    {
+        depth_.fetch_sub(1, std::memory_order_relaxed);
+        metrics::counters().dbQueueDepth.fetch_sub(1, std::memory_order_relaxed);
+        store_->addMessageEntry(entry->message);
+        publishCommitted(entry->message.id);
+    }
+
+    const auto& counters = metrics::counters();
+    logger_->info("DB writer stopped, {} messages written in {} transactions",
+        counters.dbRowsWritten.load(std::memory_order_relaxed), counters.dbCommits.load(std::memory_order_relaxed));
+}
+
+u64 MessageWriter::queueDepth() const noexcept
+{
+    return depth_.load(std::memory_order_relaxed);
+}
+
+bool MessageWriter::waitForCommit(u64 id, std::chrono::milliseconds timeout)
+{
+    // nothing past the last message enqueued is waited for
+    const u64 target = std::min(id, enqueuedId_.load(std::memory_order_acquire));
+    std::unique_lock lock(mutex_);
+    return committedCv_.wait_for(lock, timeout, [this, target]
+    {
+        return committedId_.load(std::memory_order_acquire) >= target;
+    });
+}
+
+void MessageWriter::publishCommitted(u64 id)
+{
+    {
+        const std::lock_guard lock(mutex_);
+        committedId_.store(std::max(id, committedId_.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+    committedCv_.notify_all();
+}
+
+void MessageWriter::run()
+{
+    auto deadline = std::chrono::steady_clock::time_point::max();
+
+    while (true)
+    {
+        while (batch_.size() < config_.batchRows)
+        {
+            auto entry = queue_.pop();
+            if (!entry.has_value())
+            {
+                break;
+            }
+
+            depth_.fetch_sub(1, std::memory_order_relaxed);
+            metrics::counters().dbQueueDepth.fetch_sub(1, std::memory_order_relaxed);
+
+            if (batch_.empty())
+            {
+                deadline = entry->origin.enqueuedAt + config_.batchInterval;
+            }
+            batch_.emplace_back(std::move(entry->message));
+            origins_.emplace_back(entry->origin);
+        }
+
+        const bool stopping = stopping_.load(std::memory_order_acquire);
+        if (!batch_.empty() && (batch_.size() >= config_.batchRows || stopping || std::chrono::steady_clock::now() >= deadline))
+        {
+            if (!commit())
+            {
+                waitBeforeRetry();
+            }
+            continue;
+        }
+
+        if (stopping && depth_.load(std::memory_order_acquire) == 0)
+        {
+            return;
+        }
+
+        std::unique_lock lock(mutex_);
+        if (batch_.empty())
+        {
+            cv_.wait(lock, [this]
+            {
+                return stopping_.load(std::memory_order_acquire) || depth_.load(std::memory_order_acquire) > 0;
+            });
+        }
+        else
+        {
+            cv_.wait_until(lock, deadline, [this]
+            {
+                return stopping_.load(std::memory_order_acquire) || depth_.load(std::memory_order_acquire) >= config_.batchRows;
+            });
+        }
+    }
+}
+
+bool MessageWriter::commit()
+{
+    const auto rows = static_cast<u64>(batch_.size());
+    auto& counters = metrics::counters();
+
+    if (store_->addMessageEntries(batch_))
+    {
+        counters.dbRowsWritten.fetch_add(rows, std::memory_order_relaxed);
+        counters.dbCommits.fetch_add(1, std::memory_order_relaxed);
+        if (failedCommits_ != 0)
+        {
+            logger_->info("DB writer committed its batch of {} messages after {} failed tries", rows, failedCommits_);
+        }
+    }
+    else
+    {
+        ++failedCommits_;
+        const bool split = failedCommits_ >= COMMIT_TRIES_BEFORE_SPLIT;
+        const auto failed = split ? commitRowByRow() : std::vector<u64>{};
+        const u64 written = split ? rows - failed.size() : 0;
+        const bool stopping = stopping_.load(std::memory_order_acquire);
+
+        if (written != 0)
+        {
+            // the other rows went in, these are rejected by the store on their own and never will be written
+            counters.dbRowsWritten.fetch_add(written, std::memory_order_relaxed);
+            counters.dbCommits.fetch_add(written, std::memory_order_relaxed);
+            counters.dbRowsFailed.fetch_add(failed.size(), std::memory_order_relaxed);
+            logger_->error("DB writer committed {} messages of a failing batch row by row", written);
+            for (const u64 id : failed)
+            {
+                logger_->error("DB writer dropped message {}, the store rejects it on its own", id);
+            }
+        }
+        else if (!stopping || failedCommits_ < MAX_COMMIT_TRIES_WHILE_STOPPING)
+        {
+            // not a single row went in, the store itself is failing
+            counters.dbCommitRetries.fetch_add(1, std::memory_order_relaxed);
+            logger_->error("DB writer failed to commit {} messages (try {}), {} more queued behind them",
+                rows, failedCommits_, depth_.load(std::memory_order_relaxed));
+            return false;
+        }
+        else
+        {
+            counters.dbRowsFailed.fetch_add(rows, std::memory_order_relaxed);
+            logger_->critical("DB writer is stopping and could not commit {} messages after {} tries, ids {} to {} are lost",
+                rows, failedCommits_, batch_.front().id, batch_.back().id);
+        }
+    }
+
+    const auto committedAt = std::chrono::steady_clock::now();
+
+    // a batch given up counts as committed, nothing waits on it any longer
+    publishCommitted(batch_.back().id);
+
+    for (const Origin& origin : origins_)
+    {
+        tracing::recordSpan(origin.trace, "db.write_behind", origin.enqueuedAt, committedAt, "batch", rows);
+    }
+
+    batch_.clear();
+    origins_.clear();
+    failedCommits_ = 0;
+    return true;
+}
+
+std::vector<u64> MessageWriter::commitRowByRow()
+{
+    std::vector<u64> failed;
+    std::vector<server::messages::NewMessageReceived> row(1);
+    for (auto& message : batch_)
+    {
+        // swapped in and back out, the batch stays whole in case no row goes in
+        std::swap(row.front(), message);
+        if (!store_->addMessageEntries(row))
+        {
+            failed.push_back(row.front().id);
+        }
+        std::swap(row.front(), message);
+    }
+    return failed;
+}
+
+void MessageWriter::waitBeforeRetry()
+{
+    // batchInterval, then doubling, so a store that stays down is not hammered
+    auto delay = std::max(config_.batchInterval, std::chrono::milliseconds(1));
+    for (u32 i = 1; i < failedCommits_ && delay < config_.maxRetryDelay; ++i)
+    {
+        delay *= 2;
+    }
+    delay = std::min(delay, config_.maxRetryDelay);
+
+    std::unique_lock lock(mutex_);
+    cv_.wait_for(lock, delay, [this] { return stopping_.load(std::memory_order_acquire); });
+}
+
+} // namespace server
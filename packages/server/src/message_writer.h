@@ -0,0 +1,105 @@
+#pragma once
+
+#include "message_store.h"
+#include "mpsc_queue.h"
+#include "tracing.h"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace server
+{
+
+struct MessageWriterConfig
+{
+    // a transaction is committed once it holds this many rows ...
+    u32 batchRows = 256;
+    // ... or when its oldest row has waited this long
+    std::chrono::milliseconds batchInterval{10};
+    // a batch that failed to commit is tried again after a delay doubling from batchInterval up to this
+    std::chrono::milliseconds maxRetryDelay{5000};
+    // messages enqueued while this many wait for the writer are dropped, bounding the memory of the queue
+    u64 maxQueueDepth = 100000;
+};
+
+// Write-behind persistence of chat messages. enqueue only pushes onto a lock-free queue, so the
+// io thread never waits on the message store. A dedicated thread groups the queued messages into one
+// transaction per batch, which turns one journal sync per message into one per batch. A batch that
+// fails to commit stays queued and is tried again with a growing delay. After a few failed tries it
+// is written row by row, and the rows the store rejects on their own are dropped, so one bad row
+// does not hold back every later message. A batch none of whose rows go in is kept, the store
+// itself is failing, and it is only given up when the server stops while the store still fails.
+class MessageWriter
+{
+public:
+    MessageWriter(IMessageStore* store, spdlog::logger* logger, const MessageWriterConfig& config = {});
+    ~MessageWriter();
+
+public:
+    // Safe to call from any thread
+    void enqueue(server::messages::NewMessageReceived message);
+
+    // Commits everything still queued and joins the writer thread. Producers must be stopped
+    // first, messages enqueued afterwards are written synchronously.
+    void stop();
+
+    [[nodiscard]] u64 queueDepth() const noexcept;
+
+    // Blocks until the messages up to id enqueued so far are committed, so a history page read
+    // afterwards holds them. False if they were not committed within timeout.
+    [[nodiscard]] bool waitForCommit(u64 id, std::chrono::milliseconds timeout);
+
+private:
+    struct Origin
+    {
+        std::chrono::steady_clock::time_point enqueuedAt;
+        tracing::TraceId trace;
+    };
+
+    struct Entry
+    {
+        server::messages::NewMessageReceived message;
+        Origin origin;
+    };
+
+    void run();
+    void publishCommitted(u64 id);
+    // false if the batch is kept for another try
+    [[nodiscard]] bool commit();
+    // Commits the batch one row per transaction, returns the ids of the rows that failed
+    [[nodiscard]] std::vector<u64> commitRowByRow();
+    // Waits out the delay before the next try, cut short by stop()
+    void waitBeforeRetry();
+
+private:
+    IMessageStore* store_;
+    spdlog::logger* logger_;
+    MessageWriterConfig config_;
+
+    MpscQueue<Entry> queue_;
+    std::atomic<u64> depth_{0};
+    std::atomic<u64> droppedMessages_{0};
+    std::atomic<bool> stopping_{false};
+
+    // only used to park the writer thread, producers take it when the writer has to wake up
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+
+    // ids increase with every message enqueued, so the last one committed tells what is still queued
+    std::atomic<u64> enqueuedId_{0};
+    std::atomic<u64> committedId_{0};
+    std::condition_variable committedCv_;
+
+    // current batch, only touched by the writer thread
+    std::vector<server::messages::NewMessageReceived> batch_;
+    std::vector<Origin> origins_;
+    // failed tries of the current batch
+    u32 failedCommits_{0};
+};
+
+} // namespace server
@@ -0,0 +1,387 @@
+#include "metrics.h"
+
+// std
+#include <memory>
+#include <vector>
+
+namespace server::metrics
+{
+
+namespace
+{
+
+struct AtomicHistogram
+{
+    std::array<std::atomic<u64>, histogram::BUCKET_COUNT> counts{};
+};
+
+class Recorder
+{
+public:
+    void record(HistogramId id, u64 value) noexcept
+    {
+        // single writer, a plain load + store is enough and avoids a locked instruction
+        auto& counter = histograms_[id].counts[histogram::bucketIndex(value)];
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void mergeInto(HistogramId id, histogram::Histogram& out) const noexcept
+    {
+        const auto& counts = histograms_[id].counts;
+        for (u32 i = 0; i < histogram::BUCKET_COUNT; ++i)
+        {
+            out.recordBucket(i, counts[i].load(std::memory_order_relaxed));
+        }
+    }
+
+private:
+    std::array<AtomicHistogram, HISTOGRAM_COUNT> histograms_{};
+};
+
+class Registry
+{
+public:
+    [[nodiscard]] static Registry& instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    [[nodiscard]] Recorder& threadRecorder()
+    {
+        thread_local Recorder* recorder = [this]
+        {
+            const std::lock_guard lock(mutex_);
+            return recorders_.emplace_back(std::make_unique<Recorder>()).get();
+        }();
+        return *recorder;
+    }
+
+    [[nodiscard]] histogram::Histogram snapshot(HistogramId id) const
+    {
+        histogram::Histogram out;
+        const std::lock_guard lock(mutex_);
+        for (const auto& recorder : recorders_)
+        {
+            recorder->mergeInto(id, out);
+        }
+        return out;
+    }
+
+private:
+    Registry() = default;
+
+    mutable std::mutex mutex_;
+    // recorders outlive their threads so samples of finished threads are kept
+    std::vector<std::unique_ptr<Recorder>> recorders_;
+};
+
+[[nodiscard]] std::string_view clientTypeName(u32 type) noexcept
+{
+    switch (static_cast<ClientMessageType>(type))
+    {
+    case ClientMessageType::INITIAL_CONNECTION: return "initial_connection";
+    case ClientMessageType::NEW_MESSAGE: return "new_message";
+    case ClientMessageType::REGISTER: return "register";
+    case ClientMessageType::LOGIN: return "login";
+    case ClientMessageType::SEARCH_MESSAGES: return "search_messages";
+    }
+    return {};
+}
+
+[[nodiscard]] std::string_view serverTypeName(u32 type) noexcept
+{
+    switch (static_cast<ServerMessageType>(type))
+    {
+    case ServerMessageType::RECEIVED_MESSAGE: return "received_message";
+    case ServerMessageType::USER_STATUS: return "user_status";
+    case ServerMessageType::SERVER_RESPONSE: return "server_response";
+    case ServerMessageType::SEARCH_RESULTS: return "search_results";
+    case ServerMessageType::USER_NAMES: return "user_names";
+    }
+    return {};
+}
+
+[[nodiscard]] std::string_view dbOperationName(u32 operation) noexcept
+{
+    switch (static_cast<DbOperation>(operation))
+    {
+    case DbOperation::INSERT_MESSAGE: return "insert_message";
+    case DbOperation::GET_MESSAGES: return "get_messages";
+    case DbOperation::COMMIT_BATCH: return "commit_batch";
+    case DbOperation::GET_USER: return "get_user";
+    case DbOperation::INSERT_USER: return "insert_user";
+    case DbOperation::ARCHIVE_SEGMENT: return "archive_segment";
+    case DbOperation::SEARCH_MESSAGES: return "search_messages";
+    case DbOperation::BACKUP_STEP: return "backup_step";
+    case DbOperation::COUNT: break;
+    }
+    return {};
+}
+
+}
+
+HistogramInfo describe(HistogramId id) noexcept
+{
+    if (id < CLIENT_TYPE_SLOTS)
+    {
+        return {Stage::DECODE, "decode", clientTypeName(id)};
+    }
+    id -= CLIENT_TYPE_SLOTS;
+
+    if (id < CLIENT_TYPE_SLOTS)
+    {
+        return {Stage::HANDLER, "handler", clientTypeName(id)};
+    }
+    id -= CLIENT_TYPE_SLOTS;
+
+    if (id < DB_SLOTS)
+    {
+        return {Stage::DB, "db", dbOperationName(id)};
+    }
+    id -= DB_SLOTS;
+
+    return {Stage::OUTBOX, "outbox", serverTypeName(id)};
+}
+
+void record(HistogramId id, std::chrono::nanoseconds elapsed) noexcept
+{
+    Registry::instance().threadRecorder().record(id, static_cast<u64>(std::max<i64>(0, elapsed.count())));
+}
+
+histogram::Histogram snapshot(HistogramId id)
+{
+    return Registry::instance().snapshot(id);
+}
+
+Counters& counters() noexcept
+{
+    static Counters instance;
+    return instance;
+}
+
+void addUserWithStatus(UserStatusType status) noexcept
+{
+    counters().usersByStatus[static_cast<u32>(status)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void changeUserStatus(UserStatusType from, UserStatusType to) noexcept
+{
+    if (from == to)
+    {
+        return;
+    }
+
+    counters().usersByStatus[static_cast<u32>(from)].fetch_sub(1, std::memory_order_relaxed);
+    counters().usersByStatus[static_cast<u32>(to)].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string renderPrometheus(const Rates& rates)
+{
+    const auto& c = counters();
+    std::string out;
+    out.reserve(16 * 1024);
+
+    const auto metric = [&out](std::string_view name, std::string_view type, std::string_view help)
+    {
+        out += fmt::format("# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+    };
+
+    metric("yapping_connections_accepted_total", "counter", "Connections accepted since startup.");
+    out += fmt::format("yapping_connections_accepted_total {}\n", c.connectionsAccepted.load(std::memory_order_relaxed));
+
+    metric("yapping_connections_open", "gauge", "Currently open client connections.");
+    out += fmt::format("yapping_connections_open {}\n", c.openConnections.load(std::memory_order_relaxed));
+
+    metric("yapping_outbox_bytes", "gauge", "Bytes queued in connection outboxes waiting to be written.");
+    out += fmt::format("yapping_outbox_bytes {}\n", c.outboxBytes.load(std::memory_order_relaxed));
+
+    metric("yapping_messages_in_total", "counter", "Client messages decoded.");
+    out += fmt::format("yapping_messages_in_total {}\n", c.messagesIn.load(std::memory_order_relaxed));
+
+    metric("yapping_messages_out_total", "counter", "Server messages written to a connection.");
+    out += fmt::format("yapping_messages_out_total {}\n", c.messagesOut.load(std::memory_order_relaxed));
+
+    metric("yapping_messages_in_per_second", "gauge", "Client messages decoded during the last second.");
+    out += fmt::format("yapping_messages_in_per_second {}\n", rates.messagesInPerSecond);
+
+    metric("yapping_messages_out_per_second", "gauge", "Server messages written during the last second.");
+    out += fmt::format("yapping_messages_out_per_second {}\n", rates.messagesOutPerSecond);
+
+    metric("yapping_users", "gauge", "Known users by status.");
+    constexpr std::array<std::string_view, 3> statusNames{"online", "away", "offline"};
+    for (u32 i = 0; i < statusNames.size(); ++i)
+    {
+        out += fmt::format("yapping_users{{status=\"{}\"}} {}\n", statusNames[i], c.usersByStatus[i].load(std::memory_order_relaxed));
+    }
+
+    metric("yapping_db_queue_depth", "gauge", "Messages waiting for the DB writer thread.");
+    out += fmt::format("yapping_db_queue_depth {}\n", c.dbQueueDepth.load(std::memory_order_relaxed));
+
+    metric("yapping_db_rows_written_total", "counter", "Messages committed by the DB writer thread.");
+    out += fmt::format("yapping_db_rows_written_total {}\n", c.dbRowsWritten.load(std::memory_order_relaxed));
+
+    metric("yapping_db_commit_retries_total", "counter", "Batches the DB writer thread tried again after a failed commit.");
+    out += fmt::format("yapping_db_commit_retries_total {}\n", c.dbCommitRetries.load(std::memory_order_relaxed));
+
+    metric("yapping_db_rows_failed_total", "counter", "Messages lost: rejected by the store on their own, dropped by a full DB writer queue or still failing when the server stopped.");
+    out += fmt::format("yapping_db_rows_failed_total {}\n", c.dbRowsFailed.load(std::memory_order_relaxed));
+
+    metric("yapping_db_commits_total", "counter", "Transactions committed by the DB writer thread.");
+    out += fmt::format("yapping_db_commits_total {}\n", c.dbCommits.load(std::memory_order_relaxed));
+
+    metric("yapping_history_ring_requests_total", "counter", "History pages requested, by whether the recent message ring could serve them.");
+    out += fmt::format("yapping_history_ring_requests_total{{result=\"hit\"}} {}\n", c.historyRingHits.load(std::memory_order_relaxed));
+    out += fmt::format("yapping_history_ring_requests_total{{result=\"miss\"}} {}\n", c.historyRingMisses.load(std::memory_order_relaxed));
+
+    metric("yapping_history_ring_messages", "gauge", "Messages held in the recent message ring.");
+    out += fmt::format("yapping_history_ring_messages {}\n", c.historyRingMessages.load(std::memory_order_relaxed));
+
+    metric("yapping_history_ring_bytes", "gauge", "Approximate memory used by the recent message ring.");
+    out += fmt::format("yapping_history_ring_bytes {}\n", c.historyRingBytes.load(std::memory_order_relaxed));
+
+    metric("yapping_history_frames_total", "counter", "Frames of ring messages replayed to connecting clients, by whether they were cached or had to be encoded.");
+    out += fmt::format("yapping_history_frames_total{{result=\"cached\"}} {}\n", c.historyFrameHits.load(std::memory_order_relaxed));
+    out += fmt::format("yapping_history_frames_total{{result=\"encoded\"}} {}\n", c.historyFrameEncodes.load(std::memory_order_relaxed));
+
+    metric("yapping_known_users", "gauge", "Usernames given a numeric id since the server started, packets refer to them by it.");
+    out += fmt::format("yapping_known_users {}\n", c.knownUsers.load(std::memory_order_relaxed));
+
+    metric("yapping_worker_queue_depth", "gauge", "Tasks waiting for a worker thread.");
+    out += fmt::format("yapping_worker_queue_depth {}\n", c.workerQueueDepth.load(std::memory_order_relaxed));
+
+    metric("yapping_auth_cache_requests_total", "counter", "Credential lookups, by whether the cache had the record.");
+    out += fmt::format("yapping_auth_cache_requests_total{{result=\"hit\"}} {}\n", c.authCacheHits.load(std::memory_order_relaxed));
+    out += fmt::format("yapping_auth_cache_requests_total{{result=\"miss\"}} {}\n", c.authCacheMisses.load(std::memory_order_relaxed));
+
+    metric("yapping_auth_cache_entries", "gauge", "Credential records held in the cache.");
+    out += fmt::format("yapping_auth_cache_entries {}\n", c.authCacheEntries.load(std::memory_order_relaxed));
+
+    metric("yapping_warmup_running", "gauge", "1 while the startup warm-up loads the caches, client messages are queued meanwhile.");
+    out += fmt::format("yapping_warmup_running {}\n", c.warmUpRunning.load(std::memory_order_relaxed));
+
+    metric("yapping_warmup_duration_seconds", "gauge", "Wall time of the startup warm-up, 0 until it has finished.");
+    out += fmt::format("yapping_warmup_duration_seconds {}\n", static_cast<f64>(c.warmUpDurationMs.load(std::memory_order_relaxed)) / 1000.0);
+
+    metric("yapping_warmup_queued_messages_total", "counter", "Client messages that waited for the startup warm-up.");
+    out += fmt::format("yapping_warmup_queued_messages_total {}\n", c.warmUpQueuedMessages.load(std::memory_order_relaxed));
+
+    metric("yapping_warmup_rejected_messages_total", "counter", "Client messages answered with SERVER_ERROR because the warm-up queue was full.");
+    out += fmt::format("yapping_warmup_rejected_messages_total {}\n", c.warmUpRejectedMessages.load(std::memory_order_relaxed));
+
+    metric("yapping_archive_segments_total", "counter", "Compressed archive segments written by the retention job or as closed message blocks.");
+    out += fmt::format("yapping_archive_segments_total {}\n", c.archiveSegments.load(std::memory_order_relaxed));
+
+    metric("yapping_archived_messages_total", "counter", "Messages moved from the live table into the archive.");
+    out += fmt::format("yapping_archived_messages_total {}\n", c.archivedRows.load(std::memory_order_relaxed));
+
+    metric("yapping_archive_bytes_total", "counter", "Archived message bytes, before and after compression.");
+    out += fmt::format("yapping_archive_bytes_total{{stage=\"raw\"}} {}\n", c.archiveRawBytes.load(std::memory_order_relaxed));
+    out += fmt::format("yapping_archive_bytes_total{{stage=\"compressed\"}} {}\n", c.archiveBytes.load(std::memory_order_relaxed));
+
+    metric("yapping_backups_total", "counter", "Online database backups, by result.");
+    out += fmt::format("yapping_backups_total{{result=\"completed\"}} {}\n", c.backupsCompleted.load(std::memory_order_relaxed));
+    out += fmt::format("yapping_backups_total{{result=\"failed\"}} {}\n", c.backupsFailed.load(std::memory_order_relaxed));
+
+    metric("yapping_backup_running", "gauge", "1 while an online backup is copying pages.");
+    out += fmt::format("yapping_backup_running {}\n", c.backupRunning.load(std::memory_order_relaxed));
+
+    metric("yapping_backup_pages", "gauge", "Pages of the database being backed up, in total and still to copy.");
+    out += fmt::format("yapping_backup_pages{{state=\"total\"}} {}\n", c.backupPagesTotal.load(std::memory_order_relaxed));
+    out += fmt::format("yapping_backup_pages{{state=\"remaining\"}} {}\n", c.backupPagesRemaining.load(std::memory_order_relaxed));
+
+    metric("yapping_backup_last_duration_seconds", "gauge", "Wall time of the last completed backup.");
+    out += fmt::format("yapping_backup_last_duration_seconds {}\n", static_cast<f64>(c.backupLastDurationMs.load(std::memory_order_relaxed)) / 1000.0);
+
+    metric("yapping_backup_last_success_timestamp_seconds", "gauge", "Unix time the last backup completed, 0 if none has.");
+    out += fmt::format("yapping_backup_last_success_timestamp_seconds {}\n", c.backupLastSuccess.load(std::memory_order_relaxed));
+
+    metric("yapping_latency_seconds", "summary", "Latency per stage and message type or DB operation.");
+    constexpr std::array<f64, 5> quantiles{0.5, 0.9, 0.99, 0.999, 1.0};
+    for (HistogramId id = 0; id < HISTOGRAM_COUNT; ++id)
+    {
+        const auto info = describe(id);
+        if (info.label.empty())
+        {
+            continue;
+        }
+
+        const auto h = snapshot(id);
+        const std::string labels = fmt::format("stage=\"{}\",type=\"{}\"", info.stageName, info.label);
+        for (const f64 quantile : quantiles)
+        {
+            out += fmt::format("yapping_latency_seconds{{{},quantile=\"{}\"}} {:.9f}\n",
+                labels, quantile, static_cast<f64>(h.percentile(quantile * 100.0)) / 1e9);
+        }
+        out += fmt::format("yapping_latency_seconds_sum{{{}}} {:.9f}\n", labels, static_cast<f64>(h.sum()) / 1e9);
+        out += fmt::format("yapping_latency_seconds_count{{{}}} {}\n", labels, h.count());
+    }
+
+    return out;
+}
+
+void logSummary(spdlog::logger* logger)
+{
+    const auto& c = counters();
+    const u64 hits = c.historyRingHits.load(std::memory_order_relaxed);
+    const u64 misses = c.historyRingMisses.load(std::memory_order_relaxed);
+    if (hits + misses > 0)
+    {
+        logger->info("history ring: {} hits, {} misses ({:.1f}% hit rate), {} messages in {:.1f} KiB",
+            hits, misses, 100.0 * static_cast<f64>(hits) / static_cast<f64>(hits + misses),
+            c.historyRingMessages.load(std::memory_order_relaxed),
+            static_cast<f64>(c.historyRingBytes.load(std::memory_order_relaxed)) / 1024.0);
+    }
+
+    for (HistogramId id = 0; id < HISTOGRAM_COUNT; ++id)
+    {
+        const auto info = describe(id);
+        if (info.label.empty())
+        {
+            continue;
+        }
+
+        const auto h = snapshot(id);
+        if (h.count() == 0)
+        {
+            continue;
+        }
+
+        logger->info("latency {} {}: count={} p50={:.1f}us p90={:.1f}us p99={:.1f}us p999={:.1f}us max={:.1f}us",
+            info.stageName, info.label, h.count(),
+            static_cast<f64>(h.percentile(50.0)) / 1000.0,
+            static_cast<f64>(h.percentile(90.0)) / 1000.0,
+            static_cast<f64>(h.percentile(99.0)) / 1000.0,
+            static_cast<f64>(h.percentile(99.9)) / 1000.0,
+            static_cast<f64>(h.max()) / 1000.0);
+    }
+}
+
+SummaryLogger::SummaryLogger(spdlog::logger* logger, std::chrono::seconds interval)
+    : logger_(logger), interval_(interval)
+{
+    thread_ = std::thread([this]
+    {
+        std::unique_lock lock(mutex_);
+        while (!cv_.wait_for(lock, interval_, [this] { return stopping_; }))
+        {
+            logSummary(logger_);
+        }
+    });
+}
+
+SummaryLogger::~SummaryLogger()
+{
+    {
+        const std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+} // namespace server::metrics
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "histogram.h"
+
+// std
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace server::metrics
+{
+
+enum class DbOperation
+{
+    INSERT_MESSAGE,
+    GET_MESSAGES,
+    COMMIT_BATCH,
+    GET_USER,
+    INSERT_USER,
+    ARCHIVE_SEGMENT,
+    SEARCH_MESSAGES,
+    BACKUP_STEP,
+    COUNT
+};
+
+// Every stage has one histogram per message type (or DB operation). Message type slots are
+// indexed by the wire value of the enum, so they must stay below the slot counts.
+constexpr u32 CLIENT_TYPE_SLOTS = 8;
+constexpr u32 SERVER_TYPE_SLOTS = 8;
+constexpr u32 DB_SLOTS = static_cast<u32>(DbOperation::COUNT);
+
+enum class Stage
+{
+    DECODE,
+    HANDLER,
+    DB,
+    OUTBOX
+};
+
+using HistogramId = u32;
+
+[[nodiscard]] constexpr HistogramId decodeHistogram(ClientMessageType type) noexcept
+{
+    return std::min(static_cast<u32>(type), CLIENT_TYPE_SLOTS - 1);
+}
+
+[[nodiscard]] constexpr HistogramId handlerHistogram(ClientMessageType type) noexcept
+{
+    return CLIENT_TYPE_SLOTS + std::min(static_cast<u32>(type), CLIENT_TYPE_SLOTS - 1);
+}
+
+[[nodiscard]] constexpr HistogramId dbHistogram(DbOperation operation) noexcept
+{
+    return 2 * CLIENT_TYPE_SLOTS + static_cast<u32>(operation);
+}
+
+[[nodiscard]] constexpr HistogramId outboxHistogram(ServerMessageType type) noexcept
+{
+    return 2 * CLIENT_TYPE_SLOTS + DB_SLOTS + std::min(static_cast<u32>(type), SERVER_TYPE_SLOTS - 1);
+}
+
+constexpr u32 HISTOGRAM_COUNT = 2 * CLIENT_TYPE_SLOTS + DB_SLOTS + SERVER_TYPE_SLOTS;
+
+struct HistogramInfo
+{
+    Stage stage;
+    std::string_view stageName;
+    std::string_view label;
+};
+
+// Stage and label (message type or DB operation) of a histogram, label is empty for unused slots
+[[nodiscard]] HistogramInfo describe(HistogramId id) noexcept;
+
+// Records a latency sample in the calling thread's recorder. Only the owning thread ever writes
+// to a recorder, so recording is a couple of relaxed loads and stores with no contention.
+void record(HistogramId id, std::chrono::nanoseconds elapsed) noexcept;
+
+// Merges the recorders of every thread into a single histogram (values in nanoseconds)
+[[nodiscard]] histogram::Histogram snapshot(HistogramId id);
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(HistogramId id) noexcept
+        : id_(id), start_(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        record(id_, std::chrono::steady_clock::now() - start_);
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    HistogramId id_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Counters and gauges, written from the io thread and read by the metrics endpoint
+struct Counters
+{
+    std::atomic<u64> connectionsAccepted{0};
+    std::atomic<i64> openConnections{0};
+    std::atomic<i64> outboxBytes{0};
+    std::atomic<u64> messagesIn{0};
+    std::atomic<u64> messagesOut{0};
+    std::array<std::atomic<i64>, 3> usersByStatus{};
+
+    // write-behind message persistence
+    std::atomic<i64> dbQueueDepth{0};
+    std::atomic<u64> dbRowsWritten{0};
+    std::atomic<u64> dbCommits{0};
+    std::atomic<u64> dbCommitRetries{0};
+    std::atomic<u64> dbRowsFailed{0};
+
+    // in-memory ring of recent messages in front of the history queries
+    std::atomic<u64> historyRingHits{0};
+    std::atomic<u64> historyRingMisses{0};
+    std::atomic<u64> historyRingMessages{0};
+    std::atomic<u64> historyRingBytes{0};
+    std::atomic<u64> historyFrameHits{0};
+    std::atomic<u64> historyFrameEncodes{0};
+
+    // usernames given an id by the user directory
+    std::atomic<u64> knownUsers{0};
+
+    // worker pool and credential cache
+    std::atomic<i64> workerQueueDepth{0};
+    std::atomic<u64> authCacheHits{0};
+    std::atomic<u64> authCacheMisses{0};
+    std::atomic<u64> authCacheEntries{0};
+
+    // retention and message blocks, messages moved into compressed archive segments
+    std::atomic<u64> archiveSegments{0};
+    std::atomic<u64> archivedRows{0};
+    std::atomic<u64> archiveRawBytes{0};
+    std::atomic<u64> archiveBytes{0};
+
+    // startup warm-up of the history ring and the credential cache
+    std::atomic<i64> warmUpRunning{0};
+    std::atomic<u64> warmUpDurationMs{0};
+    std::atomic<u64> warmUpQueuedMessages{0};
+    std::atomic<u64> warmUpRejectedMessages{0};
+
+    // online database backups
+    std::atomic<u64> backupsCompleted{0};
+    std::atomic<u64> backupsFailed{0};
+    std::atomic<i64> backupRunning{0};
+    std::atomic<u64> backupPagesTotal{0};
+    std::atomic<u64> backupPagesRemaining{0};
+    std::atomic<u64> backupLastDurationMs{0};
+    std::atomic<u64> backupLastSuccess{0};
+};
+
+[[nodiscard]] Counters& counters() noexcept;
+
+void addUserWithStatus(UserStatusType status) noexcept;
+void changeUserStatus(UserStatusType from, UserStatusType to) noexcept;
+
+struct Rates
+{
+    f64 messagesInPerSecond = 0.0;
+    f64 messagesOutPerSecond = 0.0;
+};
+
+// Renders counters, gauges and latency summaries in the Prometheus text exposition format
+[[nodiscard]] std::string renderPrometheus(const Rates& rates);
+
+// Writes one line per non-empty histogram to the logger
+void logSummary(spdlog::logger* logger);
+
+// Periodically logs the summary from its own thread
+class SummaryLogger
+{
+public:
+    SummaryLogger(spdlog::logger* logger, std::chrono::seconds interval);
+    ~SummaryLogger();
+
+private:
+    spdlog::logger* logger_;
+    std::chrono::seconds interval_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_{false};
+    std::thread thread_;
+};
+
+} // namespace server::metrics
@@ -0,0 +1,249 @@
+#include "metrics_http_server.h"
+
+namespace server
+{
+
+namespace
+{
+
+constexpr std::size_t MAX_REQUEST_SIZE = 8 * 1024;
+// a scrape that has not sent its request and read the answer by then is closed
+constexpr auto SESSION_TIMEOUT = std::chrono::seconds(10);
+
+[[nodiscard]] std::string makeResponse(std::string_view status, std::string_view contentType, const std::string& body)
+{
+    return fmt::format("HTTP/1.1 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
+        status, contentType, body.size(), body);
+}
+
+}
+
+struct MetricsHttpServer::Session
+{
+    explicit Session(asio::strand<asio::io_context::executor_type>& strand)
+        : socket(strand), deadline(strand), request(MAX_REQUEST_SIZE)
+    {
+    }
+
+    asio::ip::tcp::socket socket;
+    asio::steady_timer deadline;
+    asio::streambuf request;
+    std::string response;
+};
+
+MetricsHttpServer::MetricsHttpServer(spdlog::logger* logger, const std::string& address, u16 port)
+    : logger_(logger),
+      strand_(asio::make_strand(io_)),
+      acceptor_(strand_, asio::ip::tcp::endpoint(asio::ip::make_address(address), port)),
+      rateTimer_(strand_)
+{
+}
+
+MetricsHttpServer::~MetricsHttpServer()
+{
+    stop();
+}
+
+void MetricsHttpServer::start()
+{
+    if (running_)
+    {
+        return;
+    }
+    running_ = true;
+
+    logger_->info("Metrics endpoint listening on {}:{}", acceptor_.local_endpoint().address().to_string(), acceptor_.local_endpoint().port());
+
+    asio::post(strand_, [this]
+    {
+        lastSample_ = std::chrono::steady_clock::now();
+        doAccept();
+        scheduleRateSample();
+    });
+    thread_ = std::thread([this] { io_.run(); });
+}
+
+void MetricsHttpServer::stop()
+{
+    if (!running_)
+    {
+        return;
+    }
+    running_ = false;
+
+    asio::post(strand_, [this]
+    {
+        std::error_code ec;
+        std::ignore = acceptor_.close(ec);
+        rateTimer_.cancel();
+
+        // an idle scrape would keep a read pending and the thread running
+        const auto open = std::move(sessions_);
+        for (const auto& session : open)
+        {
+            closeSession(session);
+        }
+    });
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void MetricsHttpServer::setBackupHandler(std::function<bool()> handler, std::string token)
+{
+    backupHandler_ = std::move(handler);
+    backupToken_ = std::move(token);
+}
+
+void MetricsHttpServer::doAccept()
+{
+    auto session = std::make_shared<Session>(strand_);
+    acceptor_.async_accept(session->socket, [this, session](std::error_code ec)
+    {
+        if (!acceptor_.is_open())
+        {
+            return;
+        }
+
+        if (!ec)
+        {
+            handleSession(session);
+        }
+        doAccept();
+    });
+}
+
+void MetricsHttpServer::handleSession(const std::shared_ptr<Session>& session)
+{
+    sessions_.insert(session);
+    session->deadline.expires_after(SESSION_TIMEOUT);
+    session->deadline.async_wait([this, session](std::error_code ec)
+    {
+        if (!ec)
+        {
+            closeSession(session);
+        }
+    });
+
+    asio::async_read_until(session->socket, session->request, "\r\n\r\n",
+        [this, session](std::error_code ec, std::size_t)
+        {
+            if (ec)
+            {
+                closeSession(session);
+                return;
+            }
+
+            std::istream is(&session->request);
+            std::string method;
+            std::string target;
+            is >> method >> target;
+
+            if (target == "/backup" && backupHandler_)
+            {
+                if (method != "POST")
+                {
+                    session->response = makeResponse("405 Method Not Allowed", "text/plain", "");
+                }
+                else if (!backupAllowed(session, is))
+                {
+                    logger_->warn("Rejected a backup request through the metrics endpoint");
+                    session->response = makeResponse("403 Forbidden", "text/plain", "");
+                }
+                else if (backupHandler_())
+                {
+                    logger_->info("Backup requested through the metrics endpoint");
+                    session->response = makeResponse("202 Accepted", "text/plain", "backup started\n");
+                }
+                else
+                {
+                    session->response = makeResponse("409 Conflict", "text/plain", "a backup is already running\n");
+                }
+            }
+            else if (method != "GET")
+            {
+                session->response = makeResponse("405 Method Not Allowed", "text/plain", "");
+            }
+            else if (target == "/metrics")
+            {
+                session->response = makeResponse("200 OK", "text/plain; version=0.0.4", metrics::renderPrometheus(rates_));
+            }
+            else
+            {
+                session->response = makeResponse("404 Not Found", "text/plain", "");
+            }
+
+            asio::async_write(session->socket, asio::buffer(session->response),
+                [this, session](std::error_code, std::size_t)
+                {
+                    std::error_code ignore;
+                    std::ignore = session->socket.shutdown(asio::ip::tcp::socket::shutdown_both, ignore);
+                    closeSession(session);
+                });
+        });
+}
+
+void MetricsHttpServer::closeSession(const std::shared_ptr<Session>& session)
+{
+    sessions_.erase(session);
+    session->deadline.cancel();
+    std::error_code ignore;
+    std::ignore = session->socket.close(ignore);
+}
+
+bool MetricsHttpServer::backupAllowed(const std::shared_ptr<Session>& session, std::istream& headers) const
+{
+    if (backupToken_.empty())
+    {
+        std::error_code ec;
+        const auto peer = session->socket.remote_endpoint(ec);
+        return !ec && peer.address().is_loopback();
+    }
+
+    constexpr std::string_view AUTHORIZATION = "Authorization: Bearer ";
+    std::string line;
+    while (std::getline(headers, line) && line != "\r")
+    {
+        if (line.ends_with('\r'))
+        {
+            line.pop_back();
+        }
+        if (line.starts_with(AUTHORIZATION))
+        {
+            return std::string_view(line).substr(AUTHORIZATION.size()) == backupToken_;
+        }
+    }
+    return false;
+}
+
+void MetricsHttpServer::scheduleRateSample()
+{
+    rateTimer_.expires_after(std::chrono::seconds(1));
+    rateTimer_.async_wait([this](std::error_code ec)
+    {
+        if (ec)
+        {
+            return;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const f64 elapsed = std::chrono::duration<f64>(now - lastSample_).count();
+        const u64 messagesIn = metrics::counters().messagesIn.load(std::memory_order_relaxed);
+        const u64 messagesOut = metrics::counters().messagesOut.load(std::memory_order_relaxed);
+
+        if (elapsed > 0.0)
+        {
+            rates_.messagesInPerSecond = static_cast<f64>(messagesIn - lastMessagesIn_) / elapsed;
+            rates_.messagesOutPerSecond = static_cast<f64>(messagesOut - lastMessagesOut_) / elapsed;
+        }
+
+        lastMessagesIn_ = messagesIn;
+        lastMessagesOut_ = messagesOut;
+        lastSample_ = now;
+        scheduleRateSample();
+    });
+}
+
+} // namespace server
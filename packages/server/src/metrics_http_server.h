@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef ASIO_STANDALONE
+#  define ASIO_STANDALONE
+#endif
+
+#include "metrics.h"
+
+// asio
+#include "asio.hpp"
+
+// std
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+
+namespace server
+{
+
+// Minimal HTTP/1.1 listener serving GET /metrics in the Prometheus text format, and POST /backup
+// to start a database backup when a backup handler is set. Backups are only started for loopback
+// peers, or for requests carrying the backup token once one is set. It owns its io_context and thread,
+// and every handler runs on a single strand, so a scrape never competes with the chat io thread.
+class MetricsHttpServer
+{
+public:
+    MetricsHttpServer(spdlog::logger* logger, const std::string& address, u16 port);
+    ~MetricsHttpServer();
+
+public:
+    void start();
+    void stop();
+    // Runs on POST /backup, returns false if no backup could be started. With a token, requests must
+    // send it as "Authorization: Bearer <token>" from any address. Set before start().
+    void setBackupHandler(std::function<bool()> handler, std::string token = {});
+
+private:
+    struct Session;
+
+    void doAccept();
+    void handleSession(const std::shared_ptr<Session>& session);
+    void closeSession(const std::shared_ptr<Session>& session);
+    [[nodiscard]] bool backupAllowed(const std::shared_ptr<Session>& session, std::istream& headers) const;
+    void scheduleRateSample();
+
+private:
+    spdlog::logger* logger_;
+    asio::io_context io_;
+    asio::strand<asio::io_context::executor_type> strand_;
+    asio::ip::tcp::acceptor acceptor_;
+    asio::steady_timer rateTimer_;
+    std::thread thread_;
+    bool running_{false};
+    std::function<bool()> backupHandler_;
+    std::string backupToken_;
+    // connections not answered yet, closed by stop() so the thread can be joined
+    std::unordered_set<std::shared_ptr<Session>> sessions_;
+
+    // rates, sampled once per second
+    metrics::Rates rates_;
+    u64 lastMessagesIn_{0};
+    u64 lastMessagesOut_{0};
+    std::chrono::steady_clock::time_point lastSample_;
+};
+
+} // namespace server
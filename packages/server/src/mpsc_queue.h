@@ -0,0 +1,109 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace server
+{
+
+// Unbounded multi producer / single consumer queue (Vyukov's intrusive node queue). push is
+// wait-free: a producer swaps itself in as the new head with a single exchange and then links
+// the previous head to it. The consumer may briefly see the queue as empty while a producer is
+// between those two steps, the element shows up on a later pop.
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : head_(&stub_), tail_(&stub_)
+    {
+    }
+
+    ~MpscQueue()
+    {
+        while (pop().has_value())
+        {
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Safe to call from any thread
+    void push(T value)
+    {
+        auto* node = new Node{std::move(value)};
+        Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // Must only be called from the consumer thread
+    [[nodiscard]] std::optional<T> pop()
+    {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+
+        if (tail == &stub_)
+        {
+            if (next == nullptr)
+            {
+                return std::nullopt;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next != nullptr)
+        {
+            tail_ = next;
+            return take(tail);
+        }
+
+        if (tail != head_.load(std::memory_order_acquire))
+        {
+            // a producer has swapped the head but not linked it yet
+            return std::nullopt;
+        }
+
+        // tail is the last node, put the stub behind it so it can be unlinked
+        stub_.next.store(nullptr, std::memory_order_relaxed);
+        Node* previous = head_.exchange(&stub_, std::memory_order_acq_rel);
+        previous->next.store(&stub_, std::memory_order_release);
+
+        next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            return std::nullopt;
+        }
+
+        tail_ = next;
+        return take(tail);
+    }
+
+private:
+    struct Node
+    {
+        Node() = default;
+        explicit Node(T&& v) : value(std::move(v)) {}
+
+        std::atomic<Node*> next{nullptr};
+        std::optional<T> value;
+    };
+
+    [[nodiscard]] static std::optional<T> take(Node* node)
+    {
+        std::optional<T> value = std::move(node->value);
+        delete node;
+        return value;
+    }
+
+private:
+    alignas(64) std::atomic<Node*> head_;
+    alignas(64) Node* tail_;
+    Node stub_;
+};
+
+} // namespace server
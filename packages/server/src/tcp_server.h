@@ -6,12 +6,17 @@
 
 #include "global.h"
 #include "messages.h"
+#include "metrics.h"
+#include "tracing.h"
+#include "wire_frame.h"
 
 // asio
 #include "asio.hpp"
 
 // std
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <deque>
 #include <functional>
 #include <iostream>
@@ -19,6 +24,7 @@
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 class TcpServerMulti {
 public:
@@ -50,47 +56,112 @@ public:
         });
         if (io_thread_.joinable()) io_thread_.join();
         io_.restart();
+        for (auto& [id, c] : conns_) {
+            if (c) track_outbox_bytes(*c, -c->outbox_bytes);
+        }
         conns_.clear();
+        for (auto& count : encoding_connections_) count.store(0, std::memory_order_relaxed);
+        server::metrics::counters().openConnections.store(0, std::memory_order_relaxed);
         next_id_ = 1;
     }
 
-    // Send a line to a specific client. Appends \n if absent.
+    // Send a message to a specific client, framed in the encoding of its connection
     void write(u64 client_id, server::messages::ServerMessage serverMsg)
     {
-        std::string msg = std::visit([](auto const& m)
-        {
-            return m.toString();
-        }, serverMsg);
+        server::tracing::Span span{"write.post", "connection", client_id};
+        const server::tracing::TraceId trace = server::tracing::currentTrace();
+        const ServerMessageType type = messageType(serverMsg);
+
+        // the encoding of the connection is only known on the io thread, unless all of them use one
+        OutgoingFrames frames{std::move(serverMsg), {}};
+        if (const auto encoding = only_encoding_in_use(); encoding.has_value()) frames.get(encoding.value());
+
+        asio::post(io_, [this, client_id, type, trace, f = std::move(frames)]() mutable {
+            auto it = conns_.find(client_id);
+            if (it == conns_.end() || !it->second) return;
+            auto& conn = *it->second;
+            if (!conn.socket.is_open()) return;
+            enqueue(it->second, {f.get(conn.encoding), type, std::chrono::steady_clock::now(), trace});
+        });
+    }
 
-        if (msg.empty() || msg.back() != '\n') msg.push_back('\n');
-        asio::post(io_, [this, client_id, m = std::move(msg)]() mutable {
+    // Send frames already encoded in the encoding of the connection, in order and without copying
+    // them. Used to replay cached history, the caller reads the encoding on the io thread.
+    void writeFrames(u64 client_id, ServerMessageType type, std::vector<wire::SharedFrame> frames)
+    {
+        if (frames.empty()) return;
+        server::tracing::Span span{"write.post", "connection", client_id};
+        const server::tracing::TraceId trace = server::tracing::currentTrace();
+
+        asio::post(io_, [this, client_id, type, trace, frames = std::move(frames)]() mutable {
             auto it = conns_.find(client_id);
             if (it == conns_.end() || !it->second) return;
             auto& conn = *it->second;
             if (!conn.socket.is_open()) return;
-            conn.outbox.push_back(std::move(m));
+            const auto now = std::chrono::steady_clock::now();
+            for (auto& m : frames) {
+                enqueue(it->second, {std::move(m), type, now, trace});
+            }
+        });
+    }
+
+    // Everything written or broadcast to the connection from now on waits until releaseWrites().
+    // Called from the io thread, before the history of a joining client is read off it.
+    void holdWrites(u64 client_id) {
+        if (const auto it = conns_.find(client_id); it != conns_.end() && it->second) it->second->held = true;
+    }
+
+    // Writes messages to the connection ahead of everything held back since holdWrites(), then
+    // lets the held frames follow in the order they came
+    void releaseWrites(u64 client_id, std::vector<server::messages::ServerMessage> first)
+    {
+        server::tracing::Span span{"write.post", "connection", client_id};
+        const server::tracing::TraceId trace = server::tracing::currentTrace();
+
+        asio::post(io_, [this, client_id, trace, first = std::move(first)]() mutable {
+            auto it = conns_.find(client_id);
+            if (it == conns_.end() || !it->second) return;
+            auto& conn = *it->second;
+            if (!conn.socket.is_open()) return;
+            const auto now = std::chrono::steady_clock::now();
+            for (auto& message : first) {
+                OutgoingFrames frames{std::move(message), {}};
+                const auto& m = frames.get(conn.encoding);
+                track_outbox_bytes(conn, static_cast<i64>(m->size()));
+                conn.outbox.push_back({m, messageType(frames.message), now, trace});
+            }
+            conn.held = false;
+            for (auto& entry : conn.held_back) conn.outbox.push_back(std::move(entry));
+            conn.held_back.clear();
             if (!conn.writing) do_write_next(it->second);
         });
     }
 
-    // Broadcast a line to all connected clients
+    // Broadcast a message to all connected clients, encoded once per encoding in use
     void broadcast(server::messages::ServerMessage serverMsg)
     {
-        std::string msg = std::visit([](auto const& m)
-        {
-            return m.toString();
-        }, serverMsg);
+        server::tracing::Span span{"broadcast.post"};
+        const server::tracing::TraceId trace = server::tracing::currentTrace();
+        const ServerMessageType type = messageType(serverMsg);
+
+        OutgoingFrames frames{std::move(serverMsg), {}};
+        for (std::size_t i = 0; i < encoding_connections_.size(); ++i) {
+            if (encoding_connections_[i].load(std::memory_order_relaxed) != 0) frames.get(static_cast<WireEncoding>(i));
+        }
 
-        if (msg.empty() || msg.back() != '\n') msg.push_back('\n');
-        asio::post(io_, [this, m = std::move(msg)]() mutable {
+        asio::post(io_, [this, type, trace, f = std::move(frames)]() mutable {
+            const auto now = std::chrono::steady_clock::now();
             for (auto& [id, c] : conns_) {
                 if (!c || !c->socket.is_open()) continue;
-                c->outbox.push_back(m);
-                if (!c->writing) do_write_next(c);
+                enqueue(c, {f.get(c->encoding), type, now, trace});
             }
         });
     }
 
+    // Run a task on the io thread, next to the callbacks
+    template <typename F>
+    void post(F&& task) { asio::post(io_, std::forward<F>(task)); }
+
     // Callbacks
     template <typename H>
     void on_message(H&& h) { on_message_ = std::forward<H>(h); }
@@ -101,28 +172,96 @@ public:
     template <typename H>
     void on_disconnect(H&& h) { on_disconnect_ = std::forward<H>(h); }
 
-    [[nodiscard]] std::optional<std::string> getUsername(u64 connectionId) const noexcept
+    // id the user directory gave the user of the connection
+    [[nodiscard]] std::optional<u32> getUserId(u64 connectionId) const noexcept
     {
-        if (const auto it = idToUsernameMap_.find(connectionId); it != idToUsernameMap_.end())
+        if (const auto it = idToUserIdMap_.find(connectionId); it != idToUserIdMap_.end())
         {
             return it->second;
         }
         return std::nullopt;
     }
 
-    void addNewUsername(u64 connectionId, const std::string& username)
+    void addNewUser(u64 connectionId, u32 userId)
+    {
+        idToUserIdMap_[connectionId] = userId;
+    }
+
+    void removeUser(u64 connectionId)
+    {
+        idToUserIdMap_.erase(connectionId);
+    }
+
+    // Called from the io thread, false once the disconnect callback of the connection has run
+    [[nodiscard]] bool isConnected(u64 connectionId) const noexcept
+    {
+        const auto it = conns_.find(connectionId);
+        return it != conns_.end() && it->second && it->second->socket.is_open();
+    }
+
+    // Frames written to the connection from now on use encoding, false if it is not one this
+    // server knows. Called from the io thread, like the handlers and getEncoding().
+    [[nodiscard]] bool setEncoding(u64 connectionId, WireEncoding encoding)
+    {
+        const auto it = conns_.find(connectionId);
+        if (!wire::isKnownEncoding(encoding) || it == conns_.end() || !it->second)
+        {
+            return false;
+        }
+        auto& conn = *it->second;
+        encoding_connections_[static_cast<std::size_t>(conn.encoding)].fetch_sub(1, std::memory_order_relaxed);
+        encoding_connections_[static_cast<std::size_t>(encoding)].fetch_add(1, std::memory_order_relaxed);
+        conn.encoding = encoding;
+        return true;
+    }
+
+    [[nodiscard]] WireEncoding getEncoding(u64 connectionId) const noexcept
     {
-        idToUsernameMap_[connectionId] = username;
+        if (const auto it = conns_.find(connectionId); it != conns_.end() && it->second)
+        {
+            return it->second->encoding;
+        }
+        return WireEncoding::JSON;
     }
 
 private:
+    // A message and its frames, encoded the first time an encoding is asked for and shared by
+    // every connection it is queued to
+    struct OutgoingFrames {
+        server::messages::ServerMessage message;
+        std::array<wire::SharedFrame, wire::WIRE_ENCODING_COUNT> frames;
+
+        const wire::SharedFrame& get(WireEncoding encoding) {
+            auto& frame = frames[static_cast<std::size_t>(encoding)];
+            if (!frame) {
+                frame = std::visit([encoding](auto const& m) { return std::make_shared<const std::string>(wire::encodeFrame(encoding, m)); }, message);
+            }
+            return frame;
+        }
+    };
+
+    struct OutboxEntry {
+        wire::SharedFrame payload;
+        ServerMessageType type;
+        std::chrono::steady_clock::time_point enqueuedAt;
+        server::tracing::TraceId trace;
+    };
+
     struct Conn : std::enable_shared_from_this<Conn> {
         explicit Conn(asio::io_context& io, u64 id)
             : socket(io), id(id) {}
         asio::ip::tcp::socket socket;
         u64 id;
         asio::streambuf read_buf;
-        std::deque<std::string> outbox;
+        // bytes of read_buf already searched for the line end of a text frame
+        std::size_t read_searched = 0;
+        // of the frames written, frames read are told apart by their first byte
+        WireEncoding encoding{WireEncoding::JSON};
+        std::deque<OutboxEntry> outbox;
+        // queued while held, behind the history of the connection, counted in outbox_bytes
+        std::deque<OutboxEntry> held_back;
+        bool held{false};
+        i64 outbox_bytes{0};
         bool writing{false};
     };
 
@@ -143,6 +282,9 @@ private:
             auto c = std::make_shared<Conn>(io_, id);
             c->socket = std::move(*sock);
             conns_.emplace(id, c);
+            encoding_connections_[static_cast<std::size_t>(c->encoding)].fetch_add(1, std::memory_order_relaxed);
+            server::metrics::counters().connectionsAccepted.fetch_add(1, std::memory_order_relaxed);
+            server::metrics::counters().openConnections.store(static_cast<i64>(conns_.size()), std::memory_order_relaxed);
             if (on_connect_) on_connect_(id);
 
             do_read_loop(c);
@@ -153,53 +295,83 @@ private:
     }
 
     void do_read_loop(const std::shared_ptr<Conn>& c) {
-        asio::async_read_until(c->socket, c->read_buf, '\n',
+        // frames already buffered are handled first, then the rest of the next one is read
+        wire::Frame frame;
+        for (;;) {
+            const auto buffered = c->read_buf.data();
+            frame = wire::nextFrame({static_cast<const char*>(buffered.data()), buffered.size()}, c->read_searched);
+            if (frame.size == 0) break;
+            handle_frame(c, frame);
+            c->read_buf.consume(frame.size);
+            c->read_searched = 0;
+            if (!c->socket.is_open()) return;
+        }
+
+        c->read_searched = frame.searched;
+        if (frame.oversized) {
+            std::cerr << "Frame over " << wire::MAX_FRAME_BYTES << " bytes from connection " << c->id << "\n";
+            handle_disconnect(c, asio::error::message_size);
+            return;
+        }
+
+        asio::async_read(c->socket, c->read_buf, asio::transfer_at_least(frame.missing),
             [this, self=c](std::error_code ec, std::size_t){
                 if (ec) { handle_disconnect(self, ec); return; }
-                std::istream is(&self->read_buf);
-                std::string line;
-                std::getline(is, line); // strips '\n'
-
-                if (on_message_)
-                {
-                    const nlohmann::json data = nlohmann::json::parse(line, nullptr, false);
-                    if (data.is_discarded())
-                    {
-                        std::cerr << "Invalid json for message : " << line <<"\n";
-                    }
-
-                    const auto& content = data[PACKET_CONTENT_KEY];
-                    switch (data[PACKET_HEADER_KEY].get<ClientMessageType>())
-                    {
-                    case ClientMessageType::INITIAL_CONNECTION:
-                        on_message_(self->id, client::messages::InitialConnection{content});
-                        break;
-                    case ClientMessageType::NEW_MESSAGE:
-                        on_message_(self->id, client::messages::NewMessage{content});
-                        break;
-                    case ClientMessageType::LOGIN:
-                        on_message_(self->id, client::messages::Login{content});
-                        break;
-                    case ClientMessageType::REGISTER:
-                        on_message_(self->id, client::messages::Register{content});
-                        break;
-                    }
-                }
-
-                if (self->socket.is_open())
-                {
-                    do_read_loop(self);
-                }
+                do_read_loop(self);
             });
     }
 
+    void handle_frame(const std::shared_ptr<Conn>& c, const wire::Frame& frame) {
+        if (!on_message_) return;
+
+        const server::tracing::TraceScope traceScope{server::tracing::sampleMessage()};
+        server::tracing::Span messageSpan{"message", "connection", c->id};
+        server::tracing::Span parseSpan{"decode"};
+        const auto decodeStart = std::chrono::steady_clock::now();
+        const auto message = wire::decodeFrame<client::messages::ClientMessage>(frame);
+        parseSpan.end();
+        if (!message.has_value())
+        {
+            if (frame.encoding == WireEncoding::JSON)
+            {
+                std::cerr << "Invalid message : " << frame.packet << "\n";
+            }
+            else
+            {
+                std::cerr << "Invalid " << wire::encodingName(frame.encoding) << " message of " << frame.packet.size() << " bytes\n";
+            }
+            return;
+        }
+
+        const auto type = std::visit([](const auto& m) { return std::decay_t<decltype(m)>::TYPE; }, message.value());
+        server::metrics::record(server::metrics::decodeHistogram(type), std::chrono::steady_clock::now() - decodeStart);
+        server::metrics::counters().messagesIn.fetch_add(1, std::memory_order_relaxed);
+        on_message_(c->id, message.value());
+    }
+
+    void enqueue(const std::shared_ptr<Conn>& c, OutboxEntry entry) {
+        track_outbox_bytes(*c, static_cast<i64>(entry.payload->size()));
+        if (c->held) {
+            c->held_back.push_back(std::move(entry));
+            return;
+        }
+        c->outbox.push_back(std::move(entry));
+        if (!c->writing) do_write_next(c);
+    }
+
     void do_write_next(const std::shared_ptr<Conn>& c) {
         if (c->outbox.empty() || !c->socket.is_open()) { c->writing = false; return; }
         c->writing = true;
         auto& front = c->outbox.front();
-        asio::async_write(c->socket, asio::buffer(front),
+        asio::async_write(c->socket, asio::buffer(*front.payload),
             [this, self=c](std::error_code ec, std::size_t){
                 if (ec) { handle_disconnect(self, ec); return; }
+                const auto& done = self->outbox.front();
+                const auto now = std::chrono::steady_clock::now();
+                server::metrics::record(server::metrics::outboxHistogram(done.type), now - done.enqueuedAt);
+                server::tracing::recordSpan(done.trace, "write", done.enqueuedAt, now, "connection", self->id);
+                track_outbox_bytes(*self, -static_cast<i64>(done.payload->size()));
+                server::metrics::counters().messagesOut.fetch_add(1, std::memory_order_relaxed);
                 self->outbox.pop_front();
                 do_write_next(self);
             });
@@ -212,7 +384,31 @@ private:
             c->socket.close(ignore);
         }
         if (on_disconnect_) on_disconnect_(c->id);
-        conns_.erase(c->id);
+        track_outbox_bytes(*c, -c->outbox_bytes);
+        if (conns_.erase(c->id) != 0) {
+            encoding_connections_[static_cast<std::size_t>(c->encoding)].fetch_sub(1, std::memory_order_relaxed);
+        }
+        server::metrics::counters().openConnections.store(static_cast<i64>(conns_.size()), std::memory_order_relaxed);
+    }
+
+    static void track_outbox_bytes(Conn& c, i64 delta) {
+        c.outbox_bytes += delta;
+        server::metrics::counters().outboxBytes.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    // The encoding every connection uses, JSON without connections, nullopt if they differ
+    [[nodiscard]] std::optional<WireEncoding> only_encoding_in_use() const noexcept {
+        std::optional<WireEncoding> only;
+        for (std::size_t i = 0; i < encoding_connections_.size(); ++i) {
+            if (encoding_connections_[i].load(std::memory_order_relaxed) == 0) continue;
+            if (only.has_value()) return std::nullopt;
+            only = static_cast<WireEncoding>(i);
+        }
+        return only.value_or(WireEncoding::JSON);
+    }
+
+    [[nodiscard]] static ServerMessageType messageType(const server::messages::ServerMessage& serverMsg) noexcept {
+        return std::visit([](auto const& m) { return std::decay_t<decltype(m)>::TYPE; }, serverMsg);
     }
 
 private:
@@ -223,7 +419,9 @@ private:
 
     std::unordered_map<u64, std::shared_ptr<Conn>> conns_;
     u64 next_id_{1};
-    std::unordered_map<u64, std::string> idToUsernameMap_;
+    // open connections per encoding, read from the threads that write to tell which frames to encode
+    std::array<std::atomic<u32>, wire::WIRE_ENCODING_COUNT> encoding_connections_{};
+    std::unordered_map<u64, u32> idToUserIdMap_;
 
 private:
     // Callbacks
@@ -0,0 +1,320 @@
+#include "tracing.h"
+
+// std
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace server::tracing
+{
+
+namespace
+{
+
+struct Event
+{
+    const char* name;
+    const char* argName;
+    u64 arg;
+    TraceId trace;
+    i64 beginNs;
+    i64 durationNs;
+};
+
+// Single producer (the owning thread) / single consumer (the flusher) ring of events
+class ThreadBuffer
+{
+public:
+    static constexpr u64 CAPACITY = 1u << 14;
+
+    explicit ThreadBuffer(u32 tid) : tid(tid)
+    {
+    }
+
+    void push(const Event& event) noexcept
+    {
+        const u64 head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= CAPACITY)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        events_[head & (CAPACITY - 1)] = event;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    template <typename F>
+    void drain(F&& consume)
+    {
+        const u64 head = head_.load(std::memory_order_acquire);
+        u64 tail = tail_.load(std::memory_order_relaxed);
+        for (; tail != head; ++tail)
+        {
+            consume(events_[tail & (CAPACITY - 1)]);
+        }
+        tail_.store(tail, std::memory_order_release);
+    }
+
+    const u32 tid;
+    std::atomic<u64> dropped{0};
+
+private:
+    std::unique_ptr<Event[]> events_ = std::make_unique<Event[]>(CAPACITY);
+    alignas(64) std::atomic<u64> head_{0};
+    alignas(64) std::atomic<u64> tail_{0};
+};
+
+class Tracer
+{
+public:
+    [[nodiscard]] static Tracer& instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    void start(const Config& config, spdlog::logger* logger)
+    {
+        const std::lock_guard lock(mutex_);
+        if (file_.is_open())
+        {
+            return;
+        }
+
+        file_.open(config.path, std::ios::out | std::ios::trunc);
+        if (!file_)
+        {
+            logger->error("Could not open trace file {}", config.path);
+            return;
+        }
+
+        logger_ = logger;
+        path_ = config.path;
+        sampleEvery_ = std::max<u32>(1, config.sampleEvery);
+        origin_ = std::chrono::steady_clock::now();
+        deadline_ = config.duration.count() > 0 ? origin_ + config.duration : std::chrono::steady_clock::time_point::max();
+        eventsWritten_ = 0;
+        firstEvent_ = true;
+        stopping_ = false;
+
+        file_ << "[\n";
+        enabled_.store(true, std::memory_order_release);
+        flusher_ = std::thread([this] { flushLoop(); });
+
+        logger_->info("Tracing 1 in {} messages to {}", sampleEvery_, path_);
+    }
+
+    void stop()
+    {
+        {
+            const std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+
+        if (flusher_.joinable())
+        {
+            flusher_.join();
+        }
+    }
+
+    [[nodiscard]] bool enabled() const noexcept
+    {
+        return enabled_.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] TraceId sample() noexcept
+    {
+        if (!enabled())
+        {
+            return 0;
+        }
+
+        if (messages_.fetch_add(1, std::memory_order_relaxed) % sampleEvery_ != 0)
+        {
+            return 0;
+        }
+        return nextTrace_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void record(const Event& event) noexcept
+    {
+        if (enabled())
+        {
+            threadBuffer().push(event);
+        }
+    }
+
+    [[nodiscard]] i64 sinceOrigin(std::chrono::steady_clock::time_point time) const noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - origin_).count();
+    }
+
+private:
+    Tracer() = default;
+
+    [[nodiscard]] ThreadBuffer& threadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = [this]
+        {
+            const std::lock_guard lock(buffersMutex_);
+            const auto tid = static_cast<u32>(buffers_.size() + 1);
+            return buffers_.emplace_back(std::make_unique<ThreadBuffer>(tid)).get();
+        }();
+        return *buffer;
+    }
+
+    void flushLoop()
+    {
+        std::unique_lock lock(mutex_);
+        while (!stopping_)
+        {
+            cv_.wait_for(lock, std::chrono::milliseconds(100), [this] { return stopping_; });
+            drainAll();
+
+            if (std::chrono::steady_clock::now() >= deadline_)
+            {
+                // stop sampling and give in-flight messages a moment to finish their spans
+                enabled_.store(false, std::memory_order_release);
+                cv_.wait_for(lock, std::chrono::seconds(1), [this] { return stopping_; });
+                break;
+            }
+        }
+
+        enabled_.store(false, std::memory_order_release);
+        drainAll();
+        finish();
+    }
+
+    void drainAll()
+    {
+        std::vector<ThreadBuffer*> buffers;
+        {
+            const std::lock_guard lock(buffersMutex_);
+            for (const auto& buffer : buffers_)
+            {
+                buffers.push_back(buffer.get());
+            }
+        }
+
+        for (ThreadBuffer* buffer : buffers)
+        {
+            buffer->drain([this, tid = buffer->tid](const Event& event) { write(event, tid); });
+        }
+    }
+
+    void write(const Event& event, u32 tid)
+    {
+        file_ << (firstEvent_ ? "" : ",\n");
+        firstEvent_ = false;
+
+        file_ << fmt::format(R"({{"name":"{}","cat":"yapping","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f},"args":{{"trace":{})",
+            event.name, tid, static_cast<f64>(event.beginNs) / 1000.0, static_cast<f64>(event.durationNs) / 1000.0, event.trace);
+        if (event.argName != nullptr)
+        {
+            file_ << fmt::format(R"(,"{}":{})", event.argName, event.arg);
+        }
+        file_ << "}}";
+        ++eventsWritten_;
+    }
+
+    void finish()
+    {
+        u64 dropped = 0;
+        {
+            const std::lock_guard lock(buffersMutex_);
+            for (const auto& buffer : buffers_)
+            {
+                file_ << (firstEvent_ ? "" : ",\n");
+                firstEvent_ = false;
+                file_ << fmt::format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"thread {}"}}}})", buffer->tid, buffer->tid);
+                dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+            }
+        }
+
+        file_ << "\n]\n";
+        file_.close();
+        logger_->info("Trace written to {}: {} events, {} dropped", path_, eventsWritten_, dropped);
+    }
+
+private:
+    std::atomic<bool> enabled_{false};
+    std::atomic<u64> messages_{0};
+    std::atomic<TraceId> nextTrace_{0};
+    u32 sampleEvery_{1};
+    std::chrono::steady_clock::time_point origin_;
+    std::chrono::steady_clock::time_point deadline_;
+
+    // flusher
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_{false};
+    std::thread flusher_;
+    std::ofstream file_;
+    std::string path_;
+    bool firstEvent_{true};
+    u64 eventsWritten_{0};
+    spdlog::logger* logger_{nullptr};
+
+    // buffers outlive their threads, they are drained until the trace finishes
+    std::mutex buffersMutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+};
+
+thread_local TraceId currentTraceId = 0;
+
+}
+
+void start(const Config& config, spdlog::logger* logger)
+{
+    Tracer::instance().start(config, logger);
+}
+
+void stop()
+{
+    Tracer::instance().stop();
+}
+
+bool enabled() noexcept
+{
+    return Tracer::instance().enabled();
+}
+
+TraceId sampleMessage() noexcept
+{
+    return Tracer::instance().sample();
+}
+
+TraceId currentTrace() noexcept
+{
+    return currentTraceId;
+}
+
+void recordSpan(TraceId trace, const char* name, std::chrono::steady_clock::time_point begin,
+                std::chrono::steady_clock::time_point end, const char* argName, u64 arg) noexcept
+{
+    if (trace == 0)
+    {
+        return;
+    }
+
+    auto& tracer = Tracer::instance();
+    tracer.record(Event{name, argName, arg, trace, tracer.sinceOrigin(begin), std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()});
+}
+
+TraceScope::TraceScope(TraceId trace) noexcept
+    : previous_(currentTraceId)
+{
+    currentTraceId = trace;
+}
+
+TraceScope::~TraceScope()
+{
+    currentTraceId = previous_;
+}
+
+} // namespace server::tracing
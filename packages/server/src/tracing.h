@@ -0,0 +1,95 @@
+#pragma once
+
+#include "global.h"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Optional tracing of message lifecycles into a Chrome / Perfetto trace-event JSON file.
+//
+// One in every N incoming messages is sampled and gets a trace id. The id is the current trace
+// of the thread while the message is processed, so every Span opened on the way (parse, handler,
+// DB, broadcast) is recorded under it, and it is carried in the outbox so write completions can
+// be attributed as well. Events go to a per-thread single producer ring buffer that a background
+// thread drains into the file, so recording never takes a lock.
+namespace server::tracing
+{
+
+struct Config
+{
+    std::string path;
+    u32 sampleEvery = 100;
+    std::chrono::seconds duration{0};
+};
+
+using TraceId = u64;
+
+void start(const Config& config, spdlog::logger* logger);
+void stop();
+
+[[nodiscard]] bool enabled() noexcept;
+
+// Returns a new trace id if this message is sampled, 0 otherwise
+[[nodiscard]] TraceId sampleMessage() noexcept;
+
+[[nodiscard]] TraceId currentTrace() noexcept;
+
+// Records a complete span. name and argName must be string literals.
+void recordSpan(TraceId trace, const char* name, std::chrono::steady_clock::time_point begin,
+                std::chrono::steady_clock::time_point end, const char* argName = nullptr, u64 arg = 0) noexcept;
+
+// Makes trace the current trace of the thread for the lifetime of the scope
+class TraceScope
+{
+public:
+    explicit TraceScope(TraceId trace) noexcept;
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    TraceId previous_;
+};
+
+// Span of the current trace, nothing is recorded if the thread is not tracing a message
+class Span
+{
+public:
+    explicit Span(const char* name, const char* argName = nullptr, u64 arg = 0) noexcept
+        : trace_(currentTrace()), name_(name), argName_(argName), arg_(arg)
+    {
+        if (trace_ != 0)
+        {
+            begin_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~Span()
+    {
+        end();
+    }
+
+    void end() noexcept
+    {
+        if (trace_ != 0)
+        {
+            recordSpan(trace_, name_, begin_, std::chrono::steady_clock::now(), argName_, arg_);
+            trace_ = 0;
+        }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    TraceId trace_;
+    const char* name_;
+    const char* argName_;
+    u64 arg_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+} // namespace server::tracing
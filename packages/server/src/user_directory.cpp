@@ -0,0 +1,59 @@
+#include "user_directory.h"
+#include "metrics.h"
+
+namespace server
+{
+
+std::optional<u32> UserDirectory::intern(std::string_view username)
+{
+    if (const auto id = find(username); id.has_value())
+    {
+        return id;
+    }
+
+    std::unique_lock lock(mutex_);
+    // another thread can have added it between the two locks
+    if (const auto it = ids_.find(username); it != ids_.end())
+    {
+        return it->second;
+    }
+    if (names_.size() >= MAX_USER_ID)
+    {
+        return std::nullopt;
+    }
+
+    const auto id = static_cast<u32>(names_.size() + 1);
+    ids_.emplace(names_.emplace_back(username), id);
+    metrics::counters().knownUsers.store(id, std::memory_order_relaxed);
+    return id;
+}
+
+std::optional<u32> UserDirectory::find(std::string_view username) const
+{
+    std::shared_lock lock(mutex_);
+    if (const auto it = ids_.find(username); it != ids_.end())
+    {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+const std::string& UserDirectory::name(u32 id) const
+{
+    std::shared_lock lock(mutex_);
+    return names_[id - 1];
+}
+
+bool UserDirectory::contains(u32 id) const
+{
+    std::shared_lock lock(mutex_);
+    return id != 0 && id <= names_.size();
+}
+
+u32 UserDirectory::size() const
+{
+    std::shared_lock lock(mutex_);
+    return static_cast<u32>(names_.size());
+}
+
+} // namespace server
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "global.h"
+
+// std
+#include <deque>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace server
+{
+
+// Numeric ids for the usernames the server has come across, handed out from 1 in the order they
+// show up and kept until it stops. Packets refer to a user by id once the client has been told the
+// name, with a UserStatus or UserNames, and looking a name up by id is an index into the table.
+// Rows in the stores keep the names, ids are not stable across restarts. At most MAX_USER_ID
+// names get an id.
+//
+// Thread-safe, the history warm-up fills it on a worker while the io thread can already read it.
+class UserDirectory
+{
+public:
+    // id of username, a new one the first time it is seen, nullopt once MAX_USER_ID are taken
+    [[nodiscard]] std::optional<u32> intern(std::string_view username);
+
+    [[nodiscard]] std::optional<u32> find(std::string_view username) const;
+
+    // id has to be one intern handed out, names are never moved so the reference stays valid
+    [[nodiscard]] const std::string& name(u32 id) const;
+    [[nodiscard]] bool contains(u32 id) const;
+    [[nodiscard]] u32 size() const;
+
+private:
+    mutable std::shared_mutex mutex_;
+    // a deque so the views in ids_ stay valid while it grows
+    std::deque<std::string> names_;
+    std::unordered_map<std::string_view, u32> ids_;
+};
+
+} // namespace server
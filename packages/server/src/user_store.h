@@ -0,0 +1,41 @@
+#pragma once
+
+#include "global.h"
+
+// std
+#include <functional>
+#include <optional>
+#include <string>
+
+enum class AddUserResult
+{
+    ADDED,
+    USERNAME_TAKEN,
+    FAILED
+};
+
+enum class UserStoreType : u32
+{
+    // the users table of the SQLite database
+    SQLITE,
+    // a hash map that is gone when the server stops
+    MEMORY
+};
+
+using UserVisitor = std::function<void(const std::string& username, u64 passwordHash)>;
+
+// Registered users and their password hashes, picked with --user-store. Implementations are
+// thread-safe, every lookup and registration runs on the worker pool.
+class IUserStore
+{
+public:
+    virtual ~IUserStore() = default;
+
+public:
+    [[nodiscard]] virtual AddUserResult addNewUser(const std::string& username, u64 passwordHash) = 0;
+    // nullopt if the username is not registered
+    [[nodiscard]] virtual std::optional<u64> userPasswordHash(const std::string& username) const noexcept = 0;
+    // Visits up to limit users, the latest registrations first when the store keeps their order.
+    // Returns the number of users visited.
+    virtual u32 getUsers(u32 limit, const UserVisitor& visitor) const = 0;
+};
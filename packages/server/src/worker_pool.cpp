@@ -0,0 +1,87 @@
+#include "worker_pool.h"
+#include "metrics.h"
+
+namespace server
+{
+
+WorkerPool::WorkerPool(u32 threads, spdlog::logger* logger)
+    : logger_(logger)
+{
+    threads = std::max<u32>(1, threads);
+    threads_.reserve(threads);
+    for (u32 i = 0; i < threads; ++i)
+    {
+        threads_.emplace_back([this] { run(); });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::post(std::function<void()> task)
+{
+    {
+        const std::lock_guard lock(mutex_);
+        if (!stopping_)
+        {
+            tasks_.push_back({std::move(task), tracing::currentTrace()});
+            metrics::counters().workerQueueDepth.fetch_add(1, std::memory_order_relaxed);
+            cv_.notify_one();
+            return;
+        }
+    }
+
+    task();
+}
+
+void WorkerPool::stop()
+{
+    {
+        const std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    for (auto& thread : threads_)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+void WorkerPool::run()
+{
+    while (true)
+    {
+        Task task;
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty())
+            {
+                return;
+            }
+
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        metrics::counters().workerQueueDepth.fetch_sub(1, std::memory_order_relaxed);
+
+        const tracing::TraceScope scope{task.trace};
+        try
+        {
+            task.function();
+        }
+        catch (const std::exception& e)
+        {
+            // a store visitor writing to a socket or building a page can throw, the pool keeps its thread
+            logger_->error("Worker task failed: {}", e.what());
+        }
+    }
+}
+
+} // namespace server
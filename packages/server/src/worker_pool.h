@@ -0,0 +1,54 @@
+#pragma once
+
+#include "global.h"
+#include "tracing.h"
+
+// std
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace server
+{
+
+// Fixed set of threads running blocking work (database lookups) away from the io thread. Tasks
+// keep the trace of the thread that posted them, so their spans land in the same trace. A task
+// that throws is logged and the thread goes on with the next one.
+class WorkerPool
+{
+public:
+    WorkerPool(u32 threads, spdlog::logger* logger);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+public:
+    // Tasks posted after stop run on the calling thread
+    void post(std::function<void()> task);
+
+    // Runs everything already queued, then joins the threads
+    void stop();
+
+private:
+    struct Task
+    {
+        std::function<void()> function;
+        tracing::TraceId trace;
+    };
+
+    void run();
+
+private:
+    spdlog::logger* logger_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Task> tasks_;
+    bool stopping_{false};
+    std::vector<std::thread> threads_;
+};
+
+} // namespace server
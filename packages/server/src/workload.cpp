@@ -0,0 +1,268 @@
+#include "workload.h"
+
+// std
+#include <algorithm>
+#include <array>
+
+namespace server
+{
+
+namespace
+{
+
+constexpr std::string_view OPERATION_KEY = "op";
+constexpr std::string_view MESSAGES_KEY = "messages";
+constexpr std::string_view AFTER_ID_KEY = "after_id";
+constexpr std::string_view BEFORE_ID_KEY = "before_id";
+constexpr std::string_view FROM_KEY = "from";
+constexpr std::string_view TO_KEY = "to";
+constexpr std::string_view LIMIT_KEY = "limit";
+constexpr std::string_view OFFSET_KEY = "offset";
+constexpr std::string_view TEXT_KEY = "text";
+constexpr std::string_view USERNAME_KEY = "username";
+
+constexpr std::array<std::string_view, static_cast<std::size_t>(WorkloadOperationType::COUNT)> operationNames{
+    "append",
+    "history",
+    "search",
+    "add_user",
+    "user_lookup",
+};
+
+[[nodiscard]] nlohmann::json appendJson(const std::vector<server::messages::NewMessageReceived>& messages)
+{
+    nlohmann::json data;
+    data[OPERATION_KEY] = workloadOperationName(WorkloadOperationType::APPEND);
+    data[MESSAGES_KEY] = nlohmann::json::array();
+    for (const auto& message : messages)
+    {
+        data[MESSAGES_KEY].push_back(message.content());
+    }
+    return data;
+}
+
+[[nodiscard]] nlohmann::json historyJson(const HistoryQuery& query)
+{
+    nlohmann::json data;
+    data[OPERATION_KEY] = workloadOperationName(WorkloadOperationType::HISTORY);
+    data[AFTER_ID_KEY] = query.afterId;
+    data[BEFORE_ID_KEY] = query.beforeId;
+    data[FROM_KEY] = query.fromTimestamp;
+    data[TO_KEY] = query.toTimestamp;
+    data[LIMIT_KEY] = query.limit;
+    return data;
+}
+
+[[nodiscard]] nlohmann::json searchJson(const SearchQuery& query)
+{
+    nlohmann::json data;
+    data[OPERATION_KEY] = workloadOperationName(WorkloadOperationType::SEARCH);
+    data[TEXT_KEY] = query.text;
+    data[OFFSET_KEY] = query.offset;
+    data[LIMIT_KEY] = query.limit;
+    return data;
+}
+
+[[nodiscard]] nlohmann::json userJson(WorkloadOperationType type, const std::string& username)
+{
+    nlohmann::json data;
+    data[OPERATION_KEY] = workloadOperationName(type);
+    data[USERNAME_KEY] = username;
+    return data;
+}
+
+}
+
+std::string_view workloadOperationName(WorkloadOperationType type) noexcept
+{
+    const auto index = static_cast<std::size_t>(type);
+    return index < operationNames.size() ? operationNames[index] : "unknown";
+}
+
+nlohmann::json toJson(const WorkloadOperation& operation)
+{
+    switch (operation.type)
+    {
+    case WorkloadOperationType::APPEND:
+        return appendJson(operation.messages);
+    case WorkloadOperationType::HISTORY:
+        return historyJson(operation.history);
+    case WorkloadOperationType::SEARCH:
+        return searchJson(operation.search);
+    case WorkloadOperationType::ADD_USER:
+    case WorkloadOperationType::USER_LOOKUP:
+    case WorkloadOperationType::COUNT:
+        break;
+    }
+    return userJson(operation.type, operation.username);
+}
+
+std::optional<WorkloadOperation> workloadOperationFromJson(const nlohmann::json& data)
+{
+    if (!data.is_object() || !data.contains(OPERATION_KEY) || !data[OPERATION_KEY].is_string())
+    {
+        return std::nullopt;
+    }
+
+    const auto name = data[OPERATION_KEY].get<std::string>();
+    const auto found = std::find(operationNames.begin(), operationNames.end(), name);
+    if (found == operationNames.end())
+    {
+        return std::nullopt;
+    }
+
+    WorkloadOperation operation;
+    operation.type = static_cast<WorkloadOperationType>(found - operationNames.begin());
+
+    try
+    {
+        switch (operation.type)
+        {
+        case WorkloadOperationType::APPEND:
+            for (const auto& message : data.at(MESSAGES_KEY))
+            {
+                operation.messages.emplace_back(message);
+            }
+            break;
+        case WorkloadOperationType::HISTORY:
+            operation.history.afterId = data.value(AFTER_ID_KEY, u64{0});
+            operation.history.beforeId = data.value(BEFORE_ID_KEY, u64{0});
+            operation.history.fromTimestamp = data.value(FROM_KEY, u64{0});
+            operation.history.toTimestamp = data.value(TO_KEY, u64{0});
+            operation.history.limit = data.value(LIMIT_KEY, operation.history.limit);
+            break;
+        case WorkloadOperationType::SEARCH:
+            operation.search.text = data.at(TEXT_KEY).get<std::string>();
+            operation.search.offset = data.value(OFFSET_KEY, u32{0});
+            operation.search.limit = data.value(LIMIT_KEY, operation.search.limit);
+            break;
+        case WorkloadOperationType::ADD_USER:
+        case WorkloadOperationType::USER_LOOKUP:
+        case WorkloadOperationType::COUNT:
+            operation.username = data.at(USERNAME_KEY).get<std::string>();
+            break;
+        }
+    }
+    catch (const nlohmann::json::exception&)
+    {
+        return std::nullopt;
+    }
+    return operation;
+}
+
+std::optional<std::vector<WorkloadOperation>> readWorkload(const std::string& path, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = fmt::format("could not open {}", path);
+        return std::nullopt;
+    }
+
+    std::vector<WorkloadOperation> operations;
+    std::string line;
+    for (u64 number = 1; std::getline(file, line); ++number)
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+
+        auto operation = workloadOperationFromJson(nlohmann::json::parse(line, nullptr, false));
+        if (!operation.has_value())
+        {
+            error = fmt::format("{}:{} is not a workload operation", path, number);
+            return std::nullopt;
+        }
+        operations.push_back(std::move(operation.value()));
+    }
+    return operations;
+}
+
+bool writeWorkload(const std::string& path, const std::vector<WorkloadOperation>& operations)
+{
+    std::ofstream file(path);
+    for (const auto& operation : operations)
+    {
+        file << toJson(operation).dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+WorkloadRecorder::WorkloadRecorder(IMessageStore* messageStore, IUserStore* userStore, spdlog::logger* logger, const std::string& path)
+    : messageStore_(messageStore), userStore_(userStore), logger_(logger), file_(path)
+{
+    if (!file_)
+    {
+        logger_->error("Could not open workload file {}, nothing is recorded", path);
+        return;
+    }
+    logger_->info("Recording the store workload into {}", path);
+}
+
+WorkloadRecorder::~WorkloadRecorder()
+{
+    const std::lock_guard lock(mutex_);
+    file_.flush();
+}
+
+void WorkloadRecorder::record(const nlohmann::json& operation) const noexcept
+{
+    // a message with invalid UTF-8 is written with replacement characters instead of throwing
+    const std::string line = operation.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+
+    const std::lock_guard lock(mutex_);
+    if (file_)
+    {
+        file_ << line << '\n';
+    }
+}
+
+void WorkloadRecorder::addMessageEntry(const server::messages::NewMessageReceived& message)
+{
+    record(appendJson({message}));
+    messageStore_->addMessageEntry(message);
+}
+
+bool WorkloadRecorder::addMessageEntries(const std::vector<server::messages::NewMessageReceived>& messages)
+{
+    record(appendJson(messages));
+    return messageStore_->addMessageEntries(messages);
+}
+
+u32 WorkloadRecorder::getMessages(const HistoryQuery& query, const MessageVisitor& visitor) const
+{
+    record(historyJson(query));
+    return messageStore_->getMessages(query, visitor);
+}
+
+u64 WorkloadRecorder::lastMessageId() const noexcept
+{
+    return messageStore_->lastMessageId();
+}
+
+std::optional<u32> WorkloadRecorder::searchMessages(const SearchQuery& query, const MessageVisitor& visitor) const
+{
+    record(searchJson(query));
+    return messageStore_->searchMessages(query, visitor);
+}
+
+AddUserResult WorkloadRecorder::addNewUser(const std::string& username, u64 passwordHash)
+{
+    record(userJson(WorkloadOperationType::ADD_USER, username));
+    return userStore_->addNewUser(username, passwordHash);
+}
+
+std::optional<u64> WorkloadRecorder::userPasswordHash(const std::string& username) const noexcept
+{
+    record(userJson(WorkloadOperationType::USER_LOOKUP, username));
+    return userStore_->userPasswordHash(username);
+}
+
+u32 WorkloadRecorder::getUsers(u32 limit, const UserVisitor& visitor) const
+{
+    // only the startup warm-up lists users, it is not part of a workload
+    return userStore_->getUsers(limit, visitor);
+}
+
+} // namespace server
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "message_store.h"
+#include "user_store.h"
+
+// std
+#include <fstream>
+#include <mutex>
+
+namespace server
+{
+
+enum class WorkloadOperationType : u32
+{
+    APPEND,
+    HISTORY,
+    SEARCH,
+    ADD_USER,
+    USER_LOOKUP,
+    COUNT
+};
+
+[[nodiscard]] std::string_view workloadOperationName(WorkloadOperationType type) noexcept;
+
+// One call made on the stores, only the fields of its type are used
+struct WorkloadOperation
+{
+    WorkloadOperationType type = WorkloadOperationType::APPEND;
+    std::vector<server::messages::NewMessageReceived> messages;
+    HistoryQuery history{};
+    SearchQuery search{};
+    std::string username;
+};
+
+// A workload file holds one JSON object per line and operation, in the order the calls were made.
+// Password hashes are never written, a replay registers every user with the same one.
+[[nodiscard]] nlohmann::json toJson(const WorkloadOperation& operation);
+[[nodiscard]] std::optional<WorkloadOperation> workloadOperationFromJson(const nlohmann::json& data);
+// nullopt and the line that could not be read in error if the file is not a workload
+[[nodiscard]] std::optional<std::vector<WorkloadOperation>> readWorkload(const std::string& path, std::string& error);
+[[nodiscard]] bool writeWorkload(const std::string& path, const std::vector<WorkloadOperation>& operations);
+
+// Stores that append every call to a workload file before passing it on, enabled with
+// --record-workload. yapping_store_bench replays the file against every backend. History served
+// from the in-memory ring never reaches the stores and is not recorded.
+class WorkloadRecorder final : public IMessageStore, public IUserStore
+{
+public:
+    WorkloadRecorder(IMessageStore* messageStore, IUserStore* userStore, spdlog::logger* logger, const std::string& path);
+    ~WorkloadRecorder() override;
+
+    WorkloadRecorder(const WorkloadRecorder&) = delete;
+    WorkloadRecorder& operator=(const WorkloadRecorder&) = delete;
+
+public:
+    void addMessageEntry(const server::messages::NewMessageReceived& message) override;
+    [[nodiscard]] bool addMessageEntries(const std::vector<server::messages::NewMessageReceived>& messages) override;
+    u32 getMessages(const HistoryQuery& query, const MessageVisitor& visitor) const override;
+    [[nodiscard]] u64 lastMessageId() const noexcept override;
+    std::optional<u32> searchMessages(const SearchQuery& query, const MessageVisitor& visitor) const override;
+
+    [[nodiscard]] AddUserResult addNewUser(const std::string& username, u64 passwordHash) override;
+    [[nodiscard]] std::optional<u64> userPasswordHash(const std::string& username) const noexcept override;
+    u32 getUsers(u32 limit, const UserVisitor& visitor) const override;
+
+private:
+    void record(const nlohmann::json& operation) const noexcept;
+
+private:
+    IMessageStore* messageStore_;
+    IUserStore* userStore_;
+    spdlog::logger* logger_;
+    // lines are written in the order the calls take this lock
+    mutable std::mutex mutex_;
+    mutable std::ofstream file_;
+};
+
+} // namespace server